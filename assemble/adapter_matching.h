@@ -0,0 +1,313 @@
+#ifndef POPINS_ADAPTER_MATCHING_H_
+#define POPINS_ADAPTER_MATCHING_H_
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+// ==========================================================================
+// Bit-parallel adapter matching
+// ==========================================================================
+
+// Adapters are searched with a shift-add (bitap) automaton allowing up to k mismatches. Bit i of the state vector
+// for j errors is set if the adapter prefix of length i + 1 matches the text ending at the current position with at
+// most j mismatches. A base other than A, C, G, and T in the text never matches, not even as a mismatch.
+//
+// Texts are accessed through operator[] returning the rank of a base: 0-3 for A, C, G, T and 4 for any other base.
+
+typedef unsigned __int128 TAdapterWord;
+
+static const unsigned MAX_ADAPTER_LENGTH = 128;
+static const unsigned MAX_ADAPTER_ERRORS = 3;
+
+// --------------------------------------------------------------------------
+// Function adapterBaseRank()
+// --------------------------------------------------------------------------
+
+inline unsigned
+adapterBaseRank(char c)
+{
+    switch (c)
+    {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default: return 4;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Struct AdapterPattern
+// --------------------------------------------------------------------------
+
+struct AdapterPattern
+{
+    TAdapterWord masks[4];  // bit i of masks[c] is set if base i of the adapter has rank c
+    unsigned length;
+
+    AdapterPattern() : length(0)
+    {
+        masks[0] = masks[1] = masks[2] = masks[3] = 0;
+    }
+
+    AdapterPattern(std::string const & bases) : length(std::min((size_t)MAX_ADAPTER_LENGTH, bases.size()))
+    {
+        masks[0] = masks[1] = masks[2] = masks[3] = 0;
+        for (unsigned i = 0; i < length; ++i)
+        {
+            unsigned rank = adapterBaseRank(bases[i]);
+            if (rank < 4)
+                masks[rank] |= (TAdapterWord)1 << i;
+        }
+    }
+};
+
+// --------------------------------------------------------------------------
+// Struct AdapterGroup
+// --------------------------------------------------------------------------
+
+// Adapters sharing a common prefix, e.g. the TruSeq adapters differing only in their barcode. Most reads are
+// matched against the common prefix only.
+struct AdapterGroup
+{
+    AdapterPattern prefix;
+    std::vector<AdapterPattern> adapters;
+    unsigned maxLength;
+
+    AdapterGroup() : maxLength(0) {}
+};
+
+// --------------------------------------------------------------------------
+// Function buildAdapterGroups()
+// --------------------------------------------------------------------------
+
+// Groups consecutive adapters that share a prefix of at least minPrefix bases.
+inline void
+buildAdapterGroups(std::vector<AdapterGroup> & groups, std::vector<std::string> const & adapters, unsigned minPrefix = 16)
+{
+    groups.clear();
+
+    size_t i = 0;
+    while (i < adapters.size())
+    {
+        size_t prefixLength = adapters[i].size();
+        size_t j = i + 1;
+        for (; j < adapters.size(); ++j)
+        {
+            size_t common = 0;
+            while (common < prefixLength && common < adapters[j].size() && adapters[i][common] == adapters[j][common])
+                ++common;
+            if (common < minPrefix)
+                break;
+            prefixLength = common;
+        }
+
+        AdapterGroup group;
+        group.prefix = AdapterPattern(adapters[i].substr(0, prefixLength));
+        for (size_t k = i; k < j; ++k)
+        {
+            group.adapters.push_back(AdapterPattern(adapters[k]));
+            group.maxLength = std::max(group.maxLength, group.adapters.back().length);
+        }
+        groups.push_back(group);
+        i = j;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function _highestBit()
+// --------------------------------------------------------------------------
+
+// Returns the position of the highest set bit plus one, or 0 if no bit is set.
+inline unsigned
+_highestBit(TAdapterWord x)
+{
+    uint64_t high = (uint64_t)(x >> 64);
+    uint64_t low = (uint64_t)x;
+    if (high != 0)
+        return 128 - __builtin_clzll(high);
+    if (low != 0)
+        return 64 - __builtin_clzll(low);
+    return 0;
+}
+
+// --------------------------------------------------------------------------
+// Function adapterSuffixMatch()
+// --------------------------------------------------------------------------
+
+/**
+ * Finds the longest adapter prefix at the end of a text.
+ *
+ * @param prefixSeen    set to true if the full adapter matches ending before the last base of the text
+ * @param adapter       the adapter
+ * @param text          the text, accessed in [textLength - scanLength, textLength)
+ * @param textLength    the length of the text
+ * @param scanLength    the number of bases at the end of the text to scan, at least the adapter length
+ * @param errors        the maximum number of mismatches
+ *
+ * @returns             the length of the longest adapter prefix matching a suffix of the text.
+ */
+template<typename TText>
+inline unsigned
+adapterSuffixMatch(bool & prefixSeen,
+        AdapterPattern const & adapter,
+        TText const & text,
+        unsigned textLength,
+        unsigned scanLength,
+        unsigned errors)
+{
+    TAdapterWord full = adapter.length == 128 ? ~(TAdapterWord)0 : ((TAdapterWord)1 << adapter.length) - 1;
+    TAdapterWord top = (TAdapterWord)1 << (adapter.length - 1);
+
+    TAdapterWord state[MAX_ADAPTER_ERRORS + 1] = {0};
+    prefixSeen = false;
+
+    for (unsigned i = textLength - std::min(textLength, scanLength); i < textLength; ++i)
+    {
+        unsigned c = text[i];
+        if (c > 3)
+        {
+            for (unsigned j = 0; j <= errors; ++j)
+                state[j] = 0;
+            continue;
+        }
+
+        for (unsigned j = errors; j > 0; --j)
+            state[j] = (((state[j] << 1) | 1) & adapter.masks[c]) | (((state[j - 1] << 1) | 1) & full);
+        state[0] = ((state[0] << 1) | 1) & adapter.masks[c];
+
+        if ((state[errors] & top) && i + 1 < textLength)
+            prefixSeen = true;
+    }
+
+    return _highestBit(state[errors]);
+}
+
+// --------------------------------------------------------------------------
+// Function adapterContains()
+// --------------------------------------------------------------------------
+
+// Returns true if the whole text matches somewhere within the adapter with at most errors mismatches.
+template<typename TText>
+inline bool
+adapterContains(AdapterPattern const & adapter, TText const & text, unsigned textLength, unsigned errors)
+{
+    if (textLength > adapter.length)
+        return false;
+    if (textLength == 0)
+        return true;
+
+    TAdapterWord full = adapter.length == 128 ? ~(TAdapterWord)0 : ((TAdapterWord)1 << adapter.length) - 1;
+    TAdapterWord state[MAX_ADAPTER_ERRORS + 1];
+
+    unsigned c = text[0];
+    if (c > 3)
+        return false;
+    state[0] = adapter.masks[c];
+    for (unsigned j = 1; j <= errors; ++j)
+        state[j] = full;
+
+    for (unsigned i = 1; i < textLength && state[errors] != 0; ++i)
+    {
+        c = text[i];
+        if (c > 3)
+            return false;
+
+        for (unsigned j = errors; j > 0; --j)
+            state[j] = ((state[j] << 1) & adapter.masks[c]) | ((state[j - 1] << 1) & full);
+        state[0] = (state[0] << 1) & adapter.masks[c];
+    }
+
+    return state[errors] != 0;
+}
+
+// --------------------------------------------------------------------------
+// Function adapterMatchLength()
+// --------------------------------------------------------------------------
+
+// Returns the length of the longest adapter prefix at the end of the text, or the text length if the whole text
+// matches within an adapter.
+template<typename TText>
+inline unsigned
+adapterMatchLength(std::vector<AdapterGroup> const & groups, TText const & text, unsigned textLength, unsigned errors)
+{
+    unsigned best = 0;
+    for (size_t g = 0; g < groups.size(); ++g)
+    {
+        AdapterGroup const & group = groups[g];
+
+        // Match the common prefix. Adapter matches longer than the prefix require a full match of the prefix.
+        bool prefixSeen = false;
+        unsigned len = adapterSuffixMatch(prefixSeen, group.prefix, text, textLength, group.maxLength, errors);
+
+        if (prefixSeen || textLength <= group.maxLength)
+        {
+            bool seen;
+            for (size_t a = 0; a < group.adapters.size(); ++a)
+            {
+                AdapterPattern const & adapter = group.adapters[a];
+                if (adapterContains(adapter, text, textLength, errors))
+                    return textLength;
+                len = std::max(len, adapterSuffixMatch(seen, adapter, text, textLength, adapter.length, errors));
+            }
+        }
+
+        best = std::max(best, len);
+    }
+    return best;
+}
+
+// --------------------------------------------------------------------------
+// Function bandedMatchCount()
+// --------------------------------------------------------------------------
+
+// Returns the maximal number of matching bases in a global alignment of adapter[0, len) and text[textBegin,
+// textBegin + len) within the diagonals -2 to 2, with free gaps and mismatches.
+template<typename TText>
+inline int
+bandedMatchCount(std::string const & adapter, TText const & text, unsigned textBegin, unsigned len)
+{
+    static const int NONE = -1000000;
+
+    // Rows by adapter position i, entry d of a row holds column j = i + d - 2.
+    int prev[5], curr[5];
+    for (unsigned d = 0; d < 5; ++d)
+        prev[d] = d >= 2 ? 0 : NONE;
+    for (unsigned d = 2; d < 5; ++d)
+        if (d - 2 > len)
+            prev[d] = NONE;
+
+    for (unsigned i = 1; i <= len; ++i)
+    {
+        unsigned a = adapterBaseRank(adapter[i - 1]);
+        for (unsigned d = 0; d < 5; ++d)
+        {
+            int j = (int)i + (int)d - 2;
+            if (j < 0 || j > (int)len)
+            {
+                curr[d] = NONE;
+                continue;
+            }
+
+            int best = j == 0 ? 0 : NONE;
+            if (j > 0)
+            {
+                int diag = prev[d];
+                if (diag != NONE)
+                    best = diag + (a < 4 && a == text[textBegin + j - 1]);
+                if (d > 0 && curr[d - 1] > best)
+                    best = curr[d - 1];
+            }
+            if (d < 4 && prev[d + 1] > best)
+                best = prev[d + 1];
+            curr[d] = best;
+        }
+        std::copy(curr, curr + 5, prev);
+    }
+
+    return prev[2];
+}
+
+#endif  // POPINS_ADAPTER_MATCHING_H_
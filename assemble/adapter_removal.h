@@ -2,6 +2,8 @@
 #include <seqan/align.h>
 #include <seqan/index.h>
 
+#include "adapter_matching.h"
+
 #ifndef ADAPTER_REMOVAL_H_
 #define ADAPTER_REMOVAL_H_
 
@@ -52,83 +54,6 @@ getTruSeqSuffix(HiSeqXAdapters)
     return "ACACTCTTTCCCTACACGACGCTCTTCCGATCT";
 }
 
-template<typename TTag>
-inline StringSet<Dna5String>
-reverseUniversalOneError(TTag tag)
-{
-    typedef Dna5String TSeq;
-    typedef Size<TSeq>::Type TSize;
-    typedef Dna TAlphabet;
-
-    // Append the error-free sequence to sequence set.
-    StringSet<TSeq> adaptSeqs;
-    appendValue(adaptSeqs, getUniversal(tag));
-
-    reverse(adaptSeqs[0]);
-
-    // Append all sequences with one mismatch to sequence set.
-    TSeq errSeq = adaptSeqs[0];
-    for (TSize i = 0; i < length(adaptSeqs[0]); ++i)
-    {
-        for (TSize c = 0; c < ValueSize<TAlphabet>::VALUE; ++c)
-        {
-            errSeq[i] = c;
-            appendValue(adaptSeqs, errSeq);
-        }
-        errSeq[i] = adaptSeqs[0][i];
-    }
-
-    return adaptSeqs;
-}
-
-template<typename TSequence>
-bool
-startsWithTruSeq(TSequence & seq, HiSeqXAdapters tag)
-{
-    TSequence truSeqPre = getTruSeqPrefix(tag);
-    unsigned preLen = _min(length(truSeqPre), length(seq));
-    int score = globalAlignmentScore(prefix(truSeqPre, preLen), prefix(seq, preLen), Score<int>(1,0,0), -2, 2);
-    if (score > (int)preLen - 5)
-    {
-        TSequence truSeqSuf = getTruSeqSuffix(tag);
-        unsigned sufLen = _min(length(truSeqSuf), length(seq) - length(truSeqPre) - 8);
-        score += globalAlignmentScore(prefix(truSeqSuf, sufLen), infix(seq, length(truSeqPre) + 8, sufLen + 8 + length(truSeqPre)), Score<int>(1,0,0), -2, 2);
-        if (score > (int)preLen + (int)sufLen - 10) return 0;
-    }
-    else
-    {
-        truSeqPre = getTruSeqPrefix(HiSeqAdapters());
-        score = globalAlignmentScore(prefix(truSeqPre, preLen), prefix(seq, preLen), Score<int>(1,0,0), -2, 2);
-        if (score > (int)length(truSeqPre) - 5)
-        {
-            if (length(seq) < length(truSeqPre) + 8) return 0;
-            TSequence truSeqSuf = getTruSeqSuffix(HiSeqAdapters());
-            unsigned sufLen = _min(length(truSeqSuf), length(seq)- length(truSeqPre) - 8);
-            score += globalAlignmentScore(prefix(truSeqSuf, sufLen), infix(seq, length(truSeqPre) + 8, length(truSeqPre) + 8 + sufLen), Score<int>(1,0,0), -2, 2);
-            if (score > (int)preLen + (int)sufLen - 10) return 0;
-        }
-    }
-    return 1;
-}
-
-template<typename TSequence>
-bool
-startsWithTruSeq(TSequence & seq, HiSeqAdapters tag)
-{
-    TSequence truSeqPre = getTruSeqPrefix(tag);
-    unsigned preLen = _min(length(truSeqPre), length(seq));
-    int score = globalAlignmentScore(prefix(truSeqPre, preLen), prefix(seq, preLen), Score<int>(1,0,0), -2, 2);
-    if (score > (int)preLen - 5)
-    {
-        TSequence truSeqSuf = getTruSeqSuffix(tag);
-        unsigned sufLen = _min(length(truSeqSuf), length(seq) - length(truSeqPre) - 8);
-        score += globalAlignmentScore(prefix(truSeqSuf, sufLen), infix(seq, length(truSeqPre) + 8, sufLen + 8 + length(truSeqPre)), Score<int>(1,0,0), -2, 2);
-        if (score > (int)preLen + (int)sufLen - 10) return 0;
-    }
-    return 1;
-}
-
-
 inline StringSet<Dna5String>
 truSeqs(NoAdapters &)
 {
@@ -199,80 +124,6 @@ truSeqs(HiSeqXAdapters)
     return adaptSeqs;
 }
 
-template<typename TAdapterTag>
-inline StringSet<Dna5String>
-reverseTruSeqsOneError(TAdapterTag tag)
-{
-    typedef Dna5String TSeq;
-    typedef Size<TSeq>::Type TSize;
-    typedef Dna TAlphabet;
-
-    StringSet<TSeq> adaptSeqs = truSeqs(tag);
-
-    // Append all sequences with one mismatch to sequence set.
-    TSize len = length(adaptSeqs);
-    for (TSize s = 0; s < len; ++s)
-    {
-        reverse(adaptSeqs[s]);
-        TSeq errSeq = adaptSeqs[s];
-        for (TSize i = 0; i < length(adaptSeqs[s]); ++i)
-        {
-            for (TSize c = 0; c < ValueSize<TAlphabet>::VALUE; ++c)
-            {
-                errSeq[i] = c;
-                appendValue(adaptSeqs, errSeq);
-            }
-            errSeq[i] = adaptSeqs[s][i];
-        }
-    }
-
-    return adaptSeqs;
-}
-
-// Returns the length of the matching prefix.
-template<typename TIndexSeq, typename TSpec, typename TSequence>
-inline typename Size<TSequence>::Type
-prefixMatchLength(Index<TIndexSeq, TSpec> & suffixIndex, TSequence const & seq)
-{
-    typedef typename Size<TSequence>::Type TSize;
-    typedef Index<TIndexSeq, TSpec> TIndex;
-
-
-    typename Iterator<TIndex, TopDown<> >::Type it(suffixIndex);
-
-    TSize len = 0;   // length of matching prefix
-
-    while (goDown(it, seq[repLength(it)]))
-    {
-        // if end of seq reached
-        if (repLength(it) >= length(seq))
-        {
-            // if all of seq matches the beginning of some suffix
-            if (infix(representative(it), parentRepLength(it) + 1, length(seq)) ==
-                    infix(seq, parentRepLength(it) + 1, length(seq)))
-            {
-                len = length(seq);
-            }
-            break;
-        }
-
-        // if mismatch in remaining characters along this branch
-        if (infix(representative(it), parentRepLength(it) + 1, repLength(it)) !=
-                infix(seq, parentRepLength(it) + 1, repLength(it)))
-        {
-            break;
-        }
-
-        // if current prefix is a complete suffix
-        if (isRightTerminal(it))
-        {
-            len = repLength(it);
-        }
-    }
-
-    return len;
-}
-
 template<typename TSize>
 String<CigarElement<> >
 cigarPrefix(String<CigarElement<> > const & cigar, TSize len)
@@ -335,148 +186,213 @@ cigarSuffix(String<CigarElement<> > const & cigar, TSize len)
     return suffixCigar;
 }
 
-template<typename TSequence, typename TTag>
-int
-removeAdapter(BamAlignmentRecord & record,
-        Index<StringSet<TSequence> > & indexUniversal,
-        Index<StringSet<TSequence> > & indexTruSeqs,
-        unsigned minAdapterLength,
-        TTag tag)
+// --------------------------------------------------------------------------
+// Struct AdapterMatcher
+// --------------------------------------------------------------------------
+
+// The adapter sequences of a sequencing technology prepared for bit-parallel matching with up to errors mismatches.
+// Read-only after construction and shared by all cropping threads.
+template<typename TTag>
+struct AdapterMatcher
 {
-    typedef typename Size<TSequence>::Type TSize;
-    typedef ModifiedString<const TSequence, ModReverse> TRevSequence;
-    //  typedef ModifiedString<const TSequence, ModComplementDna5> TComplSequence;
-    //  typedef ModifiedString<const TComplSequence, ModReverse> TRevComplSequence; // TODO: This modifier seems to be buggy!
+    std::vector<AdapterGroup> universal;
+    std::vector<AdapterGroup> truSeqs;
 
-    TSize seqLen = length(record.seq);
+    std::string universalSeq;
+    std::string truSeqPrefix;
+    std::string truSeqSuffix;
+    std::string hiSeqPrefix;        // HiSeq TruSeq adapter checked at the begin of HiSeqX reads
+    std::string hiSeqSuffix;
 
-    if (hasFlagRC(record))
+    unsigned errors;
+
+    AdapterMatcher(unsigned e = 1) : errors(std::min(e, MAX_ADAPTER_ERRORS))
     {
-        TSequence complSeq = record.seq;
-        reverseComplement(complSeq);
+        _initAdapterMatcher(*this, TTag());
+    }
+};
 
-        // Check for adapter at begin of read.
-        if (hasFlagFirst(record))
-        {
-            // Compute alignment score to TruSeq (excluding barcode)
-            if (startsWithTruSeq(complSeq, tag) == 0)
-                return 2;
-        }
-        else
-        {
-            // Compute alignment score to reverse complement of Universal
-            TSequence universal = getUniversal(tag);
-            unsigned seqLen = _min(length(universal), length(complSeq));
-            int score = globalAlignmentScore(prefix(universal, seqLen), prefix(complSeq, seqLen), Score<int>(1,0,0), -2, 2);
-            if (score > (int)length(universal) - 5)
-                return 2;
-        }
+inline std::string
+_adapterString(Dna5String const & seq)
+{
+    CharString chars = seq;
+    return std::string(begin(chars, Standard()), end(chars, Standard()));
+}
 
-        // Search prefix of complemented read in *TruSeq* index.
-        reverse(complSeq);
-        //TComplSequence complSeq(record.seq);
-        TSize adaptLen = prefixMatchLength(indexTruSeqs, complSeq);
+template<typename TTag>
+inline void
+_initAdapterMatcher(AdapterMatcher<TTag> & matcher, TTag tag)
+{
+    std::vector<std::string> adapters(1, _adapterString(getUniversal(tag)));
+    buildAdapterGroups(matcher.universal, adapters);
+
+    StringSet<Dna5String> seqs = truSeqs(tag);
+    adapters.clear();
+    for (unsigned i = 0; i < length(seqs); ++i)
+        adapters.push_back(_adapterString(seqs[i]));
+    buildAdapterGroups(matcher.truSeqs, adapters);
+
+    matcher.universalSeq = _adapterString(getUniversal(tag));
+    matcher.truSeqPrefix = _adapterString(getTruSeqPrefix(tag));
+    matcher.truSeqSuffix = _adapterString(getTruSeqSuffix(tag));
+    matcher.hiSeqPrefix = _adapterString(getTruSeqPrefix(HiSeqAdapters()));
+    matcher.hiSeqSuffix = _adapterString(getTruSeqSuffix(HiSeqAdapters()));
+}
 
-        if (adaptLen == seqLen)
-        {
-            // Read starts with adapter.
-            //std::cerr << "Removing full read        " << record.seq << std::endl;
-            return 2;
-        }
-        else if (adaptLen >= minAdapterLength)
-        {
-            //std::cerr << "Removing first " << adaptLen << " bases from " << record.seq << std::endl;
-            replace(record.seq, 0, adaptLen, "");
-            replace(record.qual, 0, adaptLen, "");
-            record.cigar = cigarSuffix(record.cigar, adaptLen);
-            return 1;
-        }
+inline void
+_initAdapterMatcher(AdapterMatcher<NoAdapters> &, NoAdapters)
+{
+    // Nothing to be done.
+}
 
-        // Search prefix of complemented read in *Universal* index.
-        adaptLen = prefixMatchLength(indexUniversal, complSeq);
+// --------------------------------------------------------------------------
+// Struct ReadBases
+// --------------------------------------------------------------------------
 
-        if (adaptLen == seqLen)
-        {
-            // Read starts with adapter.
-            //std::cerr << "Removing full read        " << record.seq << std::endl;
-            return 2;
-        }
-        else if (adaptLen >= minAdapterLength)
-        {
-            //std::cerr << "Removing first " << adaptLen << " bases from " << record.seq << std::endl;
-            replace(record.seq, 0, adaptLen, "");
-            replace(record.qual, 0, adaptLen, "");
-            record.cigar = cigarSuffix(record.cigar, adaptLen);
-            return 1;
-        }
+// The bases of a read in sequencing direction as ranks for adapter matching, without copying the sequence.
+template<typename TSequence>
+struct ReadBases
+{
+    TSequence const & seq;
+    unsigned len;
+    bool reverseComplemented;
+
+    ReadBases(TSequence const & s, bool rc) : seq(s), len(length(s)), reverseComplemented(rc) {}
+
+    unsigned operator[](unsigned i) const
+    {
+        if (!reverseComplemented)
+            return ordValue(Dna5(seq[i]));
+        unsigned rank = ordValue(Dna5(seq[len - 1 - i]));
+        return rank > 3 ? rank : 3 - rank;
     }
-    else
+};
+
+// --------------------------------------------------------------------------
+// Function startsWithTruSeq()
+// --------------------------------------------------------------------------
+
+// Returns 0 if the read starts with the TruSeq adapter (excluding the barcode).
+template<typename TText>
+bool
+_startsWithTruSeq(TText const & text, std::string const & truSeqPre, std::string const & truSeqSuf, unsigned preLen)
+{
+    int score = bandedMatchCount(truSeqPre, text, 0, preLen);
+    if (score > (int)preLen - 5)
     {
-        // Check for adapter at begin of read.
-        if (hasFlagFirst(record))
-        {
-            // Compute alignemnt score to TruSeq (excluding barcode)
-            if (startsWithTruSeq(record.seq, tag) == 0)
-                return 2;
-        }
-        else
-        {
-            // Compute alignment score to reverse complement of Universal
-            TSequence universal = getUniversal(tag);
-            unsigned seqLen = _min(length(universal), length(record.seq));
-            int score = globalAlignmentScore(prefix(universal, seqLen), prefix(record.seq, seqLen), Score<int>(1,0,0), -2, 2);
-            if (score > (int)seqLen - 5)
-                return 2;
-        }
+        // Reads too short for the adapter suffix are removed.
+        if (text.len < truSeqPre.size() + 8) return 0;
+        unsigned sufLen = std::min((unsigned)truSeqSuf.size(), text.len - (unsigned)truSeqPre.size() - 8);
+        score += bandedMatchCount(truSeqSuf, text, truSeqPre.size() + 8, sufLen);
+        if (score > (int)preLen + (int)sufLen - 10) return 0;
+    }
+    return 1;
+}
 
-        // Search prefix of reversed read in *TruSeq* index.
-        TRevSequence revSeq(record.seq);
-        TSize adaptLen = prefixMatchLength(indexTruSeqs, revSeq);
+template<typename TText>
+bool
+startsWithTruSeq(TText const & text, AdapterMatcher<HiSeqXAdapters> const & adapters)
+{
+    unsigned preLen = std::min((unsigned)adapters.truSeqPrefix.size(), text.len);
+    int score = bandedMatchCount(adapters.truSeqPrefix, text, 0, preLen);
+    if (score > (int)preLen - 5)
+        return _startsWithTruSeq(text, adapters.truSeqPrefix, adapters.truSeqSuffix, preLen);
 
-        if (adaptLen == seqLen)
-        {
-            // Read starts with adapter.
-            //std::cerr << "Removing full read        " << record.seq << std::endl;
-            return 2;
-        }
-        else if (adaptLen >= minAdapterLength)
-        {
-            //std::cerr << "Removing last " << adaptLen << " bases from  " << record.seq << std::endl;
-            replace(record.seq, seqLen-adaptLen, seqLen, "");
-            replace(record.qual, seqLen-adaptLen, seqLen, "");
-            record.cigar = cigarPrefix(record.cigar, adaptLen);
-            return 1;
-        }
+    score = bandedMatchCount(adapters.hiSeqPrefix, text, 0, preLen);
+    if (score > (int)adapters.hiSeqPrefix.size() - 5)
+    {
+        if (text.len < adapters.hiSeqPrefix.size() + 8) return 0;
+        unsigned sufLen = std::min((unsigned)adapters.hiSeqSuffix.size(), text.len - (unsigned)adapters.hiSeqPrefix.size() - 8);
+        score += bandedMatchCount(adapters.hiSeqSuffix, text, adapters.hiSeqPrefix.size() + 8, sufLen);
+        if (score > (int)preLen + (int)sufLen - 10) return 0;
+    }
+    return 1;
+}
 
-        // Search prefix of read in *Universal* index.
-        adaptLen = prefixMatchLength(indexUniversal, revSeq);
+template<typename TText>
+bool
+startsWithTruSeq(TText const & text, AdapterMatcher<HiSeqAdapters> const & adapters)
+{
+    unsigned preLen = std::min((unsigned)adapters.truSeqPrefix.size(), text.len);
+    return _startsWithTruSeq(text, adapters.truSeqPrefix, adapters.truSeqSuffix, preLen);
+}
 
-        if (adaptLen == seqLen)
-        {
-            // Read starts with adapter.
-            //std::cerr << "Removing full read        " << record.seq << std::endl;
+// --------------------------------------------------------------------------
+// Function removeAdapter()
+// --------------------------------------------------------------------------
+
+/**
+ * Removes adapter sequence from the end of a read (in sequencing direction).
+ *
+ * @param record            the read, trimmed in place
+ * @param adapters          the adapter sequences
+ * @param minAdapterLength  the minimal length of an adapter prefix to be removed
+ *
+ * @returns                 0 if no adapter was found, 1 if an adapter was removed, and 2 if the read should be
+ *                          discarded because it starts with or consists of adapter sequence.
+ */
+template<typename TTag>
+int
+removeAdapter(BamAlignmentRecord & record,
+        AdapterMatcher<TTag> const & adapters,
+        unsigned minAdapterLength)
+{
+    typedef ReadBases<decltype(record.seq)> TText;
+
+    TText text(record.seq, hasFlagRC(record));
+    unsigned seqLen = text.len;
+
+    // Check for adapter at begin of read.
+    if (hasFlagFirst(record))
+    {
+        // Compute alignment score to TruSeq (excluding barcode)
+        if (startsWithTruSeq(text, adapters) == 0)
+            return 2;
+    }
+    else
+    {
+        // Compute alignment score to Universal
+        unsigned universalLen = std::min((unsigned)adapters.universalSeq.size(), seqLen);
+        int score = bandedMatchCount(adapters.universalSeq, text, 0, universalLen);
+        int threshold = hasFlagRC(record) ? (int)adapters.universalSeq.size() - 5 : (int)universalLen - 5;
+        if (score > threshold)
             return 2;
-        }
-        else if (adaptLen >= minAdapterLength)
-        {
-            //std::cerr << "Removing last " << adaptLen << " bases from  " << record.seq << std::endl;
-            replace(record.seq, seqLen-adaptLen, seqLen, "");
-            replace(record.qual, seqLen-adaptLen, seqLen, "");
-            record.cigar = cigarPrefix(record.cigar, adaptLen);
-            return 1;
-        }
     }
 
-    return 0;
+    // Search the end of the read for a prefix of a TruSeq adapter, then of the Universal adapter.
+    unsigned adaptLen = adapterMatchLength(adapters.truSeqs, text, seqLen, adapters.errors);
+    if (adaptLen != seqLen && adaptLen < minAdapterLength)
+        adaptLen = adapterMatchLength(adapters.universal, text, seqLen, adapters.errors);
+
+    if (adaptLen == seqLen)
+    {
+        // Read consists of adapter.
+        return 2;
+    }
+    else if (adaptLen < minAdapterLength)
+    {
+        return 0;
+    }
+
+    if (hasFlagRC(record))
+    {
+        replace(record.seq, 0, adaptLen, "");
+        replace(record.qual, 0, adaptLen, "");
+        record.cigar = cigarSuffix(record.cigar, adaptLen);
+    }
+    else
+    {
+        replace(record.seq, seqLen-adaptLen, seqLen, "");
+        replace(record.qual, seqLen-adaptLen, seqLen, "");
+        record.cigar = cigarPrefix(record.cigar, adaptLen);
+    }
+    return 1;
 }
 
-template<typename TSequence>
-int
+inline int
 removeAdapter(BamAlignmentRecord &,
-        Index<StringSet<TSequence> > &,
-        Index<StringSet<TSequence> > &,
-        unsigned,
-        NoAdapters)
+        AdapterMatcher<NoAdapters> const &,
+        unsigned)
 {
     return 0;
 }
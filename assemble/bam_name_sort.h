@@ -0,0 +1,394 @@
+#ifndef POPINS_BAM_NAME_SORT_H_
+#define POPINS_BAM_NAME_SORT_H_
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <cstdio>
+
+#include <seqan/bam_io.h>
+
+#include "../popins_bgzf.h"
+#include "read_names.h"
+
+using namespace seqan;
+
+// ==========================================================================
+// Function compare_qName()
+// ==========================================================================
+
+// The order of read names of 'samtools sort -n'.
+inline int
+compare_qName(CharString const & nameA, CharString const & nameB)
+{
+    return compareReadNames(begin(nameA, Standard()), length(nameA), begin(nameB, Standard()), length(nameB));
+}
+
+// --------------------------------------------------------------------------
+// Struct LessBamName
+// --------------------------------------------------------------------------
+
+// The order of 'samtools sort -n': by read name, then first reads before second reads.
+struct LessBamName
+{
+    bool operator()(BamAlignmentRecord const & a, BamAlignmentRecord const & b) const
+    {
+        int c = compare_qName(a.qName, b.qName);
+        return c < 0 || (c == 0 && (a.flag & 0xc0) < (b.flag & 0xc0));
+    }
+};
+
+// ==========================================================================
+// Function setSortOrder()
+// ==========================================================================
+
+// Sets the SO tag of the @HD line of a bam header.
+inline void
+setSortOrder(BamHeader & header, char const * order)
+{
+    for (unsigned i = 0; i < length(header); ++i)
+    {
+        if (header[i].type != BamHeaderRecordType::BAM_HEADER_FIRST)
+            continue;
+
+        for (unsigned j = 0; j < length(header[i].tags); ++j)
+        {
+            if (header[i].tags[j].i1 == "SO")
+            {
+                header[i].tags[j].i2 = order;
+                return;
+            }
+        }
+        appendValue(header[i].tags, Pair<CharString>("SO", order));
+        return;
+    }
+}
+
+// ==========================================================================
+// Struct BamNameSorter
+// ==========================================================================
+
+// External merge sort of bam records by read name in the order of 'samtools sort -n'. The producer writes its records
+// to the sorter, which collects them in memory. When the records of a run exceed their share of the memory budget,
+// the run is sorted and written to a temporary file of uncompressed records by a background thread while the producer
+// continues with the next run. In the end, the sorted runs are merged into the output bam file.
+struct BamNameSorter
+{
+    typedef std::vector<BamAlignmentRecord> TRecords;
+
+    std::string filePrefix;
+    size_t runMemory;
+    unsigned threads;
+
+    // Records of the current run.
+    TRecords records;
+    size_t recordMemory;
+
+    // Spilled runs and the threads still sorting and writing them.
+    std::vector<std::string> runFiles;
+    std::vector<std::thread> runThreads;
+    std::atomic<bool> failed;
+
+    BamNameSorter(CharString const & prefix, size_t memory, unsigned t) :
+        filePrefix(toCString(prefix)), threads(std::max(t, 1u)), recordMemory(0), failed(false)
+    {
+        // Each thread sorts one run at a time, one of them being filled by the producer.
+        runMemory = std::max(memory / threads, (size_t)1 << 20);
+    }
+
+    ~BamNameSorter()
+    {
+        for (unsigned i = 0; i < runThreads.size(); ++i)
+            runThreads[i].join();
+        for (unsigned i = 0; i < runFiles.size(); ++i)
+            std::remove(runFiles[i].c_str());
+    }
+};
+
+// --------------------------------------------------------------------------
+// Function sortMemory()
+// --------------------------------------------------------------------------
+
+// Approximate memory taken by a record in the sorter.
+inline size_t
+sortMemory(BamAlignmentRecord const & record)
+{
+    return sizeof(BamAlignmentRecord) + length(record.qName) + length(record.cigar) * sizeof(CigarElement<>) +
+        length(record.seq) + length(record.qual) + length(record.tags);
+}
+
+// --------------------------------------------------------------------------
+// Functions writeRunValue() and readRunValue()
+// --------------------------------------------------------------------------
+
+template<typename TValue>
+inline void
+writeRunValue(std::ostream & stream, TValue const & value)
+{
+    stream.write((char const *)&value, sizeof(TValue));
+}
+
+inline void
+writeRunValue(std::ostream & stream, CharString const & str)
+{
+    __uint32 len = length(str);
+    writeRunValue(stream, len);
+    stream.write(begin(str, Standard()), len);
+}
+
+template<typename TValue>
+inline void
+readRunValue(TValue & value, std::istream & stream)
+{
+    stream.read((char *)&value, sizeof(TValue));
+}
+
+inline void
+readRunValue(CharString & str, std::istream & stream)
+{
+    __uint32 len = 0;
+    readRunValue(len, stream);
+    resize(str, len);
+    if (len > 0)
+        stream.read(begin(str, Standard()), len);
+}
+
+// --------------------------------------------------------------------------
+// Functions writeRunRecord() and readRunRecord()
+// --------------------------------------------------------------------------
+
+// A record in a run file consists of the fields of a BamAlignmentRecord without compression.
+inline void
+writeRunRecord(std::ostream & stream, BamAlignmentRecord const & record, CharString & buffer)
+{
+    writeRunValue(stream, record.qName);
+    writeRunValue(stream, record.flag);
+    writeRunValue(stream, record.rID);
+    writeRunValue(stream, record.beginPos);
+    writeRunValue(stream, record.mapQ);
+    writeRunValue(stream, record.bin);
+    writeRunValue(stream, (__uint32)length(record.cigar));
+    for (unsigned i = 0; i < length(record.cigar); ++i)
+    {
+        writeRunValue(stream, record.cigar[i].operation);
+        writeRunValue(stream, record.cigar[i].count);
+    }
+    writeRunValue(stream, record.rNextId);
+    writeRunValue(stream, record.pNext);
+    writeRunValue(stream, record.tLen);
+    buffer = record.seq;
+    writeRunValue(stream, buffer);
+    writeRunValue(stream, record.qual);
+    writeRunValue(stream, record.tags);
+}
+
+// Returns false at the end of the run file.
+inline bool
+readRunRecord(BamAlignmentRecord & record, std::istream & stream, CharString & buffer)
+{
+    readRunValue(record.qName, stream);
+    if (!stream)
+        return false;
+
+    readRunValue(record.flag, stream);
+    readRunValue(record.rID, stream);
+    readRunValue(record.beginPos, stream);
+    readRunValue(record.mapQ, stream);
+    readRunValue(record.bin, stream);
+    __uint32 numCigar = 0;
+    readRunValue(numCigar, stream);
+    resize(record.cigar, numCigar);
+    for (unsigned i = 0; i < numCigar; ++i)
+    {
+        readRunValue(record.cigar[i].operation, stream);
+        readRunValue(record.cigar[i].count, stream);
+    }
+    readRunValue(record.rNextId, stream);
+    readRunValue(record.pNext, stream);
+    readRunValue(record.tLen, stream);
+    readRunValue(buffer, stream);
+    record.seq = buffer;
+    readRunValue(record.qual, stream);
+    readRunValue(record.tags, stream);
+
+    return (bool)stream;
+}
+
+// --------------------------------------------------------------------------
+// Function writeSortedRun()
+// --------------------------------------------------------------------------
+
+// Sorts the records of a run and writes them to a run file. Runs in a background thread.
+inline void
+writeSortedRun(BamNameSorter::TRecords records, std::string const & runFile, std::atomic<bool> & failed)
+{
+    std::stable_sort(records.begin(), records.end(), LessBamName());
+
+    std::ofstream stream(runFile.c_str(), std::ios::binary);
+    CharString buffer;
+    for (BamNameSorter::TRecords::const_iterator it = records.begin(); it != records.end() && stream; ++it)
+        writeRunRecord(stream, *it, buffer);
+    stream.close();
+
+    if (!stream)
+    {
+        std::cerr << "ERROR: Could not write temporary file " << runFile << " for sorting by read name." << std::endl;
+        failed = true;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function spillRun()
+// --------------------------------------------------------------------------
+
+inline void
+spillRun(BamNameSorter & sorter)
+{
+    std::stringstream runFile;
+    runFile << sorter.filePrefix << ".sort." << sorter.runFiles.size() << ".tmp";
+    sorter.runFiles.push_back(runFile.str());
+
+    if (sorter.threads < 2)
+    {
+        writeSortedRun(std::move(sorter.records), sorter.runFiles.back(), sorter.failed);
+    }
+    else
+    {
+        // Wait for the oldest run if all other threads are busy.
+        if (sorter.runThreads.size() + 1 >= sorter.threads)
+        {
+            sorter.runThreads.front().join();
+            sorter.runThreads.erase(sorter.runThreads.begin());
+        }
+        sorter.runThreads.push_back(std::thread(writeSortedRun, std::move(sorter.records), sorter.runFiles.back(),
+                std::ref(sorter.failed)));
+    }
+
+    sorter.records.clear();
+    sorter.recordMemory = 0;
+}
+
+// --------------------------------------------------------------------------
+// Function writeRecord()
+// --------------------------------------------------------------------------
+
+// Adds a record to the sorter.
+inline void
+writeRecord(BamNameSorter & sorter, BamAlignmentRecord const & record)
+{
+    sorter.records.push_back(record);
+    sorter.recordMemory += sortMemory(record);
+    if (sorter.recordMemory >= sorter.runMemory)
+        spillRun(sorter);
+}
+
+// --------------------------------------------------------------------------
+// Struct GreaterRunHead
+// --------------------------------------------------------------------------
+
+// Heap order of the runs' next records for the k-way merge. Equal records are taken from the earlier run first.
+struct GreaterRunHead
+{
+    std::vector<BamAlignmentRecord> const & heads;
+
+    GreaterRunHead(std::vector<BamAlignmentRecord> const & h) :
+        heads(h)
+    {}
+
+    bool operator()(unsigned i, unsigned j) const
+    {
+        LessBamName less;
+        if (less(heads[j], heads[i])) return true;
+        if (less(heads[i], heads[j])) return false;
+        return i > j;
+    }
+};
+
+// --------------------------------------------------------------------------
+// Function writeSortedRecords()
+// --------------------------------------------------------------------------
+
+// Writes all records added to the sorter in sorted order to the output bam file, which must have its header written.
+// The records of an already sorted bam file can be merged in, preceding equal records of the sorter.
+// Returns 1 on error.
+inline bool
+writeSortedRecords(ParallelBamFileOut & outStream, BamNameSorter & sorter, BamFileIn * sortedIn = 0)
+{
+    // Sort in memory if nothing was spilled.
+    if (sorter.runFiles.empty() && sortedIn == 0)
+    {
+        std::stable_sort(sorter.records.begin(), sorter.records.end(), LessBamName());
+        for (BamNameSorter::TRecords::const_iterator it = sorter.records.begin(); it != sorter.records.end(); ++it)
+            writeRecord(outStream, *it);
+        sorter.records.clear();
+        sorter.recordMemory = 0;
+        return 0;
+    }
+
+    if (!sorter.records.empty())
+        spillRun(sorter);
+    for (unsigned i = 0; i < sorter.runThreads.size(); ++i)
+        sorter.runThreads[i].join();
+    sorter.runThreads.clear();
+    if (sorter.failed)
+        return 1;
+
+    // Merge the runs, the sorted bam file being the first run if given.
+    unsigned firstRun = (sortedIn != 0) ? 1 : 0;
+    unsigned numRuns = sorter.runFiles.size() + firstRun;
+    std::vector<std::unique_ptr<std::ifstream> > runs;
+    std::vector<BamAlignmentRecord> heads(numRuns);
+    GreaterRunHead greater(heads);
+    std::priority_queue<unsigned, std::vector<unsigned>, GreaterRunHead> queue(greater);
+
+    CharString buffer;
+    auto readHead = [&](unsigned i) -> bool
+    {
+        if (i < firstRun)
+        {
+            if (atEnd(*sortedIn))
+                return false;
+            readRecord(heads[i], *sortedIn);
+            return true;
+        }
+        return readRunRecord(heads[i], *runs[i - firstRun], buffer);
+    };
+
+    for (unsigned i = 0; i < sorter.runFiles.size(); ++i)
+    {
+        runs.push_back(std::unique_ptr<std::ifstream>(new std::ifstream(sorter.runFiles[i].c_str(), std::ios::binary)));
+        if (!runs[i]->is_open())
+        {
+            std::cerr << "ERROR: Could not open temporary file " << sorter.runFiles[i] << " for sorting by read name." << std::endl;
+            return 1;
+        }
+    }
+    for (unsigned i = 0; i < numRuns; ++i)
+        if (readHead(i))
+            queue.push(i);
+
+    while (!queue.empty())
+    {
+        unsigned i = queue.top();
+        queue.pop();
+        writeRecord(outStream, heads[i]);
+        if (readHead(i))
+            queue.push(i);
+    }
+
+    for (unsigned i = 0; i < runs.size(); ++i)
+    {
+        runs[i]->close();
+        std::remove(sorter.runFiles[i].c_str());
+    }
+    sorter.runFiles.clear();
+
+    return 0;
+}
+
+#endif  // POPINS_BAM_NAME_SORT_H_
@@ -1,10 +1,22 @@
 #ifndef NOVINS_CROP_UNMAPPED_H_
 #define NOVINS_CROP_UNMAPPED_H_
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include <seqan/seq_io.h>
 #include <seqan/bam_io.h>
 
+#include "../popins_bam_view.h"
+#include "../popins_parallel.h"
 #include "adapter_removal.h"
+#include "bam_name_sort.h"
+#include "fastq_store.h"
+#include "read_store.h"
+#include "quality_trimming.h"
+#include "read_filtering.h"
 
 
 using namespace seqan;
@@ -24,12 +36,13 @@ using namespace seqan;
  *   - The read end is soft-clipped by 25 or more bases at both ends.
  *   - The alignment score as indicated by the AS tag is lower than 0.5 * read length.
  *
- * @param record    a read's mapping record from a bam file
+ * @param record    a read's mapping record from a bam file, a BamAlignmentRecord or a BamRecordView
  *
  * @returns         true if the read has low mapping quality and otherwise false.
  */
+template<typename TRecord>
 inline bool
-hasLowMappingQuality(BamAlignmentRecord & record, int humanSeqs)
+hasLowMappingQuality(TRecord & record, int humanSeqs)
 {
     typedef Iterator<String<CigarElement<> > >::Type TIter;
 
@@ -55,13 +68,11 @@ hasLowMappingQuality(BamAlignmentRecord & record, int humanSeqs)
         return true;
 
     // Check for AS (alignment score) lower than 0.5 * readLength.
-    BamTagsDict tagsDict(record.tags);
-    unsigned idx;
-    if (findTagKey(idx, tagsDict, "AS"))
+    CharString tags;
+    unsigned score = 0;
+    if (findTagValue(score, record, "AS", tags))
     {
-        unsigned score = 0;
-        extractTagValue(score, tagsDict, idx);
-        if (score < 0.5*length(record.seq))
+        if (score < 0.5*readLength(record))
             return true;
     }
 
@@ -76,58 +87,20 @@ template<typename TSize_>
 inline bool
 removeLowQuality(BamAlignmentRecord & record, TSize_ qualThresh)
 {
-    typedef Iterator<CharString, Rooted>::Type TIter;
-    typedef Size<CharString>::Type TSize;
-
-    TSize windowSize = std::max(TSize(5), length(record.qual) / 10);
-    TSize windowThresh = qualThresh*windowSize;
-
-    // Initialize windowQual with first windowSize quality values.
-    TSize windowQual = 0; 
-    TIter qualEnd = end(record.qual);
-    TIter windowEnd = begin(record.qual) + std::min(windowSize, length(record.qual));
-    TIter windowBegin = begin(record.qual);
-    for (; windowBegin != windowEnd; ++windowBegin) 
-        windowQual += *windowBegin - 33;
-
-    // Check quality from the left.
-    for (windowBegin = begin(record.qual); windowEnd < qualEnd; ++windowEnd, ++windowBegin)
-    {
-        if (windowQual >= (TSize)windowThresh)
-        {
-            while (*windowBegin - 33 < qualThresh) ++windowBegin;
-            record.seq = suffix(record.seq, position(windowBegin));
-            record.qual = suffix(record.qual, position(windowBegin));
-            break;
-        }
+    static QualityTrimKernels const kernels = qualityTrimKernels();
 
-        windowQual -= *windowBegin - 33;
-        windowQual += *windowEnd - 33;
-    }
-    if (windowEnd == qualEnd) return 1;
-
-    // Initialize windowQual with last windowSize quality values.
-    windowQual = 0;
-    TIter qualBegin = begin(record.qual);
-    windowEnd = end(record.qual) - 1;
-    windowBegin = windowEnd - std::min(windowSize, length(record.qual));
-    for (; windowEnd != windowBegin; --windowEnd)
-        windowQual += *windowEnd - 33;
+    // Find the part of the read to keep in windows of size max(5, length/10) from the left and from the right.
+    size_t left = 0, right = 0;
+    if (!qualityTrimBounds(left, right, begin(record.qual, Standard()), length(record.qual), qualThresh, kernels))
+        return 1;
 
-    // Check quality from the right.
-    for (windowEnd = end(record.qual) - 1; windowBegin >= qualBegin; --windowBegin, --windowEnd)
+    if (right != length(record.qual))
     {
-        if (windowQual >= (TSize)windowThresh)
-        {
-            while (*windowEnd - 33 < qualThresh) --windowEnd;
-            record.seq = prefix(record.seq, position(windowEnd) + 1);
-            record.qual = prefix(record.qual, position(windowEnd) + 1);
-            break;
-        }
-
-        windowQual -= *windowEnd - 33;
-        windowQual += *windowBegin -33;
+        record.seq = prefix(record.seq, right);
+        record.qual = prefix(record.qual, right);
     }
+    record.seq = suffix(record.seq, left);
+    record.qual = suffix(record.qual, left);
 
     if (length(record.seq) < 30) return 1;
     return 0;
@@ -162,123 +135,358 @@ setMateUnmapped(BamAlignmentRecord & record)
     record.tLen = BamAlignmentRecord::INVALID_LEN;
 }
 
+// --------------------------------------------------------------------------
+// Function assignBytes()
+// --------------------------------------------------------------------------
+
+inline void
+assignBytes(CharString & str, char const * bytes, size_t len)
+{
+    resize(str, len, Exact());
+    if (len > 0)
+        std::copy(bytes, bytes + len, begin(str, Standard()));
+}
+
+// --------------------------------------------------------------------------
+// Enum CropReadsFormat
+// --------------------------------------------------------------------------
+
+// Output of the cropped reads: the sample's read store, optionally with binned qualities, or an interleaved fastq file
+// for remapping with bwa.
+enum CropReadsFormat
+{
+    CROP_READ_STORE,
+    CROP_READ_STORE_BINNED,
+    CROP_INTERLEAVED_FASTQ
+};
+
+// --------------------------------------------------------------------------
+// Struct CropFastqOut
+// --------------------------------------------------------------------------
+
+// The output of cropped reads and, optionally, the fastq files of the reads after quality filtering for the assembly,
+// which are written in the same pass. If interleaved, pairs and single reads are all written to one fastq file, the two
+// reads of a pair one after the other.
+struct CropFastqOut
+{
+    bool interleaved;
+    SeqFileOut fastq;
+    ReadStoreWriter store;
+
+    bool filter;
+    SeqFileOut filteredFirst;
+    SeqFileOut filteredSecond;
+    SeqFileOut filteredSingle;
+
+    unsigned long keptPairs;
+    unsigned long keptSingles;
+    unsigned long discarded;
+
+    CropFastqOut() :
+        interleaved(false), filter(false), keptPairs(0), keptSingles(0), discarded(0)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Function openFiltered()
+// --------------------------------------------------------------------------
+
+// Opens the fastq files of quality filtered reads and enables the filtering.
+inline bool
+openFiltered(CropFastqOut & out, Triple<CharString> const & filteredFiles)
+{
+    if (!open(out.filteredFirst, toCString(filteredFiles.i1)) ||
+            !open(out.filteredSecond, toCString(filteredFiles.i2)) ||
+            !open(out.filteredSingle, toCString(filteredFiles.i3)))
+    {
+        std::cerr << "ERROR: Could not open fastq files " << filteredFiles.i1 << ", " << filteredFiles.i2 << ", ";
+        std::cerr << filteredFiles.i3 << " for writing." << std::endl;
+        return false;
+    }
+    out.filter = true;
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function open()
+// --------------------------------------------------------------------------
+
+// Opens the read store or the interleaved fastq file. Quality filtering is enabled if the filtered files are given.
+inline bool
+open(CropFastqOut & out, CharString const & readsFile, CropReadsFormat format, Triple<CharString> const & filteredFiles)
+{
+    out.interleaved = (format == CROP_INTERLEAVED_FASTQ);
+    if (out.interleaved)
+    {
+        if (!open(out.fastq, toCString(readsFile)))
+        {
+            std::cerr << "ERROR: Could not open fastq file " << readsFile << " for writing." << std::endl;
+            return false;
+        }
+    }
+    else if (!open(out.store, toCString(readsFile), format == CROP_READ_STORE_BINNED))
+    {
+        std::cerr << "ERROR: Could not open read store " << readsFile << " for writing." << std::endl;
+        return false;
+    }
+
+    if (filteredFiles.i1 != "")
+        return openFiltered(out, filteredFiles);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function close()
+// --------------------------------------------------------------------------
+
+// Returns false on error.
+inline bool
+close(CropFastqOut & out)
+{
+    if (!out.interleaved && !close(out.store))
+    {
+        std::cerr << "ERROR: Could not write read store " << out.store.fileName << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function writeFilteredPair()
+// --------------------------------------------------------------------------
+
+// Trims a read pair and writes it to the filtered fastq files. If only one read passes, it is kept as a single read.
+inline void
+writeFilteredPair(CropFastqOut & out,
+        CharString const & name,
+        CharString const & firstSeq,
+        CharString const & firstQual,
+        CharString const & secondSeq,
+        CharString const & secondQual)
+{
+    size_t firstLength = filterTrimLength(begin(firstSeq, Standard()), begin(firstQual, Standard()),
+                                          std::min(length(firstSeq), length(firstQual)));
+    size_t secondLength = filterTrimLength(begin(secondSeq, Standard()), begin(secondQual, Standard()),
+                                           std::min(length(secondSeq), length(secondQual)));
+
+    if (firstLength != 0 && secondLength != 0)
+    {
+        writeRecord(out.filteredFirst, name, prefix(firstSeq, firstLength), prefix(firstQual, firstLength));
+        writeRecord(out.filteredSecond, name, prefix(secondSeq, secondLength), prefix(secondQual, secondLength));
+        ++out.keptPairs;
+    }
+    else if (firstLength != 0)
+    {
+        writeRecord(out.filteredSingle, name, prefix(firstSeq, firstLength), prefix(firstQual, firstLength));
+        ++out.keptSingles;
+        ++out.discarded;
+    }
+    else if (secondLength != 0)
+    {
+        writeRecord(out.filteredSingle, name, prefix(secondSeq, secondLength), prefix(secondQual, secondLength));
+        ++out.keptSingles;
+        ++out.discarded;
+    }
+    else
+    {
+        out.discarded += 2;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function writeFilteredSingle()
+// --------------------------------------------------------------------------
+
+// Trims a single read and writes it to the filtered fastq file if it passes.
+inline void
+writeFilteredSingle(CropFastqOut & out, CharString const & name, CharString const & seq, CharString const & qual)
+{
+    size_t len = filterTrimLength(begin(seq, Standard()), begin(qual, Standard()), std::min(length(seq), length(qual)));
+    if (len != 0)
+    {
+        writeRecord(out.filteredSingle, name, prefix(seq, len), prefix(qual, len));
+        ++out.keptSingles;
+    }
+    else
+    {
+        ++out.discarded;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function writeFastqPair()
+// --------------------------------------------------------------------------
+
+// Writes a read pair to the read store or fastq file and, if filtering is enabled, to the filtered fastq files.
+inline void
+writeFastqPair(CropFastqOut & out,
+        CharString const & name,
+        CharString const & firstSeq,
+        CharString const & firstQual,
+        CharString const & secondSeq,
+        CharString const & secondQual)
+{
+    if (out.interleaved)
+    {
+        writeRecord(out.fastq, name, firstSeq, firstQual);
+        writeRecord(out.fastq, name, secondSeq, secondQual);
+    }
+    else
+    {
+        writePair(out.store, begin(name, Standard()), length(name),
+                  begin(firstSeq, Standard()), length(firstSeq), begin(firstQual, Standard()), length(firstQual),
+                  begin(secondSeq, Standard()), length(secondSeq), begin(secondQual, Standard()), length(secondQual));
+    }
+
+    if (out.filter)
+        writeFilteredPair(out, name, firstSeq, firstQual, secondSeq, secondQual);
+}
+
+// --------------------------------------------------------------------------
+// Function writeFastqSingle()
+// --------------------------------------------------------------------------
+
+// Writes a single read to the read store or fastq file and, if filtering is enabled, to the filtered fastq file.
+inline void
+writeFastqSingle(CropFastqOut & out, CharString const & name, CharString const & seq, CharString const & qual)
+{
+    if (out.interleaved)
+        writeRecord(out.fastq, name, seq, qual);
+    else
+        writeSingle(out.store, begin(name, Standard()), length(name),
+                    begin(seq, Standard()), length(seq), begin(qual, Standard()), length(qual));
+
+    if (out.filter)
+        writeFilteredSingle(out, name, seq, qual);
+}
+
+// --------------------------------------------------------------------------
+// Function printFilteringStatus()
+// --------------------------------------------------------------------------
+
+inline void
+printFilteringStatus(CropFastqOut const & out, Triple<CharString> const & filteredFiles)
+{
+    std::ostringstream msg;
+    msg << "Filtered reads written to " << filteredFiles.i1 << ", " << filteredFiles.i2 << ", " << filteredFiles.i3;
+    msg << ", " << out.keptPairs << " pairs and " << out.keptSingles << " single reads kept, ";
+    msg << out.discarded << " reads discarded.";
+    printStatus(msg);
+}
+
 // --------------------------------------------------------------------------
 // Function appendFastqRecord()
 // --------------------------------------------------------------------------
 
-// Append a read to map of fastq records.
+// Append a read to store of fastq records. The reads are written to the fastq files in name order by writeFastq(), also
+// those that complete a pair. Returns 1 if the read's mate is in the store, in memory or spilled to disk, i.e. the read
+// completes a pair.
 bool
-appendFastqRecord(SeqFileOut & firstStream,
-        SeqFileOut & secondStream,
-        std::map<CharString, Pair<CharString> > & firstReads,
-        std::map<CharString, Pair<CharString> > & secondReads,
+appendFastqRecord(FastqStore & firstReads,
+        FastqStore & secondReads,
         BamAlignmentRecord const & record)
 {
+    FastqStore & mateReads = hasFlagFirst(record) ? secondReads : firstReads;
+    bool paired = containsRead(mateReads, begin(record.qName, Standard()), length(record.qName));
+
     CharString seq = record.seq;
     CharString qual = record.qual;
 
-    if (hasFlagRC(record))
+    // The read completing a pair is written as it is in the bam file.
+    uint32_t flags = 0;
+    if (!paired && hasFlagRC(record))
     {
         reverseComplement(seq);
         reverse(qual);
+        flags = FastqStore::REVERSED;
     }
 
-    if (hasFlagFirst(record))
-    {
-        if (secondReads.count(record.qName) != 0)
-        {
-            Pair<CharString> second = secondReads[record.qName];
-            writeRecord(firstStream, record.qName, record.seq, record.qual);
-            writeRecord(secondStream, record.qName, second.i1, second.i2);
-            secondReads.erase(record.qName);
-            return 1;
-        }
-        else
-        {
-            firstReads[record.qName] = Pair<CharString>(seq, qual);
-            return 0;
-        }
-    }
-    else // hasFlagLast(record)
-    {
-        if (firstReads.count(record.qName) != 0)
-        {
-            Pair<CharString> first = firstReads[record.qName];
-            writeRecord(firstStream, record.qName, first.i1, first.i2);
-            writeRecord(secondStream, record.qName, record.seq, record.qual);
-            firstReads.erase(record.qName);
-            return 1;
-        }
-        else
-        {
-            secondReads[record.qName] = Pair<CharString>(seq, qual);
-            return 0;
-        }
-    }
+    FastqStore & reads = hasFlagFirst(record) ? firstReads : secondReads;
+    insertRead(reads, begin(record.qName, Standard()), length(record.qName),
+               begin(seq, Standard()), length(seq), begin(qual, Standard()), length(qual), flags);
+    return paired;
 }
 
 // --------------------------------------------------------------------------
 // Function writeFastq()
 // --------------------------------------------------------------------------
 
+// Writes the reads of the stores in name order as pairs and single reads and closes the output.
 int
-writeFastq(SeqFileOut & fastqFirst,
-        SeqFileOut & fastqSecond,
-        SeqFileOut & fastqSingle,
-        std::map<CharString, Pair<CharString> > const & firstReads,
-        std::map<CharString, Pair<CharString> > const & secondReads)
+writeFastq(CropFastqOut & fastqOut,
+        FastqStore const & firstReads,
+        FastqStore const & secondReads)
 {
-    typedef std::map<CharString, Pair<CharString> > TFastqMap;
+    if (firstReads.failed || secondReads.failed)
+    {
+        std::cerr << "ERROR: Could not write temporary files for reads with prefix " << firstReads.spillPrefix << std::endl;
+        return 1;
+    }
+
+    // Initialize cursors over reads in fastq stores.
+    FastqStoreCursor firstIt, secondIt;
+    if (!openCursor(firstIt, firstReads) || !openCursor(secondIt, secondReads))
+    {
+        std::cerr << "ERROR: Could not read temporary files for reads with prefix " << firstReads.spillPrefix << std::endl;
+        return 1;
+    }
 
-    // Initialize iterators over reads in fastq maps.
-    TFastqMap::const_iterator firstIt = firstReads.begin();
-    TFastqMap::const_iterator firstEnd = firstReads.end();
-    TFastqMap::const_iterator secondIt = secondReads.begin();
-    TFastqMap::const_iterator secondEnd = secondReads.end();
+    CharString name, seq, qual, mateSeq, mateQual;
 
-    // Iterate over reads and output to fastq files (paired.1 and paired.2, or single).
-    while (firstIt != firstEnd && secondIt != secondEnd)
+    // Iterate over reads and output them as pairs or single reads.
+    while (!firstIt.atEnd && !secondIt.atEnd)
     {
-        if (firstIt->first < secondIt->first)
+        if (lessFastqName(firstIt.name, firstIt.nameLength, secondIt.name, secondIt.nameLength))
         {
-            writeRecord(fastqSingle, firstIt->first, firstIt->second.i1, firstIt->second.i2);
-            ++firstIt;
+            assignBytes(name, firstIt.name, firstIt.nameLength);
+            assignBytes(seq, firstIt.seq, firstIt.seqLength);
+            assignBytes(qual, firstIt.qual, firstIt.qualLength);
+            writeFastqSingle(fastqOut, name, seq, qual);
+            goNext(firstIt);
         }
-        else if (firstIt->first == secondIt->first)
+        else if (!lessFastqName(secondIt.name, secondIt.nameLength, firstIt.name, firstIt.nameLength))
         {
-            writeRecord(fastqFirst, firstIt->first, firstIt->second.i1, firstIt->second.i2);
-            writeRecord(fastqSecond, secondIt->first, secondIt->second.i1, secondIt->second.i2);
-            ++firstIt; ++secondIt;
+            assignBytes(name, firstIt.name, firstIt.nameLength);
+            assignBytes(seq, firstIt.seq, firstIt.seqLength);
+            assignBytes(qual, firstIt.qual, firstIt.qualLength);
+            assignBytes(mateSeq, secondIt.seq, secondIt.seqLength);
+            assignBytes(mateQual, secondIt.qual, secondIt.qualLength);
+            writeFastqPair(fastqOut, name, seq, qual, mateSeq, mateQual);
+            goNext(firstIt); goNext(secondIt);
         }
-        else // firstIt->first > secondIt->first
+        else // firstIt.name > secondIt.name
         {
-            writeRecord(fastqSingle, secondIt->first, secondIt->second.i1, secondIt->second.i2);
-            ++secondIt;
+            assignBytes(name, secondIt.name, secondIt.nameLength);
+            assignBytes(seq, secondIt.seq, secondIt.seqLength);
+            assignBytes(qual, secondIt.qual, secondIt.qualLength);
+            writeFastqSingle(fastqOut, name, seq, qual);
+            goNext(secondIt);
         }
     }
 
-    // Iterate over remaining reads and output to single.fastq.
-    while (firstIt != firstEnd)
+    // Iterate over remaining reads and output them as single reads.
+    FastqStoreCursor & restIt = firstIt.atEnd ? secondIt : firstIt;
+    while (!restIt.atEnd)
     {
-        writeRecord(fastqSingle, firstIt->first, firstIt->second.i1, firstIt->second.i2);
-        ++firstIt;
-    }
-    while (secondIt != secondEnd)
-    {
-        writeRecord(fastqSingle, secondIt->first, secondIt->second.i1, secondIt->second.i2);
-        ++secondIt;
+        assignBytes(name, restIt.name, restIt.nameLength);
+        assignBytes(seq, restIt.seq, restIt.seqLength);
+        assignBytes(qual, restIt.qual, restIt.qualLength);
+        writeFastqSingle(fastqOut, name, seq, qual);
+        goNext(restIt);
     }
 
-    return 0;
+    return close(fastqOut) ? 0 : 1;
 }
 
 // --------------------------------------------------------------------------
 // Function findOtherReads()
 // --------------------------------------------------------------------------
 
+// Finds the mapped mates of low quality reads in the input bam file and writes them to the mates bam file. Returns the
+// number of mates found or -1 on error.
 template<typename TPos>
 int
-findOtherReads(BamFileOut & matesStream,
+findOtherReads(BamNameSorter & matesStream,
         std::map<Pair<TPos>, Pair<CharString, bool> > & otherReads,
         CharString const & mappingBam)
 {
@@ -345,125 +553,1278 @@ findOtherReads(BamFileOut & matesStream,
     return numFound;
 }
 
-// ==========================================================================
-// Function crop_unmapped()
-// ==========================================================================
+// Searches the mates in all input bam files of a sample. The files have the same reference sequences.
+template<typename TPos>
+int
+findOtherReads(BamNameSorter & matesStream,
+        std::map<Pair<TPos>, Pair<CharString, bool> > & otherReads,
+        String<CharString> const & mappingBams)
+{
+    int numFound = 0;
+    for (unsigned i = 0; i < length(mappingBams); ++i)
+    {
+        int found = findOtherReads(matesStream, otherReads, mappingBams[i]);
+        if (found == -1)
+            return -1;
+        numFound += found;
+    }
+    return numFound;
+}
+
+// --------------------------------------------------------------------------
+// Enum CropAction
+// --------------------------------------------------------------------------
+
+// What happens to a record of the input bam file after classification.
+enum CropAction
+{
+    CROP_SKIP,      // Uninteresting record.
+    CROP_UNMAPPED,  // Unmapped read to go into the fastq files.
+    CROP_LOW_MAPQ,  // Read with low mapping quality to go into the fastq files.
+    CROP_MATE,      // Mapped read with unmapped mate to go into the mates bam file.
+    CROP_DISCARDED  // Unmapped or low quality read that is too short after trimming.
+};
+
+// --------------------------------------------------------------------------
+// Function classifyRecord()
+// --------------------------------------------------------------------------
+
+// Decides what to do with a record. Only depends on the record itself so that it can be called concurrently.
+// Takes a BamAlignmentRecord or a BamRecordView, which needs decoding only if the action is not CROP_SKIP. The aligned
+// bases are counted only if countCoverage is set.
+template<typename TRecord>
+inline CropAction
+classifyRecord(unsigned long & alignedBaseCount, bool countCoverage, TRecord & record, int humanSeqs)
+{
+    // Check for flags that indicate 'uninteresting' bam records.
+    if (hasFlagDuplicate(record) or hasFlagSecondary(record) or
+            hasFlagQCNoPass(record) or hasFlagSupplementary(record)) return CROP_SKIP;
+
+    if (countCoverage && !hasFlagUnmapped(record))
+        alignedBaseCount += readLength(record);
+
+    // Check the read's unmapped flag.
+    if (hasFlagUnmapped(record))
+        return CROP_UNMAPPED;
+
+    // Check for low mapping quality.
+    if (hasLowMappingQuality(record, humanSeqs))
+        return CROP_LOW_MAPQ;
+
+    // Check the mate's unmapped flag.
+    if (hasFlagNextUnmapped(record))
+        return CROP_MATE;
+
+    return CROP_SKIP;
+}
+
+// --------------------------------------------------------------------------
+// Function trimRecord()
+// --------------------------------------------------------------------------
 
+// Quality and adapter trimming of a record to go into the fastq files. Returns CROP_DISCARDED if it is too short.
 template<typename TAdapterTag>
-int
-crop_unmapped(double & avgCov,
-        Triple<CharString> & fastqFiles,
-        CharString & matesBam,
-        CharString const & mappingBam,
-        int humanSeqs,
-        TAdapterTag tag)
+inline CropAction
+trimRecord(BamAlignmentRecord & record,
+        CropAction action,
+        AdapterMatcher<TAdapterTag> const & adapters)
 {
-    typedef __int32 TPos;
-    typedef std::map<CharString, Pair<CharString> > TFastqMap; // Reads to go into fastq files.
-    typedef std::map<Pair<TPos>, Pair<CharString, bool> > TOtherMap; // Reads to crop in a second pass of the input file.
-    typedef StringSet<Dna5String> TStringSet;
+    if (action != CROP_UNMAPPED && action != CROP_LOW_MAPQ)
+        return action;
 
-    // Open the input and output bam files.
-    BamFileIn inStream(toCString(mappingBam));
-    BamFileOut matesStream(context(inStream), toCString(matesBam));
+    if (removeLowQuality(record, 20) != 1 && removeAdapter(record, adapters, 30) != 2)
+        return action;
 
-    // Copy the header.
-    BamHeader header;
-    readHeader(header, inStream);
-    writeHeader(matesStream, header);
+    return CROP_DISCARDED;
+}
 
-    unsigned long genomeLength = 0;
-    for (unsigned i = 0; i < length(header); ++i)
-    {
-        if (header[i].type != BamHeaderRecordType::BAM_HEADER_REFERENCE)
-            continue;
+// --------------------------------------------------------------------------
+// Function applyCropAction()
+// --------------------------------------------------------------------------
 
-        for (unsigned j = 0; j < length(header[i].tags); ++j)
-        {
-            if (header[i].tags[j].i1 != "LN")
-                continue;
+// Adds a classified record to the stores of fastq records or to the mates bam file. Must be called in input order.
+// Returns true if the record waits for its mapped mate to be found.
+template<typename TOtherMap>
+inline bool
+applyCropAction(BamNameSorter & matesStream,
+        FastqStore & firstReads,
+        FastqStore & secondReads,
+        TOtherMap & otherReads,
+        BamAlignmentRecord const & record,
+        CropAction action)
+{
+    typedef typename TOtherMap::key_type TKey;
 
-            genomeLength += lexicalCast<unsigned>(header[i].tags[j].i2);
+    switch (action)
+    {
+        case CROP_UNMAPPED:
+            appendFastqRecord(firstReads, secondReads, record);
+            break;
+        case CROP_LOW_MAPQ:
+            if (appendFastqRecord(firstReads, secondReads, record) == 0)
+            {
+                otherReads[TKey(record.rNextId, record.pNext)] = Pair<CharString, bool>(record.qName, hasFlagFirst(record));
+                return true;
+            }
+            break;
+        case CROP_MATE:
+            writeRecord(matesStream, record);
+            break;
+        default:
             break;
-        }
     }
+    return false;
+}
 
-    // Create maps for fastq records (first read in pair and second read in pair) and bam records without mate.
-    TFastqMap firstReads, secondReads;
-    TOtherMap otherReads;
+// --------------------------------------------------------------------------
+// Function shardPosition()
+// --------------------------------------------------------------------------
 
-    // Open the output fastq files.    
-    SeqFileOut fastqFirstStream(toCString(fastqFiles.i1));
-    SeqFileOut fastqSecondStream(toCString(fastqFiles.i2));
-    SeqFileOut fastqSingleStream(toCString(fastqFiles.i3));
+// Returns the sort position of a record with unplaced reads (rID -1) sorting last.
+template<typename TRecord>
+inline Pair<__int32>
+shardPosition(TRecord const & record)
+{
+    if (record.rID == BamAlignmentRecord::INVALID_REFID)
+        return Pair<__int32>(maxValue<__int32>(), record.beginPos);
+    return Pair<__int32>(record.rID, record.beginPos);
+}
 
-    // Retrieve the adapter sequences with up to one error and create indices.
-    TStringSet universal = reverseUniversalOneError(tag);
-    TStringSet truSeqs = reverseTruSeqsOneError(tag);
-    Index<TStringSet> indexUniversal(universal);
-    Index<TStringSet> indexTruSeqs(truSeqs);
+// --------------------------------------------------------------------------
+// Struct SinglePassMates
+// --------------------------------------------------------------------------
 
-    // Iterate over the input file.
-    BamAlignmentRecord record;
-    unsigned long alignedBaseCount = 0;
-    while (!atEnd(inStream))
-    {
-        // Read the next read from input file.
-        readRecord(record, inStream);
+// Finds the mapped mates of low quality reads while streaming through the coordinate-sorted input once.
+// Mapped reads whose mate lies further down the input are kept as pending, keyed by the mate's position, until
+// the stream passes that position. Pending reads spill to sorted bam files on disk if there are too many of them.
+// Mates of low quality reads that lie further down are remembered as wanted and picked up when the stream gets there.
+struct SinglePassMates
+{
+    typedef std::multimap<Pair<__int32>, BamAlignmentRecord> TPending;
+    typedef std::multimap<Pair<__int32>, CharString> TWanted;
 
-        // Check for flags that indicate 'uninteresting' bam records.
-        if (hasFlagDuplicate(record) or hasFlagSecondary(record) or
-                hasFlagQCNoPass(record) or hasFlagSupplementary(record)) continue;
+    static const unsigned MAX_PENDING = 1000000;
 
-        if (!hasFlagUnmapped(record))
-            alignedBaseCount += length(record.seq);
+    TPending pending;
+    TWanted wanted;
+    int humanSeqs;
 
-        // Check the read's unmapped flag.
-        if (hasFlagUnmapped(record))
-        {
-            if (removeLowQuality(record, 20) != 1 && removeAdapter(record, indexUniversal, indexTruSeqs, 30, tag) != 2)
-                appendFastqRecord(fastqFirstStream, fastqSecondStream, firstReads, secondReads, record);
-        }
+    // Spilled pending reads, one sorted run per file, with the next record of each run.
+    CharString filePrefix;
+    String<CharString> runFiles;
+    std::vector<BamFileIn *> runs;
+    String<BamAlignmentRecord> runHeads;
 
-        // Check for low mapping quality.
-        else if (hasLowMappingQuality(record, humanSeqs))
-        {
-            if (removeLowQuality(record, 20) != 1 && removeAdapter(record, indexUniversal, indexTruSeqs, 30, tag) != 2)
-            {
-                if (appendFastqRecord(fastqFirstStream, fastqSecondStream, firstReads, secondReads, record) == 0)
-                    otherReads[Pair<TPos>(record.rNextId, record.pNext)] = Pair<CharString, bool>(record.qName, hasFlagFirst(record));
-            }
-        }
+    // Found mates, written to the mates bam file at the end when all low quality reads are known.
+    CharString foundFile;
+    ParallelBamFileOut * foundStream;
+    unsigned numFound;
+
+    // Threads for compressing the temporary bam files.
+    unsigned threads;
+
+    SinglePassMates(CharString const & prefix, int seqs, unsigned t) :
+        humanSeqs(seqs), filePrefix(prefix), foundStream(0), numFound(0), threads(t)
+    {
+        foundFile = prefix;
+        foundFile += ".found.bam";
+    }
 
-        // Check the mate's unmapped flag.
-        else if (hasFlagNextUnmapped(record))
+    ~SinglePassMates()
+    {
+        delete foundStream;
+        for (unsigned i = 0; i < runs.size(); ++i)
         {
-            writeRecord(matesStream, record);
+            delete runs[i];
+            remove(toCString(runFiles[i]));
         }
+        remove(toCString(foundFile));
     }
-    close(inStream);
+};
 
-    avgCov = (double)alignedBaseCount / (double)genomeLength;
+// --------------------------------------------------------------------------
+// Function mayBeWanted()
+// --------------------------------------------------------------------------
 
-    std::ostringstream msg;
-    msg << "Map of low quality mates has " << otherReads.size() << " records.";
-    printStatus(msg);
+// Returns true if the record's mate could be a low quality read that goes into the fastq files.
+inline bool
+mayBeWanted(BamAlignmentRecord const & record, int humanSeqs)
+{
+    if (hasFlagUnmapped(record) || hasFlagNextUnmapped(record) || record.rNextId == BamAlignmentRecord::INVALID_REFID)
+        return false;
 
-    // Write the remaining fastq records.
-    if (writeFastq(fastqFirstStream, fastqSecondStream, fastqSingleStream, firstReads, secondReads) != 0) return 1;
-    firstReads.clear();
-    secondReads.clear();
+    // The mate is considered well mapped if this read is within 1000 bp in opposite orientation.
+    if (record.rID == record.rNextId && abs(record.beginPos - record.pNext) < 1000 && hasFlagRC(record) != hasFlagNextRC(record))
+        return false;
 
-    msg.str("");
-    msg << "Unmapped reads written to " << fastqFiles.i1 << ", " << fastqFiles.i2 << ", " << fastqFiles.i3;
-    printStatus(msg);
+    if (record.rNextId > humanSeqs)
+        return false;
 
-    // Find the other read end of the low quality mapping reads and write them to the output bam file. 
-    int found = findOtherReads(matesStream, otherReads, mappingBam);
-    if (found == -1) return 1;
+    return Pair<__int32>(record.rNextId, record.pNext) >= shardPosition(record);
+}
+
+// --------------------------------------------------------------------------
+// Function spillPendingMates()
+// --------------------------------------------------------------------------
+
+inline void
+spillPendingMates(SinglePassMates & mates, BamFileIn & inStream, BamHeader const & header)
+{
+    std::stringstream runFile;
+    runFile << mates.filePrefix << ".pending." << mates.runs.size() << ".bam";
+    appendValue(mates.runFiles, runFile.str());
+
+    {
+        ParallelBamFileOut runStream;
+        open(runStream, back(mates.runFiles), context(inStream), mates.threads, BGZF_INTERMEDIATE_LEVEL);
+        writeHeader(runStream, header);
+        for (SinglePassMates::TPending::const_iterator it = mates.pending.begin(); it != mates.pending.end(); ++it)
+            writeRecord(runStream, it->second);
+    }
+    mates.pending.clear();
+
+    BamFileIn * run = new BamFileIn(toCString(back(mates.runFiles)));
+    BamHeader runHeader;
+    readHeader(runHeader, *run);
+    mates.runs.push_back(run);
+    resize(mates.runHeads, mates.runs.size());
+    readRecord(back(mates.runHeads), *run);
+}
+
+// --------------------------------------------------------------------------
+// Function passRecord()
+// --------------------------------------------------------------------------
+
+// Advances the stream position to the record, which must be passed here before it is trimmed.
+inline void
+passRecord(SinglePassMates & mates, BamAlignmentRecord const & record, BamFileIn & inStream, BamHeader const & header)
+{
+    typedef SinglePassMates::TWanted::iterator TWantedIter;
+
+    Pair<__int32> pos = shardPosition(record);
+
+    // Load spilled pending reads whose mate is at the current position.
+    for (unsigned i = 0; i < mates.runs.size(); ++i)
+    {
+        BamFileIn * run = mates.runs[i];
+        while (run != 0 && Pair<__int32>(mates.runHeads[i].rNextId, mates.runHeads[i].pNext) <= pos)
+        {
+            mates.pending.insert(std::make_pair(Pair<__int32>(mates.runHeads[i].rNextId, mates.runHeads[i].pNext), mates.runHeads[i]));
+            if (atEnd(*run))
+            {
+                delete run;
+                run = mates.runs[i] = 0;
+            }
+            else
+            {
+                readRecord(mates.runHeads[i], *run);
+            }
+        }
+    }
+
+    // Drop pending reads whose mate has been passed.
+    mates.pending.erase(mates.pending.begin(), mates.pending.lower_bound(pos));
+
+    // Pick up the record if it is a wanted mate.
+    std::pair<TWantedIter, TWantedIter> range = mates.wanted.equal_range(pos);
+    for (TWantedIter it = range.first; it != range.second; ++it)
+    {
+        if (it->second != record.qName)
+            continue;
+
+        writeRecord(*mates.foundStream, record);
+        ++mates.numFound;
+        mates.wanted.erase(it);
+        return;
+    }
+
+    // Keep the record if its mate further down the stream may turn out to be a low quality read.
+    if (mayBeWanted(record, mates.humanSeqs))
+    {
+        mates.pending.insert(std::make_pair(Pair<__int32>(record.rNextId, record.pNext), record));
+        if (mates.pending.size() > SinglePassMates::MAX_PENDING)
+            spillPendingMates(mates, inStream, header);
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function waitForMate()
+// --------------------------------------------------------------------------
+
+// Looks up the mapped mate of a low quality read among the pending reads or remembers it as wanted.
+inline void
+waitForMate(SinglePassMates & mates, BamAlignmentRecord const & record)
+{
+    typedef SinglePassMates::TPending::iterator TPendingIter;
+
+    Pair<__int32> pos = shardPosition(record);
+    Pair<__int32> matePos(record.rNextId, record.pNext);
+
+    if (matePos <= pos)
+    {
+        std::pair<TPendingIter, TPendingIter> range = mates.pending.equal_range(pos);
+        for (TPendingIter it = range.first; it != range.second; ++it)
+        {
+            if (it->second.qName != record.qName || shardPosition(it->second) != matePos)
+                continue;
+
+            writeRecord(*mates.foundStream, it->second);
+            ++mates.numFound;
+            mates.pending.erase(it);
+            return;
+        }
+        if (matePos < pos)
+            return;
+    }
+
+    mates.wanted.insert(std::make_pair(matePos, record.qName));
+}
+
+// --------------------------------------------------------------------------
+// Function writeFoundMates()
+// --------------------------------------------------------------------------
+
+// Writes the found mates to the mates bam file unless both ends are low quality and, hence, in the fastq files.
+template<typename TOtherMap>
+int
+writeFoundMates(BamNameSorter & matesStream, SinglePassMates & mates, TOtherMap const & otherReads)
+{
+    typedef typename TOtherMap::key_type TKey;
+
+    bool closed = close(*mates.foundStream);
+    delete mates.foundStream;
+    mates.foundStream = 0;
+    if (!closed)
+        return -1;
+
+    BamFileIn foundStream(toCString(mates.foundFile));
+    BamHeader header;
+    readHeader(header, foundStream);
+
+    BamAlignmentRecord record;
+    while (!atEnd(foundStream))
+    {
+        readRecord(record, foundStream);
+        if (otherReads.count(TKey(record.rNextId, record.pNext)) == 0)
+        {
+            setMateUnmapped(record);
+            writeRecord(matesStream, record);
+        }
+    }
+
+    return mates.numFound;
+}
+
+// --------------------------------------------------------------------------
+// Struct CropBatch
+// --------------------------------------------------------------------------
+
+// A block of consecutive input records handed through the stages of the cropping pipeline. The reader fills in the
+// raw views, the workers decode the records that are not skipped. The records are reused when the batch returns to
+// the pool of free batches.
+struct CropBatch
+{
+    static const unsigned CAPACITY = 4096;
+
+    unsigned long id;
+    unsigned numRecords;
+    unsigned long alignedBaseCount;
+    String<BamRecordView> views;
+    String<BamAlignmentRecord> records;
+    String<CropAction> actions;
+    String<BamAlignmentRecord> untrimmed;  // Copies of trimmed records, only kept for single-pass cropping.
+
+    CropBatch(bool keepUntrimmed) :
+        id(0), numRecords(0), alignedBaseCount(0)
+    {
+        resize(views, CAPACITY);
+        resize(records, CAPACITY);
+        resize(actions, CAPACITY);
+        if (keepUntrimmed)
+            resize(untrimmed, CAPACITY);
+    }
+};
+
+typedef BoundedQueue<CropBatch *> TCropQueue;
+
+// --------------------------------------------------------------------------
+// Function readCropBatches()
+// --------------------------------------------------------------------------
+
+// Pipeline stage 1: fill free batches with records from the input file.
+inline void
+readCropBatches(TCropQueue & readBatches,
+        TCropQueue & freeBatches,
+        BamFileIn & inStream,
+        std::atomic<bool> & failed)
+{
+    unsigned long id = 0;
+    CropBatch * batch;
+
+    try
+    {
+        while (!atEnd(inStream) && dequeue(batch, freeBatches))
+        {
+            batch->id = id++;
+            batch->numRecords = 0;
+            while (batch->numRecords < CropBatch::CAPACITY && !atEnd(inStream))
+            {
+                readRecord(batch->views[batch->numRecords], inStream);
+                ++batch->numRecords;
+            }
+            if (!enqueue(readBatches, batch))
+            {
+                delete batch;
+                break;
+            }
+        }
+    }
+    catch (std::exception const & e)
+    {
+        std::cerr << "ERROR: Could not read record from input BAM file. " << e.what() << std::endl;
+        failed = true;
+    }
+
+    closeQueue(readBatches);
+}
+
+// --------------------------------------------------------------------------
+// Function classifyCropBatches()
+// --------------------------------------------------------------------------
+
+// Pipeline stage 2: filter, decode, quality trim and adapter trim the records of a batch. Skipped records are only
+// decoded for single-pass cropping, which passes all records on. On error, the queues of free and read batches are
+// closed so that the reader stops and the remaining workers drain the read batches without classifying them.
+template<typename TAdapterTag>
+void
+classifyCropBatches(TCropQueue & classifiedBatches,
+        TCropQueue & readBatches,
+        TCropQueue & freeBatches,
+        std::atomic<unsigned> & activeWorkers,
+        std::atomic<bool> & failed,
+        bool countCoverage,
+        int humanSeqs,
+        AdapterMatcher<TAdapterTag> const & adapters)
+{
+    CropBatch * batch;
+    while (dequeue(batch, readBatches))
+    {
+        if (failed)
+        {
+            delete batch;
+            continue;
+        }
+
+        try
+        {
+            batch->alignedBaseCount = 0;
+            for (unsigned i = 0; i < batch->numRecords; ++i)
+            {
+                CropAction action = classifyRecord(batch->alignedBaseCount, countCoverage, batch->views[i], humanSeqs);
+                if (action != CROP_SKIP || !empty(batch->untrimmed))
+                    assignRecord(batch->records[i], batch->views[i]);
+                if ((action == CROP_UNMAPPED || action == CROP_LOW_MAPQ) && !empty(batch->untrimmed))
+                    batch->untrimmed[i] = batch->records[i];
+                batch->actions[i] = trimRecord(batch->records[i], action, adapters);
+            }
+        }
+        catch (std::exception const & e)
+        {
+            std::cerr << "ERROR: Could not process record from input BAM file. " << e.what() << std::endl;
+            failed = true;
+            delete batch;
+            closeQueue(freeBatches);
+            closeQueue(readBatches);
+            continue;
+        }
+
+        if (!enqueue(classifiedBatches, batch))
+            delete batch;
+    }
+
+    // The last worker to finish signals the end of input to the writer.
+    if (--activeWorkers == 0)
+        closeQueue(classifiedBatches);
+}
+
+// --------------------------------------------------------------------------
+// Function cropRecordsPipelined()
+// --------------------------------------------------------------------------
+
+// Runs the first pass of crop_unmapped() with one reader thread, several worker threads, and the
+// calling thread as writer. The writer applies the batches in input order, so that the fastq files,
+// the mates bam file, and the map of low quality mates are identical to the single-threaded pass.
+template<typename TOtherMap, typename TAdapterTag>
+int
+cropRecordsPipelined(unsigned long & alignedBaseCount,
+        bool countCoverage,
+        BamNameSorter & matesStream,
+        FastqStore & firstReads,
+        FastqStore & secondReads,
+        TOtherMap & otherReads,
+        SinglePassMates * singlePass,
+        BamFileIn & inStream,
+        BamHeader const & header,
+        int humanSeqs,
+        unsigned threads,
+        AdapterMatcher<TAdapterTag> const & adapters)
+{
+    // One thread each for reading and writing, the rest for classifying.
+    unsigned numWorkers = std::max(1u, threads - std::min(threads, 2u));
+    unsigned numBatches = 4 * numWorkers + 4;
+
+    TCropQueue freeBatches(numBatches);
+    TCropQueue readBatches(numBatches);
+    TCropQueue classifiedBatches(numBatches);
+
+    for (unsigned i = 0; i < numBatches; ++i)
+        enqueue(freeBatches, new CropBatch(singlePass != 0));
+
+    std::atomic<bool> failed(false);
+    std::atomic<unsigned> activeWorkers(numWorkers);
+    std::map<unsigned long, CropBatch *> overtaken;
+    std::thread reader;
+    std::vector<std::thread> workers;
+
+    // Stop the pipeline also if the writer leaves by an exception. Closing the queues wakes up blocked threads, which
+    // then delete the batches they cannot pass on.
+    ScopeGuard stopPipeline([&]()
+    {
+        closeQueue(freeBatches);
+        closeQueue(readBatches);
+        closeQueue(classifiedBatches);
+        if (reader.joinable())
+            reader.join();
+        for (unsigned i = 0; i < workers.size(); ++i)
+            if (workers[i].joinable())
+                workers[i].join();
+
+        CropBatch * batch;
+        while (dequeue(batch, freeBatches))
+            delete batch;
+        while (dequeue(batch, readBatches))
+            delete batch;
+        while (dequeue(batch, classifiedBatches))
+            delete batch;
+        for (std::map<unsigned long, CropBatch *>::iterator it = overtaken.begin(); it != overtaken.end(); ++it)
+            delete it->second;
+    });
+
+    // Start the reader and the workers.
+    reader = std::thread(readCropBatches, std::ref(readBatches), std::ref(freeBatches), std::ref(inStream), std::ref(failed));
+    for (unsigned i = 0; i < numWorkers; ++i)
+        workers.push_back(std::thread(classifyCropBatches<TAdapterTag>, std::ref(classifiedBatches), std::ref(readBatches), std::ref(freeBatches),
+                std::ref(activeWorkers), std::ref(failed), countCoverage, humanSeqs, std::cref(adapters)));
+
+    // Write the batches in input order, holding back batches that overtook their predecessors.
+    unsigned long nextId = 0;
+    CropBatch * batch;
+    while (dequeue(batch, classifiedBatches))
+    {
+        overtaken[batch->id] = batch;
+        while (!overtaken.empty() && overtaken.begin()->first == nextId)
+        {
+            batch = overtaken.begin()->second;
+
+            alignedBaseCount += batch->alignedBaseCount;
+            for (unsigned i = 0; i < batch->numRecords; ++i)
+            {
+                BamAlignmentRecord & record = batch->records[i];
+                CropAction action = batch->actions[i];
+
+                if (singlePass != 0)
+                    passRecord(*singlePass, (action == CROP_SKIP || action == CROP_MATE) ? record : batch->untrimmed[i], inStream, header);
+
+                if (applyCropAction(matesStream, firstReads, secondReads, otherReads, record, action)
+                        && singlePass != 0)
+                    waitForMate(*singlePass, record);
+            }
+
+            overtaken.erase(overtaken.begin());
+            ++nextId;
+            if (!enqueue(freeBatches, batch))
+                delete batch;
+        }
+    }
+
+    reader.join();
+    for (unsigned i = 0; i < numWorkers; ++i)
+        workers[i].join();
+
+    return failed;
+}
+
+// --------------------------------------------------------------------------
+// Struct CropShard
+// --------------------------------------------------------------------------
+
+// A part of one of the coordinate-sorted input bam files and the state collected while cropping it. Genomic shards
+// cover the records in [begin, end) by (rID, beginPos), the last shard covers the tail of unplaced reads.
+template<typename TOtherMap>
+struct CropShard
+{
+    unsigned file;
+    Pair<__int32> begin;
+    Pair<__int32> end;
+
+    unsigned long alignedBaseCount;
+    FastqStore * firstReads;
+    FastqStore * secondReads;
+    TOtherMap otherReads;
+
+    CropShard() :
+        file(0), alignedBaseCount(0), firstReads(0), secondReads(0)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Function defineCropShards()
+// --------------------------------------------------------------------------
+
+// Splits the reference sequences into numShards regions of equal length and adds a region for the unplaced reads.
+// Each region is a shard of each of the numFiles input files. The shards are ordered by region, then by file, i.e.
+// in the order of their records in the merged input files.
+template<typename TShard>
+void
+defineCropShards(String<TShard> & shards, String<unsigned long> const & refLengths, unsigned numShards, unsigned numFiles)
+{
+    unsigned long genomeLength = 0;
+    for (unsigned rID = 0; rID < length(refLengths); ++rID)
+        genomeLength += refLengths[rID];
+    unsigned long shardLength = genomeLength / numShards + 1;
+
+    // Compute the shard boundaries.
+    String<Pair<__int32> > bounds;
+    appendValue(bounds, Pair<__int32>(0, 0));
+    unsigned long offset = 0;
+    unsigned long next = shardLength;
+    for (unsigned rID = 0; rID < length(refLengths); ++rID)
+    {
+        for (; next < offset + refLengths[rID]; next += shardLength)
+            appendValue(bounds, Pair<__int32>(rID, next - offset));
+        offset += refLengths[rID];
+    }
+    appendValue(bounds, Pair<__int32>(length(refLengths), 0));
+
+    // The regions between the boundaries and the region of unplaced reads.
+    String<Pair<Pair<__int32> > > regions;
+    for (unsigned i = 0; i < length(bounds) - 1; ++i)
+        appendValue(regions, Pair<Pair<__int32> >(bounds[i], bounds[i + 1]));
+    appendValue(regions, Pair<Pair<__int32> >(Pair<__int32>(maxValue<__int32>(), minValue<__int32>()),
+                                              Pair<__int32>(maxValue<__int32>(), maxValue<__int32>())));
+
+    clear(shards);
+    resize(shards, length(regions) * numFiles);
+    for (unsigned i = 0; i < length(shards); ++i)
+    {
+        shards[i].file = i % numFiles;
+        shards[i].begin = regions[i / numFiles].i1;
+        shards[i].end = regions[i / numFiles].i2;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function jumpToShard()
+// --------------------------------------------------------------------------
+
+// Positions the input file before the first record of the shard. Returns false if the shard is empty.
+template<typename TShard>
+bool
+jumpToShard(BamFileIn & inStream, BamIndex<Bai> const & bamIndex, TShard const & shard,
+        CharString const & mappingBam, String<unsigned long> const & refLengths)
+{
+    bool hasAligns = false;
+
+    if (shard.begin.i1 == maxValue<__int32>())
+    {
+        // Unplaced reads follow the last reference sequence with alignments.
+        for (int rID = length(refLengths) - 1; rID >= 0 && !hasAligns; --rID)
+            jumpToRegion(inStream, hasAligns, rID, 0, refLengths[rID], bamIndex);
+
+        // Without any alignments the unplaced reads start right after the header.
+        if (!hasAligns)
+        {
+            close(inStream);
+            open(inStream, toCString(mappingBam));
+            BamHeader header;
+            readHeader(header, inStream);
+        }
+        return true;
+    }
+
+    for (__int32 rID = shard.begin.i1; rID < shard.end.i1 || (rID == shard.end.i1 && shard.end.i2 > 0); ++rID)
+    {
+        __int32 pos = (rID == shard.begin.i1) ? shard.begin.i2 : 0;
+        jumpToRegion(inStream, hasAligns, rID, pos, refLengths[rID], bamIndex);
+        if (hasAligns)
+            return true;
+    }
+    return false;
+}
+
+// --------------------------------------------------------------------------
+// Struct CropShardInput
+// --------------------------------------------------------------------------
+
+// An input bam file opened by a worker thread of sharded cropping.
+struct CropShardInput
+{
+    BamFileIn stream;
+    BamIndex<Bai> index;
+};
+
+// --------------------------------------------------------------------------
+// Function openShardInput()
+// --------------------------------------------------------------------------
+
+// Returns false if the bam file or its index cannot be opened.
+inline bool
+openShardInput(CropShardInput & input, CharString const & mappingBam)
+{
+    if (!open(input.stream, toCString(mappingBam)))
+    {
+        std::cerr << "ERROR: Could not open input BAM file " << mappingBam << std::endl;
+        return false;
+    }
+    BamHeader header;
+    readHeader(header, input.stream);
+
+    CharString baiFile = mappingBam;
+    baiFile += ".bai";
+    if (!open(input.index, toCString(baiFile)))
+    {
+        std::cerr << "ERROR: Could not read BAI index file " << baiFile << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function cropShards()
+// --------------------------------------------------------------------------
+
+// Worker thread for sharded cropping. Takes shards in turn, each with its own maps of reads waiting for their
+// mate. Mates of unmapped reads are written to the shared mates bam file under a lock. The input files are opened
+// when the worker takes the first shard of them.
+template<typename TShard, typename TAdapterTag>
+void
+cropShards(String<TShard> & shards,
+        std::atomic<unsigned> & nextShard,
+        BamNameSorter & matesStream,
+        std::mutex & outputMutex,
+        String<CharString> const & mappingBams,
+        String<unsigned long> const & refLengths,
+        bool countCoverage,
+        int humanSeqs,
+        std::atomic<bool> & failed,
+        AdapterMatcher<TAdapterTag> const & adapters)
+{
+    try
+    {
+        std::vector<std::unique_ptr<CropShardInput> > inputs(length(mappingBams));
+
+        BamRecordView view;
+        BamAlignmentRecord record;
+        for (unsigned s = nextShard++; s < length(shards); s = nextShard++)
+        {
+            TShard & shard = shards[s];
+            CharString const & mappingBam = mappingBams[shard.file];
+            if (!inputs[shard.file])
+            {
+                inputs[shard.file].reset(new CropShardInput);
+                if (!openShardInput(*inputs[shard.file], mappingBam))
+                {
+                    failed = true;
+                    return;
+                }
+            }
+            BamFileIn & inStream = inputs[shard.file]->stream;
+            if (!jumpToShard(inStream, inputs[shard.file]->index, shard, mappingBam, refLengths))
+                continue;
+
+            while (!atEnd(inStream))
+            {
+                readRecord(view, inStream);
+
+                // Skip records of the previous shard that overlap the start of this shard.
+                Pair<__int32> pos = shardPosition(view);
+                if (pos < shard.begin) continue;
+                if (!(pos < shard.end)) break;
+
+                CropAction action = classifyRecord(shard.alignedBaseCount, countCoverage, view, humanSeqs);
+                if (action == CROP_SKIP) continue;
+
+                assignRecord(record, view);
+                action = trimRecord(record, action, adapters);
+                if (action == CROP_SKIP || action == CROP_DISCARDED) continue;
+
+                // Only the mates bam file is shared, the shard's stores may spill to disk without holding the lock.
+                if (action == CROP_MATE)
+                {
+                    std::lock_guard<std::mutex> lock(outputMutex);
+                    writeRecord(matesStream, record);
+                }
+                else
+                {
+                    applyCropAction(matesStream,
+                            *shard.firstReads, *shard.secondReads, shard.otherReads, record, action);
+                }
+            }
+        }
+    }
+    catch (std::exception const & e)
+    {
+        std::cerr << "ERROR: Could not read record from input BAM file. " << e.what() << std::endl;
+        failed = true;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function removeWaiting()
+// --------------------------------------------------------------------------
+
+template<typename TOtherMap, typename TWaitingMap>
+inline void
+removeWaiting(TOtherMap & otherReads, TWaitingMap const & waiting, CharString const & qName)
+{
+    typename TWaitingMap::const_iterator w = waiting.find(qName);
+    if (w == waiting.end())
+        return;
+
+    // The position may have been claimed by another read later in the shard.
+    typename TOtherMap::iterator it = otherReads.find(w->second);
+    if (it != otherReads.end() && it->second.i1 == qName)
+        otherReads.erase(it);
+}
+
+// --------------------------------------------------------------------------
+// Function insertShardRead()
+// --------------------------------------------------------------------------
+
+// Moves the current read of a shard's store into the store of all reads. A read that completes a pair with a read of
+// an earlier shard is stored as it is in the bam file, as in a single pass over the whole file.
+inline void
+insertShardRead(FastqStore & reads, FastqStoreCursor const & it, bool completesPair)
+{
+    if (!completesPair || (it.flags & FastqStore::REVERSED) == 0)
+    {
+        insertRead(reads, it.name, it.nameLength, it.seq, it.seqLength, it.qual, it.qualLength, it.flags);
+        return;
+    }
+
+    CharString seq, qual;
+    assignBytes(seq, it.seq, it.seqLength);
+    assignBytes(qual, it.qual, it.qualLength);
+    reverseComplement(seq);
+    reverse(qual);
+    insertRead(reads, it.name, it.nameLength, begin(seq, Standard()), length(seq), begin(qual, Standard()), length(qual), 0);
+}
+
+// --------------------------------------------------------------------------
+// Function mergeShardReads()
+// --------------------------------------------------------------------------
+
+// Moves the reads of a shard into the stores of all reads. A read without its mate in the shard completes the pair
+// if the mate is in an earlier shard, also if it was spilled to disk.
+template<typename TOtherMap, typename TWaitingMap>
+inline void
+mergeShardReads(FastqStore & firstReads,
+        FastqStore & secondReads,
+        FastqStore const & shardFirstReads,
+        FastqStore const & shardSecondReads,
+        TOtherMap & otherReads,
+        TWaitingMap const & waiting)
+{
+    FastqStoreCursor firstIt, secondIt;
+    if (!openCursor(firstIt, shardFirstReads) || !openCursor(secondIt, shardSecondReads))
+    {
+        firstReads.failed = true;
+        return;
+    }
+
+    CharString name;
+    while (!firstIt.atEnd || !secondIt.atEnd)
+    {
+        bool takeFirst = !firstIt.atEnd &&
+            (secondIt.atEnd || !lessFastqName(secondIt.name, secondIt.nameLength, firstIt.name, firstIt.nameLength));
+        bool takeSecond = !secondIt.atEnd &&
+            (firstIt.atEnd || !lessFastqName(firstIt.name, firstIt.nameLength, secondIt.name, secondIt.nameLength));
+
+        bool completesPair = false;
+        if (takeFirst != takeSecond)
+        {
+            FastqStoreCursor & it = takeFirst ? firstIt : secondIt;
+            if (containsRead(takeFirst ? secondReads : firstReads, it.name, it.nameLength))
+            {
+                completesPair = true;
+                assignBytes(name, it.name, it.nameLength);
+                removeWaiting(otherReads, waiting, name);
+            }
+        }
+
+        if (takeFirst)
+        {
+            insertShardRead(firstReads, firstIt, completesPair);
+            goNext(firstIt);
+        }
+        if (takeSecond)
+        {
+            insertShardRead(secondReads, secondIt, completesPair);
+            goNext(secondIt);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function mergeCropShards()
+// --------------------------------------------------------------------------
+
+// Reconciles the per-shard state in shard order. A read whose mate is waiting in an earlier shard completes the
+// pair and does not wait for its mapped mate, just as in a single pass over the whole file.
+template<typename TOtherMap, typename TShard>
+void
+mergeCropShards(unsigned long & alignedBaseCount,
+        FastqStore & firstReads,
+        FastqStore & secondReads,
+        TOtherMap & otherReads,
+        String<TShard> & shards)
+{
+    typedef typename TOtherMap::key_type TKey;
+
+    for (unsigned s = 0; s < length(shards); ++s)
+    {
+        TShard & shard = shards[s];
+        alignedBaseCount += shard.alignedBaseCount;
+
+        // Index the shard's reads waiting for their mapped mate by read name.
+        std::map<CharString, TKey> waiting;
+        for (typename TOtherMap::const_iterator it = shard.otherReads.begin(); it != shard.otherReads.end(); ++it)
+            waiting[it->second.i1] = it->first;
+
+        mergeShardReads(firstReads, secondReads, *shard.firstReads, *shard.secondReads, shard.otherReads, waiting);
+
+        for (typename TOtherMap::const_iterator it = shard.otherReads.begin(); it != shard.otherReads.end(); ++it)
+            otherReads[it->first] = it->second;
+
+        delete shard.firstReads;
+        delete shard.secondReads;
+        shard.firstReads = 0;
+        shard.secondReads = 0;
+        shard.otherReads.clear();
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function cropRecordsSharded()
+// --------------------------------------------------------------------------
+
+// Runs the first pass of crop_unmapped() on genomic shards of the input files in parallel using the BAM indices.
+template<typename TOtherMap, typename TAdapterTag>
+int
+cropRecordsSharded(unsigned long & alignedBaseCount,
+        bool countCoverage,
+        BamNameSorter & matesStream,
+        FastqStore & firstReads,
+        FastqStore & secondReads,
+        TOtherMap & otherReads,
+        String<CharString> const & mappingBams,
+        String<unsigned long> const & refLengths,
+        int humanSeqs,
+        unsigned threads,
+        unsigned numShards,
+        AdapterMatcher<TAdapterTag> const & adapters)
+{
+    typedef CropShard<TOtherMap> TShard;
+
+    String<TShard> shards;
+    defineCropShards(shards, refLengths, numShards, length(mappingBams));
+
+    // The shards' stores of reads waiting for their mate share the memory budget.
+    size_t shardBytes = std::max(firstReads.maxBytes / length(shards), (size_t)1 << 22);
+    for (unsigned s = 0; s < length(shards); ++s)
+    {
+        std::ostringstream shardPrefix;
+        shardPrefix << ".shard" << s;
+        shards[s].firstReads = new FastqStore(firstReads.spillPrefix + shardPrefix.str(), shardBytes);
+        shards[s].secondReads = new FastqStore(secondReads.spillPrefix + shardPrefix.str(), shardBytes);
+    }
+
+    std::ostringstream msg;
+    msg << "Cropping " << length(shards) << " shards of " << mappingBams[0];
+    if (length(mappingBams) > 1)
+        msg << " and " << (length(mappingBams) - 1) << " more BAM files";
+    msg << " using " << threads << " threads.";
+    printStatus(msg);
+
+    std::atomic<unsigned> nextShard(0);
+    std::mutex outputMutex;
+    std::atomic<bool> failed(false);
+
+    std::vector<std::thread> workers;
+    ScopeGuard joinWorkers([&]()
+    {
+        for (unsigned i = 0; i < workers.size(); ++i)
+            if (workers[i].joinable())
+                workers[i].join();
+    });
+    for (unsigned i = 0; i < std::min(threads, (unsigned)length(shards)); ++i)
+        workers.push_back(std::thread(cropShards<TShard, TAdapterTag>, std::ref(shards), std::ref(nextShard),
+                std::ref(matesStream), std::ref(outputMutex),
+                std::cref(mappingBams), std::cref(refLengths), countCoverage, humanSeqs, std::ref(failed), std::cref(adapters)));
+    for (unsigned i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    if (failed)
+    {
+        for (unsigned s = 0; s < length(shards); ++s)
+        {
+            delete shards[s].firstReads;
+            delete shards[s].secondReads;
+        }
+        return 1;
+    }
+
+    mergeCropShards(alignedBaseCount, firstReads, secondReads, otherReads, shards);
+    return 0;
+}
+
+// --------------------------------------------------------------------------
+// Function appendInputHeader()
+// --------------------------------------------------------------------------
+
+// Adds the read groups and programs of another input bam file of the sample to the header. Returns false if the file
+// has other reference sequences than the first input file.
+inline bool
+appendInputHeader(BamHeader & header, BamFileIn & firstStream, CharString const & mappingBam)
+{
+    BamFileIn inStream;
+    if (!open(inStream, toCString(mappingBam)))
+    {
+        std::cerr << "ERROR: Could not open input BAM file " << mappingBam << std::endl;
+        return false;
+    }
+    BamHeader inHeader;
+    readHeader(inHeader, inStream);
+
+    bool sameReference = length(contigNames(context(inStream))) == length(contigNames(context(firstStream)));
+    for (unsigned i = 0; sameReference && i < length(contigNames(context(inStream))); ++i)
+        sameReference = contigNames(context(inStream))[i] == contigNames(context(firstStream))[i] &&
+                        contigLengths(context(inStream))[i] == contigLengths(context(firstStream))[i];
+    if (!sameReference)
+    {
+        std::cerr << "ERROR: The reference sequences in the header of " << mappingBam << " differ from those of the ";
+        std::cerr << "first input BAM file." << std::endl;
+        return false;
+    }
+
+    for (unsigned i = 0; i < length(inHeader); ++i)
+    {
+        if (inHeader[i].type != BamHeaderRecordType::BAM_HEADER_READ_GROUP &&
+                inHeader[i].type != BamHeaderRecordType::BAM_HEADER_PROGRAM)
+            continue;
+
+        bool found = false;
+        for (unsigned j = 0; j < length(header) && !found; ++j)
+        {
+            found = header[j].type == inHeader[i].type && length(header[j].tags) == length(inHeader[i].tags);
+            for (unsigned k = 0; found && k < length(inHeader[i].tags); ++k)
+                found = header[j].tags[k].i1 == inHeader[i].tags[k].i1 && header[j].tags[k].i2 == inHeader[i].tags[k].i2;
+        }
+        if (!found)
+            appendValue(header, inHeader[i]);
+    }
+    return true;
+}
+
+// ==========================================================================
+// Function crop_unmapped()
+// ==========================================================================
+
+// Crops the unmapped reads and the reads with low mapping quality from the input bam files of a sample. Several input
+// files, e.g. one per lane, are cropped in parallel shards and give the same result as their merged bam file. The
+// average coverage is counted from the aligned bases only if countCoverage is set, otherwise it is set to 0.
+template<typename TAdapterTag>
+int
+crop_unmapped(double & avgCov,
+        bool countCoverage,
+        CharString const & readsFile,
+        CropReadsFormat readsFormat,
+        Triple<CharString> const & filteredFiles,
+        CharString & matesBam,
+        String<CharString> const & mappingBams,
+        int humanSeqs,
+        unsigned threads,
+        unsigned shards,
+        bool singlePass,
+        size_t storeMemory,
+        int compressionLevel,
+        AdapterMatcher<TAdapterTag> const & adapters)
+{
+    typedef __int32 TPos;
+    typedef std::map<Pair<TPos>, Pair<CharString, bool> > TOtherMap; // Reads to crop in a second pass of the input file.
+
+    CharString const & mappingBam = mappingBams[0];
+    if (singlePass && length(mappingBams) > 1)
+    {
+        std::cerr << "ERROR: Several input BAM files cannot be cropped in a single pass." << std::endl;
+        return 1;
+    }
+
+    // Open the input and output bam files. A single pass can read the input from stdin.
+    BamFileIn inStream;
+    if (singlePass && mappingBam == "-")
+    {
+        if (!open(inStream, std::cin, Bam()))
+        {
+            std::cerr << "ERROR: Could not read BAM file from stdin." << std::endl;
+            return 1;
+        }
+    }
+    else if (!open(inStream, toCString(mappingBam)))
+    {
+        std::cerr << "ERROR: Could not open input BAM file " << mappingBam << std::endl;
+        return 1;
+    }
+
+    // Copy the header, including the read groups of further input files. The mates bam file is sorted by read name.
+    BamHeader header;
+    readHeader(header, inStream);
+    BamHeader matesHeader = header;
+    for (unsigned i = 1; i < length(mappingBams); ++i)
+        if (!appendInputHeader(matesHeader, inStream, mappingBams[i]))
+            return 1;
+    setSortOrder(matesHeader, "queryname");
+
+    ParallelBamFileOut matesOut;
+    if (!open(matesOut, matesBam, context(inStream), threads, compressionLevel))
+        return 1;
+    writeHeader(matesOut, matesHeader);
+
+    unsigned long genomeLength = 0;
+    String<unsigned long> refLengths;
+    for (unsigned i = 0; i < length(header); ++i)
+    {
+        if (header[i].type != BamHeaderRecordType::BAM_HEADER_REFERENCE)
+            continue;
+
+        for (unsigned j = 0; j < length(header[i].tags); ++j)
+        {
+            if (header[i].tags[j].i1 != "LN")
+                continue;
+
+            appendValue(refLengths, lexicalCast<unsigned>(header[i].tags[j].i2));
+            genomeLength += back(refLengths);
+            break;
+        }
+    }
+
+    // The stores of unpaired reads and the sorter of mates fill up at the same time and share the memory budget.
+    size_t sorterMemory = storeMemory / 2;
+    size_t readsMemory = storeMemory - sorterMemory;
+
+    // Create stores for fastq records (first read in pair and second read in pair) and a map for bam records without mate.
+    std::string storePrefix = toCString(readsFile);
+    FastqStore firstReads(storePrefix + ".first", readsMemory / 2);
+    FastqStore secondReads(storePrefix + ".second", readsMemory / 2);
+    TOtherMap otherReads;
+
+    // Collect the records for the mates bam file for sorting them by read name.
+    BamNameSorter matesStream(matesBam, sorterMemory, threads);
+
+    // Open the output of cropped reads and, if given, the fastq files of quality filtered reads.
+    CropFastqOut fastqOut;
+    if (!open(fastqOut, readsFile, readsFormat, filteredFiles))
+        return 1;
+
+    // Prepare the lookup of mapped mates during the pass over the input file.
+    SinglePassMates mates(matesBam, humanSeqs, threads);
+    if (singlePass)
+    {
+        mates.foundStream = new ParallelBamFileOut;
+        if (!open(*mates.foundStream, mates.foundFile, context(inStream), threads, BGZF_INTERMEDIATE_LEVEL))
+            return 1;
+        writeHeader(*mates.foundStream, header);
+    }
+
+    unsigned long alignedBaseCount = 0;
+    if ((shards > 1 || length(mappingBams) > 1) && !singlePass)
+    {
+        // Iterate over genomic shards of the input files in parallel.
+        if (cropRecordsSharded(alignedBaseCount, countCoverage, matesStream,
+                firstReads, secondReads, otherReads, mappingBams, refLengths, humanSeqs, threads, shards, adapters) != 0)
+            return 1;
+    }
+    else if (threads > 1)
+    {
+        // Iterate over the input file with a pipeline of reader, worker, and writer threads.
+        if (cropRecordsPipelined(alignedBaseCount, countCoverage, matesStream,
+                firstReads, secondReads, otherReads, singlePass ? &mates : 0, inStream, header, humanSeqs, threads, adapters) != 0)
+            return 1;
+    }
+    else
+    {
+        // Iterate over the input file.
+        BamRecordView view;
+        BamAlignmentRecord record;
+        while (!atEnd(inStream))
+        {
+            // Read the next read from input file, decoding it only if it is not skipped.
+            readRecord(view, inStream);
+
+            CropAction action = classifyRecord(alignedBaseCount, countCoverage, view, humanSeqs);
+            if (action == CROP_SKIP && !singlePass)
+                continue;
+
+            assignRecord(record, view);
+            if (singlePass)
+                passRecord(mates, record, inStream, header);
+
+            action = trimRecord(record, action, adapters);
+            if (applyCropAction(matesStream, firstReads, secondReads, otherReads, record, action)
+                    && singlePass)
+                waitForMate(mates, record);
+        }
+    }
+    close(inStream);
+
+    avgCov = (double)alignedBaseCount / (double)genomeLength;
+
+    std::ostringstream msg;
+    msg << "Map of low quality mates has " << otherReads.size() << " records.";
+    printStatus(msg);
+
+    // Write the remaining fastq records.
+    if (writeFastq(fastqOut, firstReads, secondReads) != 0) return 1;
+    clearFastqStore(firstReads);
+    clearFastqStore(secondReads);
+
+    msg.str("");
+    msg << "Unmapped reads written to " << readsFile;
+    if (!fastqOut.interleaved)
+        msg << ", " << fastqOut.store.numPairs << " pairs and " << fastqOut.store.numSingles << " single reads.";
+    printStatus(msg);
+
+    if (fastqOut.filter)
+        printFilteringStatus(fastqOut, filteredFiles);
+
+    // Find the other read end of the low quality mapping reads and write them to the output bam file. 
+    int found = 0;
+    if (singlePass)
+    {
+        found = writeFoundMates(matesStream, mates, otherReads);
+        if (found == -1) return 1;
+    }
+    else
+    {
+        found = findOtherReads(matesStream, otherReads, mappingBams);
+        if (found == -1) return 1;
+    }
+
+    if (writeSortedRecords(matesOut, matesStream) != 0 || !close(matesOut))
+        return 1;
 
     msg.str("");
-    msg << "Mapped mates of unmapped reads written to " << matesBam << " , " << found << " found in second pass.";
+    msg << "Mapped mates of unmapped reads sorted by read name and written to " << matesBam << " , " << found << (singlePass ? " found in single pass." : " found in second pass.");
     printStatus(msg);
 
     return 0;
@@ -472,14 +1833,24 @@ crop_unmapped(double & avgCov,
 
 template<typename TAdapterTag>
 int
-crop_unmapped(Triple<CharString> & fastqFiles,
+crop_unmapped(CharString const & readsFile,
+        CropReadsFormat readsFormat,
+        Triple<CharString> const & filteredFiles,
         CharString & matesBam,
         CharString const & mappingBam,
         int humanSeqs,
-        TAdapterTag tag)
+        unsigned threads,
+        unsigned shards,
+        bool singlePass,
+        size_t storeMemory,
+        int compressionLevel,
+        AdapterMatcher<TAdapterTag> const & adapters)
 {
     double cov;
-    return crop_unmapped(cov, fastqFiles, matesBam, mappingBam, humanSeqs, tag);
+    String<CharString> mappingBams;
+    appendValue(mappingBams, mappingBam);
+    return crop_unmapped(cov, false, readsFile, readsFormat, filteredFiles, matesBam, mappingBams, humanSeqs, threads, shards, singlePass, storeMemory,
+                         compressionLevel, adapters);
 }
 
 #endif // #ifndef NOVINS_CROP_UNMAPPED_H_
@@ -0,0 +1,845 @@
+#ifndef POPINS_DEBRUIJN_ASSEMBLY_H_
+#define POPINS_DEBRUIJN_ASSEMBLY_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <stdint.h>
+
+// ==========================================================================
+// In-process de Bruijn graph assembly
+// ==========================================================================
+
+// An alternative to velveth/velvetg for the assembly of the filtered unmapped reads, kept entirely in memory:
+//   1. The canonical k-mers of all reads are counted in parallel into a hash table split into locked partitions.
+//   2. The k-mers are compacted into unitigs, i.e. maximal non-branching paths of the de Bruijn graph.
+//   3. Unitigs with an average k-mer coverage below the coverage cutoff or above the maximal coverage are removed as
+//      in velvetg's -cov_cutoff and -max_coverage, then short dead ends (tips) of fewer than 2k bases. The remaining
+//      k-mers are compacted again.
+//   4. Read pairs are located on the unitigs. Contigs are extended across a branch if the pairs linking the contig
+//      to one of the successors are at least minPairLinks and no pair links it to another successor.
+// Contigs shorter than 2k bases are not reported, like velvet's default minimal contig length.
+
+typedef unsigned __int128 TKmer;
+
+enum DeBruijnDefaults
+{
+    MIN_ASSEMBLY_KMER_LENGTH = 15,
+    MAX_ASSEMBLY_KMER_LENGTH = 63,
+    KMER_PARTITIONS = 256,
+    KMER_BUFFER_SIZE = 1024,
+    READS_PER_CHUNK = 4096
+};
+
+// --------------------------------------------------------------------------
+// Struct DeBruijnOptions
+// --------------------------------------------------------------------------
+
+struct DeBruijnOptions
+{
+    unsigned k;             // odd, between MIN_ASSEMBLY_KMER_LENGTH and MAX_ASSEMBLY_KMER_LENGTH
+    unsigned threads;
+    double covCutoff;
+    double maxCoverage;
+    unsigned minPairLinks;
+
+    DeBruijnOptions() :
+        k(47), threads(1), covCutoff(2.0), maxCoverage(100.0), minPairLinks(3)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Struct DeBruijnStats
+// --------------------------------------------------------------------------
+
+struct DeBruijnStats
+{
+    size_t distinctKmers;
+    size_t unitigs;
+    size_t lowCoverageUnitigs;
+    size_t highCoverageUnitigs;
+    size_t tips;
+    size_t pairLinks;
+
+    DeBruijnStats() :
+        distinctKmers(0), unitigs(0), lowCoverageUnitigs(0), highCoverageUnitigs(0), tips(0), pairLinks(0)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Struct AssemblyReads
+// --------------------------------------------------------------------------
+
+// The reads to assemble, concatenated into one string. Pairs have to be appended before single reads, the first
+// 2 * numPaired reads are then the pairs as consecutive reads.
+struct AssemblyReads
+{
+    std::string bases;
+    std::vector<size_t> ends;
+    size_t numPaired;
+
+    AssemblyReads() : numPaired(0) {}
+};
+
+inline size_t
+numReads(AssemblyReads const & reads)
+{
+    return reads.ends.size();
+}
+
+inline void
+appendRead(AssemblyReads & reads, char const * seq, size_t len)
+{
+    reads.bases.append(seq, len);
+    reads.ends.push_back(reads.bases.size());
+}
+
+inline void
+appendPair(AssemblyReads & reads, char const * seq1, size_t len1, char const * seq2, size_t len2)
+{
+    appendRead(reads, seq1, len1);
+    appendRead(reads, seq2, len2);
+    ++reads.numPaired;
+}
+
+// --------------------------------------------------------------------------
+// Struct AssembledContig
+// --------------------------------------------------------------------------
+
+struct AssembledContig
+{
+    std::string seq;
+    double cov;         // average k-mer coverage
+};
+
+// --------------------------------------------------------------------------
+// K-mer encoding
+// --------------------------------------------------------------------------
+
+inline unsigned
+_kmerBaseRank(char c)
+{
+    switch (c)
+    {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default: return 4;
+    }
+}
+
+inline uint64_t
+_kmerHash(TKmer x)
+{
+    uint64_t h = (uint64_t)x ^ ((uint64_t)(x >> 64) * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Encodes the k bases at seq into the forward and the reverse complement k-mer. Returns false if there is an N.
+inline bool
+_encodeKmer(TKmer & fwd, TKmer & rc, char const * seq, unsigned k)
+{
+    fwd = 0;
+    rc = 0;
+    for (unsigned i = 0; i < k; ++i)
+    {
+        unsigned r = _kmerBaseRank(seq[i]);
+        if (r > 3)
+            return false;
+        fwd = (fwd << 2) | r;
+        rc |= (TKmer)(3 - r) << (2 * i);
+    }
+    return true;
+}
+
+inline void
+_reverseComplement(std::string & seq)
+{
+    std::reverse(seq.begin(), seq.end());
+    for (size_t i = 0; i < seq.size(); ++i)
+    {
+        switch (seq[i])
+        {
+            case 'A': seq[i] = 'T'; break;
+            case 'C': seq[i] = 'G'; break;
+            case 'G': seq[i] = 'C'; break;
+            case 'T': seq[i] = 'A'; break;
+            default: seq[i] = 'N';
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Struct KmerTable
+// --------------------------------------------------------------------------
+
+// Open-addressing hash table of canonical k-mers, split into partitions by the high bits of the hash that are
+// locked separately while counting. After counting, each k-mer is assigned to a unitig.
+struct KmerTable
+{
+    static TKmer occupied() { return (TKmer)1 << 127; }
+
+    enum { NO_NODE = 0xffffffff };
+
+    struct Partition
+    {
+        std::vector<TKmer> keys;        // k-mer | occupied(), or 0 if the slot is empty
+        std::vector<uint32_t> counts;   // 0 if the k-mer was removed
+        std::vector<uint32_t> nodes;    // unitig << 1 | 1 if the canonical k-mer is on the unitig's forward strand
+        size_t size;
+        std::mutex mutex;
+
+        Partition() : keys(1024, 0), counts(1024, 0), size(0) {}
+    };
+
+    unsigned k;
+    TKmer mask;
+    std::vector<Partition> partitions;
+
+    KmerTable(unsigned k_) :
+        k(k_), mask(k_ == 64 ? ~(TKmer)0 : ((TKmer)1 << (2 * k_)) - 1), partitions(KMER_PARTITIONS)
+    {}
+};
+
+inline size_t
+_findSlot(KmerTable::Partition const & part, TKmer key, uint64_t hash)
+{
+    size_t capacity = part.keys.size();
+    size_t slot = hash & (capacity - 1);
+    while (part.keys[slot] != 0 && part.keys[slot] != key)
+        slot = (slot + 1) & (capacity - 1);
+    return slot;
+}
+
+inline void
+_growPartition(KmerTable::Partition & part)
+{
+    std::vector<TKmer> keys(part.keys.size() * 2, 0);
+    std::vector<uint32_t> counts(part.keys.size() * 2, 0);
+    keys.swap(part.keys);
+    counts.swap(part.counts);
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        if (keys[i] == 0)
+            continue;
+        size_t slot = _findSlot(part, keys[i], _kmerHash(keys[i] & ~KmerTable::occupied()));
+        part.keys[slot] = keys[i];
+        part.counts[slot] = counts[i];
+    }
+}
+
+// Adds the buffered k-mers of one partition. The caller holds the partition's lock.
+inline void
+_countKmers(KmerTable::Partition & part, std::vector<std::pair<TKmer, uint64_t> > const & buffer)
+{
+    for (size_t i = 0; i < buffer.size(); ++i)
+    {
+        TKmer key = buffer[i].first | KmerTable::occupied();
+        size_t slot = _findSlot(part, key, buffer[i].second);
+        if (part.keys[slot] == 0)
+        {
+            part.keys[slot] = key;
+            ++part.size;
+            if (part.size * 10 > part.keys.size() * 7)
+            {
+                _growPartition(part);
+                slot = _findSlot(part, key, buffer[i].second);
+            }
+        }
+        if (part.counts[slot] != 0xffffffff)
+            ++part.counts[slot];
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function findKmer()
+// --------------------------------------------------------------------------
+
+// Returns the partition and slot of a canonical k-mer that is present, i.e. counted and not removed.
+inline bool
+findKmer(KmerTable::Partition * & part, size_t & slot, KmerTable & table, TKmer canonical)
+{
+    uint64_t hash = _kmerHash(canonical);
+    part = &table.partitions[hash >> 56];
+    slot = _findSlot(*part, canonical | KmerTable::occupied(), hash);
+    return part->keys[slot] != 0 && part->counts[slot] != 0;
+}
+
+inline bool
+hasKmer(KmerTable & table, TKmer canonical)
+{
+    KmerTable::Partition * part;
+    size_t slot;
+    return findKmer(part, slot, table, canonical);
+}
+
+// --------------------------------------------------------------------------
+// Function countKmers()
+// --------------------------------------------------------------------------
+
+inline void
+_countKmersWorker(KmerTable & table, AssemblyReads const & reads, std::atomic<size_t> & nextChunk)
+{
+    unsigned k = table.k;
+    unsigned shift = 2 * (k - 1);
+
+    std::vector<std::vector<std::pair<TKmer, uint64_t> > > buffers(KMER_PARTITIONS);
+
+    for (size_t chunk = nextChunk++; chunk * READS_PER_CHUNK < numReads(reads); chunk = nextChunk++)
+    {
+        size_t chunkEnd = std::min(numReads(reads), (chunk + 1) * READS_PER_CHUNK);
+        for (size_t r = chunk * READS_PER_CHUNK; r < chunkEnd; ++r)
+        {
+            size_t begin = r == 0 ? 0 : reads.ends[r - 1];
+            TKmer fwd = 0, rc = 0;
+            unsigned len = 0;
+            for (size_t i = begin; i < reads.ends[r]; ++i)
+            {
+                unsigned c = _kmerBaseRank(reads.bases[i]);
+                if (c > 3)
+                {
+                    len = 0;
+                    continue;
+                }
+                fwd = ((fwd << 2) | c) & table.mask;
+                rc = (rc >> 2) | ((TKmer)(3 - c) << shift);
+                if (++len < k)
+                    continue;
+
+                TKmer canonical = std::min(fwd, rc);
+                uint64_t hash = _kmerHash(canonical);
+                std::vector<std::pair<TKmer, uint64_t> > & buffer = buffers[hash >> 56];
+                buffer.push_back(std::make_pair(canonical, hash));
+                if (buffer.size() == KMER_BUFFER_SIZE)
+                {
+                    KmerTable::Partition & part = table.partitions[hash >> 56];
+                    std::lock_guard<std::mutex> lock(part.mutex);
+                    _countKmers(part, buffer);
+                    buffer.clear();
+                }
+            }
+        }
+    }
+
+    for (unsigned p = 0; p < KMER_PARTITIONS; ++p)
+    {
+        std::lock_guard<std::mutex> lock(table.partitions[p].mutex);
+        _countKmers(table.partitions[p], buffers[p]);
+    }
+}
+
+// Counts the canonical k-mers of all reads using the given number of threads.
+inline void
+countKmers(KmerTable & table, AssemblyReads const & reads, unsigned threads)
+{
+    std::atomic<size_t> nextChunk(0);
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i)
+        workers.push_back(std::thread(_countKmersWorker, std::ref(table), std::cref(reads), std::ref(nextChunk)));
+    _countKmersWorker(table, reads, nextChunk);
+    for (unsigned i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+// --------------------------------------------------------------------------
+// Struct Unitig
+// --------------------------------------------------------------------------
+
+struct Unitig
+{
+    std::string seq;
+    uint64_t kmerCount;     // sum of the counts of the unitig's k-mers
+    bool removed;
+};
+
+inline double
+unitigCoverage(Unitig const & unitig, unsigned k)
+{
+    return (double)unitig.kmerCount / (double)(unitig.seq.size() - k + 1);
+}
+
+// --------------------------------------------------------------------------
+// Function _extendUnitig()
+// --------------------------------------------------------------------------
+
+// Walks the non-branching path from k-mer (fwd, rc) forward, appending the bases to seq and assigning the k-mers to
+// the unitig. Since the walk may run along the reverse strand of the unitig, onForward gives the walk's strand.
+inline void
+_extendUnitig(std::string & seq, uint64_t & kmerCount, KmerTable & table, TKmer fwd, TKmer rc,
+        uint32_t unitig, bool onForward)
+{
+    static const char BASES[] = "ACGT";
+    unsigned shift = 2 * (table.k - 1);
+
+    while (true)
+    {
+        // Find the only successor.
+        unsigned numSucc = 0, base = 0;
+        TKmer next = 0, nextRc = 0;
+        for (unsigned b = 0; b < 4; ++b)
+        {
+            TKmer cand = ((fwd << 2) | b) & table.mask;
+            TKmer candRc = (rc >> 2) | ((TKmer)(3 - b) << shift);
+            if (hasKmer(table, std::min(cand, candRc)))
+            {
+                ++numSucc;
+                next = cand;
+                nextRc = candRc;
+                base = b;
+            }
+        }
+        if (numSucc != 1)
+            break;
+
+        // Check that the successor has no other predecessor.
+        unsigned numPred = 0;
+        for (unsigned b = 0; b < 4; ++b)
+        {
+            TKmer cand = ((nextRc << 2) | b) & table.mask;
+            TKmer candRc = (next >> 2) | ((TKmer)(3 - b) << shift);
+            if (hasKmer(table, std::min(cand, candRc)))
+                ++numPred;
+        }
+        if (numPred != 1)
+            break;
+
+        KmerTable::Partition * part;
+        size_t slot;
+        findKmer(part, slot, table, std::min(next, nextRc));
+        if (part->nodes[slot] != (uint32_t)KmerTable::NO_NODE)
+            break;  // cycle
+
+        bool canonicalOnWalk = next <= nextRc;
+        part->nodes[slot] = (unitig << 1) | (canonicalOnWalk == onForward ? 1 : 0);
+        kmerCount += part->counts[slot];
+        seq.push_back(BASES[base]);
+
+        fwd = next;
+        rc = nextRc;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function buildUnitigs()
+// --------------------------------------------------------------------------
+
+// Compacts the present k-mers of the table into unitigs.
+inline void
+buildUnitigs(std::vector<Unitig> & unitigs, KmerTable & table)
+{
+    unsigned k = table.k;
+    unitigs.clear();
+
+    for (unsigned p = 0; p < KMER_PARTITIONS; ++p)
+        table.partitions[p].nodes.assign(table.partitions[p].keys.size(), (uint32_t)KmerTable::NO_NODE);
+
+    std::string left;
+    for (unsigned p = 0; p < KMER_PARTITIONS; ++p)
+    {
+        KmerTable::Partition & part = table.partitions[p];
+        for (size_t s = 0; s < part.keys.size(); ++s)
+        {
+            if (part.keys[s] == 0 || part.counts[s] == 0 || part.nodes[s] != (uint32_t)KmerTable::NO_NODE)
+                continue;
+
+            uint32_t id = unitigs.size();
+            unitigs.push_back(Unitig());
+            Unitig & unitig = unitigs.back();
+            unitig.removed = false;
+
+            // Decode the seed k-mer and its reverse complement.
+            TKmer seed = part.keys[s] & ~KmerTable::occupied();
+            left.assign(k, 'A');
+            for (unsigned i = 0; i < k; ++i)
+                left[i] = "TGCA"[(unsigned)(seed >> (2 * i)) & 3];
+            TKmer seedRc = 0;
+            _encodeKmer(seedRc, seed, left.c_str(), k);
+
+            part.nodes[s] = (id << 1) | 1;
+            unitig.kmerCount = part.counts[s];
+
+            // Walk along the reverse strand first, then along the forward strand.
+            _extendUnitig(left, unitig.kmerCount, table, seedRc, seed, id, false);
+            unitig.seq = left;
+            _reverseComplement(unitig.seq);
+            _extendUnitig(unitig.seq, unitig.kmerCount, table, seed, seedRc, id, true);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function removeUnitig()
+// --------------------------------------------------------------------------
+
+inline void
+removeUnitig(Unitig & unitig, KmerTable & table)
+{
+    unsigned k = table.k;
+    unsigned shift = 2 * (k - 1);
+
+    TKmer fwd, rc;
+    _encodeKmer(fwd, rc, unitig.seq.c_str(), k);
+    for (size_t i = k; ; ++i)
+    {
+        KmerTable::Partition * part;
+        size_t slot;
+        if (findKmer(part, slot, table, std::min(fwd, rc)))
+            part->counts[slot] = 0;
+        if (i == unitig.seq.size())
+            break;
+
+        unsigned c = _kmerBaseRank(unitig.seq[i]);
+        fwd = ((fwd << 2) | c) & table.mask;
+        rc = (rc >> 2) | ((TKmer)(3 - c) << shift);
+    }
+    unitig.removed = true;
+}
+
+// --------------------------------------------------------------------------
+// Function successors()
+// --------------------------------------------------------------------------
+
+// An oriented unitig, unitig << 1 | 1 for its forward strand and unitig << 1 for its reverse strand.
+typedef uint32_t TOrientedUnitig;
+
+// Returns the oriented unitigs following an oriented unitig in the graph.
+inline void
+successors(std::vector<TOrientedUnitig> & succ, TOrientedUnitig node, std::vector<Unitig> const & unitigs,
+        KmerTable & table)
+{
+    unsigned k = table.k;
+    unsigned shift = 2 * (k - 1);
+    succ.clear();
+
+    // The last k-mer of the oriented unitig.
+    std::string const & seq = unitigs[node >> 1].seq;
+    TKmer fwd, rc;
+    if (node & 1)
+        _encodeKmer(fwd, rc, seq.c_str() + seq.size() - k, k);
+    else
+        _encodeKmer(rc, fwd, seq.c_str(), k);
+
+    for (unsigned b = 0; b < 4; ++b)
+    {
+        TKmer cand = ((fwd << 2) | b) & table.mask;
+        TKmer candRc = (rc >> 2) | ((TKmer)(3 - b) << shift);
+        KmerTable::Partition * part;
+        size_t slot;
+        if (!findKmer(part, slot, table, std::min(cand, candRc)))
+            continue;
+
+        uint32_t value = part->nodes[slot];
+        bool onForward = (cand <= candRc) == ((value & 1) == 1);
+        succ.push_back((value & ~1u) | (onForward ? 1 : 0));
+    }
+}
+
+inline size_t
+numPredecessors(TOrientedUnitig node, std::vector<Unitig> const & unitigs, KmerTable & table)
+{
+    std::vector<TOrientedUnitig> pred;
+    successors(pred, node ^ 1, unitigs, table);
+    return pred.size();
+}
+
+// --------------------------------------------------------------------------
+// Function removeUnitigs()
+// --------------------------------------------------------------------------
+
+// Removes unitigs outside the coverage range and tips shorter than 2k bases, then compacts the graph again.
+inline void
+removeUnitigs(std::vector<Unitig> & unitigs, KmerTable & table, DeBruijnOptions const & options, DeBruijnStats & stats)
+{
+    unsigned k = table.k;
+
+    for (size_t u = 0; u < unitigs.size(); ++u)
+    {
+        double cov = unitigCoverage(unitigs[u], k);
+        if (cov < options.covCutoff)
+        {
+            removeUnitig(unitigs[u], table);
+            ++stats.lowCoverageUnitigs;
+        }
+        else if (cov > options.maxCoverage)
+        {
+            removeUnitig(unitigs[u], table);
+            ++stats.highCoverageUnitigs;
+        }
+    }
+    buildUnitigs(unitigs, table);
+
+    // Clip tips in two rounds, since clipping may turn branches into new tips.
+    for (unsigned round = 0; round < 2; ++round)
+    {
+        std::vector<size_t> tips;
+        for (size_t u = 0; u < unitigs.size(); ++u)
+        {
+            if (unitigs[u].seq.size() >= 2 * k)
+                continue;
+            size_t numPred = numPredecessors((TOrientedUnitig)(u << 1 | 1), unitigs, table);
+            size_t numSucc = numPredecessors((TOrientedUnitig)(u << 1), unitigs, table);
+            if ((numPred == 0) != (numSucc == 0))
+                tips.push_back(u);
+        }
+        if (tips.empty())
+            break;
+
+        for (size_t i = 0; i < tips.size(); ++i)
+            removeUnitig(unitigs[tips[i]], table);
+        stats.tips += tips.size();
+        buildUnitigs(unitigs, table);
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function countPairLinks()
+// --------------------------------------------------------------------------
+
+typedef std::unordered_map<uint64_t, uint32_t> TPairLinks;
+
+// Returns the oriented unitig of the first present k-mer of a read, on which the read lies on the forward strand.
+inline bool
+_locateRead(TOrientedUnitig & node, KmerTable & table, char const * seq, size_t len)
+{
+    unsigned k = table.k;
+    unsigned shift = 2 * (k - 1);
+
+    TKmer fwd = 0, rc = 0;
+    unsigned kmerLength = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned c = _kmerBaseRank(seq[i]);
+        if (c > 3)
+        {
+            kmerLength = 0;
+            continue;
+        }
+        fwd = ((fwd << 2) | c) & table.mask;
+        rc = (rc >> 2) | ((TKmer)(3 - c) << shift);
+        if (++kmerLength < k)
+            continue;
+
+        KmerTable::Partition * part;
+        size_t slot;
+        if (findKmer(part, slot, table, std::min(fwd, rc)))
+        {
+            uint32_t value = part->nodes[slot];
+            node = (value & ~1u) | ((fwd <= rc) == ((value & 1) == 1) ? 1 : 0);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void
+_countPairLinksWorker(TPairLinks & links, KmerTable & table, AssemblyReads const & reads,
+        std::atomic<size_t> & nextChunk)
+{
+    for (size_t chunk = nextChunk++; chunk * READS_PER_CHUNK < reads.numPaired; chunk = nextChunk++)
+    {
+        size_t chunkEnd = std::min(reads.numPaired, (chunk + 1) * READS_PER_CHUNK);
+        for (size_t p = chunk * READS_PER_CHUNK; p < chunkEnd; ++p)
+        {
+            size_t begin1 = p == 0 ? 0 : reads.ends[2 * p - 1];
+            size_t begin2 = reads.ends[2 * p];
+            TOrientedUnitig node1, node2;
+            if (!_locateRead(node1, table, reads.bases.c_str() + begin1, reads.ends[2 * p] - begin1) ||
+                    !_locateRead(node2, table, reads.bases.c_str() + begin2, reads.ends[2 * p + 1] - begin2))
+                continue;
+            if ((node1 >> 1) == (node2 >> 1))
+                continue;
+
+            // The second read lies on the reverse strand downstream of the first read.
+            ++links[(uint64_t)node1 << 32 | (node2 ^ 1)];
+            ++links[(uint64_t)node2 << 32 | (node1 ^ 1)];
+        }
+    }
+}
+
+// Counts the pairs linking two oriented unitigs, key a << 32 | b for pairs with b downstream of a.
+inline void
+countPairLinks(TPairLinks & links, KmerTable & table, AssemblyReads const & reads, unsigned threads)
+{
+    std::atomic<size_t> nextChunk(0);
+    std::vector<TPairLinks> threadLinks(threads);
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i)
+        workers.push_back(std::thread(_countPairLinksWorker, std::ref(threadLinks[i]), std::ref(table),
+                std::cref(reads), std::ref(nextChunk)));
+    _countPairLinksWorker(threadLinks[0], table, reads, nextChunk);
+    for (unsigned i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    links.swap(threadLinks[0]);
+    for (unsigned i = 1; i < threads; ++i)
+        for (TPairLinks::const_iterator it = threadLinks[i].begin(); it != threadLinks[i].end(); ++it)
+            links[it->first] += it->second;
+}
+
+// --------------------------------------------------------------------------
+// Function buildContigs()
+// --------------------------------------------------------------------------
+
+// Extends the path of oriented unitigs at its end across branches resolved by read pairs.
+inline void
+_extendPath(std::vector<TOrientedUnitig> & path, std::vector<bool> & used, std::vector<Unitig> const & unitigs,
+        KmerTable & table, TPairLinks const & links, unsigned minPairLinks)
+{
+    std::vector<TOrientedUnitig> succ;
+    while (true)
+    {
+        successors(succ, path.back(), unitigs, table);
+        if (succ.empty())
+            break;
+
+        // Count the pairs linking the path to each successor.
+        TOrientedUnitig best = 0;
+        unsigned bestLinks = 0, otherLinks = 0;
+        for (size_t s = 0; s < succ.size(); ++s)
+        {
+            unsigned numLinks = 0;
+            for (size_t i = 0; i < path.size(); ++i)
+            {
+                TPairLinks::const_iterator it = links.find((uint64_t)path[i] << 32 | succ[s]);
+                if (it != links.end())
+                    numLinks += it->second;
+            }
+            if (numLinks > bestLinks)
+            {
+                otherLinks += bestLinks;
+                bestLinks = numLinks;
+                best = succ[s];
+            }
+            else
+            {
+                otherLinks += numLinks;
+            }
+        }
+
+        if (bestLinks < minPairLinks || otherLinks != 0 || used[best >> 1])
+            break;
+
+        used[best >> 1] = true;
+        path.push_back(best);
+    }
+}
+
+inline void
+_flipPath(std::vector<TOrientedUnitig> & path)
+{
+    std::reverse(path.begin(), path.end());
+    for (size_t i = 0; i < path.size(); ++i)
+        path[i] ^= 1;
+}
+
+// Joins unitigs into contigs, starting from the longest unitigs.
+inline void
+buildContigs(std::vector<AssembledContig> & contigs, std::vector<Unitig> const & unitigs, KmerTable & table,
+        TPairLinks const & links, unsigned minPairLinks)
+{
+    unsigned k = table.k;
+
+    std::vector<std::pair<size_t, uint32_t> > order;
+    for (size_t u = 0; u < unitigs.size(); ++u)
+        order.push_back(std::make_pair(unitigs[u].seq.size(), (uint32_t)u));
+    std::sort(order.begin(), order.end(), std::greater<std::pair<size_t, uint32_t> >());
+
+    std::vector<bool> used(unitigs.size(), false);
+    std::vector<TOrientedUnitig> path;
+    std::string seq;
+    for (size_t o = 0; o < order.size(); ++o)
+    {
+        uint32_t u = order[o].second;
+        if (used[u] || unitigs[u].removed)
+            continue;
+
+        used[u] = true;
+        path.assign(1, (TOrientedUnitig)(u << 1 | 1));
+        _extendPath(path, used, unitigs, table, links, minPairLinks);
+        _flipPath(path);
+        _extendPath(path, used, unitigs, table, links, minPairLinks);
+        _flipPath(path);
+
+        AssembledContig contig;
+        uint64_t kmerCount = 0;
+        for (size_t i = 0; i < path.size(); ++i)
+        {
+            Unitig const & unitig = unitigs[path[i] >> 1];
+            seq = unitig.seq;
+            if ((path[i] & 1) == 0)
+                _reverseComplement(seq);
+            contig.seq.append(seq, i == 0 ? 0 : k - 1, std::string::npos);
+            kmerCount += unitig.kmerCount;
+        }
+        if (contig.seq.size() < 2 * k)
+            continue;
+
+        contig.cov = (double)kmerCount / (double)(contig.seq.size() - k + 1);
+        contigs.push_back(contig);
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function assemblyKmerLength()
+// --------------------------------------------------------------------------
+
+// Returns the k-mer length used for a requested one, the next smaller odd length within the supported range. Odd
+// lengths avoid k-mers that are their own reverse complement.
+inline unsigned
+assemblyKmerLength(unsigned k)
+{
+    k = std::max((unsigned)MIN_ASSEMBLY_KMER_LENGTH, std::min((unsigned)MAX_ASSEMBLY_KMER_LENGTH, k));
+    return k % 2 == 0 ? k - 1 : k;
+}
+
+// --------------------------------------------------------------------------
+// Function assembleDeBruijn()
+// --------------------------------------------------------------------------
+
+/**
+ * Assembles reads in memory with a de Bruijn graph.
+ *
+ * @param contigs   the assembled contigs of at least 2k bases
+ * @param stats     counts of the assembly steps
+ * @param reads     the reads, pairs first
+ * @param options   the k-mer length, number of threads, coverage range, and minimal number of pairs to extend a contig
+ */
+inline void
+assembleDeBruijn(std::vector<AssembledContig> & contigs,
+        DeBruijnStats & stats,
+        AssemblyReads const & reads,
+        DeBruijnOptions const & options)
+{
+    unsigned k = assemblyKmerLength(options.k);
+    unsigned threads = std::max(1u, options.threads);
+
+    KmerTable table(k);
+    countKmers(table, reads, threads);
+    for (unsigned p = 0; p < KMER_PARTITIONS; ++p)
+        stats.distinctKmers += table.partitions[p].size;
+
+    std::vector<Unitig> unitigs;
+    buildUnitigs(unitigs, table);
+    stats.unitigs = unitigs.size();
+    removeUnitigs(unitigs, table, options, stats);
+
+    TPairLinks links;
+    countPairLinks(links, table, reads, threads);
+    stats.pairLinks = links.size() / 2;
+
+    contigs.clear();
+    buildContigs(contigs, unitigs, table, links, options.minPairLinks);
+}
+
+#endif  // POPINS_DEBRUIJN_ASSEMBLY_H_
@@ -0,0 +1,761 @@
+#ifndef POPINS_FASTQ_STORE_H_
+#define POPINS_FASTQ_STORE_H_
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <utility>
+#include <stdint.h>
+
+#include "read_names.h"
+
+// ==========================================================================
+// Struct FastqStore
+// ==========================================================================
+
+// Reads waiting for their mate while cropping. The name, sequence, and quality bytes of a read are stored in a bump
+// arena and found through an open-addressing hash table over the read name. Once the memory budget is reached, the
+// arena is compacted or, if mostly live, its reads are spilled to a name-sorted run file on disk. Spilled reads are
+// still found by name through an index of each run file that takes about 8 bytes per read.
+struct FastqStore
+{
+    struct Entry
+    {
+        uint64_t hash;
+        char * data;           // name, sequence, and quality bytes; 0 if erased
+        uint32_t nameLength;
+        uint32_t seqLength;
+        uint32_t qualLength;
+        uint32_t flags;        // REVERSED or 0
+    };
+
+    // The sorted name hashes of all reads in a run file, and the name and file offset of every INDEX_STEP-th read.
+    struct RunIndex
+    {
+        std::vector<uint64_t> hashes;
+        std::vector<std::string> names;
+        std::vector<uint64_t> offsets;
+    };
+
+    enum
+    {
+        EMPTY = 0,
+        ERASED = 0xffffffff,
+        BLOCK_SIZE = 1 << 22,
+        MAX_RUNS = 64,          // run files are merged into one when reaching this number
+        INDEX_STEP = 64,        // number of reads in a run file per indexed name
+        REVERSED = 1            // flag of reads stored reverse complemented
+    };
+
+    std::vector<Entry> entries;
+    std::vector<uint32_t> slots;    // entry index + 1, EMPTY, or ERASED
+    size_t numErased;
+
+    std::vector<char *> blocks;
+    char * blockPos;
+    size_t blockRemaining;
+    size_t arenaBytes;
+    size_t liveBytes;
+
+    size_t maxBytes;
+    size_t blockSize;
+    std::string spillPrefix;
+    std::vector<std::string> runFiles;
+    std::vector<RunIndex> runIndices;
+    bool failed;                    // set if writing or reading a run file failed
+
+    // The run file last opened for looking up a spilled read.
+    std::ifstream lookupStream;
+    size_t lookupRun;
+
+    FastqStore(std::string const & prefix, size_t budget) :
+        numErased(0), blockPos(0), blockRemaining(0), arenaBytes(0), liveBytes(0), maxBytes(budget),
+        blockSize(std::max((size_t)1 << 12, std::min((size_t)BLOCK_SIZE, budget / 16))), spillPrefix(prefix), failed(false),
+        lookupRun(MAX_RUNS)
+    {
+        slots.resize(1024, (uint32_t)EMPTY);
+    }
+
+    ~FastqStore()
+    {
+        for (size_t i = 0; i < blocks.size(); ++i)
+            delete[] blocks[i];
+        for (size_t i = 0; i < runFiles.size(); ++i)
+            std::remove(runFiles[i].c_str());
+    }
+
+private:
+    FastqStore(FastqStore const &);
+    FastqStore & operator=(FastqStore const &);
+};
+
+// --------------------------------------------------------------------------
+// Function fastqNameHash()
+// --------------------------------------------------------------------------
+
+// 64-bit FNV-1a hash of a read name.
+inline uint64_t
+fastqNameHash(char const * name, size_t len)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= (unsigned char)name[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// --------------------------------------------------------------------------
+// Function lessFastqName()
+// --------------------------------------------------------------------------
+
+// Order of read names in the output fastq files: the order of 'samtools sort -n' so that bwa's output for the fastq
+// files is sorted by read name, with ties of distinct names broken bytewise.
+inline bool
+lessFastqName(char const * a, size_t aLen, char const * b, size_t bLen)
+{
+    int c = compareReadNames(a, aLen, b, bLen);
+    if (c != 0)
+        return c < 0;
+    c = std::memcmp(a, b, std::min(aLen, bLen));
+    return c < 0 || (c == 0 && aLen < bLen);
+}
+
+// --------------------------------------------------------------------------
+// Function numReads()
+// --------------------------------------------------------------------------
+
+inline size_t
+numReads(FastqStore const & store)
+{
+    return store.entries.size() - store.numErased;
+}
+
+// --------------------------------------------------------------------------
+// Function _findSlot()
+// --------------------------------------------------------------------------
+
+// Returns the slot holding the name, or the slot where it would be inserted if not present.
+inline size_t
+_findSlot(FastqStore const & store, char const * name, size_t len, uint64_t hash)
+{
+    size_t mask = store.slots.size() - 1;
+    size_t insertAt = store.slots.size();
+    for (size_t s = hash & mask; ; s = (s + 1) & mask)
+    {
+        uint32_t slot = store.slots[s];
+        if (slot == FastqStore::EMPTY)
+            return insertAt < store.slots.size() ? insertAt : s;
+        if (slot == FastqStore::ERASED)
+        {
+            if (insertAt == store.slots.size())
+                insertAt = s;
+            continue;
+        }
+        FastqStore::Entry const & entry = store.entries[slot - 1];
+        if (entry.hash == hash && entry.nameLength == len && std::memcmp(entry.data, name, len) == 0)
+            return s;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function _rehash()
+// --------------------------------------------------------------------------
+
+// Drops the erased entries and rebuilds the hash table with the given number of slots.
+inline void
+_rehash(FastqStore & store, size_t numSlots)
+{
+    size_t numLive = 0;
+    for (size_t i = 0; i < store.entries.size(); ++i)
+        if (store.entries[i].data != 0)
+            store.entries[numLive++] = store.entries[i];
+    store.entries.resize(numLive);
+    store.numErased = 0;
+
+    std::vector<uint32_t>(numSlots, (uint32_t)FastqStore::EMPTY).swap(store.slots);
+    size_t mask = numSlots - 1;
+    for (size_t i = 0; i < store.entries.size(); ++i)
+    {
+        size_t s = store.entries[i].hash & mask;
+        while (store.slots[s] != FastqStore::EMPTY)
+            s = (s + 1) & mask;
+        store.slots[s] = i + 1;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function _allocate()
+// --------------------------------------------------------------------------
+
+inline char *
+_allocate(FastqStore & store, size_t bytes)
+{
+    if (bytes > store.blockRemaining)
+    {
+        size_t blockSize = std::max(bytes, store.blockSize);
+        store.blocks.push_back(new char[blockSize]);
+        store.blockPos = store.blocks.back();
+        store.blockRemaining = blockSize;
+        store.arenaBytes += blockSize;
+    }
+    char * data = store.blockPos;
+    store.blockPos += bytes;
+    store.blockRemaining -= bytes;
+    return data;
+}
+
+// --------------------------------------------------------------------------
+// Function sortedReads()
+// --------------------------------------------------------------------------
+
+// Returns pointers to the reads in memory, sorted by name.
+struct LessFastqEntry
+{
+    bool operator()(FastqStore::Entry const * a, FastqStore::Entry const * b) const
+    {
+        return lessFastqName(a->data, a->nameLength, b->data, b->nameLength);
+    }
+};
+
+inline void
+sortedReads(std::vector<FastqStore::Entry const *> & sorted, FastqStore const & store)
+{
+    sorted.clear();
+    sorted.reserve(numReads(store));
+    for (size_t i = 0; i < store.entries.size(); ++i)
+        if (store.entries[i].data != 0)
+            sorted.push_back(&store.entries[i]);
+    std::sort(sorted.begin(), sorted.end(), LessFastqEntry());
+}
+
+// --------------------------------------------------------------------------
+// Function _clearMemory()
+// --------------------------------------------------------------------------
+
+inline void
+_clearMemory(FastqStore & store)
+{
+    for (size_t i = 0; i < store.blocks.size(); ++i)
+        delete[] store.blocks[i];
+    store.blocks.clear();
+    store.blockPos = 0;
+    store.blockRemaining = 0;
+    store.arenaBytes = 0;
+    store.liveBytes = 0;
+    store.entries.clear();
+    store.numErased = 0;
+    std::vector<uint32_t>(1024, (uint32_t)FastqStore::EMPTY).swap(store.slots);
+}
+
+// --------------------------------------------------------------------------
+// Function _closeLookup()
+// --------------------------------------------------------------------------
+
+inline void
+_closeLookup(FastqStore & store)
+{
+    if (store.lookupStream.is_open())
+        store.lookupStream.close();
+    store.lookupStream.clear();
+    store.lookupRun = FastqStore::MAX_RUNS;
+}
+
+// --------------------------------------------------------------------------
+// Function clearFastqStore()
+// --------------------------------------------------------------------------
+
+// Releases the memory and removes the run files of a store.
+inline void
+clearFastqStore(FastqStore & store)
+{
+    _clearMemory(store);
+    _closeLookup(store);
+    for (size_t i = 0; i < store.runFiles.size(); ++i)
+        std::remove(store.runFiles[i].c_str());
+    store.runFiles.clear();
+    store.runIndices.clear();
+}
+
+// --------------------------------------------------------------------------
+// Function _writeRunRead()
+// --------------------------------------------------------------------------
+
+// Writes a read to a run file and adds it to the run's index. The offset is advanced to the next read.
+inline void
+_writeRunRead(std::ofstream & run,
+        FastqStore::RunIndex & index,
+        uint64_t & offset,
+        char const * data,
+        uint32_t nameLength,
+        uint32_t seqLength,
+        uint32_t qualLength,
+        uint32_t flags)
+{
+    if (index.hashes.size() % FastqStore::INDEX_STEP == 0)
+    {
+        index.names.push_back(std::string(data, nameLength));
+        index.offsets.push_back(offset);
+    }
+    index.hashes.push_back(fastqNameHash(data, nameLength));
+
+    uint32_t header[4] = {nameLength, seqLength, qualLength, flags};
+    run.write((char const *)header, sizeof(header));
+    run.write(data, nameLength + seqLength + qualLength);
+    offset += sizeof(header) + nameLength + seqLength + qualLength;
+}
+
+// --------------------------------------------------------------------------
+// Function compactFastqStore()
+// --------------------------------------------------------------------------
+
+// Copies the live reads into a fresh arena and drops erased entries.
+inline void
+compactFastqStore(FastqStore & store)
+{
+    std::vector<FastqStore::Entry> live;
+    live.reserve(numReads(store));
+    for (size_t i = 0; i < store.entries.size(); ++i)
+        if (store.entries[i].data != 0)
+            live.push_back(store.entries[i]);
+
+    std::vector<char *> oldBlocks;
+    oldBlocks.swap(store.blocks);
+    store.blockPos = 0;
+    store.blockRemaining = 0;
+    store.arenaBytes = 0;
+
+    for (size_t i = 0; i < live.size(); ++i)
+    {
+        size_t bytes = live[i].nameLength + live[i].seqLength + live[i].qualLength;
+        char * data = _allocate(store, bytes);
+        std::memcpy(data, live[i].data, bytes);
+        live[i].data = data;
+    }
+    for (size_t i = 0; i < oldBlocks.size(); ++i)
+        delete[] oldBlocks[i];
+
+    store.entries.swap(live);
+    store.numErased = 0;
+    size_t numSlots = 1024;
+    while (numSlots < 2 * store.entries.size())
+        numSlots *= 2;
+    _rehash(store, numSlots);
+}
+
+inline void _mergeRuns(FastqStore & store);
+
+// --------------------------------------------------------------------------
+// Function spillFastqStore()
+// --------------------------------------------------------------------------
+
+// Writes all reads in memory to a new name-sorted run file and clears the memory.
+inline bool
+spillFastqStore(FastqStore & store)
+{
+    std::ostringstream fileName;
+    fileName << store.spillPrefix << ".spill." << store.runFiles.size();
+    store.runFiles.push_back(fileName.str());
+    store.runIndices.push_back(FastqStore::RunIndex());
+
+    std::ofstream run(fileName.str().c_str(), std::ios::binary);
+    if (!run.good())
+    {
+        store.failed = true;
+        return false;
+    }
+
+    std::vector<FastqStore::Entry const *> sorted;
+    sortedReads(sorted, store);
+    FastqStore::RunIndex & index = store.runIndices.back();
+    uint64_t offset = 0;
+    for (size_t i = 0; i < sorted.size(); ++i)
+    {
+        FastqStore::Entry const & entry = *sorted[i];
+        _writeRunRead(run, index, offset, entry.data, entry.nameLength, entry.seqLength, entry.qualLength, entry.flags);
+    }
+    std::sort(index.hashes.begin(), index.hashes.end());
+
+    _clearMemory(store);
+    if (!run.good())
+        store.failed = true;
+    run.close();
+
+    if (!store.failed && store.runFiles.size() >= FastqStore::MAX_RUNS)
+        _mergeRuns(store);
+    return !store.failed;
+}
+
+// --------------------------------------------------------------------------
+// Function _fitBudget()
+// --------------------------------------------------------------------------
+
+inline size_t
+_usedBytes(FastqStore const & store)
+{
+    return store.arenaBytes + store.entries.size() * sizeof(FastqStore::Entry) + store.slots.size() * sizeof(uint32_t);
+}
+
+inline bool
+_fitBudget(FastqStore & store)
+{
+    if (_usedBytes(store) <= store.maxBytes)
+        return true;
+
+    // Compact if most of the arena holds erased reads, spill if that does not suffice.
+    if (store.liveBytes < store.arenaBytes / 2)
+    {
+        compactFastqStore(store);
+        if (_usedBytes(store) <= store.maxBytes)
+            return true;
+    }
+
+    return spillFastqStore(store);
+}
+
+// --------------------------------------------------------------------------
+// Function findRead()
+// --------------------------------------------------------------------------
+
+// Returns the read with the given name, or 0 if it is not in memory.
+inline FastqStore::Entry *
+findRead(FastqStore & store, char const * name, size_t len)
+{
+    size_t s = _findSlot(store, name, len, fastqNameHash(name, len));
+    uint32_t slot = store.slots[s];
+    if (slot == FastqStore::EMPTY || slot == FastqStore::ERASED)
+        return 0;
+    FastqStore::Entry & entry = store.entries[slot - 1];
+    if (entry.nameLength != len || std::memcmp(entry.data, name, len) != 0)
+        return 0;
+    return &entry;
+}
+
+// --------------------------------------------------------------------------
+// Function _runContains()
+// --------------------------------------------------------------------------
+
+// Looks up a name in a run file. Only reads the block of INDEX_STEP reads that holds the name if its hash is in the run.
+inline bool
+_runContains(FastqStore & store, size_t r, char const * name, size_t len, uint64_t hash)
+{
+    FastqStore::RunIndex const & index = store.runIndices[r];
+    if (!std::binary_search(index.hashes.begin(), index.hashes.end(), hash))
+        return false;
+
+    // The last indexed read with a name not after the name.
+    size_t lo = 0, hi = index.names.size();
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (lessFastqName(name, len, index.names[mid].data(), index.names[mid].size()))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    if (lo == 0)
+        return false;
+
+    if (store.lookupRun != r)
+    {
+        _closeLookup(store);
+        store.lookupStream.open(store.runFiles[r].c_str(), std::ios::binary);
+        store.lookupRun = r;
+    }
+    store.lookupStream.clear();
+    store.lookupStream.seekg(index.offsets[lo - 1]);
+
+    std::string readName;
+    uint32_t header[4];
+    for (unsigned i = 0; i < FastqStore::INDEX_STEP && store.lookupStream.read((char *)header, sizeof(header)); ++i)
+    {
+        readName.resize(header[0]);
+        if (header[0] != 0 && !store.lookupStream.read(&readName[0], header[0]))
+            break;
+        if (readName.size() == len && std::memcmp(readName.data(), name, len) == 0)
+            return true;
+        if (lessFastqName(name, len, readName.data(), readName.size()))
+            return false;
+        store.lookupStream.seekg(header[1] + header[2], std::ios::cur);
+    }
+
+    if (!store.lookupStream.good() && !store.lookupStream.eof())
+        store.failed = true;
+    return false;
+}
+
+// --------------------------------------------------------------------------
+// Function containsRead()
+// --------------------------------------------------------------------------
+
+// Returns true if a read with the given name is in the store, in memory or spilled to a run file.
+inline bool
+containsRead(FastqStore & store, char const * name, size_t len)
+{
+    if (findRead(store, name, len) != 0)
+        return true;
+    if (store.runFiles.empty())
+        return false;
+
+    uint64_t hash = fastqNameHash(name, len);
+    for (size_t r = 0; r < store.runFiles.size(); ++r)
+        if (_runContains(store, r, name, len, hash))
+            return true;
+    return false;
+}
+
+// --------------------------------------------------------------------------
+// Function eraseRead()
+// --------------------------------------------------------------------------
+
+inline void
+eraseRead(FastqStore & store, FastqStore::Entry * entry)
+{
+    size_t s = _findSlot(store, entry->data, entry->nameLength, entry->hash);
+    store.slots[s] = FastqStore::ERASED;
+    store.liveBytes -= entry->nameLength + entry->seqLength + entry->qualLength;
+    entry->data = 0;
+    ++store.numErased;
+}
+
+// --------------------------------------------------------------------------
+// Function insertRead()
+// --------------------------------------------------------------------------
+
+// Adds a read, replacing a read of the same name in memory. Returns false if spilling to disk failed.
+inline bool
+insertRead(FastqStore & store,
+        char const * name, size_t nameLength,
+        char const * seq, size_t seqLength,
+        char const * qual, size_t qualLength,
+        uint32_t flags)
+{
+    FastqStore::Entry * existing = findRead(store, name, nameLength);
+    if (existing != 0)
+        eraseRead(store, existing);
+
+    // Keep the load factor including erased slots below one half. Rehashing drops the erased entries, the table grows
+    // only if the live reads fill more than a quarter of it, such that at least a quarter of the slots is free after
+    // a rehash.
+    if (2 * (store.entries.size() + 1) > store.slots.size())
+    {
+        size_t numSlots = store.slots.size();
+        while (4 * (numReads(store) + 1) > numSlots)
+            numSlots *= 2;
+        _rehash(store, numSlots);
+    }
+
+    size_t bytes = nameLength + seqLength + qualLength;
+    FastqStore::Entry entry;
+    entry.hash = fastqNameHash(name, nameLength);
+    entry.data = _allocate(store, bytes);
+    entry.nameLength = nameLength;
+    entry.seqLength = seqLength;
+    entry.qualLength = qualLength;
+    entry.flags = flags;
+    std::memcpy(entry.data, name, nameLength);
+    std::memcpy(entry.data + nameLength, seq, seqLength);
+    std::memcpy(entry.data + nameLength + seqLength, qual, qualLength);
+
+    store.entries.push_back(entry);
+    store.slots[_findSlot(store, name, nameLength, entry.hash)] = store.entries.size();
+    store.liveBytes += bytes;
+
+    return _fitBudget(store);
+}
+
+// ==========================================================================
+// Struct FastqStoreCursor
+// ==========================================================================
+
+// Iterates over all reads of a store, in memory and spilled, in name order.
+struct FastqStoreCursor
+{
+    std::vector<FastqStore::Entry const *> sorted;
+    size_t pos;
+
+    std::vector<std::ifstream *> runs;
+    std::vector<std::string> runHeads;      // name, sequence, and quality bytes of the next read of each run
+    std::vector<uint32_t> runLengths;       // name, sequence, and quality length and flags of the next read of each run
+
+    // The current read.
+    int source;                             // -1 for memory, otherwise the run
+    char const * name;
+    size_t nameLength;
+    char const * seq;
+    size_t seqLength;
+    char const * qual;
+    size_t qualLength;
+    uint32_t flags;
+    bool atEnd;
+
+    FastqStoreCursor() : pos(0), source(-1), atEnd(true) {}
+
+    ~FastqStoreCursor()
+    {
+        for (size_t i = 0; i < runs.size(); ++i)
+            delete runs[i];
+    }
+
+private:
+    FastqStoreCursor(FastqStoreCursor const &);
+    FastqStoreCursor & operator=(FastqStoreCursor const &);
+};
+
+// --------------------------------------------------------------------------
+// Function _readRunHead()
+// --------------------------------------------------------------------------
+
+inline void
+_readRunHead(FastqStoreCursor & cursor, size_t r)
+{
+    std::ifstream * run = cursor.runs[r];
+    if (run == 0)
+        return;
+
+    uint32_t * lengths = &cursor.runLengths[4 * r];
+    if (!run->read((char *)lengths, 4 * sizeof(uint32_t)))
+    {
+        delete run;
+        cursor.runs[r] = 0;
+        return;
+    }
+    cursor.runHeads[r].resize(lengths[0] + lengths[1] + lengths[2]);
+    if (!cursor.runHeads[r].empty())
+        run->read(&cursor.runHeads[r][0], cursor.runHeads[r].size());
+}
+
+// --------------------------------------------------------------------------
+// Function goNext()
+// --------------------------------------------------------------------------
+
+// Moves the cursor to the read with the next smallest name among memory and runs.
+inline void
+goNext(FastqStoreCursor & cursor)
+{
+    // Advance the source of the current read.
+    if (!cursor.atEnd)
+    {
+        if (cursor.source == -1)
+            ++cursor.pos;
+        else
+            _readRunHead(cursor, cursor.source);
+    }
+
+    cursor.atEnd = true;
+    if (cursor.pos < cursor.sorted.size())
+    {
+        FastqStore::Entry const & entry = *cursor.sorted[cursor.pos];
+        cursor.atEnd = false;
+        cursor.source = -1;
+        cursor.name = entry.data;
+        cursor.nameLength = entry.nameLength;
+        cursor.seq = entry.data + entry.nameLength;
+        cursor.seqLength = entry.seqLength;
+        cursor.qual = cursor.seq + entry.seqLength;
+        cursor.qualLength = entry.qualLength;
+        cursor.flags = entry.flags;
+    }
+
+    for (size_t r = 0; r < cursor.runs.size(); ++r)
+    {
+        if (cursor.runs[r] == 0)
+            continue;
+
+        char const * name = cursor.runHeads[r].data();
+        uint32_t const * lengths = &cursor.runLengths[4 * r];
+        if (!cursor.atEnd && !lessFastqName(name, lengths[0], cursor.name, cursor.nameLength))
+            continue;
+
+        cursor.atEnd = false;
+        cursor.source = r;
+        cursor.name = name;
+        cursor.nameLength = lengths[0];
+        cursor.seq = name + lengths[0];
+        cursor.seqLength = lengths[1];
+        cursor.qual = cursor.seq + lengths[1];
+        cursor.qualLength = lengths[2];
+        cursor.flags = lengths[3];
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function openCursor()
+// --------------------------------------------------------------------------
+
+// Sorts the reads in memory once and opens the run files. The store must not change while the cursor is used.
+inline bool
+openCursor(FastqStoreCursor & cursor, FastqStore const & store, bool withMemory = true)
+{
+    cursor.sorted.clear();
+    if (withMemory)
+        sortedReads(cursor.sorted, store);
+    cursor.pos = 0;
+
+    cursor.runs.resize(store.runFiles.size(), 0);
+    cursor.runHeads.resize(store.runFiles.size());
+    cursor.runLengths.resize(4 * store.runFiles.size());
+    for (size_t r = 0; r < store.runFiles.size(); ++r)
+    {
+        cursor.runs[r] = new std::ifstream(store.runFiles[r].c_str(), std::ios::binary);
+        if (!cursor.runs[r]->good())
+            return false;
+        _readRunHead(cursor, r);
+    }
+
+    cursor.atEnd = true;
+    goNext(cursor);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function _mergeRuns()
+// --------------------------------------------------------------------------
+
+// Merges all run files of a store into a single run file to limit the number of open files.
+inline void
+_mergeRuns(FastqStore & store)
+{
+    std::ostringstream fileName;
+    fileName << store.spillPrefix << ".spill.merged." << store.runFiles.size();
+
+    FastqStore::RunIndex index;
+    {
+        FastqStoreCursor cursor;
+        std::ofstream run(fileName.str().c_str(), std::ios::binary);
+        if (!run.good() || !openCursor(cursor, store, false))
+        {
+            store.failed = true;
+            return;
+        }
+
+        uint64_t offset = 0;
+        for (; !cursor.atEnd; goNext(cursor))
+            _writeRunRead(run, index, offset, cursor.name, cursor.nameLength, cursor.seqLength, cursor.qualLength,
+                          cursor.flags);
+        if (!run.good())
+            store.failed = true;
+    }
+    std::sort(index.hashes.begin(), index.hashes.end());
+
+    _closeLookup(store);
+    for (size_t i = 0; i < store.runFiles.size(); ++i)
+        std::remove(store.runFiles[i].c_str());
+    store.runFiles.clear();
+    store.runIndices.clear();
+
+    // Rename the merged run to the name of the first run so that later runs get fresh names.
+    std::ostringstream firstName;
+    firstName << store.spillPrefix << ".spill.0";
+    if (std::rename(fileName.str().c_str(), firstName.str().c_str()) != 0)
+        store.failed = true;
+    store.runFiles.push_back(firstName.str());
+    store.runIndices.push_back(std::move(index));
+}
+
+#endif  // POPINS_FASTQ_STORE_H_
@@ -1,12 +1,16 @@
 #include <sstream>
+#include <iomanip>
+#include <thread>
 #include <cerrno>
 
 #include <seqan/file.h>
 #include <seqan/sequence.h>
 
 #include "../popins_utils.h"
+#include "../popins_parallel.h"
 #include "../command_line_parsing.h"
 #include "crop_unmapped.h"
+#include "debruijn_assembly.h"
 
 #ifndef POPINS_ASSEMBLE_H_
 #define POPINS_ASSEMBLE_H_
@@ -60,8 +64,10 @@ retrieveSampleID(CharString & sampleID, CharString & mappingBam)
 // ==========================================================================
 
 inline int
-remapping(Triple<CharString> & fastqFilesTemp,
-        Triple<CharString> & fastqFiles,
+remapping(CharString const & interleavedFastq,
+        CharString const & readsFile,
+        CropReadsFormat readsFormat,
+        Triple<CharString> const & filteredFiles,
         CharString const & referenceFile,
         CharString const & workingDir,
         unsigned humanSeqs,
@@ -71,10 +77,6 @@ remapping(Triple<CharString> & fastqFilesTemp,
 {
     std::stringstream cmd;
 
-    CharString f1 = prefix;
-    f1 += "remapped.sam";
-    CharString remappedSam = getFileName(workingDir, f1);
-
     CharString f2 = prefix;
     f2 += "remapped.bam";
     CharString remappedBam = getFileName(workingDir, f2);
@@ -91,42 +93,34 @@ remapping(Triple<CharString> & fastqFilesTemp,
     msg << "Remapping unmapped reads using " << BWA;
     printStatus(msg);
 
-    // Run BWA on unmapped reads (pairs).
+    // Run BWA on unmapped reads, pairs and single end interleaved, and read its output from a pipe.
     cmd.str("");
-    cmd << BWA << " mem -t " << threads << " " << referenceFile << " " << fastqFilesTemp.i1 << " " << fastqFilesTemp.i2 << " > " << remappedSam;
-    if (system(cmd.str().c_str()) != 0)
-    {
-        std::cerr << "ERROR while running bwa on " << fastqFilesTemp.i1 << " and " << fastqFilesTemp.i2 << std::endl;
+    cmd << BWA << " mem -p -t " << threads << " " << referenceFile << " " << interleavedFastq;
+    SamPipe bwaPipe(cmd.str());
+    BamHeader header;
+    if (!openSamPipe(bwaPipe, header))
         return 1;
-    }
-
-    remove(toCString(fastqFilesTemp.i1));
-    remove(toCString(fastqFilesTemp.i2));
 
-    // Run BWA on unmapped reads (single end).
-    cmd.str("");
-    cmd << BWA << " mem -t " << threads << " " << referenceFile << " " << fastqFilesTemp.i3 << " | awk '$1 !~ /@/' >> " << remappedSam;
-    if (system(cmd.str().c_str()) != 0)
+    // Write BWA output to bam, which is sorted by samtools.
     {
-        std::cerr << "ERROR while running bwa on " << fastqFilesTemp.i3 << std::endl;
-        return 1;
-    }
-
-    remove(toCString(fastqFilesTemp.i3));
-
-    msg.str("");
-    msg << "Converting BWA output " << remappedSam << " to bam format.";
-    printStatus(msg);
+        ParallelBamFileOut outStream;
+        if (!open(outStream, remappedUnsortedBam, context(bwaPipe.samStream), threads, BGZF_INTERMEDIATE_LEVEL))
+            return 1;
+        writeHeader(outStream, header);
 
-    // Convert BWA output to bam.
-    cmd.str("");
-    cmd << SAMTOOLS << " view -S -h -b " << remappedSam << " > " << remappedUnsortedBam;
-    if (system(cmd.str().c_str()) != 0)
-    {
-        std::cerr << "ERROR while converting BWA output " << remappedSam << " to bam." << std::endl;
-        return 1;
+        BamAlignmentRecord record;
+        while (!atEnd(bwaPipe.samStream))
+        {
+            readRecord(record, bwaPipe.samStream);
+            writeRecord(outStream, record);
+        }
+        if (!close(outStream))
+            return 1;
     }
-    remove(toCString(remappedSam));
+    if (!closeSamPipe(bwaPipe))
+        return 1;
+
+    remove(toCString(interleavedFastq));
 
     msg.str("");
     msg << "Sorting " << remappedUnsortedBam << " using " << SAMTOOLS;
@@ -159,25 +153,18 @@ remapping(Triple<CharString> & fastqFilesTemp,
     printStatus(msg);
 
     // Crop unmapped and create bam file of remapping.
-    if (crop_unmapped(fastqFiles, remappedUnsortedBam, remappedBam, humanSeqs, NoAdapters()) != 0)
+    if (crop_unmapped(readsFile, readsFormat, filteredFiles, remappedUnsortedBam, remappedBam, humanSeqs, threads, 1, false, parseMemory(memory) * threads,
+            BGZF_INTERMEDIATE_LEVEL, AdapterMatcher<NoAdapters>()) != 0)
         return 1;
     remove(toCString(remappedBai));
 
-    msg.str("");
-    msg << "Sorting " << remappedUnsortedBam << " by read name using " << SAMTOOLS;
-    printStatus(msg);
-
-    // Sort <WD>/remapped.bam by read name.
-    cmd.str("");
-    cmd << SAMTOOLS << " sort -n -@ " << threads << " -m " << memory << " -o " << remappedBam << " " << remappedUnsortedBam << " ";
-    if (system(cmd.str().c_str()) != 0)
+    // The cropped records are sorted by read name, replace <WD>/remapped.bam with them.
+    if (std::rename(toCString(remappedUnsortedBam), toCString(remappedBam)) != 0)
     {
-        std::cerr << "ERROR while sorting " << remappedUnsortedBam << std::endl;
+        std::cerr << "ERROR: Could not rename " << remappedUnsortedBam << " to " << remappedBam << std::endl;
         return 1;
     }
 
-    remove(toCString(remappedUnsortedBam));
-
     return 0;
 }
 
@@ -220,27 +207,63 @@ setMates(BamAlignmentRecord & record1, BamAlignmentRecord & record2)
     record2.flag |= BAM_FLAG_MULTIPLE;
 }
 
-// ==========================================================================
+// --------------------------------------------------------------------------
+// Struct MergeInput
+// --------------------------------------------------------------------------
+
+// An input file of merge_and_set_mate() with its current record, the key of the record's read name, and the table that
+// translates its reference ids to those of the merged header.
+struct MergeInput
+{
+    BamFileIn & stream;
+    String<__int32> rIdMap;
+    BamAlignmentRecord record;
+    std::string key;
+    bool atEnd;
+
+    MergeInput(BamFileIn & s) :
+        stream(s), atEnd(false)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Function setRIdMap()
+// --------------------------------------------------------------------------
 
-// Correct the reference ids of a BamAlignmentRecord for the concatenated header.
 template<typename TNameStore>
 inline void
-readRecordAndCorrectRIds(BamAlignmentRecord & record,
-        BamFileIn & stream,
-        NameStoreCache<TNameStore> & nameStoreCache)
+setRIdMap(MergeInput & input, NameStoreCache<TNameStore> & nameStoreCache)
 {
-    readRecord(record, stream);
+    resize(input.rIdMap, length(contigNames(context(input.stream))));
+    for (unsigned i = 0; i < length(input.rIdMap); ++i)
+        getIdByName(input.rIdMap[i], nameStoreCache, contigNames(context(input.stream))[i]);
+}
 
-    if (record.rID != BamAlignmentRecord::INVALID_REFID)
+// --------------------------------------------------------------------------
+// Function readNextRecord()
+// --------------------------------------------------------------------------
+
+// Reads the next record into the input's record, corrects its reference ids for the merged header, and computes the
+// key of its read name.
+inline void
+readNextRecord(MergeInput & input)
+{
+    if (atEnd(input.stream))
     {
-        CharString rName = contigNames(context(stream))[record.rID];
-        getIdByName(record.rID, nameStoreCache, rName);
+        input.atEnd = true;
+        return;
     }
+
+    BamAlignmentRecord & record = input.record;
+    readRecord(record, input.stream);
+
+    if (record.rID != BamAlignmentRecord::INVALID_REFID)
+        record.rID = input.rIdMap[record.rID];
     if (record.rNextId != BamAlignmentRecord::INVALID_REFID)
-    {
-        CharString rNextName = contigNames(context(stream))[record.rNextId];
-        getIdByName(record.rNextId, nameStoreCache, rNextName);
-    }
+        record.rNextId = input.rIdMap[record.rNextId];
+
+    input.key.clear();
+    appendReadNameKey(input.key, begin(record.qName, Standard()), length(record.qName));
 }
 
 // ==========================================================================
@@ -287,42 +310,17 @@ mergeHeaders(BamHeader & header,
     }
 }
 
-// ==========================================================================
-
-// This function is adapted from samtools code (fuction strnum_cmp in bam_sort.c) to ensure the exact same sort order.
-int
-compare_qName(CharString & nameA, CharString & nameB)
-{
-    const char * _a = toCString(nameA);
-    const char * _b = toCString(nameB);
-    const unsigned char *a = (const unsigned char*)_a, *b = (const unsigned char*)_b;
-    const unsigned char *pa = a, *pb = b;
-    while (*pa && *pb) {
-        if (isdigit(*pa) && isdigit(*pb)) {
-            while (*pa == '0') ++pa;
-            while (*pb == '0') ++pb;
-            while (isdigit(*pa) && isdigit(*pb) && *pa == *pb) ++pa, ++pb;
-            if (isdigit(*pa) && isdigit(*pb)) {
-                int i = 0;
-                while (isdigit(pa[i]) && isdigit(pb[i])) ++i;
-                return isdigit(pa[i])? 1 : isdigit(pb[i])? -1 : (int)*pa - (int)*pb;
-            } else if (isdigit(*pa)) return 1;
-            else if (isdigit(*pb)) return -1;
-            else if (pa - a != pb - b) return pa - a < pb - b? 1 : -1;
-        } else {
-            if (*pa != *pb) return (int)*pa - (int)*pb;
-            ++pa; ++pb;
-        }
-    }
-    return *pa? 1 : *pb? -1 : 0;
-}
-
 // ==========================================================================
 // Function merge_and_set_mate()
 // ==========================================================================
 
 bool
-merge_and_set_mate(CharString & mergedBam, unsigned & nonContigSeqs, CharString & nonRefBam, CharString & remappedBam)
+merge_and_set_mate(CharString & mergedBam,
+        unsigned & nonContigSeqs,
+        CharString & nonRefBam,
+        CharString & remappedBam,
+        unsigned threads,
+        int compressionLevel)
 {
     std::ostringstream msg;
     msg << "Merging bam files " << nonRefBam << " and " << remappedBam;
@@ -343,101 +341,104 @@ merge_and_set_mate(CharString & mergedBam, unsigned & nonContigSeqs, CharString
 
     // Open the output stream and write the header.
     FormattedFileContext<BamFileOut, Dependent<> >::Type bamContextDep(bamContext);
-    BamFileOut outStream(bamContextDep, toCString(mergedBam));
+    ParallelBamFileOut outStream;
+    if (!open(outStream, mergedBam, bamContextDep, threads, compressionLevel))
+        return 1;
     writeHeader(outStream, outHeader);
 
     nonContigSeqs = length(contigNames(context(nonRefStream)));
 
     printStatus(" - merging read records...");
 
-    // Read the first record from each input file. Correct ids in records from remappedStreams for new header.
-    BamAlignmentRecord record1, record2;
-    if (!atEnd(nonRefStream)) readRecordAndCorrectRIds(record1, nonRefStream, contigNamesCache(bamContextDep));
-    else record1.qName = "*";
-    if (!atEnd(remappedStream)) readRecordAndCorrectRIds(record2, remappedStream, contigNamesCache(bamContextDep));
-    else record2.qName = "*";
+    // Read the first record from each input file. Correct ids in records from both streams for the new header.
+    MergeInput input1(nonRefStream), input2(remappedStream);
+    setRIdMap(input1, contigNamesCache(bamContextDep));
+    setRIdMap(input2, contigNamesCache(bamContextDep));
+    readNextRecord(input1);
+    readNextRecord(input2);
 
     // Iterate both input files, set mate positions in pairs, and write all records to the output file.
-    while (record1.qName != "*" || record2.qName != "*")
+    while (!input1.atEnd || !input2.atEnd)
     {
-        while ((compare_qName(record2.qName, record1.qName) < 0 || record1.qName == "*") && record2.qName != "*")
+        while (!input2.atEnd && (input1.atEnd || input2.key < input1.key))
         {
-            writeRecord(outStream, record2);
-            if (!atEnd(remappedStream)) readRecordAndCorrectRIds(record2, remappedStream, contigNamesCache(bamContextDep));
-            else record2.qName = "*";
+            writeRecord(outStream, input2.record);
+            readNextRecord(input2);
         }
 
         bool incr1 = false;
-        while (record1.qName == record2.qName && record2.qName != "*")
+        while (!input1.atEnd && !input2.atEnd && input1.key == input2.key)
         {
             incr1 = true;
-            setMates(record1, record2);
-            writeRecord(outStream, record1);
-            writeRecord(outStream, record2);
-            if (!atEnd(remappedStream)) readRecordAndCorrectRIds(record2, remappedStream, contigNamesCache(bamContextDep));
-            else record2.qName = "*";
+            setMates(input1.record, input2.record);
+            writeRecord(outStream, input1.record);
+            writeRecord(outStream, input2.record);
+            readNextRecord(input2);
         }
         if (incr1)
-        {
-            if (!atEnd(nonRefStream)) readRecordAndCorrectRIds(record1, nonRefStream, contigNamesCache(bamContextDep));
-            else record1.qName = "*";
-        }
+            readNextRecord(input1);
 
-        while ((compare_qName(record1.qName, record2.qName) < 0 || record2.qName == "*") && record1.qName != "*")
+        while (!input1.atEnd && (input2.atEnd || input1.key < input2.key))
         {
-            writeRecord(outStream, record1);
-            if (!atEnd(nonRefStream)) readRecordAndCorrectRIds(record1, nonRefStream, contigNamesCache(bamContextDep));
-            else record1.qName = "*";
+            writeRecord(outStream, input1.record);
+            readNextRecord(input1);
         }
     }
 
+    if (!close(outStream))
+        return 1;
+
     return 0;
 }
 
 // ==========================================================================
-// Function sickle_filtering()
+// Function quality_filtering()
 // ==========================================================================
 
+// Filters the reads in the read store of a previous cropping step. Cropping writes the filtered files directly otherwise.
 inline bool
-sickle_filtering(Triple<CharString> & filteredFiles,
-        Triple<CharString> & fastqFiles,
-        CharString & workingDirectory)
+quality_filtering(Triple<CharString> & filteredFiles,
+        CharString const & readsFile)
 {
-    std::stringstream cmd;
-
     std::ostringstream msg;
-    msg << "Filtering fastq files using " << SICKLE ;
+    msg << "Filtering reads in " << readsFile;
     printStatus(msg);
 
-    cmd.str("");
-    cmd << SICKLE << " pe -q 20 -l 60 -x -n -t sanger -f" << fastqFiles.i1 << " -r " << fastqFiles.i2;
-    cmd << " -o " << filteredFiles.i1 << " -p " << filteredFiles.i2 << " -s " << filteredFiles.i3;
-    if (system(cmd.str().c_str()) != 0) // runs sickle on paired end reads
+    ReadStoreReader store;
+    if (!open(store, toCString(readsFile)))
     {
-        std::cerr << "ERROR while filtering " << fastqFiles.i1 << " and " << fastqFiles.i2;
-        std::cerr << " using " << SICKLE << std::endl;
+        std::cerr << "ERROR: Could not open read store " << readsFile << " for reading." << std::endl;
         return 1;
     }
 
-    CharString singleFiltered2 = getFileName(workingDirectory, "filtered.single2.fastq");
+    CropFastqOut fastqOut;
+    if (!openFiltered(fastqOut, filteredFiles))
+        return 1;
 
-    cmd.str("");
-    cmd << SICKLE << " se -q 20 -l 60 -x -n -t sanger -f " << fastqFiles.i3 << " -o " << singleFiltered2;
-    if (system(cmd.str().c_str()) != 0) // runs sickle on single end reads
+    CharString name, seq, qual, mateSeq, mateQual;
+    while (readRecord(store))
     {
-        std::cerr << "ERROR while filtering " << fastqFiles.i3 << " using " << SICKLE << std::endl;
-        return 1;
+        assignBytes(name, store.name.data(), store.name.size());
+        assignBytes(seq, store.seq[0].data(), store.seq[0].size());
+        assignBytes(qual, store.qual[0].data(), store.qual[0].size());
+        if (store.paired)
+        {
+            assignBytes(mateSeq, store.seq[1].data(), store.seq[1].size());
+            assignBytes(mateQual, store.qual[1].data(), store.qual[1].size());
+            writeFilteredPair(fastqOut, name, seq, qual, mateSeq, mateQual);
+        }
+        else
+        {
+            writeFilteredSingle(fastqOut, name, seq, qual);
+        }
     }
-
-    cmd.str("");
-    cmd << "cat " << singleFiltered2 << " >> " << filteredFiles.i3;
-    if (system(cmd.str().c_str()) != 0) // merges the fastq files of single end reads.
+    if (store.offset != store.dataEnd)
     {
-        std::cerr << "ERROR while concatenating " << singleFiltered2 << " to " << filteredFiles.i3 << std::endl;
+        std::cerr << "ERROR: Could not read record " << store.recordNumber << " of read store " << readsFile << std::endl;
         return 1;
     }
 
-    remove(toCString(singleFiltered2));
+    printFilteringStatus(fastqOut, filteredFiles);
 
     return 0;
 }
@@ -491,6 +492,275 @@ velvet_assembly(Triple<CharString> & filteredFiles, Triple<CharString> & filtere
     return 0;
 }
 
+// ==========================================================================
+// Function loadAssemblyReads()
+// ==========================================================================
+
+// Appends the reads of a fastq file, or of two fastq files of read pairs, to the reads for the built-in assembler.
+inline bool
+loadAssemblyReads(AssemblyReads & reads, CharString const & firstFile, CharString const & secondFile)
+{
+    SeqFileIn firstStream, secondStream;
+    if (!open(firstStream, toCString(firstFile)) || (secondFile != "" && !open(secondStream, toCString(secondFile))))
+    {
+        std::cerr << "ERROR: Could not open fastq file " << firstFile;
+        if (secondFile != "")
+            std::cerr << " or " << secondFile;
+        std::cerr << " for reading." << std::endl;
+        return 1;
+    }
+
+    CharString name, seq, mateSeq;
+    try
+    {
+        while (!atEnd(firstStream))
+        {
+            readRecord(name, seq, firstStream);
+            if (secondFile == "")
+            {
+                appendRead(reads, begin(seq, Standard()), length(seq));
+                continue;
+            }
+
+            if (atEnd(secondStream))
+            {
+                std::cerr << "ERROR: Different numbers of reads in " << firstFile << " and " << secondFile << std::endl;
+                return 1;
+            }
+            readRecord(name, mateSeq, secondStream);
+            appendPair(reads, begin(seq, Standard()), length(seq), begin(mateSeq, Standard()), length(mateSeq));
+        }
+    }
+    catch (std::exception const & e)
+    {
+        std::cerr << "ERROR while reading " << firstFile << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// ==========================================================================
+// Function builtin_assembly()
+// ==========================================================================
+
+// Assembles the filtered reads in memory and writes the contigs in velvet's format. Matepair reads only contribute
+// their k-mers, they are not used to extend contigs.
+inline bool
+builtin_assembly(Triple<CharString> & filteredFiles,
+        Triple<CharString> & filteredMPFiles,
+        CharString & contigFile,
+        unsigned kmerLength,
+        unsigned threads,
+        bool matepair)
+{
+    std::ostringstream msg;
+    msg << "Loading filtered fastq files for the built-in assembler.";
+    printStatus(msg);
+
+    // Pairs have to come first.
+    AssemblyReads reads;
+    if (loadAssemblyReads(reads, filteredFiles.i1, filteredFiles.i2) != 0 ||
+            loadAssemblyReads(reads, filteredFiles.i3, "") != 0)
+        return 1;
+    if (matepair && (loadAssemblyReads(reads, filteredMPFiles.i1, "") != 0 ||
+            loadAssemblyReads(reads, filteredMPFiles.i2, "") != 0 ||
+            loadAssemblyReads(reads, filteredMPFiles.i3, "") != 0))
+        return 1;
+
+    unsigned k = assemblyKmerLength(kmerLength);
+    msg.str("");
+    msg << "Assembling " << numReads(reads) << " reads (" << reads.numPaired << " pairs) with k=" << k;
+    msg << " using " << threads << " threads.";
+    printStatus(msg);
+
+    DeBruijnOptions options;
+    options.k = k;
+    options.threads = threads;
+
+    std::vector<AssembledContig> contigs;
+    DeBruijnStats stats;
+    assembleDeBruijn(contigs, stats, reads, options);
+
+    msg.str("");
+    msg << "Graph of " << stats.distinctKmers << " k-mers and " << stats.unitigs << " unitigs, removed ";
+    msg << stats.lowCoverageUnitigs << " low and " << stats.highCoverageUnitigs << " high coverage unitigs and ";
+    msg << stats.tips << " tips, " << stats.pairLinks << " unitig pairs linked by reads.";
+    printStatus(msg);
+
+    std::ofstream stream(toCString(contigFile));
+    if (!stream.is_open())
+    {
+        std::cerr << "ERROR: Could not open " << contigFile << " for writing." << std::endl;
+        return 1;
+    }
+
+    for (size_t i = 0; i < contigs.size(); ++i)
+    {
+        // Velvet's contig names give the length in k-mers.
+        stream << ">NODE_" << (i + 1) << "_length_" << (contigs[i].seq.size() - k + 1);
+        stream << "_cov_" << std::fixed << std::setprecision(6) << contigs[i].cov << "\n";
+        for (size_t pos = 0; pos < contigs[i].seq.size(); pos += 60)
+            stream << contigs[i].seq.substr(pos, 60) << "\n";
+    }
+    stream.close();
+
+    msg.str("");
+    msg << contigs.size() << " contigs written to " << contigFile;
+    printStatus(msg);
+
+    return 0;
+}
+
+// ==========================================================================
+// Function getFastqFileNames()
+// ==========================================================================
+
+// Names of the fastq files of first reads, second reads, and single reads in the working directory.
+inline Triple<CharString>
+getFastqFileNames(CharString const & workingDirectory, CharString const & prefix)
+{
+    CharString first = prefix, second = prefix, single = prefix;
+    first += "paired.1.fastq";
+    second += "paired.2.fastq";
+    single += "single.fastq";
+    return Triple<CharString>(getFileName(workingDirectory, first),
+                              getFileName(workingDirectory, second),
+                              getFileName(workingDirectory, single));
+}
+
+// ==========================================================================
+// Function export_fastq()
+// ==========================================================================
+
+// Exports the reads of a read store to fastq files of first reads, second reads, and single reads. Returns 1 on error.
+inline bool
+export_fastq(Triple<CharString> const & fastqFiles, CharString const & readsFile)
+{
+    if (!exportFastq(toCString(readsFile), toCString(fastqFiles.i1), toCString(fastqFiles.i2), toCString(fastqFiles.i3)))
+        return 1;
+
+    std::ostringstream msg;
+    msg << "Reads in " << readsFile << " exported to " << fastqFiles.i1 << ", " << fastqFiles.i2 << ", " << fastqFiles.i3;
+    printStatus(msg);
+    return 0;
+}
+
+// ==========================================================================
+// Function crop_and_remap()
+// ==========================================================================
+
+// Crops the reads without high-quality alignment from the bam files of a sample, remaps them if a reference is given, and writes the
+// quality filtered reads for the assembly. All files are named with the prefix, e.g. "MP." for mate pairs. Temporary
+// files and the filtered reads are written to the scratch directory, non_ref.bam and the read store are moved from there
+// to the working directory when complete. Cropping is skipped if the read store exists from a previous run. The reads
+// in the read store are exported to fastq files if requested. The average coverage is counted while cropping only if
+// countCoverage is set. Returns 1 on error.
+inline bool
+crop_and_remap(double & avgCov,
+        bool countCoverage,
+        bool & cropped,
+        String<CharString> const & mappingFiles,
+        CharString const & workingDirectory,
+        CharString const & scratchDirectory,
+        CharString prefix,
+        AssemblyOptions const & options,
+        unsigned threads)
+{
+    std::ostringstream msg;
+    cropped = false;
+
+    CharString f1 = prefix, f2 = prefix, f3 = prefix, f5 = prefix;
+    f1 += "non_ref_tmp.bam";
+    f2 += "non_ref.bam";
+    f3 += "remapping.fastq";
+    f5 += "unmapped_reads.bin";
+    CharString nonRefBamTemp = getFileName(scratchDirectory, f1);
+    CharString nonRefBam = getFileName(workingDirectory, f2);
+    CharString nonRefBamScratch = getFileName(scratchDirectory, f2);
+    CharString remappingFastq = getFileName(scratchDirectory, f3);
+    CharString readsFile = getFileName(workingDirectory, f5);
+    CharString readsFileScratch = getFileName(scratchDirectory, f5);
+
+    CharString filteredPrefix = prefix;
+    filteredPrefix += "filtered.";
+    Triple<CharString> fastqFiles = getFastqFileNames(workingDirectory, prefix);
+    Triple<CharString> filteredFiles = getFastqFileNames(scratchDirectory, filteredPrefix);
+    CropReadsFormat readsFormat = options.binQualities ? CROP_READ_STORE_BINNED : CROP_READ_STORE;
+
+    // check if files already exits
+    if (exists(readsFile))
+    {
+        msg << "Found " << readsFile << ", skipping cropping step.";
+        printStatus(msg);
+
+        // Quality filtering/trimming of reads cropped previously.
+        if (quality_filtering(filteredFiles, readsFile) != 0)
+            return 1;
+        return options.exportFastq && export_fastq(fastqFiles, readsFile) != 0;
+    }
+
+    // The last cropping step writes the quality filtered reads for the assembly. With remapping, the first cropping step
+    // writes the reads interleaved into a single fastq file for bwa.
+    Triple<CharString> cropFilteredFiles = options.referenceFile == "" ? filteredFiles : Triple<CharString>();
+    CharString cropReadsFile = options.referenceFile == "" ? readsFileScratch : remappingFastq;
+    CropReadsFormat cropReadsFormat = options.referenceFile == "" ? readsFormat : CROP_INTERLEAVED_FASTQ;
+
+    // The mapped mates are written sorted by read name, to a temporary file if they are merged with remapped reads.
+    CharString matesBam = options.referenceFile == "" ? nonRefBamScratch : nonRefBamTemp;
+    int matesLevel = options.referenceFile == "" ? options.compressionLevel : BGZF_INTERMEDIATE_LEVEL;
+    size_t memory = parseMemory(options.memory) * threads;
+
+    msg << "Cropping unmapped reads from " << mappingFiles[0];
+    if (length(mappingFiles) > 1)
+        msg << " and " << (length(mappingFiles) - 1) << " more BAM files";
+    printStatus(msg);
+
+    // Crop unmapped reads and reads with unreliable mappings from the input bam file.
+    if (options.adapters == "HiSeqX")
+    {
+        if (crop_unmapped(avgCov, countCoverage, cropReadsFile, cropReadsFormat, cropFilteredFiles, matesBam, mappingFiles, options.humanSeqs, threads, options.shards, options.singlePass, memory, matesLevel, AdapterMatcher<HiSeqXAdapters>(options.adapterErrors)) != 0)
+            return 1;
+    }
+    else if (options.adapters == "HiSeq")
+    {
+        if (crop_unmapped(avgCov, countCoverage, cropReadsFile, cropReadsFormat, cropFilteredFiles, matesBam, mappingFiles, options.humanSeqs, threads, options.shards, options.singlePass, memory, matesLevel, AdapterMatcher<HiSeqAdapters>(options.adapterErrors)) != 0)
+            return 1;
+    }
+    else
+    {
+        if (crop_unmapped(avgCov, countCoverage, cropReadsFile, cropReadsFormat, cropFilteredFiles, matesBam, mappingFiles, options.humanSeqs, threads, options.shards, options.singlePass, memory, matesLevel, AdapterMatcher<NoAdapters>(options.adapterErrors)) != 0)
+            return 1;
+    }
+    cropped = true;
+
+    // Remapping of unmapped with bwa if a fasta reference is given.
+    if (options.referenceFile != "")
+    {
+        // Align with bwa, write the read store of unaligned reads, and sort remaining bam records by read name.
+        CharString f4 = prefix;
+        f4 += "remapped.bam";
+        CharString remappedBam = getFileName(scratchDirectory, f4);
+        CharString sortMemory = options.memory;
+        if (remapping(remappingFastq, readsFileScratch, readsFormat, filteredFiles, options.referenceFile, scratchDirectory,
+                options.humanSeqs, threads, sortMemory, prefix) != 0)
+            return 1;
+
+        // Set the mate's location and merge non_ref.bam and remapped.bam into a single file.
+        unsigned nonContigSeqs;
+        if (merge_and_set_mate(nonRefBamScratch, nonContigSeqs, nonRefBamTemp, remappedBam, threads, options.compressionLevel) != 0)
+            return 1;
+        remove(toCString(remappedBam));
+        remove(toCString(nonRefBamTemp));
+    }
+
+    // Move the read store last, its existence marks a completed cropping step.
+    if (!moveFile(nonRefBamScratch, nonRefBam) || !moveFile(readsFileScratch, readsFile))
+        return 1;
+
+    return options.exportFastq && export_fastq(fastqFiles, readsFile) != 0;
+}
+
 // ==========================================================================
 // Function popins_assemble()
 // ==========================================================================
@@ -518,215 +788,137 @@ int popins_assemble(int argc, char const ** argv)
         printStatus(msg);
     }
 
-    SampleInfo info = initSampleInfo(options.mappingFile, options.sampleID, options.adapters);
-
-    CharString matesBam = getFileName(workingDirectory, "mates.bam");
-    CharString nonRefBamTemp = getFileName(workingDirectory, "non_ref_tmp.bam");
-    CharString nonRefBam = getFileName(workingDirectory, "non_ref.bam");
-
-    CharString fastqFirst = getFileName(workingDirectory, "paired.1.fastq");
-    CharString fastqSecond = getFileName(workingDirectory, "paired.2.fastq");
-    CharString fastqSingle = getFileName(workingDirectory, "single.fastq");
-    Triple<CharString> fastqFiles = Triple<CharString>(fastqFirst, fastqSecond, fastqSingle);
-
-    // check if files already exits
-    std::fstream stream(toCString(fastqFirst));
-    if (!stream.is_open())
+    // Temporary files go to a scratch directory in the temporary directory if given, otherwise to the working directory.
+    ScratchDirectory scratch;
+    scratch.path = workingDirectory;
+    if (options.tmpDir != "")
     {
-        msg.str("");
-        msg << "Cropping unmapped reads from " << options.mappingFile;
-        printStatus(msg);
-
-        // Crop unmapped reads and reads with unreliable mappings from the input bam file.
-        if (options.adapters == "HiSeqX")
-        {
-            if (crop_unmapped(info.avg_cov, fastqFiles, matesBam, options.mappingFile, options.humanSeqs, HiSeqXAdapters()) != 0)
-                return 7;
-        }
-        else if (options.adapters == "HiSeq")
-        {
-            if (crop_unmapped(info.avg_cov, fastqFiles, matesBam, options.mappingFile, options.humanSeqs, HiSeqAdapters()) != 0)
-                return 7;
-        }
-        else
-        {
-            if (crop_unmapped(info.avg_cov, fastqFiles, matesBam, options.mappingFile, options.humanSeqs, NoAdapters()) != 0)
-                return 7;
-        }
-
-        CharString sampleInfoFile = getFileName(workingDirectory, "POPINS_SAMPLE_INFO");
-        writeSampleInfo(info, sampleInfoFile);
-
-        msg.str("");
-        msg << "Sample info written to \'" << sampleInfoFile << "\'.";
-        printStatus(msg);
+        if (!createScratchDirectory(scratch, options.tmpDir, options.sampleID))
+            return 7;
 
         msg.str("");
-        msg << "Sorting " << matesBam << " using " << SAMTOOLS;
+        msg << "Temporary files are written to " << scratch.path;
         printStatus(msg);
-
-        // Sort <WD>/mates.bam by read name.
-        std::stringstream cmd;
-        if (options.referenceFile != "")
-            cmd << SAMTOOLS << " sort -n -@ " << options.threads << " -m " << options.memory << " -o " << nonRefBamTemp << " " << matesBam;
-        else
-            cmd << SAMTOOLS << " sort -n -@ " << options.threads << " -m " << options.memory << " -o " << nonRefBam << " " << matesBam;
-        if (system(cmd.str().c_str()) != 0)
-        {
-            std::cerr << "ERROR while sorting " << matesBam << std::endl;
-            return 7;
-        }
-
-        remove(toCString(matesBam));
-
-        // Remapping of unmapped with bwa if a fasta reference is given.
-        if (options.referenceFile != "")
-        {
-            Triple<CharString> fastqFilesTemp = fastqFiles;
-            fastqFiles = Triple<CharString>(fastqFirst, fastqSecond, fastqSingle);
-
-            // Align with bwa, update fastq files of unaligned reads, and sort remaining bam records by read name.
-            CharString remappedBam = getFileName(workingDirectory, "remapped.bam");
-            CharString prefix = "";
-            if (remapping(fastqFilesTemp, fastqFiles, options.referenceFile, workingDirectory,
-                    options.humanSeqs, options.threads, options.memory, prefix) != 0)
-                return 7;
-
-            // Set the mate's location and merge non_ref.bam and remapped.bam into a single file.
-            unsigned nonContigSeqs;
-            if (merge_and_set_mate(nonRefBam, nonContigSeqs, nonRefBamTemp, remappedBam) != 0) return 7;
-            remove(toCString(remappedBam));
-            remove(toCString(nonRefBamTemp));
-        }
     }
-    else
+    CharString scratchDirectory = scratch.path;
+
+    // The read length and insert sizes are sampled from the first BAM file, all BAM files are listed in the sample info.
+    SampleInfo info = initSampleInfo(options.mappingFile, options.sampleID, options.adapters);
+    for (unsigned i = 1; i < length(options.mappingFiles); ++i)
     {
-        printStatus("Found files, skipping cropping step.");
+        info.bam_file += ",";
+        info.bam_file += options.mappingFiles[i];
     }
 
-    CharString firstFiltered = getFileName(workingDirectory, "filtered.paired.1.fastq");
-    CharString secondFiltered = getFileName(workingDirectory, "filtered.paired.2.fastq");
-    CharString singleFiltered = getFileName(workingDirectory, "filtered.single.fastq");
-    Triple<CharString> filteredFiles(firstFiltered, secondFiltered, singleFiltered);
-
-    // Quality filtering/trimming with sickle.
-    if (sickle_filtering(filteredFiles, fastqFiles, workingDirectory) != 0)
-        return 7;
-
-    // MP handling
-    CharString matesMPBam = getFileName(workingDirectory, "MP.mates.bam");
-    CharString nonRefBamMPTemp = getFileName(workingDirectory, "MP.non_ref_tmp.bam");
-    CharString nonRefMPBam = getFileName(workingDirectory, "MP.non_ref.bam");
+    Triple<CharString> filteredFiles = getFastqFileNames(scratchDirectory, "filtered.");
+    Triple<CharString> filteredMPFiles = getFastqFileNames(scratchDirectory, "MP.filtered.");
+    bool matepair = options.matepairFile != "";
 
-    CharString fastqMPFirst = getFileName(workingDirectory, "MP.paired.1.fastq");
-    CharString fastqMPSecond = getFileName(workingDirectory, "MP.paired.2.fastq");
-    CharString fastqMPSingle = getFileName(workingDirectory, "MP.single.fastq");
-    Triple<CharString> fastqMPFiles = Triple<CharString>(fastqMPFirst, fastqMPSecond, fastqMPSingle);
+    // Split the threads between the chains of paired-end and mate-pair reads, by the sizes of their input files.
+    unsigned threads = options.threads, mpThreads = 0;
+    if (matepair && options.threads > 1)
+    {
+        struct stat peStat, mpStat;
+        double share = 0.5;
+        off_t peSize = 0;
+        for (unsigned i = 0; i < length(options.mappingFiles); ++i)
+            if (options.mappingFiles[i] != "-" && stat(toCString(options.mappingFiles[i]), &peStat) == 0)
+                peSize += peStat.st_size;
+        if (peSize > 0 && stat(toCString(options.matepairFile), &mpStat) == 0)
+            share = (double)mpStat.st_size / (peSize + mpStat.st_size);
+        mpThreads = std::min(std::max((unsigned)(share * options.threads + 0.5), 1u), options.threads - 1);
+        threads = options.threads - mpThreads;
+    }
 
-    if (options.matepairFile != "")
+    // Crop, remap, and filter the mate-pair reads concurrently to the paired-end reads if there are threads for both.
+    bool mpFailed = false, mpCropped = false;
+    String<CharString> matepairFiles;
+    appendValue(matepairFiles, options.matepairFile);
+    std::thread mpThread;
+    ScopeGuard joinMpThread([&]()
     {
-        // check if MP files already exits
-        std::fstream MPstream(toCString(fastqMPFirst));
-        if (!MPstream.is_open())
-        {
-            msg.str("");
-            msg << "Cropping unmapped matepair reads from " << options.matepairFile;
-            printStatus(msg);
+        if (mpThread.joinable())
+            mpThread.join();
+    });
+    if (matepair && mpThreads > 0)
+    {
+        msg.str("");
+        msg << "Processing " << options.mappingFile << " with " << threads << " and " << options.matepairFile;
+        msg << " with " << mpThreads << " threads concurrently.";
+        printStatus(msg);
 
-            // Crop unmapped reads and reads with unreliable mappings from the input bam file.
-            if (options.adapters == "HiSeqX")
-            {
-                if (crop_unmapped(fastqMPFiles, matesMPBam, options.matepairFile, options.humanSeqs, HiSeqXAdapters()) != 0)
-                    return 7;
-            }
-            else if (options.adapters == "HiSeq")
-            {
-                if (crop_unmapped(fastqMPFiles, matesMPBam, options.matepairFile, options.humanSeqs, HiSeqAdapters()) != 0)
-                    return 7;
-            }
-            else
+        mpThread = std::thread([&]()
+        {
+            try
             {
-                if (crop_unmapped(fastqMPFiles, matesMPBam, options.matepairFile, options.humanSeqs, NoAdapters()) != 0)
-                    return 7;
+                double mpCov;
+                mpFailed = crop_and_remap(mpCov, false, mpCropped, matepairFiles, workingDirectory, scratchDirectory, "MP.", options, mpThreads);
             }
-
-            msg.str("");
-            msg << "Sorting " << matesMPBam << " using " << SAMTOOLS;
-            printStatus(msg);
-
-            // Sort <WD>/mates.bam by read name.
-            std::stringstream cmd;
-            if (options.referenceFile != "")
-                cmd << SAMTOOLS << " sort -n -@ " << options.threads << " -m " << options.memory << " -o " << nonRefBamMPTemp << " " << matesMPBam;
-            else
-                cmd << SAMTOOLS << " sort -n -@ " << options.threads << " -m " << options.memory << " -o " << nonRefMPBam << " " << matesMPBam;
-            if (system(cmd.str().c_str()) != 0)
+            catch (std::exception const & e)
             {
-                std::cerr << "ERROR while sorting " << matesMPBam << std::endl;
-                return 7;
+                std::cerr << "ERROR while processing " << options.matepairFile << ": " << e.what() << std::endl;
+                mpFailed = true;
             }
+        });
+    }
 
-            remove(toCString(matesMPBam));
+    // The average coverage is counted while cropping unless estimated from the bam index of a single bam file.
+    bool countCoverage = !options.fastStats || info.avg_cov == 0 || length(options.mappingFiles) > 1;
+    bool cropped = false;
+    double cropCov = 0;
+    bool failed = crop_and_remap(cropCov, countCoverage, cropped, options.mappingFiles, workingDirectory, scratchDirectory, "", options, threads);
 
-            // Remapping of unmapped with bwa if a fasta reference is given.
-            if (options.referenceFile != "")
-            {
-                Triple<CharString> fastqMPFilesTemp = fastqMPFiles;
-                fastqMPFiles = Triple<CharString>(fastqMPFirst, fastqMPSecond, fastqMPSingle);
-
-                // Align with bwa, update fastq files of unaligned reads, and sort remaining bam records by read name.
-                CharString remappedMPBam = getFileName(workingDirectory, "MP.remapped.bam");
-                CharString prefix = "MP.";
-                if (remapping(fastqMPFilesTemp, fastqMPFiles, options.referenceFile, workingDirectory,
-                        options.humanSeqs, options.threads, options.memory, prefix) != 0)
-                    return 7;
-
-                // Set the mate's location and merge non_ref.bam and remapped.bam into a single file
-                unsigned nonContigSeqs;
-                if (merge_and_set_mate(nonRefMPBam, nonContigSeqs, nonRefBamMPTemp, remappedMPBam) != 0)
-                    return 7;
-                remove(toCString(remappedMPBam));
-                remove(toCString(nonRefBamMPTemp));
-            }
-        }
-        else
-        {
-            printStatus("Found matepair files, skipping cropping step");
-        }
+    if (mpThread.joinable())
+        mpThread.join();
+    else if (matepair && !failed)
+    {
+        double mpCov;
+        mpFailed = crop_and_remap(mpCov, false, mpCropped, matepairFiles, workingDirectory, scratchDirectory, "MP.", options, threads);
     }
 
+    if (failed || mpFailed)
+        return 7;
 
-    CharString firstMPFiltered = getFileName(workingDirectory, "MP.filtered.paired.1.fastq");
-    CharString secondMPFiltered = getFileName(workingDirectory, "MP.filtered.paired.2.fastq");
-    CharString singleMPFiltered = getFileName(workingDirectory, "MP.filtered.single.fastq");
+    if (cropped)
+    {
+        if (countCoverage)
+            info.avg_cov = cropCov;
 
-    Triple<CharString> filteredMPFiles(firstMPFiltered, secondMPFiltered, singleMPFiltered);
+        CharString sampleInfoFile = getFileName(workingDirectory, "POPINS_SAMPLE_INFO");
+        writeSampleInfo(info, sampleInfoFile);
 
-    if (options.matepairFile != "")
+        msg.str("");
+        msg << "Sample info written to \'" << sampleInfoFile << "\'.";
+        printStatus(msg);
+    }
+
+    // Assembly with velvet or the built-in assembler.
+    CharString assemblyDirectory = getFileName(scratchDirectory, "assembly");
+    CharString contigFile = getFileName(workingDirectory, "contigs.fa");
+    if (options.assembler == "builtin")
     {
-        if (sickle_filtering(filteredMPFiles,fastqMPFiles, workingDirectory) != 0)
+        if (builtin_assembly(filteredFiles, filteredMPFiles, contigFile, options.kmerLength, options.threads, matepair) != 0)
             return 7;
     }
-
-    // Assembly with velvet.
-    CharString assemblyDirectory = getFileName(workingDirectory, "assembly");
-    if (velvet_assembly(filteredFiles, filteredMPFiles, assemblyDirectory, options.kmerLength, options.matepairFile != "") != 0)
+    else if (velvet_assembly(filteredFiles, filteredMPFiles, assemblyDirectory, options.kmerLength, matepair) != 0)
         return 7;
 
-    remove(toCString(firstFiltered));
-    remove(toCString(secondFiltered));
-    remove(toCString(singleFiltered));
+    remove(toCString(filteredFiles.i1));
+    remove(toCString(filteredFiles.i2));
+    remove(toCString(filteredFiles.i3));
 
-    if (options.matepairFile == "")
+    if (!matepair)
     {
-        remove(toCString(firstMPFiltered));
-        remove(toCString(secondMPFiltered));
-        remove(toCString(singleMPFiltered));
+        remove(toCString(filteredMPFiles.i1));
+        remove(toCString(filteredMPFiles.i2));
+        remove(toCString(filteredMPFiles.i3));
     }
 
+    if (options.assembler == "builtin")
+        return res;
+
     // Copy contigs file to workingDirectory and remove assembly directory.
     CharString contigFileAssembly = getFileName(assemblyDirectory, "contigs.fa");
-    CharString contigFile = getFileName(workingDirectory, "contigs.fa");
     std::ifstream src(toCString(contigFileAssembly), std::ios::binary);
     std::ofstream dst(toCString(contigFile), std::ios::binary);
     dst << src.rdbuf();
@@ -0,0 +1,305 @@
+#ifndef POPINS_QUALITY_TRIMMING_H_
+#define POPINS_QUALITY_TRIMMING_H_
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POPINS_TRIM_X86 1
+#include <immintrin.h>
+#endif
+
+// ==========================================================================
+// Quality trimming kernels
+// ==========================================================================
+
+// The sliding-window quality trimming of removeLowQuality() expressed on prefix sums of the quality values. For a
+// read of length n and window size w, sum[k] = prefix[k + w] - prefix[k] is the quality of the window starting at k.
+// From the left, the first window k in [0, n - w) reaching the threshold is searched, from the right the last
+// window k in [left + 1, n - w]. Window sums are compared as unsigned values like the original size_t arithmetic,
+// so the result is identical for any quality string.
+//
+// The kernels are selected at runtime: AVX2 if the CPU supports it, otherwise SSE4.1, otherwise scalar code.
+
+// --------------------------------------------------------------------------
+// Function _qualityPrefixSums()
+// --------------------------------------------------------------------------
+
+inline void
+_qualityPrefixSums(int32_t * prefix, char const * qual, size_t n)
+{
+    int32_t sum = 0;
+    prefix[0] = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        sum += qual[i] - 33;
+        prefix[i + 1] = sum;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Functions _firstWindow() and _lastWindow()
+// --------------------------------------------------------------------------
+
+// Returns the first k in [begin, end) with prefix[k + w] - prefix[k] >= thresh, or end if there is none.
+inline size_t
+_firstWindow(int32_t const * prefix, size_t begin, size_t end, size_t w, uint32_t thresh)
+{
+    for (size_t k = begin; k < end; ++k)
+        if ((uint32_t)(prefix[k + w] - prefix[k]) >= thresh)
+            return k;
+    return end;
+}
+
+// Returns the last k in [begin, end) with prefix[k + w] - prefix[k] >= thresh, or end if there is none.
+inline size_t
+_lastWindow(int32_t const * prefix, size_t begin, size_t end, size_t w, uint32_t thresh)
+{
+    for (size_t k = end; k > begin; --k)
+        if ((uint32_t)(prefix[k - 1 + w] - prefix[k - 1]) >= thresh)
+            return k - 1;
+    return end;
+}
+
+#ifdef POPINS_TRIM_X86
+
+// --------------------------------------------------------------------------
+// SSE4.1 kernels
+// --------------------------------------------------------------------------
+
+__attribute__((target("sse4.1")))
+inline void
+_qualityPrefixSumsSse(int32_t * prefix, char const * qual, size_t n)
+{
+    __m128i carry = _mm_setzero_si128();
+    __m128i offset = _mm_set1_epi32(33);
+    prefix[0] = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        int32_t bytes;
+        __builtin_memcpy(&bytes, qual + i, 4);
+        __m128i x = _mm_sub_epi32(_mm_cvtepi8_epi32(_mm_cvtsi32_si128(bytes)), offset);
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, carry);
+        _mm_storeu_si128((__m128i *)(prefix + i + 1), x);
+        carry = _mm_shuffle_epi32(x, 0xff);
+    }
+    int32_t sum = prefix[i];
+    for (; i < n; ++i)
+    {
+        sum += qual[i] - 33;
+        prefix[i + 1] = sum;
+    }
+}
+
+__attribute__((target("sse4.1")))
+inline size_t
+_firstWindowSse(int32_t const * prefix, size_t begin, size_t end, size_t w, uint32_t thresh)
+{
+    __m128i t = _mm_set1_epi32(thresh);
+    size_t k = begin;
+    for (; k + 4 <= end; k += 4)
+    {
+        __m128i sums = _mm_sub_epi32(_mm_loadu_si128((__m128i const *)(prefix + k + w)),
+                                     _mm_loadu_si128((__m128i const *)(prefix + k)));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_max_epu32(sums, t), sums)));
+        if (mask != 0)
+            return k + __builtin_ctz(mask);
+    }
+    return _firstWindow(prefix, k, end, w, thresh);
+}
+
+__attribute__((target("sse4.1")))
+inline size_t
+_lastWindowSse(int32_t const * prefix, size_t begin, size_t end, size_t w, uint32_t thresh)
+{
+    __m128i t = _mm_set1_epi32(thresh);
+    size_t k = end;
+    for (; k >= begin + 4; k -= 4)
+    {
+        __m128i sums = _mm_sub_epi32(_mm_loadu_si128((__m128i const *)(prefix + k - 4 + w)),
+                                     _mm_loadu_si128((__m128i const *)(prefix + k - 4)));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_max_epu32(sums, t), sums)));
+        if (mask != 0)
+            return k - 4 + 31 - __builtin_clz(mask);
+    }
+    size_t last = _lastWindow(prefix, begin, k, w, thresh);
+    return last == k ? end : last;
+}
+
+// --------------------------------------------------------------------------
+// AVX2 kernels
+// --------------------------------------------------------------------------
+
+__attribute__((target("avx2")))
+inline void
+_qualityPrefixSumsAvx2(int32_t * prefix, char const * qual, size_t n)
+{
+    __m256i carry = _mm256_setzero_si256();
+    __m256i offset = _mm256_set1_epi32(33);
+    prefix[0] = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i x = _mm256_sub_epi32(_mm256_cvtepi8_epi32(_mm_loadl_epi64((__m128i const *)(qual + i))), offset);
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+        // Add the total of the lower lane to the upper lane.
+        __m256i low = _mm256_permute2x128_si256(x, x, 0x08);
+        x = _mm256_add_epi32(x, _mm256_shuffle_epi32(low, 0xff));
+        x = _mm256_add_epi32(x, carry);
+        _mm256_storeu_si256((__m256i *)(prefix + i + 1), x);
+        carry = _mm256_permutevar8x32_epi32(x, _mm256_set1_epi32(7));
+    }
+    int32_t sum = prefix[i];
+    for (; i < n; ++i)
+    {
+        sum += qual[i] - 33;
+        prefix[i + 1] = sum;
+    }
+}
+
+__attribute__((target("avx2")))
+inline size_t
+_firstWindowAvx2(int32_t const * prefix, size_t begin, size_t end, size_t w, uint32_t thresh)
+{
+    __m256i t = _mm256_set1_epi32(thresh);
+    size_t k = begin;
+    for (; k + 8 <= end; k += 8)
+    {
+        __m256i sums = _mm256_sub_epi32(_mm256_loadu_si256((__m256i const *)(prefix + k + w)),
+                                        _mm256_loadu_si256((__m256i const *)(prefix + k)));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_max_epu32(sums, t), sums)));
+        if (mask != 0)
+            return k + __builtin_ctz(mask);
+    }
+    return _firstWindow(prefix, k, end, w, thresh);
+}
+
+__attribute__((target("avx2")))
+inline size_t
+_lastWindowAvx2(int32_t const * prefix, size_t begin, size_t end, size_t w, uint32_t thresh)
+{
+    __m256i t = _mm256_set1_epi32(thresh);
+    size_t k = end;
+    for (; k >= begin + 8; k -= 8)
+    {
+        __m256i sums = _mm256_sub_epi32(_mm256_loadu_si256((__m256i const *)(prefix + k - 8 + w)),
+                                        _mm256_loadu_si256((__m256i const *)(prefix + k - 8)));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_max_epu32(sums, t), sums)));
+        if (mask != 0)
+            return k - 8 + 31 - __builtin_clz(mask);
+    }
+    size_t last = _lastWindow(prefix, begin, k, w, thresh);
+    return last == k ? end : last;
+}
+
+#endif  // POPINS_TRIM_X86
+
+// --------------------------------------------------------------------------
+// Struct QualityTrimKernels
+// --------------------------------------------------------------------------
+
+struct QualityTrimKernels
+{
+    void (*prefixSums)(int32_t *, char const *, size_t);
+    size_t (*firstWindow)(int32_t const *, size_t, size_t, size_t, uint32_t);
+    size_t (*lastWindow)(int32_t const *, size_t, size_t, size_t, uint32_t);
+};
+
+enum QualityTrimIsa
+{
+    TRIM_ISA_AUTO,
+    TRIM_ISA_SCALAR,
+    TRIM_ISA_SSE41,
+    TRIM_ISA_AVX2
+};
+
+// Returns the kernels for the given instruction set, or the best ones supported by the CPU.
+inline QualityTrimKernels
+qualityTrimKernels(QualityTrimIsa isa = TRIM_ISA_AUTO)
+{
+    QualityTrimKernels kernels = {_qualityPrefixSums, _firstWindow, _lastWindow};
+#ifdef POPINS_TRIM_X86
+    if (isa == TRIM_ISA_AUTO)
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            isa = TRIM_ISA_AVX2;
+        else if (__builtin_cpu_supports("sse4.1"))
+            isa = TRIM_ISA_SSE41;
+    }
+    if (isa == TRIM_ISA_AVX2)
+    {
+        QualityTrimKernels avx2 = {_qualityPrefixSumsAvx2, _firstWindowAvx2, _lastWindowAvx2};
+        kernels = avx2;
+    }
+    else if (isa == TRIM_ISA_SSE41)
+    {
+        QualityTrimKernels sse = {_qualityPrefixSumsSse, _firstWindowSse, _lastWindowSse};
+        kernels = sse;
+    }
+#else
+    (void)isa;
+#endif
+    return kernels;
+}
+
+// --------------------------------------------------------------------------
+// Function qualityTrimBounds()
+// --------------------------------------------------------------------------
+
+/**
+ * Computes the quality trimming of a read as in removeLowQuality().
+ *
+ * @param left, right   the part [left, right) of the read to keep
+ * @param qual          the read's quality string (Phred+33)
+ * @param n             the read length
+ * @param qualThresh    the quality threshold for windows and the trimmed ends
+ * @param kernels       the kernels to use
+ *
+ * @returns             false if no window from the left reaches the threshold and the read is discarded untrimmed.
+ */
+inline bool
+qualityTrimBounds(size_t & left,
+        size_t & right,
+        char const * qual,
+        size_t n,
+        int qualThresh,
+        QualityTrimKernels const & kernels)
+{
+    size_t w = std::max((size_t)5, n / 10);
+    if (n <= w)
+        return false;
+
+    thread_local std::vector<int32_t> prefix;
+    if (prefix.size() < n + 1)
+        prefix.resize(n + 1);
+    kernels.prefixSums(&prefix[0], qual, n);
+
+    uint32_t windowThresh = (uint32_t)(qualThresh * w);
+
+    // Check quality from the left.
+    size_t first = kernels.firstWindow(&prefix[0], 0, n - w, w, windowThresh);
+    if (first == n - w)
+        return false;
+    left = first;
+    while (qual[left] - 33 < qualThresh) ++left;
+
+    // Check quality from the right.
+    right = n;
+    size_t last = kernels.lastWindow(&prefix[0], left + 1, n - w + 1, w, windowThresh);
+    if (last != n - w + 1)
+    {
+        right = last + w;
+        while (qual[right - 1] - 33 < qualThresh) --right;
+    }
+
+    return true;
+}
+
+#endif  // POPINS_QUALITY_TRIMMING_H_
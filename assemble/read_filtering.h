@@ -0,0 +1,93 @@
+#ifndef POPINS_READ_FILTERING_H_
+#define POPINS_READ_FILTERING_H_
+
+#include <cstddef>
+
+// ==========================================================================
+// Sliding-window read filtering
+// ==========================================================================
+
+// The quality filtering of the reads passed to the assembler, as previously done with 'sickle pe/se -q 20 -l 60 -x -n
+// -t sanger': Reads are trimmed at the 3' end only, where a sliding window of 10% of the read length first drops below
+// the average quality threshold, and truncated at the first N. Reads shorter than the length threshold after trimming
+// are discarded. Of a pair, a read that passes while its mate is discarded is kept as a single read.
+
+enum ReadFilterDefaults
+{
+    FILTER_QUAL_THRESH = 20,
+    FILTER_MIN_LENGTH = 60
+};
+
+// --------------------------------------------------------------------------
+// Function filterTrimLength()
+// --------------------------------------------------------------------------
+
+/**
+ * Computes the 3' trimming of a read.
+ *
+ * @param seq           the read's sequence
+ * @param qual          the read's quality string (Phred+33)
+ * @param n             the read length
+ * @param qualThresh    the threshold for the average quality of a window and for the quality of the trimmed end
+ * @param minLength     the minimal length of the trimmed read
+ *
+ * @returns             the length of the prefix of the read to keep, or 0 if the read is discarded.
+ */
+inline size_t
+filterTrimLength(char const * seq,
+        char const * qual,
+        size_t n,
+        int qualThresh = FILTER_QUAL_THRESH,
+        size_t minLength = FILTER_MIN_LENGTH)
+{
+    if (n == 0 || n < minLength)
+        return 0;
+
+    // The window size is truncated from the floating point product like in sickle.
+    size_t w = (size_t)(0.1 * n);
+    if (w == 0)
+        w = n;
+    long windowThresh = (long)qualThresh * (long)w;
+
+    long windowQual = 0;
+    for (size_t i = 0; i < w; ++i)
+        windowQual += qual[i] - 33;
+
+    // Cut at the first base below the threshold in the first window with a low average quality.
+    size_t cut = n;
+    for (size_t k = 0; k + w <= n; ++k)
+    {
+        if (windowQual < windowThresh)
+        {
+            for (size_t i = k; i < k + w; ++i)
+            {
+                if (qual[i] - 33 < qualThresh)
+                {
+                    cut = i;
+                    break;
+                }
+            }
+            break;
+        }
+
+        windowQual -= qual[k] - 33;
+        if (k + w < n)
+            windowQual += qual[k + w] - 33;
+    }
+
+    // Truncate at the first N.
+    for (size_t i = 0; i < cut; ++i)
+    {
+        if (seq[i] == 'N' || seq[i] == 'n')
+        {
+            cut = i;
+            break;
+        }
+    }
+
+    if (cut < minLength)
+        return 0;
+    return cut;
+}
+
+#endif  // POPINS_READ_FILTERING_H_
@@ -0,0 +1,88 @@
+#ifndef POPINS_READ_NAMES_H_
+#define POPINS_READ_NAMES_H_
+
+#include <cctype>
+#include <cstddef>
+#include <string>
+
+// ==========================================================================
+// Function compareReadNames()
+// ==========================================================================
+
+// This function is adapted from samtools code (fuction strnum_cmp in bam_sort.c) to ensure the exact same sort order
+// of read names as 'samtools sort -n': Runs of digits compare by their numeric value. Characters past the end of a
+// name compare like the terminating null character.
+inline int
+compareReadNames(char const * nameA, size_t lenA, char const * nameB, size_t lenB)
+{
+    const unsigned char *a = (const unsigned char*)nameA;
+    const unsigned char *b = (const unsigned char*)nameB;
+    auto A = [&](size_t i) -> int { return i < lenA ? a[i] : 0; };
+    auto B = [&](size_t i) -> int { return i < lenB ? b[i] : 0; };
+
+    size_t pa = 0, pb = 0;
+    while (A(pa) && B(pb)) {
+        if (isdigit(A(pa)) && isdigit(B(pb))) {
+            while (A(pa) == '0') ++pa;
+            while (B(pb) == '0') ++pb;
+            while (isdigit(A(pa)) && isdigit(B(pb)) && A(pa) == B(pb)) ++pa, ++pb;
+            if (isdigit(A(pa)) && isdigit(B(pb))) {
+                size_t i = 0;
+                while (isdigit(A(pa + i)) && isdigit(B(pb + i))) ++i;
+                return isdigit(A(pa + i))? 1 : isdigit(B(pb + i))? -1 : A(pa) - B(pb);
+            } else if (isdigit(A(pa))) return 1;
+            else if (isdigit(B(pb))) return -1;
+            else if (pa != pb) return pa < pb? 1 : -1;
+        } else {
+            if (A(pa) != B(pb)) return A(pa) - B(pb);
+            ++pa; ++pb;
+        }
+    }
+    return A(pa)? 1 : B(pb)? -1 : 0;
+}
+
+// ==========================================================================
+// Function appendReadNameKey()
+// ==========================================================================
+
+// Appends a key of a read name to a string such that a bytewise comparison of two keys gives the order of
+// compareReadNames(). Each run of digits is replaced by the digit '0', the number of significant digits, the
+// significant digits, and a value decreasing with the number of leading zeros. Counts below 255 take one byte.
+inline void
+appendReadNameKey(std::string & key, char const * name, size_t len)
+{
+    auto appendCount = [&](size_t count, bool increasing)
+    {
+        if (count < 255)
+        {
+            key += (char)(increasing ? count : 255 - count);
+            return;
+        }
+        unsigned value = increasing ? count : ~(unsigned)count;
+        key += (char)(increasing ? 255 : 0);
+        for (int shift = 24; shift >= 0; shift -= 8)
+            key += (char)((value >> shift) & 0xff);
+    };
+
+    size_t i = 0;
+    while (i < len)
+    {
+        if (!isdigit((unsigned char)name[i]))
+        {
+            key += name[i++];
+            continue;
+        }
+
+        size_t zeros = 0;
+        while (i < len && name[i] == '0') ++zeros, ++i;
+        size_t first = i;
+        while (i < len && isdigit((unsigned char)name[i])) ++i;
+
+        key += '0';
+        appendCount(i - first, true);
+        key.append(name + first, i - first);
+        appendCount(zeros, false);
+    }
+}
+
+#endif  // POPINS_READ_NAMES_H_
@@ -0,0 +1,566 @@
+#ifndef POPINS_READ_STORE_H_
+#define POPINS_READ_STORE_H_
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// ==========================================================================
+// Read store file format
+// ==========================================================================
+
+// The cropped reads of a sample in a single binary file, in the read name order of the fastq output (lessFastqName).
+// All integers are little-endian.
+//
+//   header:  magic "PIRS", version (uint32), flags (uint32, READ_STORE_BINNED)
+//   record:  paired (uint8), name length (varint), name,
+//            then for each read of the record:
+//              sequence length (varint), quality length (varint),
+//              bases packed into 2 bits each (A=0, C=1, G=2, T=3), first base in the lowest bits,
+//              number of exceptions (varint), exceptions as position delta (varint) and character, e.g. for N,
+//              qualities as characters or, if binned, as 4-bit bin codes, two per byte
+//   index:   record number and file offset (uint64 each) of every READ_STORE_INDEX_STEP-th record
+//   footer:  number of pairs, number of single reads, offset of the index, number of index entries (uint64 each),
+//            magic "PIRS"
+
+static const char READ_STORE_MAGIC[4] = {'P', 'I', 'R', 'S'};
+static const uint32_t READ_STORE_VERSION = 1;
+static const uint32_t READ_STORE_BINNED = 1;
+static const uint64_t READ_STORE_INDEX_STEP = 4096;
+static const size_t READ_STORE_HEADER_SIZE = 12;
+static const size_t READ_STORE_FOOTER_SIZE = 36;
+
+// --------------------------------------------------------------------------
+// Functions appendStoreValue() and appendVarint()
+// --------------------------------------------------------------------------
+
+inline void
+appendStoreValue(std::string & buffer, uint64_t value, unsigned numBytes)
+{
+    for (unsigned i = 0; i < numBytes; ++i)
+        buffer += (char)((value >> (8 * i)) & 0xff);
+}
+
+inline void
+appendVarint(std::string & buffer, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer += (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buffer += (char)value;
+}
+
+// --------------------------------------------------------------------------
+// Functions qualityBin() and binQuality()
+// --------------------------------------------------------------------------
+
+// Illumina's 8-level binning of phred qualities: 0-1, 2-9, 10-19, 20-24, 25-29, 30-34, 35-39, and 40 or more, each bin
+// represented by a single quality.
+inline unsigned
+qualityBin(char qual)
+{
+    static const int lowerBounds[7] = {2, 10, 20, 25, 30, 35, 40};
+    int q = (unsigned char)qual - 33;
+    unsigned bin = 0;
+    while (bin < 7 && q >= lowerBounds[bin])
+        ++bin;
+    return bin;
+}
+
+inline char
+binQuality(unsigned bin)
+{
+    static const char representatives[8] = {2, 6, 15, 22, 27, 33, 37, 40};
+    return representatives[bin & 7] + 33;
+}
+
+// ==========================================================================
+// Struct ReadStoreWriter
+// ==========================================================================
+
+// Writes a read store. Records must be written in read name order.
+struct ReadStoreWriter
+{
+    std::ofstream file;
+    std::string fileName;
+    bool binned;
+
+    uint64_t offset;
+    uint64_t numPairs;
+    uint64_t numSingles;
+    std::vector<uint64_t> index;    // record number and offset of every READ_STORE_INDEX_STEP-th record
+
+    std::string buffer;
+
+    ReadStoreWriter() :
+        binned(false), offset(0), numPairs(0), numSingles(0)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Function open()
+// --------------------------------------------------------------------------
+
+// Returns false if the file cannot be opened.
+inline bool
+open(ReadStoreWriter & store, std::string const & fileName, bool binned)
+{
+    store.file.open(fileName.c_str(), std::ios::binary);
+    if (!store.file.is_open())
+        return false;
+
+    store.fileName = fileName;
+    store.binned = binned;
+
+    std::string header(READ_STORE_MAGIC, 4);
+    appendStoreValue(header, READ_STORE_VERSION, 4);
+    appendStoreValue(header, binned ? READ_STORE_BINNED : 0, 4);
+    store.file.write(header.data(), header.size());
+    store.offset = header.size();
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function _appendStoreRead()
+// --------------------------------------------------------------------------
+
+inline void
+_appendStoreRead(std::string & buffer, char const * seq, size_t seqLength, char const * qual, size_t qualLength,
+        bool binned)
+{
+    appendVarint(buffer, seqLength);
+    appendVarint(buffer, qualLength);
+
+    // Packed bases, collecting the positions of other characters as exceptions.
+    size_t packedBegin = buffer.size();
+    buffer.resize(packedBegin + (seqLength + 3) / 4, 0);
+    size_t numExceptions = 0;
+    for (size_t i = 0; i < seqLength; ++i)
+    {
+        unsigned code;
+        switch (seq[i])
+        {
+            case 'A': code = 0; break;
+            case 'C': code = 1; break;
+            case 'G': code = 2; break;
+            case 'T': code = 3; break;
+            default: code = 0; ++numExceptions;
+        }
+        buffer[packedBegin + i / 4] |= (char)(code << (2 * (i % 4)));
+    }
+
+    appendVarint(buffer, numExceptions);
+    size_t last = 0;
+    for (size_t i = 0; i < seqLength && numExceptions != 0; ++i)
+    {
+        if (seq[i] == 'A' || seq[i] == 'C' || seq[i] == 'G' || seq[i] == 'T')
+            continue;
+        appendVarint(buffer, i - last);
+        buffer += seq[i];
+        last = i;
+    }
+
+    if (!binned)
+    {
+        buffer.append(qual, qualLength);
+        return;
+    }
+    for (size_t i = 0; i < qualLength; i += 2)
+    {
+        unsigned codes = qualityBin(qual[i]);
+        if (i + 1 < qualLength)
+            codes |= qualityBin(qual[i + 1]) << 4;
+        buffer += (char)codes;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function _writeStoreRecord()
+// --------------------------------------------------------------------------
+
+inline void
+_writeStoreRecord(ReadStoreWriter & store)
+{
+    uint64_t recordNumber = store.numPairs + store.numSingles;
+    if (recordNumber % READ_STORE_INDEX_STEP == 0)
+    {
+        store.index.push_back(recordNumber);
+        store.index.push_back(store.offset);
+    }
+
+    store.file.write(store.buffer.data(), store.buffer.size());
+    store.offset += store.buffer.size();
+}
+
+// --------------------------------------------------------------------------
+// Function writePair()
+// --------------------------------------------------------------------------
+
+inline void
+writePair(ReadStoreWriter & store,
+        char const * name, size_t nameLength,
+        char const * firstSeq, size_t firstSeqLength, char const * firstQual, size_t firstQualLength,
+        char const * secondSeq, size_t secondSeqLength, char const * secondQual, size_t secondQualLength)
+{
+    store.buffer.clear();
+    store.buffer += (char)1;
+    appendVarint(store.buffer, nameLength);
+    store.buffer.append(name, nameLength);
+    _appendStoreRead(store.buffer, firstSeq, firstSeqLength, firstQual, firstQualLength, store.binned);
+    _appendStoreRead(store.buffer, secondSeq, secondSeqLength, secondQual, secondQualLength, store.binned);
+
+    _writeStoreRecord(store);
+    ++store.numPairs;
+}
+
+// --------------------------------------------------------------------------
+// Function writeSingle()
+// --------------------------------------------------------------------------
+
+inline void
+writeSingle(ReadStoreWriter & store,
+        char const * name, size_t nameLength,
+        char const * seq, size_t seqLength, char const * qual, size_t qualLength)
+{
+    store.buffer.clear();
+    store.buffer += (char)0;
+    appendVarint(store.buffer, nameLength);
+    store.buffer.append(name, nameLength);
+    _appendStoreRead(store.buffer, seq, seqLength, qual, qualLength, store.binned);
+
+    _writeStoreRecord(store);
+    ++store.numSingles;
+}
+
+// --------------------------------------------------------------------------
+// Function close()
+// --------------------------------------------------------------------------
+
+// Writes the index and the footer. Returns false on error.
+inline bool
+close(ReadStoreWriter & store)
+{
+    if (!store.file.is_open())
+        return true;
+
+    std::string tail;
+    for (size_t i = 0; i < store.index.size(); ++i)
+        appendStoreValue(tail, store.index[i], 8);
+    appendStoreValue(tail, store.numPairs, 8);
+    appendStoreValue(tail, store.numSingles, 8);
+    appendStoreValue(tail, store.offset, 8);
+    appendStoreValue(tail, store.index.size() / 2, 8);
+    tail.append(READ_STORE_MAGIC, 4);
+    store.file.write(tail.data(), tail.size());
+
+    store.file.close();
+    return !store.file.fail();
+}
+
+// ==========================================================================
+// Struct ReadStoreReader
+// ==========================================================================
+
+// Reads the records of a read store in order, optionally starting at any record through the index.
+struct ReadStoreReader
+{
+    std::ifstream file;
+    std::string fileName;
+    bool binned;
+
+    uint64_t numPairs;
+    uint64_t numSingles;
+    uint64_t dataEnd;               // offset of the index
+    std::vector<uint64_t> index;    // record number and offset of every READ_STORE_INDEX_STEP-th record
+
+    // The current record.
+    uint64_t recordNumber;
+    uint64_t offset;
+    bool paired;
+    std::string name;
+    std::string seq[2];
+    std::string qual[2];
+
+    std::string buffer;
+
+    ReadStoreReader() :
+        binned(false), numPairs(0), numSingles(0), dataEnd(0), recordNumber(0), offset(0), paired(false)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Function _storeValue()
+// --------------------------------------------------------------------------
+
+inline uint64_t
+_storeValue(char const * bytes, unsigned numBytes)
+{
+    uint64_t value = 0;
+    for (unsigned i = 0; i < numBytes; ++i)
+        value |= (uint64_t)(unsigned char)bytes[i] << (8 * i);
+    return value;
+}
+
+// --------------------------------------------------------------------------
+// Function open()
+// --------------------------------------------------------------------------
+
+// Reads the header, the footer, and the index, and positions the reader at the first record. Returns false if the file
+// cannot be opened or is not a complete read store.
+inline bool
+open(ReadStoreReader & store, std::string const & fileName)
+{
+    store.file.open(fileName.c_str(), std::ios::binary);
+    if (!store.file.is_open())
+        return false;
+    store.fileName = fileName;
+
+    char header[READ_STORE_HEADER_SIZE];
+    char footer[READ_STORE_FOOTER_SIZE];
+    if (!store.file.read(header, READ_STORE_HEADER_SIZE) ||
+            !store.file.seekg(-(std::streamoff)READ_STORE_FOOTER_SIZE, std::ios::end) ||
+            !store.file.read(footer, READ_STORE_FOOTER_SIZE))
+        return false;
+    if (std::memcmp(header, READ_STORE_MAGIC, 4) != 0 || std::memcmp(footer + 32, READ_STORE_MAGIC, 4) != 0 ||
+            _storeValue(header + 4, 4) != READ_STORE_VERSION)
+        return false;
+
+    store.binned = (_storeValue(header + 8, 4) & READ_STORE_BINNED) != 0;
+    store.numPairs = _storeValue(footer, 8);
+    store.numSingles = _storeValue(footer + 8, 8);
+    store.dataEnd = _storeValue(footer + 16, 8);
+
+    store.index.resize(2 * _storeValue(footer + 24, 8));
+    std::string indexBytes(8 * store.index.size(), '\0');
+    store.file.seekg(store.dataEnd);
+    if (!indexBytes.empty() && !store.file.read(&indexBytes[0], indexBytes.size()))
+        return false;
+    for (size_t i = 0; i < store.index.size(); ++i)
+        store.index[i] = _storeValue(&indexBytes[8 * i], 8);
+
+    store.recordNumber = 0;
+    store.offset = READ_STORE_HEADER_SIZE;
+    return (bool)store.file.seekg(store.offset);
+}
+
+// --------------------------------------------------------------------------
+// Function numRecords()
+// --------------------------------------------------------------------------
+
+inline uint64_t
+numRecords(ReadStoreReader const & store)
+{
+    return store.numPairs + store.numSingles;
+}
+
+// --------------------------------------------------------------------------
+// Function _readVarint()
+// --------------------------------------------------------------------------
+
+inline bool
+_readVarint(uint64_t & value, ReadStoreReader & store)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        int c = store.file.get();
+        if (c == EOF)
+            return false;
+        ++store.offset;
+        value |= (uint64_t)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+// --------------------------------------------------------------------------
+// Function _readStoreBytes()
+// --------------------------------------------------------------------------
+
+inline bool
+_readStoreBytes(std::string & bytes, size_t len, ReadStoreReader & store)
+{
+    bytes.resize(len);
+    if (len != 0 && !store.file.read(&bytes[0], len))
+        return false;
+    store.offset += len;
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function _readStoreRead()
+// --------------------------------------------------------------------------
+
+inline bool
+_readStoreRead(std::string & seq, std::string & qual, ReadStoreReader & store)
+{
+    static const char bases[4] = {'A', 'C', 'G', 'T'};
+
+    uint64_t seqLength, qualLength, numExceptions;
+    if (!_readVarint(seqLength, store) || !_readVarint(qualLength, store) ||
+            !_readStoreBytes(store.buffer, (seqLength + 3) / 4, store))
+        return false;
+
+    seq.resize(seqLength);
+    for (size_t i = 0; i < seqLength; ++i)
+        seq[i] = bases[((unsigned char)store.buffer[i / 4] >> (2 * (i % 4))) & 3];
+
+    if (!_readVarint(numExceptions, store))
+        return false;
+    uint64_t pos = 0, delta;
+    for (uint64_t i = 0; i < numExceptions; ++i)
+    {
+        int c;
+        if (!_readVarint(delta, store) || (c = store.file.get()) == EOF || (pos += delta) >= seqLength)
+            return false;
+        ++store.offset;
+        seq[pos] = (char)c;
+    }
+
+    if (!store.binned)
+        return _readStoreBytes(qual, qualLength, store);
+
+    if (!_readStoreBytes(store.buffer, (qualLength + 1) / 2, store))
+        return false;
+    qual.resize(qualLength);
+    for (size_t i = 0; i < qualLength; ++i)
+        qual[i] = binQuality((unsigned char)store.buffer[i / 2] >> (4 * (i % 2)));
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function readRecord()
+// --------------------------------------------------------------------------
+
+// Reads the next record into the reader's current record. Returns false at the end of the records or on error; check
+// the reader's offset against dataEnd to tell them apart.
+inline bool
+readRecord(ReadStoreReader & store)
+{
+    if (store.offset >= store.dataEnd)
+        return false;
+
+    int paired = store.file.get();
+    uint64_t nameLength;
+    if (paired == EOF)
+        return false;
+    ++store.offset;
+    store.paired = (paired == 1);
+
+    if (!_readVarint(nameLength, store) || !_readStoreBytes(store.name, nameLength, store) ||
+            !_readStoreRead(store.seq[0], store.qual[0], store))
+        return false;
+    if (store.paired && !_readStoreRead(store.seq[1], store.qual[1], store))
+        return false;
+
+    ++store.recordNumber;
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function seekRecord()
+// --------------------------------------------------------------------------
+
+// Positions the reader such that the next call of readRecord() reads the record with the given number. Returns false
+// if there is no such record.
+inline bool
+seekRecord(ReadStoreReader & store, uint64_t recordNumber)
+{
+    if (recordNumber >= numRecords(store))
+        return false;
+
+    size_t entry = recordNumber / READ_STORE_INDEX_STEP;
+    if (2 * entry + 1 >= store.index.size())
+        return false;
+    store.recordNumber = store.index[2 * entry];
+    store.offset = store.index[2 * entry + 1];
+    store.file.clear();
+    if (!store.file.seekg(store.offset))
+        return false;
+
+    while (store.recordNumber < recordNumber)
+        if (!readRecord(store))
+            return false;
+    return true;
+}
+
+// ==========================================================================
+// Function exportFastq()
+// ==========================================================================
+
+// Writes the reads of a read store to fastq files: the first and second reads of pairs and the single reads to three
+// files, or all reads to the first file if the others are empty, the two reads of a pair one after the other.
+// Returns false on error.
+inline bool
+exportFastq(std::string const & storeFile,
+        std::string const & firstFile,
+        std::string const & secondFile,
+        std::string const & singleFile)
+{
+    ReadStoreReader store;
+    if (!open(store, storeFile))
+    {
+        std::cerr << "ERROR: Could not open read store " << storeFile << std::endl;
+        return false;
+    }
+
+    bool interleaved = secondFile.empty();
+    std::ofstream first(firstFile.c_str()), second, single;
+    if (!interleaved)
+    {
+        second.open(secondFile.c_str());
+        single.open(singleFile.c_str());
+    }
+    if (!first.is_open() || (!interleaved && (!second.is_open() || !single.is_open())))
+    {
+        std::cerr << "ERROR: Could not open fastq file " << firstFile;
+        if (!interleaved)
+            std::cerr << ", " << secondFile << ", or " << singleFile;
+        std::cerr << " for writing." << std::endl;
+        return false;
+    }
+
+    auto writeFastqRecord = [&](std::ofstream & out, unsigned i)
+    {
+        out << '@' << store.name << '\n' << store.seq[i] << "\n+\n" << store.qual[i] << '\n';
+    };
+
+    while (readRecord(store))
+    {
+        if (store.paired)
+        {
+            writeFastqRecord(first, 0);
+            writeFastqRecord(interleaved ? first : second, 1);
+        }
+        else
+        {
+            writeFastqRecord(interleaved ? first : single, 0);
+        }
+    }
+    if (store.offset != store.dataEnd)
+    {
+        std::cerr << "ERROR: Could not read record " << store.recordNumber << " of read store " << storeFile << std::endl;
+        return false;
+    }
+
+    first.close();
+    if (!interleaved)
+    {
+        second.close();
+        single.close();
+    }
+    if (first.fail() || second.fail() || single.fail())
+    {
+        std::cerr << "ERROR: Could not write fastq files for read store " << storeFile << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif  // POPINS_READ_STORE_H_
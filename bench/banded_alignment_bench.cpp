@@ -0,0 +1,141 @@
+// Microbenchmark of the verification of contig pairs in pairwiseAlignment().
+//
+// Compares the throughput of the score-only banded alignment kernels (scalar, SSE4.1, and the runtime selection used
+// by pairwiseAlignment()) with the previous full localAlignment() on simulated contig pairs with the default scoring
+// of popins merge and checks that all of them take the same decision for every pair.
+//
+// Build and run with:  make bench/banded_alignment_bench && bench/banded_alignment_bench [NUM_PAIRS] [CONTIG_LENGTH]
+
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <iomanip>
+
+#include "../popins_utils.h"
+#include "../merge/popins_merge.h"
+
+using namespace seqan;
+
+// --------------------------------------------------------------------------
+// Struct ContigPair
+// --------------------------------------------------------------------------
+
+struct ContigPair
+{
+    Dna5String contig1;
+    Dna5String contig2;
+    int lowerDiag;
+    int upperDiag;
+};
+
+// --------------------------------------------------------------------------
+// Function simulatePairs()
+// --------------------------------------------------------------------------
+
+// Pairs of which half overlap with 0.5% substitutions and a few indels, with a band around the true diagonal of the
+// width of a SWIFT hit, and half are unrelated.
+void
+simulatePairs(std::vector<ContigPair> & pairs, unsigned numPairs, unsigned contigLength)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> base(0, 3);
+
+    pairs.resize(numPairs);
+    for (unsigned i = 0; i < numPairs; ++i)
+    {
+        ContigPair & pair = pairs[i];
+        resize(pair.contig1, contigLength);
+        for (unsigned j = 0; j < contigLength; ++j)
+            pair.contig1[j] = Dna5(base(rng));
+
+        int diag = rng() % (contigLength / 2);
+        if (i % 2 == 0)
+        {
+            pair.contig2 = suffix(pair.contig1, diag);
+            for (unsigned j = 0; j < length(pair.contig2); ++j)
+                if (rng() % 200 == 0) pair.contig2[j] = Dna5(base(rng));
+            for (unsigned k = 0; k < 3; ++k)
+                erase(pair.contig2, rng() % length(pair.contig2));
+        }
+        else
+        {
+            resize(pair.contig2, contigLength);
+            for (unsigned j = 0; j < contigLength; ++j)
+                pair.contig2[j] = Dna5(base(rng));
+        }
+        pair.lowerDiag = diag - 30;
+        pair.upperDiag = diag + 10;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function runBenchmark()
+// --------------------------------------------------------------------------
+
+template<typename TVerify>
+double
+runBenchmark(std::vector<bool> & decisions, std::vector<ContigPair> & pairs, TVerify verify)
+{
+    decisions.assign(pairs.size(), false);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < pairs.size(); ++i)
+        decisions[i] = verify(pairs[i]);
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+    return pairs.size() / seconds.count();
+}
+
+int main(int argc, char const ** argv)
+{
+    unsigned numPairs = argc > 1 ? lexicalCast<unsigned>(argv[1]) : 20000;
+    unsigned contigLength = argc > 2 ? lexicalCast<unsigned>(argv[2]) : 2000;
+
+    std::vector<ContigPair> pairs;
+    simulatePairs(pairs, numPairs, contigLength);
+
+    MergingOptions options;
+    Score<int, Simple> scoringScheme(options.matchScore, options.errorPenalty, options.errorPenalty);
+    BandedScoring scoring(options.matchScore, options.errorPenalty, options.errorPenalty, options.minScore);
+
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << "Verifying " << numPairs << " pairs of contigs of length " << contigLength << "." << std::endl;
+
+    std::vector<bool> reference, decisions;
+    double rate = runBenchmark(reference, pairs, [&](ContigPair & p)
+    {
+        Align<Dna5String, ArrayGaps> align;
+        resize(rows(align), 2);
+        setSource(row(align, 0), p.contig1);
+        setSource(row(align, 1), p.contig2);
+        return localAlignment(align, scoringScheme, p.lowerDiag, p.upperDiag) > options.minScore;
+    });
+    std::cout << "localAlignment() (previous) " << std::setw(12) << rate << " pairs/s" << std::endl;
+
+    rate = runBenchmark(decisions, pairs, [&](ContigPair & p)
+    {
+        return pairwiseAlignment(p.contig1, p.contig2, scoringScheme, p.lowerDiag, p.upperDiag, options.minScore);
+    });
+    std::cout << "pairwiseAlignment()         " << std::setw(12) << rate << " pairs/s"
+              << (decisions == reference ? "" : "  MISMATCH") << std::endl;
+
+    char const * names[] = {"scalar kernel               ", "SSE4.1 kernel               "};
+    BandedAlignIsa isas[] = {BANDED_ISA_SCALAR, BANDED_ISA_SSE41};
+    for (unsigned i = 0; i < 2; ++i)
+    {
+#ifdef POPINS_BANDED_X86
+        if (isas[i] == BANDED_ISA_SSE41 && !__builtin_cpu_supports("sse4.1")) continue;
+#else
+        if (isas[i] != BANDED_ISA_SCALAR) continue;
+#endif
+        TBandedScoreKernel kernel = bandedScoreKernel(scoring, isas[i]);
+        rate = runBenchmark(decisions, pairs, [&](ContigPair & p)
+        {
+            return bandedScoreExceeds(p.contig1, p.contig2, p.lowerDiag, p.upperDiag, scoring, kernel);
+        });
+        std::cout << names[i] << std::setw(12) << rate << " pairs/s"
+                  << (decisions == reference ? "" : "  MISMATCH") << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+// Benchmark of the built-in de Bruijn graph assembler against velvet.
+//
+// Assembles the same read sets with assembleDeBruijn() and with velveth/velvetg as called by popins assemble, and
+// reports the runtime and contig statistics of both. The reads are given as the filtered fastq files of a sample
+// directory or, if no files are given, simulated from a random genome with a few repeats and written to fastq files.
+//
+// Build and run with:  make bench/debruijn_assembly_bench && bench/debruijn_assembly_bench [THREADS] [K]
+//                      [FIRST.fastq SECOND.fastq SINGLE.fastq]
+
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <iomanip>
+
+#include "../popins_utils.h"
+#include "../assemble/popins_assemble.h"
+
+using namespace seqan;
+
+// --------------------------------------------------------------------------
+// Function simulateReadFiles()
+// --------------------------------------------------------------------------
+
+// Writes pairs of 150 bp reads with an insert size of 400 bp and 0.5% substitution errors at 30x coverage of a random
+// genome of 1 Mbp that contains repeats of 300 bp and 2 kbp.
+void
+simulateReadFiles(Triple<CharString> const & files)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> base(0, 3);
+    std::normal_distribution<double> insert(400, 30);
+
+    unsigned genomeLength = 1000000, readLength = 150;
+    Dna5String genome;
+    resize(genome, genomeLength);
+    for (unsigned i = 0; i < genomeLength; ++i)
+        genome[i] = Dna5(base(rng));
+    for (unsigned i = 1; i < 4; ++i)
+    {
+        infix(genome, 200000 * i, 200000 * i + 300) = infix(genome, 1000, 1300);
+        infix(genome, 200000 * i + 50000, 200000 * i + 52000) = infix(genome, 5000, 7000);
+    }
+
+    SeqFileOut first(toCString(files.i1)), second(toCString(files.i2)), single(toCString(files.i3));
+    CharString qual;
+    resize(qual, readLength, 'I');
+
+    unsigned numPairs = 30 * genomeLength / (2 * readLength);
+    for (unsigned i = 0; i < numPairs; ++i)
+    {
+        unsigned fragment = std::max(readLength, (unsigned)insert(rng));
+        unsigned pos = rng() % (genomeLength - fragment);
+        Dna5String read1 = infix(genome, pos, pos + readLength);
+        Dna5String read2 = infix(genome, pos + fragment - readLength, pos + fragment);
+        reverseComplement(read2);
+        for (unsigned j = 0; j < readLength; ++j)
+        {
+            if (rng() % 200 == 0) read1[j] = Dna5(base(rng));
+            if (rng() % 200 == 0) read2[j] = Dna5(base(rng));
+        }
+
+        std::ostringstream name;
+        name << "read" << i;
+        writeRecord(first, name.str(), read1, qual);
+        writeRecord(second, name.str(), read2, qual);
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function printContigStats()
+// --------------------------------------------------------------------------
+
+void
+printContigStats(char const * assembler, double seconds, std::vector<size_t> lengths)
+{
+    std::sort(lengths.begin(), lengths.end(), std::greater<size_t>());
+
+    size_t total = 0;
+    for (size_t i = 0; i < lengths.size(); ++i)
+        total += lengths[i];
+
+    size_t n50 = 0, sum = 0;
+    for (size_t i = 0; i < lengths.size() && n50 == 0; ++i)
+    {
+        sum += lengths[i];
+        if (2 * sum >= total)
+            n50 = lengths[i];
+    }
+
+    std::cout << assembler << std::fixed << std::setprecision(2) << std::setw(10) << seconds << " s"
+              << std::setw(10) << lengths.size() << " contigs" << std::setw(12) << total << " bp"
+              << "   N50 " << std::setw(8) << n50 << "   max " << std::setw(8) << (lengths.empty() ? 0 : lengths[0])
+              << std::endl;
+}
+
+int main(int argc, char const ** argv)
+{
+    unsigned threads = argc > 1 ? lexicalCast<unsigned>(argv[1]) : 4;
+    unsigned kmerLength = argc > 2 ? lexicalCast<unsigned>(argv[2]) : 47;
+
+    Triple<CharString> files("bench_reads.1.fastq", "bench_reads.2.fastq", "bench_reads.single.fastq");
+    if (argc > 5)
+    {
+        files = Triple<CharString>(argv[3], argv[4], argv[5]);
+    }
+    else
+    {
+        std::cout << "Simulating reads to " << files.i1 << " and " << files.i2 << "." << std::endl;
+        simulateReadFiles(files);
+    }
+
+    // Built-in assembler, including loading the reads.
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    AssemblyReads reads;
+    if (loadAssemblyReads(reads, files.i1, files.i2) != 0 || loadAssemblyReads(reads, files.i3, "") != 0)
+        return 1;
+
+    DeBruijnOptions options;
+    options.k = kmerLength;
+    options.threads = threads;
+    std::vector<AssembledContig> contigs;
+    DeBruijnStats stats;
+    assembleDeBruijn(contigs, stats, reads, options);
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+    std::vector<size_t> lengths;
+    for (size_t i = 0; i < contigs.size(); ++i)
+        lengths.push_back(contigs[i].seq.size());
+    std::vector<size_t> builtinLengths = lengths;
+    double builtinSeconds = seconds.count();
+
+    // Velvet on the same read files.
+    CharString assemblyDirectory = "bench_assembly";
+    Triple<CharString> noMatePairs;
+    start = std::chrono::steady_clock::now();
+    if (velvet_assembly(files, noMatePairs, assemblyDirectory, kmerLength, false) != 0)
+        return 1;
+    seconds = std::chrono::steady_clock::now() - start;
+
+    lengths.clear();
+    SeqFileIn velvetContigs(toCString(getFileName(assemblyDirectory, "contigs.fa")));
+    CharString contigName;
+    Dna5String contigSeq;
+    while (!atEnd(velvetContigs))
+    {
+        readRecord(contigName, contigSeq, velvetContigs);
+        lengths.push_back(length(contigSeq));
+    }
+    close(velvetContigs);
+    removeAssemblyDirectory(assemblyDirectory);
+
+    std::cout << "Assembled " << numReads(reads) << " reads with k=" << assemblyKmerLength(kmerLength) << ", ";
+    std::cout << threads << " threads for the built-in assembler." << std::endl;
+    printContigStats("built-in", builtinSeconds, builtinLengths);
+    printContigStats("velvet  ", seconds.count(), lengths);
+
+    return 0;
+}
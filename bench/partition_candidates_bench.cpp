@@ -0,0 +1,142 @@
+// Benchmark of the candidate stages of partitionContigs(): SWIFT filtering against chains of shared minimizers.
+//
+// Simulates contigs of many samples that are partial copies of a set of insertion sequences with few substitutions,
+// half of them reverse complemented, together with sample-specific random contigs. Both candidate stages partition the
+// same contigs. partitionContigs() reports the number of candidates and banded alignments, and the benchmark adds the
+// runtime and the number of components and of insertions whose contigs all end up in one component.
+//
+// Build and run with:  make bench/partition_candidates_bench && bench/partition_candidates_bench [SAMPLES] [THREADS]
+
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <iomanip>
+
+#include "../popins_utils.h"
+#include "../merge/popins_merge.h"
+
+using namespace seqan;
+
+// --------------------------------------------------------------------------
+// Function simulateContigs()
+// --------------------------------------------------------------------------
+
+// Each sample carries each of 300 insertions of 500 to 5000 bp with probability 0.3 as a contig covering 60 to 100%
+// of the insertion with 0.2% substitutions, and 20 random contigs of its own. The insertion of each contig is
+// recorded in origins, -1 for random contigs.
+void
+simulateContigs(String<Contig<Dna5String> > & contigs, std::vector<int> & origins, unsigned numSamples)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> base(0, 3);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    unsigned numInsertions = 300;
+    std::vector<Dna5String> insertions(numInsertions);
+    for (unsigned i = 0; i < numInsertions; ++i)
+    {
+        resize(insertions[i], 500 + rng() % 4500);
+        for (unsigned j = 0; j < length(insertions[i]); ++j)
+            insertions[i][j] = Dna5(base(rng));
+    }
+
+    for (unsigned s = 0; s < numSamples; ++s)
+    {
+        std::ostringstream sample;
+        sample << "sample" << s;
+        CharString pn = sample.str();
+
+        for (unsigned i = 0; i < numInsertions + 20; ++i)
+        {
+            Dna5String seq;
+            if (i < numInsertions)
+            {
+                if (percent(rng) >= 30) continue;
+                unsigned len = length(insertions[i]) * (60 + percent(rng) % 41) / 100;
+                unsigned pos = rng() % (length(insertions[i]) - len + 1);
+                seq = infix(insertions[i], pos, pos + len);
+                for (unsigned j = 0; j < len; ++j)
+                    if (rng() % 500 == 0) seq[j] = Dna5(base(rng));
+                if (percent(rng) < 50)
+                    reverseComplement(seq);
+            }
+            else
+            {
+                resize(seq, 500 + rng() % 2000);
+                for (unsigned j = 0; j < length(seq); ++j)
+                    seq[j] = Dna5(base(rng));
+            }
+
+            std::ostringstream name;
+            name << "contig_" << i;
+            CharString contigId = name.str();
+            ContigId id(pn, contigId, true);
+            appendValue(contigs, Contig<Dna5String>(seq, id));
+            origins.push_back(i < numInsertions ? (int)i : -1);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function runBenchmark()
+// --------------------------------------------------------------------------
+
+void
+runBenchmark(String<Contig<Dna5String> > & contigs,
+        std::vector<int> const & origins,
+        MergingOptions & options,
+        char const * name)
+{
+    typedef Size<Dna5String>::Type TSize;
+
+    ConcurrentUnionFind uf;
+    resize(uf, length(contigs));
+    std::set<Pair<TSize> > alignedPairs;
+    std::map<TSize, ContigComponent<Dna5String> > components;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    partitionContigs(uf, alignedPairs, contigs, options);
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    unionFindToComponents(components, uf, alignedPairs, length(contigs)/2);
+    addSingletons(components, contigs, uf);
+
+    // An insertion is recovered if all of its contigs are in the same component.
+    unsigned fwdContigCount = length(contigs)/2;
+    std::map<int, std::set<int> > insertionComponents;
+    for (unsigned i = 0; i < fwdContigCount; ++i)
+        if (origins[i] >= 0)
+            insertionComponents[origins[i]].insert(std::min(findSet(uf, i), findSet(uf, i + fwdContigCount)));
+    unsigned recovered = 0;
+    for (std::map<int, std::set<int> >::iterator it = insertionComponents.begin(); it != insertionComponents.end(); ++it)
+        if (it->second.size() == 1)
+            ++recovered;
+
+    std::cout << name << std::fixed << std::setprecision(2) << std::setw(10) << seconds.count() << " s"
+              << std::setw(12) << alignedPairs.size() << " aligned pairs" << std::setw(8) << components.size()
+              << " components" << std::setw(6) << recovered << "/" << insertionComponents.size()
+              << " insertions recovered" << std::endl;
+}
+
+int main(int argc, char const ** argv)
+{
+    unsigned numSamples = argc > 1 ? lexicalCast<unsigned>(argv[1]) : 50;
+    unsigned threads = argc > 2 ? lexicalCast<unsigned>(argv[2]) : 4;
+
+    String<Contig<Dna5String> > contigs;
+    std::vector<int> origins;
+    simulateContigs(contigs, origins, numSamples);
+    addReverseComplementContigs(contigs);
+    std::cout << "Partitioning " << length(contigs)/2 << " contigs of " << numSamples << " samples with " << threads
+              << " threads." << std::endl;
+
+    MergingOptions options;
+    options.threads = threads;
+
+    options.candidates = "swift";
+    runBenchmark(contigs, origins, options, "swift     ");
+
+    options.candidates = "minimizer";
+    runBenchmark(contigs, origins, options, "minimizer ");
+
+    return 0;
+}
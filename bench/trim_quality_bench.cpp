@@ -0,0 +1,204 @@
+// Microbenchmark of the quality trimming in removeLowQuality().
+//
+// Compares the throughput of the prefix-sum kernels (scalar, SSE4.1, AVX2, and the runtime selection used by
+// removeLowQuality()) with the previous iterator-based implementation on simulated reads and checks that all of
+// them trim every read identically.
+//
+// Build and run with:  make bench/trim_quality_bench && bench/trim_quality_bench [NUM_READS] [READ_LENGTH]
+
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <iomanip>
+
+#include "../popins_utils.h"
+#include "../assemble/crop_unmapped.h"
+
+using namespace seqan;
+
+// --------------------------------------------------------------------------
+// Function removeLowQualityIterators()
+// --------------------------------------------------------------------------
+
+// The previous implementation of removeLowQuality().
+template<typename TSize_>
+inline bool
+removeLowQualityIterators(BamAlignmentRecord & record, TSize_ qualThresh)
+{
+    typedef Iterator<CharString, Rooted>::Type TIter;
+    typedef Size<CharString>::Type TSize;
+
+    TSize windowSize = std::max(TSize(5), length(record.qual) / 10);
+    TSize windowThresh = qualThresh*windowSize;
+
+    // Initialize windowQual with first windowSize quality values.
+    TSize windowQual = 0;
+    TIter qualEnd = end(record.qual);
+    TIter windowEnd = begin(record.qual) + std::min(windowSize, length(record.qual));
+    TIter windowBegin = begin(record.qual);
+    for (; windowBegin != windowEnd; ++windowBegin)
+        windowQual += *windowBegin - 33;
+
+    // Check quality from the left.
+    for (windowBegin = begin(record.qual); windowEnd < qualEnd; ++windowEnd, ++windowBegin)
+    {
+        if (windowQual >= (TSize)windowThresh)
+        {
+            while (*windowBegin - 33 < qualThresh) ++windowBegin;
+            record.seq = suffix(record.seq, position(windowBegin));
+            record.qual = suffix(record.qual, position(windowBegin));
+            break;
+        }
+
+        windowQual -= *windowBegin - 33;
+        windowQual += *windowEnd - 33;
+    }
+    if (windowEnd == qualEnd) return 1;
+
+    // Initialize windowQual with last windowSize quality values.
+    windowQual = 0;
+    TIter qualBegin = begin(record.qual);
+    windowEnd = end(record.qual) - 1;
+    windowBegin = windowEnd - std::min(windowSize, length(record.qual));
+    for (; windowEnd != windowBegin; --windowEnd)
+        windowQual += *windowEnd - 33;
+
+    // Check quality from the right.
+    for (windowEnd = end(record.qual) - 1; windowBegin >= qualBegin; --windowBegin, --windowEnd)
+    {
+        if (windowQual >= (TSize)windowThresh)
+        {
+            while (*windowEnd - 33 < qualThresh) --windowEnd;
+            record.seq = prefix(record.seq, position(windowEnd) + 1);
+            record.qual = prefix(record.qual, position(windowEnd) + 1);
+            break;
+        }
+
+        windowQual -= *windowEnd - 33;
+        windowQual += *windowBegin -33;
+    }
+
+    if (length(record.seq) < 30) return 1;
+    return 0;
+}
+
+// --------------------------------------------------------------------------
+// Function simulateReads()
+// --------------------------------------------------------------------------
+
+// Reads with good quality in the middle and degrading quality towards the ends, some of them entirely poor.
+void
+simulateReads(String<BamAlignmentRecord> & records, unsigned numReads, unsigned readLength)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> base(0, 3);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    resize(records, numReads);
+    for (unsigned i = 0; i < numReads; ++i)
+    {
+        BamAlignmentRecord & record = records[i];
+        resize(record.seq, readLength);
+        resize(record.qual, readLength);
+
+        bool poor = percent(rng) < 5;
+        unsigned headLength = percent(rng) < 20 ? percent(rng) % 10 : 0;
+        unsigned tailLength = percent(rng) % (readLength / 3);
+        for (unsigned j = 0; j < readLength; ++j)
+        {
+            record.seq[j] = Dna5(base(rng));
+            int q = 25 + percent(rng) % 16;
+            if (poor || j < headLength || j >= readLength - tailLength)
+                q = percent(rng) % 25;
+            record.qual[j] = char(33 + q);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function runBenchmark()
+// --------------------------------------------------------------------------
+
+template<typename TTrim>
+double
+runBenchmark(String<BamAlignmentRecord> & trimmed, String<BamAlignmentRecord> const & records, TTrim trim)
+{
+    trimmed = records;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < length(trimmed); ++i)
+        trimmed[i].flag = trim(trimmed[i]);
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+    return length(records) / seconds.count();
+}
+
+// --------------------------------------------------------------------------
+// Function sameTrimming()
+// --------------------------------------------------------------------------
+
+bool
+sameTrimming(String<BamAlignmentRecord> const & a, String<BamAlignmentRecord> const & b)
+{
+    for (unsigned i = 0; i < length(a); ++i)
+        if (a[i].flag != b[i].flag || a[i].seq != b[i].seq || a[i].qual != b[i].qual)
+            return false;
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Struct KernelTrim
+// --------------------------------------------------------------------------
+
+struct KernelTrim
+{
+    QualityTrimKernels kernels;
+
+    KernelTrim(QualityTrimIsa isa) : kernels(qualityTrimKernels(isa)) {}
+
+    bool operator()(BamAlignmentRecord & record) const
+    {
+        size_t left = 0, right = 0;
+        if (!qualityTrimBounds(left, right, begin(record.qual, Standard()), length(record.qual), 20, kernels))
+            return 1;
+        record.seq = infix(record.seq, left, right);
+        record.qual = infix(record.qual, left, right);
+        return length(record.seq) < 30;
+    }
+};
+
+int main(int argc, char const ** argv)
+{
+    unsigned numReads = argc > 1 ? lexicalCast<unsigned>(argv[1]) : 1000000;
+    unsigned readLength = argc > 2 ? lexicalCast<unsigned>(argv[2]) : 150;
+
+    String<BamAlignmentRecord> records, reference, trimmed;
+    simulateReads(records, numReads, readLength);
+
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << "Trimming " << numReads << " reads of length " << readLength << "." << std::endl;
+
+    double rate = runBenchmark(reference, records, [](BamAlignmentRecord & r) { return removeLowQualityIterators(r, 20); });
+    std::cout << "iterators (previous)    " << std::setw(12) << rate << " reads/s" << std::endl;
+
+    rate = runBenchmark(trimmed, records, [](BamAlignmentRecord & r) { return removeLowQuality(r, 20); });
+    std::cout << "removeLowQuality()      " << std::setw(12) << rate << " reads/s"
+              << (sameTrimming(reference, trimmed) ? "" : "  MISMATCH") << std::endl;
+
+    char const * names[] = {"scalar prefix sums      ", "SSE4.1 prefix sums      ", "AVX2 prefix sums        "};
+    QualityTrimIsa isas[] = {TRIM_ISA_SCALAR, TRIM_ISA_SSE41, TRIM_ISA_AVX2};
+    for (unsigned i = 0; i < 3; ++i)
+    {
+#ifdef POPINS_TRIM_X86
+        if (isas[i] == TRIM_ISA_SSE41 && !__builtin_cpu_supports("sse4.1")) continue;
+        if (isas[i] == TRIM_ISA_AVX2 && !__builtin_cpu_supports("avx2")) continue;
+#else
+        if (isas[i] != TRIM_ISA_SCALAR) continue;
+#endif
+        rate = runBenchmark(trimmed, records, KernelTrim(isas[i]));
+        std::cout << names[i] << std::setw(12) << rate << " reads/s"
+                  << (sameTrimming(reference, trimmed) ? "" : "  MISMATCH") << std::endl;
+    }
+
+    return 0;
+}
@@ -13,23 +13,35 @@ using namespace seqan;
 // ==========================================================================
 
 struct AssemblyOptions {
-    CharString mappingFile;
+    String<CharString> mappingFiles;
+    CharString mappingFile;  // The first of the mapping files.
     CharString matepairFile;
     CharString referenceFile;
 
     CharString prefix;
     CharString sampleID;
+    CharString tmpDir;
 
     unsigned kmerLength;
+    CharString assembler;
     CharString adapters;
+    unsigned adapterErrors;
     int humanSeqs;
 
+    bool singlePass;
+    bool fastStats;
+    bool binQualities;
+    bool exportFastq;
+
     unsigned threads;
+    unsigned shards;
     CharString memory;
+    int compressionLevel;
 
     AssemblyOptions () :
-        matepairFile(""), referenceFile(""), prefix("."), sampleID(""),
-      kmerLength(47), humanSeqs(maxValue<int>()), threads(1), memory("768M")
+        matepairFile(""), referenceFile(""), prefix("."), sampleID(""), tmpDir(""),
+      kmerLength(47), assembler("velvet"), adapterErrors(1), humanSeqs(maxValue<int>()), singlePass(false), fastStats(false), binQualities(false), exportFastq(false), threads(1), shards(1), memory("768M"),
+      compressionLevel(6)
     {}
 };
 
@@ -38,6 +50,8 @@ struct MergingOptions {
     CharString outputFile;
     CharString skippedFile;
     CharString contigsFileName;
+    CharString stateFile;
+    CharString updateFile;
     std::fstream outputStream;
     std::fstream skippedStream;
     bool verbose;
@@ -52,9 +66,18 @@ struct MergingOptions {
 
     double minEntropy;
 
+    CharString candidates;
+    unsigned minimizerLength;
+    unsigned minimizerWindow;
+    bool benchmarkCandidates;
+
+    unsigned threads;
+
     MergingOptions() :
-        prefix("."), outputFile("supercontigs.fa"), skippedFile(""), contigsFileName("contigs.fa"), verbose(false),
-        errorRate(0.01), minimalLength(60), qgramLength(47), matchScore(1), errorPenalty(-5), minScore(90), minTipScore(30), minEntropy(0.75)
+        prefix("."), outputFile("supercontigs.fa"), skippedFile(""), contigsFileName("contigs.fa"), stateFile(""),
+        updateFile(""), verbose(false),
+        errorRate(0.01), minimalLength(60), qgramLength(47), matchScore(1), errorPenalty(-5), minScore(90), minTipScore(30), minEntropy(0.75),
+        candidates("swift"), minimizerLength(19), minimizerWindow(10), benchmarkCandidates(false), threads(1)
     {}
 };
 
@@ -101,10 +124,15 @@ struct PlacingOptions {
     unsigned maxInsertSize;
     unsigned groupDist;
 
+    // Take the read length and insert size from the sample info unless given on the command line.
+    bool sampleReadLength;
+    bool sampleInsertSize;
+
     PlacingOptions() :
         prefix("."), sampleID(""), outFile("insertions.vcf"), locationsFile("locations.txt"), groupsFile("groups.txt"),
         supercontigFile("supercontigs.fa"), referenceFile("genome.fa"),
-        minLocScore(0.3), minAnchorReads(2), readLength(100), maxInsertSize(800), groupDist(100)
+        minLocScore(0.3), minAnchorReads(2), readLength(100), maxInsertSize(800), groupDist(100),
+        sampleReadLength(false), sampleInsertSize(false)
     {}
 };
 
@@ -121,6 +149,7 @@ struct GenotypingOptions {
     bool addReadGroup;
 
     int maxInsertSize;
+    bool sampleInsertSize;      // Take the insert size from the sample info unless given on the command line.
     int bpQclip;
     int minSeqLen;
     double minReadProb;
@@ -141,7 +170,7 @@ struct GenotypingOptions {
     GenotypingOptions() :
         prefix("."), sampleID(""), referenceFile("genome.fa"), supercontigFile("supercontigs.fa"), vcfFile("insertions.vcf"),
       genotypingModel("RANDOM"), regionWindowSize(50), addReadGroup(false),
-        maxInsertSize(500), bpQclip(0), minSeqLen(10), minReadProb(0.00001), maxBARcount(200),
+        maxInsertSize(500), sampleInsertSize(false), bpQclip(0), minSeqLen(10), minReadProb(0.00001), maxBARcount(200),
         match(1), mismatch(-2), gapOpen(-4), gapExtend(-1), minAlignScore(55),
       verbose(false), callBoth(false), useReadCounts(false), fullOverlap(false)
     {}
@@ -156,6 +185,7 @@ setHiddenOptions(ArgumentParser & parser, bool hide, AssemblyOptions &)
 {
    hideOption(parser, "matePair", hide);
    hideOption(parser, "kmerLength", hide);
+   hideOption(parser, "adapterErrors", hide);
 }
 
 void
@@ -170,6 +200,9 @@ setHiddenOptions(ArgumentParser & parser, bool hide, MergingOptions &)
    hideOption(parser, "t", hide);
    hideOption(parser, "v", hide);
    hideOption(parser, "f", hide);
+   hideOption(parser, "minimizerLength", hide);
+   hideOption(parser, "minimizerWindow", hide);
+   hideOption(parser, "benchmarkCandidates", hide);
 }
 
 void
@@ -228,42 +261,67 @@ setupParser(ArgumentParser & parser, AssemblyOptions & options)
     setDate(parser, VERSION_DATE);
 
     // Define usage line and long description.
-    addUsageLine(parser, "[\\fIOPTIONS\\fP] \\fIBAM_FILE\\fP");
+    addUsageLine(parser, "[\\fIOPTIONS\\fP] \\fIBAM_FILE\\fP [\\fIBAM_FILE\\fP ...]");
     addDescription(parser, "Finds reads without high-quality alignment in the \\fIBAM FILE\\fP, quality filters them "
-          "using SICKLE and assembles them into contigs using VELVET. If the option \'--reference \\fIFASTA FILE\\fP\' "
+          "and assembles them into contigs using VELVET. If the option \'--reference \\fIFASTA FILE\\fP\' "
           "is set, the reads are first remapped to this reference using BwA-MEM and only reads that remain without "
           "high-quality alignment after remapping are quality-filtered and assembled.");
+    addDescription(parser, "Several BAM files of the sample, e.g. one per lane, are cropped in parallel as if they were "
+          "merged into one BAM file. They need to be aligned to the same reference sequences.");
 
-    // Require a bam file as argument.
-    addArgument(parser, ArgParseArgument(ArgParseArgument::INPUT_FILE, "BAM_FILE"));
+    // Require one or more bam files as arguments.
+    addArgument(parser, ArgParseArgument(ArgParseArgument::INPUT_FILE, "BAM_FILE", true));
 
     // Setup the options.
     addSection(parser, "Input/output options");
     addOption(parser, ArgParseOption("p", "prefix", "Path to the sample directories.", ArgParseArgument::STRING, "PATH"));
     addOption(parser, ArgParseOption("s", "sample", "An ID for the sample.", ArgParseArgument::STRING, "SAMPLE_ID"));
     addOption(parser, ArgParseOption("mp", "matePair", "", ArgParseArgument::INPUT_FILE, "BAM FILE"));
+    addOption(parser, ArgParseOption("", "binQualities", "Store the qualities of the cropped reads in 8 bins (Illumina scheme) in the read store."));
+    addOption(parser, ArgParseOption("", "exportFastq", "Export the cropped reads from the read store to paired.1.fastq, paired.2.fastq, and single.fastq."));
+    addOption(parser, ArgParseOption("", "tmpdir", "Directory for temporary files, e.g. on node-local storage. Only the results are moved to the sample directory. "
+          "Use 'ram' for the RAM-backed /dev/shm.", ArgParseArgument::STRING, "PATH"));
 
     addSection(parser, "Algorithm options");
     addOption(parser, ArgParseOption("a", "adapters", "Enable adapter removal for Illumina reads. Default: \\fIno adapter removal\\fP.", ArgParseArgument::STRING, "STR"));
+    addOption(parser, ArgParseOption("", "adapterErrors", "Maximum number of mismatches in adapter sequences found at read ends.", ArgParseArgument::INTEGER, "INT"));
     addOption(parser, ArgParseOption("r", "reference", "Remap reads to this reference before assembly. Default: \\fIno remapping\\fP.", ArgParseArgument::INPUT_FILE, "FASTA_FILE"));
     addOption(parser, ArgParseOption("f", "filter", "Treat reads aligned to all but the first INT reference sequences after remapping as high-quality aligned even if their alignment quality is low. "
           "Recommended for non-human reference sequences.", ArgParseArgument::INTEGER, "INT"));
-    addOption(parser, ArgParseOption("k", "kmerLength", "The k-mer size for velvet assembly.", ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, ArgParseOption("k", "kmerLength", "The k-mer size for the assembly.", ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, ArgParseOption("", "assembler", "Assemble with VELVET or with the built-in multi-threaded de Bruijn graph assembler.", ArgParseArgument::STRING, "STR"));
+    addOption(parser, ArgParseOption("", "singlePass", "Crop the BAM file in a single pass without using the BAM index. "
+          "Implied if \\fIBAM_FILE\\fP is '-' for reading from stdin, which requires the option '--sample'."));
+    addOption(parser, ArgParseOption("", "fastStats", "Estimate the average coverage from the BAM index and sampled records instead of counting the aligned bases while cropping."));
 
     addSection(parser, "Compute resource options");
-    addOption(parser, ArgParseOption("t", "threads", "Number of threads to use for BWA and samtools sort.", ArgParseArgument::INTEGER, "INT"));
-    addOption(parser, ArgParseOption("m", "memory", "Maximum memory per thread for samtools sort; suffix K/M/G recognized.", ArgParseArgument::STRING, "STR"));
+    addOption(parser, ArgParseOption("t", "threads", "Number of threads to use for cropping, BWA, sorting, BAM compression, and the built-in assembler.", ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, ArgParseOption("m", "memory", "Maximum memory per thread for sorting and for unpaired reads held while cropping; suffix K/M/G recognized.", ArgParseArgument::STRING, "STR"));
+    addOption(parser, ArgParseOption("", "shards", "Crop the BAM file in INT genomic regions in parallel using the BAM index.", ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, ArgParseOption("", "compressionLevel", "Compression level of the non_ref.bam file. Temporary BAM files are compressed with level 1.", ArgParseArgument::INTEGER, "INT"));
 
     // Set valid and default values.
     setValidValues(parser, "adapters", "HiSeq HiSeqX");
+    setValidValues(parser, "assembler", "velvet builtin");
     setValidValues(parser, "reference", "fa fna fasta gz");
     setMinValue(parser, "threads", "1");
+    setMinValue(parser, "shards", "1");
+    setMinValue(parser, "kmerLength", "15");
+    setMinValue(parser, "compressionLevel", "0");
+    setMaxValue(parser, "compressionLevel", "9");
+    setMinValue(parser, "adapterErrors", "0");
+    setMaxValue(parser, "adapterErrors", "3");
 
     setDefaultValue(parser, "prefix", "\'.\'");
     setDefaultValue(parser, "sample", "retrieval from BAM file header");
+    setDefaultValue(parser, "tmpdir", "the sample directory");
     setDefaultValue(parser, "kmerLength", options.kmerLength);
+    setDefaultValue(parser, "assembler", options.assembler);
+    setDefaultValue(parser, "adapterErrors", options.adapterErrors);
     setDefaultValue(parser, "threads", options.threads);
     setDefaultValue(parser, "memory", options.memory);
+    setDefaultValue(parser, "shards", options.shards);
+    setDefaultValue(parser, "compressionLevel", options.compressionLevel);
 
     // Hide some options from default help.
     setHiddenOptions(parser, true, options);
@@ -289,6 +347,8 @@ setupParser(ArgumentParser & parser, MergingOptions & options)
     addOption(parser, ArgParseOption("c", "contigs", "Name of supercontigs output file.", ArgParseArgument::OUTPUT_FILE, "FASTA_FILE"));
     addOption(parser, ArgParseOption("s", "skipped", "Write skipped contigs to a file. Default: \\fIdo not write skipped contigs\\fP", ArgParseArgument::OUTPUT_FILE, "FASTA_FILE"));
     addOption(parser, ArgParseOption("v", "verbose", "Enable verbose output of components."));
+    addOption(parser, ArgParseOption("", "saveState", "Write the contigs, aligned pairs, and supercontigs to a state file for later updates. Default: \\fIdo not write a state file\\fP", ArgParseArgument::OUTPUT_FILE, "FILE"));
+    addOption(parser, ArgParseOption("", "update", "Update the merge saved in a state file: only contigs not in the state file are aligned and only components that changed are merged again. Default: \\fImerge all contigs\\fP", ArgParseArgument::INPUT_FILE, "FILE"));
 
     addSection(parser, "Algorithm options");
     addOption(parser, ArgParseOption("y", "minEntropy", "Ignore low-complexity contigs with entropy below FLOAT. Use 0 to disable.", ArgParseArgument::DOUBLE, "FLOAT"));
@@ -300,6 +360,13 @@ setupParser(ArgumentParser & parser, MergingOptions & options)
     addOption(parser, ArgParseOption("mm", "penalty", "Error penalty for Smith-Waterman alignment.", ArgParseArgument::INTEGER, "INT"));
     addOption(parser, ArgParseOption("a", "minScore", "Minimal score for Smith-Waterman alignment.", ArgParseArgument::INTEGER, "INT"));
     addOption(parser, ArgParseOption("t", "minTipScore", "Minimal score for tips in supercontig graph.", ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, ArgParseOption("", "candidates", "Method for finding candidate pairs of similar contigs, SWIFT filtering or chains of shared (w,k)-minimizers.", ArgParseArgument::STRING, "STR"));
+    addOption(parser, ArgParseOption("", "minimizerLength", "Length k of minimizers.", ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, ArgParseOption("", "minimizerWindow", "Number w of consecutive k-mers from which a minimizer is chosen.", ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, ArgParseOption("", "benchmarkCandidates", "Partition the contigs also with the other candidate method and report its candidates, runtime, and components."));
+
+    addSection(parser, "Compute resource options");
+    addOption(parser, ArgParseOption("", "threads", "Number of threads to use for partitioning the contigs and constructing supercontigs.", ArgParseArgument::INTEGER, "INT"));
 
     // Set valid values.
     setValidValues(parser, "c", "fa fna fasta");
@@ -311,6 +378,11 @@ setupParser(ArgumentParser & parser, MergingOptions & options)
     setMinValue(parser, "l", "3");
     setMinValue(parser, "k", "3");
     setMinValue(parser, "t", "0");
+    setValidValues(parser, "candidates", "swift minimizer");
+    setMinValue(parser, "minimizerLength", "3");
+    setMaxValue(parser, "minimizerLength", "31");
+    setMinValue(parser, "minimizerWindow", "1");
+    setMinValue(parser, "threads", "1");
 
     // Set default values.
     setDefaultValue(parser, "prefix", "\'.\'");
@@ -325,6 +397,10 @@ setupParser(ArgumentParser & parser, MergingOptions & options)
     setDefaultValue(parser, "mm", options.errorPenalty);
     setDefaultValue(parser, "a", options.minScore);
     setDefaultValue(parser, "t", options.minTipScore);
+    setDefaultValue(parser, "candidates", options.candidates);
+    setDefaultValue(parser, "minimizerLength", options.minimizerLength);
+    setDefaultValue(parser, "minimizerWindow", options.minimizerWindow);
+    setDefaultValue(parser, "threads", options.threads);
 
     // Hide some options from default help.
     setHiddenOptions(parser, true, options);
@@ -357,8 +433,8 @@ setupParser(ArgumentParser & parser, ContigMapOptions & options)
     addOption(parser, ArgParseOption("d", "noNonRefNew", "Delete the non_ref_new.bam file after writing locations."));
 
     addSection(parser, "Compute resource options");
-    addOption(parser, ArgParseOption("t", "threads", "Number of threads to use for BWA and samtools sort.", ArgParseArgument::INTEGER, "INT"));
-    addOption(parser, ArgParseOption("m", "memory", "Maximum memory per thread for samtools sort; suffix K/M/G recognized.", ArgParseArgument::STRING, "STR"));
+    addOption(parser, ArgParseOption("t", "threads", "Number of threads to use for BWA, sorting, and BAM compression.", ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, ArgParseOption("m", "memory", "Maximum memory per thread for sorting; suffix K/M/G recognized.", ArgParseArgument::STRING, "STR"));
 
     // Set valid values.
     setMinValue(parser, "threads", "1");
@@ -459,8 +535,8 @@ setupParser(ArgumentParser & parser, PlacingOptions<SplitAlign> & options)
     addOption(parser, ArgParseOption("r", "reference", "Name of reference genome file.", ArgParseArgument::INPUT_FILE, "FASTA_FILE"));
 
     addSection(parser, "Algorithm options");
-    addOption(parser, ArgParseOption("", "maxInsertSize", "The maximum expected insert size of the read pairs.", ArgParseArgument::INTEGER, "INT"));
-    addOption(parser, ArgParseOption("", "readLength", "The length of the reads.", ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, ArgParseOption("", "maxInsertSize", "The maximum expected insert size of the read pairs. If set, overrides the estimate in the sample info.", ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, ArgParseOption("", "readLength", "The length of the reads. If set, overrides the read length in the sample info.", ArgParseArgument::INTEGER, "INT"));
 
     // Set valid values.
     setValidValues(parser, "contigs", "fa fna fasta");
@@ -538,7 +614,7 @@ setupParser(ArgumentParser & parser, GenotypingOptions & options)
     addOption(parser, ArgParseOption("rg", "addReadGroup", "Add read group."));
 
     addSection(parser, "Read(-pair) options");
-    addOption(parser, ArgParseOption("", "maxInsertSize", "Maximum read pair insert size.", ArgParseArgument::INTEGER, "INT"));
+    addOption(parser, ArgParseOption("", "maxInsertSize", "Maximum read pair insert size. If set, overrides the estimate in the sample info.", ArgParseArgument::INTEGER, "INT"));
     addOption(parser, ArgParseOption("", "qual", "Quality score threshold for read trimming.", ArgParseArgument::INTEGER, "INT"));
     addOption(parser, ArgParseOption("", "minSeqLen", "Minimum read length after trimming.", ArgParseArgument::INTEGER, "INT"));
     addOption(parser, ArgParseOption("", "minReadProb", "Minimum read probability.", ArgParseArgument::DOUBLE, "DOUBLE"));
@@ -597,7 +673,10 @@ setupParser(ArgumentParser & parser, GenotypingOptions & options)
 void
 getOptionValues(AssemblyOptions & options, ArgumentParser const & parser)
 {
-    getArgumentValue(options.mappingFile, parser, 0);
+    std::vector<std::string> const & mappingFiles = getArgumentValues(parser, 0);
+    for (unsigned i = 0; i < mappingFiles.size(); ++i)
+        appendValue(options.mappingFiles, mappingFiles[i]);
+    options.mappingFile = options.mappingFiles[0];
 
     if (isSet(parser, "prefix"))
        getOptionValue(options.prefix, parser, "prefix");
@@ -605,18 +684,34 @@ getOptionValues(AssemblyOptions & options, ArgumentParser const & parser)
        getOptionValue(options.sampleID, parser, "sample");
     if (isSet(parser, "matePair"))
         getOptionValue(options.matepairFile, parser, "matePair");
+    if (isSet(parser, "tmpdir"))
+        getOptionValue(options.tmpDir, parser, "tmpdir");
+    if (options.tmpDir == "ram")
+        options.tmpDir = "/dev/shm";
     if (isSet(parser, "adapters"))
         getOptionValue(options.adapters, parser, "adapters");
+    if (isSet(parser, "adapterErrors"))
+        getOptionValue(options.adapterErrors, parser, "adapterErrors");
     if (isSet(parser, "reference"))
         getOptionValue(options.referenceFile, parser, "reference");
     if (isSet(parser, "filter"))
         getOptionValue(options.humanSeqs, parser, "filter");
     if (isSet(parser, "kmerLength"))
         getOptionValue(options.kmerLength, parser, "kmerLength");
+    if (isSet(parser, "assembler"))
+        getOptionValue(options.assembler, parser, "assembler");
     if (isSet(parser, "threads"))
         getOptionValue(options.threads, parser, "threads");
     if (isSet(parser, "memory"))
         getOptionValue(options.memory, parser, "memory");
+    if (isSet(parser, "shards"))
+        getOptionValue(options.shards, parser, "shards");
+    if (isSet(parser, "compressionLevel"))
+        getOptionValue(options.compressionLevel, parser, "compressionLevel");
+    options.singlePass = isSet(parser, "singlePass") || options.mappingFile == "-";
+    options.fastStats = isSet(parser, "fastStats");
+    options.binQualities = isSet(parser, "binQualities");
+    options.exportFastq = isSet(parser, "exportFastq");
 }
 
 void
@@ -634,6 +729,10 @@ getOptionValues(MergingOptions & options, ArgumentParser & parser)
         getOptionValue(options.skippedFile, parser, "skipped");
     if (isSet(parser, "verbose"))
         options.verbose = true;
+    if (isSet(parser, "saveState"))
+        getOptionValue(options.stateFile, parser, "saveState");
+    if (isSet(parser, "update"))
+        getOptionValue(options.updateFile, parser, "update");
 
     if (isSet(parser, "minEntropy"))
         getOptionValue(options.minEntropy, parser, "minEntropy");
@@ -652,6 +751,16 @@ getOptionValues(MergingOptions & options, ArgumentParser & parser)
         getOptionValue(options.errorPenalty, parser, "penalty");
     if (isSet(parser, "minTipScore"))
         getOptionValue(options.minTipScore, parser, "minTipScore");
+    if (isSet(parser, "candidates"))
+        getOptionValue(options.candidates, parser, "candidates");
+    if (isSet(parser, "minimizerLength"))
+        getOptionValue(options.minimizerLength, parser, "minimizerLength");
+    if (isSet(parser, "minimizerWindow"))
+        getOptionValue(options.minimizerWindow, parser, "minimizerWindow");
+    options.benchmarkCandidates = isSet(parser, "benchmarkCandidates");
+
+    if (isSet(parser, "threads"))
+        getOptionValue(options.threads, parser, "threads");
 }
 
 void
@@ -721,6 +830,8 @@ getOptionValues(PlacingOptions<SplitAlign> & options, ArgumentParser & parser)
         getOptionValue(options.maxInsertSize, parser, "maxInsertSize");
     if (isSet(parser, "readLength"))
         getOptionValue(options.readLength, parser, "readLength");
+    options.sampleInsertSize = !isSet(parser, "maxInsertSize");
+    options.sampleReadLength = !isSet(parser, "readLength");
 }
 
 void
@@ -767,6 +878,7 @@ getOptionValues(GenotypingOptions & options, ArgumentParser & parser)
 
     if (isSet(parser, "maxInsertSize"))
         getOptionValue(options.maxInsertSize, parser, "maxInsertSize");
+    options.sampleInsertSize = !isSet(parser, "maxInsertSize");
     if (isSet(parser, "minReadProb"))
         getOptionValue(options.minReadProb, parser, "minReadProb");
     if (isSet(parser, "maxReadCount"))
@@ -793,26 +905,66 @@ checkInput(AssemblyOptions & options)
 		res = ArgumentParser::PARSE_ERROR;
 	}
 
-	if (!exists(options.mappingFile))
+	if (options.mappingFile == "-")
 	{
-		std::cerr << "ERROR: Input BAM file \'" << options.mappingFile << "\' does not exist." << std::endl;
-		res = ArgumentParser::PARSE_ERROR;
+		if (options.sampleID == "")
+		{
+			std::cerr << "ERROR: A sample ID is required when reading the BAM file from stdin." << std::endl;
+			res = ArgumentParser::PARSE_ERROR;
+		}
 	}
 
-	CharString baiFile = options.mappingFile;
-	baiFile += ".bai";
-	if (!exists(baiFile))
+	if (length(options.mappingFiles) > 1 && options.singlePass)
 	{
-		std::cerr << "ERROR: BAM index file \'" << baiFile << "\' does not exist." << std::endl;
+		std::cerr << "ERROR: Several BAM files cannot be read in a single pass or from stdin." << std::endl;
 		res = ArgumentParser::PARSE_ERROR;
 	}
 
+	for (unsigned i = 0; i < length(options.mappingFiles); ++i)
+	{
+		if (options.mappingFiles[i] == "-")
+			continue;
+
+		if (length(options.mappingFiles) > 1 &&
+		    std::find(begin(options.mappingFiles[i]), end(options.mappingFiles[i]), ',') != end(options.mappingFiles[i]))
+		{
+			std::cerr << "ERROR: Path of BAM file \'" << options.mappingFiles[i] << "\' contains a comma, which separates several BAM files in POPINS_SAMPLE_INFO." << std::endl;
+			res = ArgumentParser::PARSE_ERROR;
+		}
+
+		if (!exists(options.mappingFiles[i]))
+		{
+			std::cerr << "ERROR: Input BAM file \'" << options.mappingFiles[i] << "\' does not exist." << std::endl;
+			res = ArgumentParser::PARSE_ERROR;
+		}
+
+		CharString baiFile = options.mappingFiles[i];
+		baiFile += ".bai";
+		if (!options.singlePass && !exists(baiFile))
+		{
+			std::cerr << "ERROR: BAM index file \'" << baiFile << "\' does not exist." << std::endl;
+			res = ArgumentParser::PARSE_ERROR;
+		}
+	}
+
 	if (options.matepairFile != "" && !exists(options.matepairFile))
 	{
 		std::cerr << "ERROR: Input BAM file \'" << options.matepairFile << "\' does not exist." << std::endl;
 		res = ArgumentParser::PARSE_ERROR;
 	}
 
+	if (options.assembler == "builtin" && options.kmerLength > 63)
+	{
+		std::cerr << "ERROR: The k-mer length of the built-in assembler is at most 63." << std::endl;
+		res = ArgumentParser::PARSE_ERROR;
+	}
+
+	if (parseMemory(options.memory) == 0)
+	{
+		std::cerr << "ERROR: Invalid memory size \'" << options.memory << "\'." << std::endl;
+		res = ArgumentParser::PARSE_ERROR;
+	}
+
 	return res;
 }
 
@@ -833,6 +985,12 @@ checkInput(MergingOptions & options)
 		res = ArgumentParser::PARSE_ERROR;
 	}
 
+	if (options.updateFile != "" && !exists(options.updateFile))
+	{
+		std::cerr << "ERROR: State file \'" << options.updateFile << "\' does not exist." << std::endl;
+		res = ArgumentParser::PARSE_ERROR;
+	}
+
 	return res;
 }
 
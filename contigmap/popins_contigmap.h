@@ -19,15 +19,14 @@ using namespace seqan;
 // ==========================================================================
 
 bool
-write_fastq(CharString & fastqFirst,
-        CharString & fastqSecond,
-        CharString & fastqSingle,
-        CharString & unmappedBam)
+write_fastq(CharString & readsFile,
+        CharString & unmappedBam,
+        size_t storeMemory)
 {
-    typedef std::map<CharString, Pair<CharString> > TFastqMap;
-
-    // Create maps for fastq records (first read in pair and second read in pair).
-    TFastqMap firstReads, secondReads;
+    // Create stores for fastq records (first read in pair and second read in pair).
+    std::string storePrefix = toCString(readsFile);
+    FastqStore firstReads(storePrefix + ".first", storeMemory / 2);
+    FastqStore secondReads(storePrefix + ".second", storeMemory / 2);
 
     // Open bam file.
     BamFileIn inStream(toCString(unmappedBam));
@@ -37,10 +36,10 @@ write_fastq(CharString & fastqFirst,
     readHeader(header, inStream);
     clear(header);
 
-    // Open the output fastq files.    
-    SeqFileOut fastqFirstStream(toCString(fastqFirst));
-    SeqFileOut fastqSecondStream(toCString(fastqSecond));
-    SeqFileOut fastqSingleStream(toCString(fastqSingle));
+    // Open the output read store.
+    CropFastqOut fastqOut;
+    if (!open(fastqOut, readsFile, CROP_READ_STORE, Triple<CharString>()))
+        return 1;
 
     // Iterate over bam file and append fastq records.
     BamAlignmentRecord record;
@@ -48,11 +47,84 @@ write_fastq(CharString & fastqFirst,
     {
         readRecord(record, inStream);
         if (hasFlagUnmapped(record))
-            appendFastqRecord(fastqFirstStream, fastqSecondStream, firstReads, secondReads, record);
+            appendFastqRecord(firstReads, secondReads, record);
+    }
+
+    // Write the read store.
+    if (writeFastq(fastqOut, firstReads, secondReads) != 0) return 1;
+
+    return 0;
+}
+
+// ==========================================================================
+// Function interleave_fastq()
+// ==========================================================================
+
+// Writes the pairs and single reads into one fastq file in read name order, the two reads of a pair one after the
+// other, for bwa's smart pairing. Used for sample directories with fastq files instead of a read store.
+bool
+interleave_fastq(CharString const & outFile,
+        CharString const & fastqFirst,
+        CharString const & fastqSecond,
+        CharString const & fastqSingle)
+{
+    SeqFileIn firstStream, secondStream, singleStream;
+    if (!open(firstStream, toCString(fastqFirst)) || !open(secondStream, toCString(fastqSecond)) ||
+            !open(singleStream, toCString(fastqSingle)))
+    {
+        std::cerr << "ERROR: Could not open fastq files " << fastqFirst << ", " << fastqSecond << ", ";
+        std::cerr << fastqSingle << " for reading." << std::endl;
+        return 1;
+    }
+
+    SeqFileOut outStream;
+    if (!open(outStream, toCString(outFile)))
+    {
+        std::cerr << "ERROR: Could not open fastq file " << outFile << " for writing." << std::endl;
+        return 1;
+    }
+
+    CharString name, seq, qual, mateName, mateSeq, mateQual, singleName, singleSeq, singleQual;
+
+    bool hasPair = !atEnd(firstStream);
+    if (hasPair)
+    {
+        readRecord(name, seq, qual, firstStream);
+        readRecord(mateName, mateSeq, mateQual, secondStream);
     }
+    bool hasSingle = !atEnd(singleStream);
+    if (hasSingle)
+        readRecord(singleName, singleSeq, singleQual, singleStream);
 
-    // Write the fastq files.
-    if (writeFastq(fastqFirstStream, fastqSecondStream, fastqSingleStream, firstReads, secondReads) != 0) return 1;
+    while (hasPair || hasSingle)
+    {
+        if (hasPair && (!hasSingle || lessFastqName(begin(name, Standard()), length(name),
+                                                    begin(singleName, Standard()), length(singleName))))
+        {
+            writeRecord(outStream, name, seq, qual);
+            writeRecord(outStream, mateName, mateSeq, mateQual);
+
+            hasPair = !atEnd(firstStream);
+            if (hasPair != !atEnd(secondStream))
+            {
+                std::cerr << "ERROR: Different numbers of reads in " << fastqFirst << " and " << fastqSecond << std::endl;
+                return 1;
+            }
+            if (hasPair)
+            {
+                readRecord(name, seq, qual, firstStream);
+                readRecord(mateName, mateSeq, mateQual, secondStream);
+            }
+        }
+        else
+        {
+            writeRecord(outStream, singleName, singleSeq, singleQual);
+
+            hasSingle = !atEnd(singleStream);
+            if (hasSingle)
+                readRecord(singleName, singleSeq, singleQual, singleStream);
+        }
+    }
 
     return 0;
 }
@@ -61,19 +133,34 @@ write_fastq(CharString & fastqFirst,
 // Function fill_sequences()
 // ==========================================================================
 
+// Reads bwa's output from a pipe, fills in the sequences of secondary records, and writes the records sorted by read
+// name. The records are written directly as long as they are in order, which they are if bwa aligned fastq files
+// sorted by read name. Otherwise, the rest is sorted and merged with the records written so far.
 bool
-fill_sequences(CharString & outFile, CharString & inFile)
+fill_sequences(CharString & outFile, std::string const & bwaCommand, size_t memory, unsigned threads)
 {
     typedef Position<Dna5String>::Type TPos;
 
-    BamFileIn inStream(toCString(inFile));
-    BamFileOut outStream(context(inStream), toCString(outFile));
-
+    SamPipe bwaPipe(bwaCommand);
     BamHeader header;
-    readHeader(header, inStream);
+    if (!openSamPipe(bwaPipe, header))
+        return 1;
+    BamFileIn & inStream = bwaPipe.samStream;
+
+    // The output is merged with non_ref.bam and needs little compression.
+    ParallelBamFileOut outStream;
+    if (!open(outStream, outFile, context(inStream), threads, BGZF_INTERMEDIATE_LEVEL))
+        return 1;
+    BamNameSorter sorter(outFile, memory, threads);
+    CharString presortedFile = outFile;
+    presortedFile += ".presorted.bam";
+
+    setSortOrder(header, "queryname");
     writeHeader(outStream, header);
 
-    BamAlignmentRecord firstRecord, nextRecord;
+    bool presorted = true;
+    LessBamName less;
+    BamAlignmentRecord firstRecord, nextRecord, lastRecord;
     while (!atEnd(inStream))
     {
         readRecord(nextRecord, inStream);
@@ -115,12 +202,49 @@ fill_sequences(CharString & outFile, CharString & inFile)
             }
         }
 
-        writeRecord(outStream, nextRecord);
+        // Write the record directly if it is in order.
+        if (presorted && !less(nextRecord, lastRecord))
+        {
+            writeRecord(outStream, nextRecord);
+            lastRecord.qName = nextRecord.qName;
+            lastRecord.flag = nextRecord.flag;
+            continue;
+        }
+
+        if (presorted)
+        {
+            printStatus("BWA output is not sorted by read name, sorting the remaining records.");
+            presorted = false;
+            if (!close(outStream))
+                return 1;
+            if (std::rename(toCString(outFile), toCString(presortedFile)) != 0)
+            {
+                std::cerr << "ERROR: Could not rename " << outFile << " to " << presortedFile << std::endl;
+                return 1;
+            }
+        }
+        writeRecord(sorter, nextRecord);
     }
 
-    close(outStream);
+    if (!closeSamPipe(bwaPipe))
+        return 1;
 
-    return 0;
+    if (presorted)
+        return !close(outStream);
+
+    // Merge the records written directly with the sorted rest.
+    BamFileIn presortedStream(toCString(presortedFile));
+    BamHeader presortedHeader;
+    readHeader(presortedHeader, presortedStream);
+
+    ParallelBamFileOut sortedStream;
+    if (!open(sortedStream, outFile, context(inStream), threads, BGZF_INTERMEDIATE_LEVEL))
+        return 1;
+    writeHeader(sortedStream, header);
+    bool failed = writeSortedRecords(sortedStream, sorter, &presortedStream) != 0 || !close(sortedStream);
+    remove(toCString(presortedFile));
+
+    return failed;
 }
 
 
@@ -138,7 +262,8 @@ int popins_contigmap(int argc, char const ** argv)
 
     CharString workingDirectory = getFileName(options.prefix, options.sampleID);
 
-    // Check for input files to exist.
+    // Check for input files to exist. Sample directories of earlier versions have fastq files instead of a read store.
+    CharString readsFile = getFileName(workingDirectory, "unmapped_reads.bin");
     CharString fastqFirst = getFileName(workingDirectory, "paired.1.fastq");
     CharString fastqSecond = getFileName(workingDirectory, "paired.2.fastq");
     CharString fastqSingle = getFileName(workingDirectory, "single.fastq");
@@ -146,10 +271,12 @@ int popins_contigmap(int argc, char const ** argv)
     CharString nonRefNew = getFileName(workingDirectory, "non_ref_new.bam");
     CharString locationsFile = getFileName(workingDirectory, "locations.txt");
 
-    if (!exists(fastqFirst) || !exists(fastqSecond) || !exists(fastqSingle) || !exists(nonRefBam))
+    bool readStore = exists(readsFile);
+    if ((!readStore && (!exists(fastqFirst) || !exists(fastqSecond) || !exists(fastqSingle))) || !exists(nonRefBam))
     {
         std::cerr << "ERROR: Could not find all input files ";
-        std::cerr << fastqFirst << ", " << fastqSecond << ", " << fastqSingle << ", and " << nonRefBam << std::endl;
+        std::cerr << readsFile << " (or " << fastqFirst << ", " << fastqSecond << ", " << fastqSingle << ") and ";
+        std::cerr << nonRefBam << std::endl;
         return 7;
     }
 
@@ -160,8 +287,7 @@ int popins_contigmap(int argc, char const ** argv)
     if (!exists(nonRefNew))
     {
         // Create names of temporary files.
-        CharString mappedSam = getFileName(workingDirectory, "contig_mapped_unsorted.sam");
-        CharString mappedBamUnsorted = getFileName(workingDirectory, "contig_mapped_unsorted.bam");
+        CharString interleavedFastq = getFileName(workingDirectory, "contig_mapping.fastq");
         CharString mappedBam = getFileName(workingDirectory, "contig_mapped.bam");
         CharString mergedBam = getFileName(workingDirectory, "merged.bam");
 
@@ -184,58 +310,34 @@ int popins_contigmap(int argc, char const ** argv)
             }
         }
 
-        msg << "Mapping reads to contigs using " << BWA;
-        printStatus(msg);
-
-        // Remapping to contigs with bwa.
-        cmd.str("");
-        if (!options.bestAlignment) cmd << BWA << " mem -a ";
-        else cmd << BWA << " mem ";
-        cmd << "-t " << options.threads << " " << options.contigFile << " " << fastqFirst << " " << fastqSecond << " > " << mappedSam;
-        if (system(cmd.str().c_str()) != 0)
-        {
-            std::cerr << "ERROR while running bwa on " << fastqFirst << " and " << fastqSecond << std::endl;
-            return 7;
-        }
-        //remove(toCString(fastqFirst));
-        //remove(toCString(fastqSecond));
-
-        cmd.str("");
-        if (!options.bestAlignment) cmd << BWA << " mem -a ";
-        else cmd << BWA << " mem ";
-        cmd << "-t " << options.threads << " " << options.contigFile << " " << fastqSingle << " | awk '$1 !~ /@/' >> " << mappedSam;
-        if (system(cmd.str().c_str()) != 0)
+        // Interleave the pairs and single reads for a single run of bwa.
+        if (readStore)
         {
-            std::cerr << "ERROR while running bwa on " << fastqSingle << std::endl;
-            return 7;
+            if (!exportFastq(toCString(readsFile), toCString(interleavedFastq), "", ""))
+                return 7;
         }
-        //remove(toCString(fastqSingle));
-
-        printStatus("Filling in sequences of secondary records in bwa output");
-
-        // Fill in sequences in bwa output.
-        if (fill_sequences(mappedBamUnsorted, mappedSam) != 0)
+        else if (interleave_fastq(interleavedFastq, fastqFirst, fastqSecond, fastqSingle) != 0)
         {
             return 7;
         }
-        remove(toCString(mappedSam));
 
-        msg.str("");
-        msg << "Sorting " << mappedBamUnsorted << " by read name using " << SAMTOOLS;
+        msg << "Mapping reads to contigs using " << BWA;
         printStatus(msg);
 
-        // Sort <WD>/contig_mapped.bam by read name
+        // Remapping to contigs with bwa, pairing the interleaved reads with the same name.
         cmd.str("");
-        cmd << SAMTOOLS << " sort -n -@ " << options.threads << " -m " << options.memory << " -o " << mappedBam << " " << mappedBamUnsorted;
-        if (system(cmd.str().c_str()) != 0)
+        cmd << BWA << " mem -p " << (options.bestAlignment ? "" : "-a ");
+        cmd << "-t " << options.threads << " " << options.contigFile << " " << interleavedFastq;
+
+        // Fill in sequences in bwa output and sort <WD>/contig_mapped.bam by read name.
+        if (fill_sequences(mappedBam, cmd.str(), parseMemory(options.memory) * options.threads, options.threads) != 0)
         {
-            std::cerr << "ERROR while sorting " << mappedBamUnsorted << " by read name using " << SAMTOOLS << std::endl;
             return 7;
         }
-        remove(toCString(mappedBamUnsorted));
+        remove(toCString(interleavedFastq));
 
         // Merge non_ref.bam with contig_mapped and set the mates.
-        if (merge_and_set_mate(mergedBam, nonContigSeqs, nonRefBam, mappedBam) != 0)
+        if (merge_and_set_mate(mergedBam, nonContigSeqs, nonRefBam, mappedBam, options.threads, BGZF_INTERMEDIATE_LEVEL) != 0)
             return 7;
 
         remove(toCString(mappedBam));
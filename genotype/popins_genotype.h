@@ -69,6 +69,10 @@ popins_genotype(int argc, char const ** argv)
     if (readSampleInfo(sampleInfo, sampleInfoFile) != 0)
        return 1;
 
+    // Size the reference windows by the sample's insert sizes.
+    if (options.sampleInsertSize)
+        options.maxInsertSize = sampleMaxInsertSize(sampleInfo, options.maxInsertSize);
+
     // Open the input VCF file and prepare output VCF stream.
     VcfFileIn vcfIn(toCString(options.vcfFile));
     CharString outfile = getFileName(samplePath, "insertions.vcf");
@@ -110,10 +114,9 @@ popins_genotype(int argc, char const ** argv)
         }
     }
 
-    // Open the bam file. (A bam file needs the bai index and the bam file stream.)
-    BamIndex<Bai> bamIndex;
-    BamFileIn bamStream;
-    if (initializeBam(toCString(sampleInfo.bam_file), bamIndex, bamStream) != 0)
+    // Open the bam files of the sample. (A bam file needs the bai index and the bam file stream.)
+    std::vector<std::unique_ptr<IndexedBamFileIn> > bams;
+    if (openSampleBams(bams, sampleInfo) != 0)
        return 7;
 
     // Build an index of the insertion sequences' fasta file.
@@ -145,7 +148,7 @@ popins_genotype(int argc, char const ** argv)
         readRecord(record, vcfIn);
 
         std::vector<double> vC(3);
-        variantCallRegion(record, vcfIn, faIndex, faIndexAlt, bamIndex, bamStream, bamIndexAlt, bamStreamAlt, options, vC);
+        variantCallRegion(record, vcfIn, faIndex, faIndexAlt, bams, bamIndexAlt, bamStreamAlt, options, vC);
 
         std::string gtString;
         probsToGtString(vC, gtString);
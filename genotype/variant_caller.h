@@ -17,6 +17,9 @@
 #include <seqan/bam_io.h>
 #include <seqan/vcf_io.h>
 
+#include "../popins_bam_view.h"
+#include "../popins_utils.h"
+
 using namespace seqan;
 
 // Sequence, alignment, and alignment row.
@@ -237,12 +240,14 @@ int readBamRegion(BamIndex< Bai>& baiI, BamFileIn& bamS,
         return 1;
     }
 
+    // Records are decoded only if they pass the position and flag checks.
+    BamRecordView view;
     BamAlignmentRecord record;
-    readRecord(record, bamS);
+    readRecord(view, bamS);
 
     // Jump the BGZF stream to this position.
     bool hasAlignments = false;
-    unsigned regionBeg = std::max(0, beg - (int)length(record.seq));
+    unsigned regionBeg = std::max(0, beg - (int)view.seqLength);
     if (!jumpToRegion( bamS, hasAlignments, rID, regionBeg, end, baiI ))
     {
         std::cerr << "ERROR: Could not jump to " << rID << " " << chrom << ":" << regionBeg << "-" << end << "\n";
@@ -254,17 +259,18 @@ int readBamRegion(BamIndex< Bai>& baiI, BamFileIn& bamS,
 
     while (!atEnd(bamS))
     {
-        readRecord(record, bamS);
+        readRecord(view, bamS);
 
         //  if( verbose ) std::cout << "Reading " << record.qName << std::endl;
         // If we are on the next reference or at the end already then we stop.
-        if (record.rID == -1 || record.rID > rID || record.beginPos >= end )
+        if (view.rID == -1 || view.rID > rID || view.beginPos >= end )
             break;
         // If we are left of the selected position then we skip this record.
-        if (record.beginPos + getAlignmentLengthInRef(record)  < (unsigned)beg) // We would like to read the read even if the end pos is less than the begin of our region
+        if (view.beginPos + getAlignmentLengthInRef(view)  < (unsigned)beg) // We would like to read the read even if the end pos is less than the begin of our region
             continue;
 
-        if( (not hasFlagDuplicate( record )) and (not hasFlagQCNoPass( record )) ){
+        if( (not hasFlagDuplicate( view )) and (not hasFlagQCNoPass( view )) ){
+            assignRecord(record, view);
             if( addReadGroup ){
                 BamTagsDict tagsDict(record.tags);
                 unsigned idx;
@@ -296,6 +302,18 @@ int readBamRegion(BamIndex< Bai>& baiI, BamFileIn& bamS,
     return 0;
 }
 
+// Reads the region from all bam files of a sample, as from the merged bam file. Read names are unique to the bam file
+// of their lane, such that the records of a pair are found in the same file.
+int readBamRegion(std::vector<std::unique_ptr<IndexedBamFileIn> > & bams,
+        CharString& chrom, int beg, int end, bool addReadGroup, bool verbose,
+        std::map< CharString, BamAlignmentRecord>& bars1, std::map< CharString, BamAlignmentRecord>& bars2 )
+{
+    for (unsigned i = 0; i < bams.size(); ++i)
+        if (readBamRegion(bams[i]->index, bams[i]->stream, chrom, beg, end, addReadGroup, verbose, bars1, bars2) != 0)
+            return 1;
+    return 0;
+}
+
 template<typename TOptions>
 int addBARsToVC(std::map< CharString, BamAlignmentRecord>&  bars,  TSequence& refSeq, TSequence& altSeq, TOptions & options, std::vector< double>& vC)
 {
@@ -439,7 +457,7 @@ parseInfoField( CharString& infoField, bool verbose, int& refDl, int& refDr ){
 template<typename TOptions>
 int variantCallRegionReadPair(CharString & chrom, CharString & componentName,
         int beginPos, int devL, int devR, component_dir componentDir,
-        BamIndex< Bai>& baiI, BamFileIn& bamS,
+        std::vector<std::unique_ptr<IndexedBamFileIn> > & bams,
         BamIndex< Bai>& baiIAlt, BamFileIn& bamSAlt,
         TOptions & options, std::vector< double>& vC)
 {
@@ -450,8 +468,8 @@ int variantCallRegionReadPair(CharString & chrom, CharString & componentName,
     std::map< CharString, BamAlignmentRecord> bars2R;
     std::map< CharString, BamAlignmentRecord> bars2Ins;
 
-    readBamRegion( baiI, bamS, chrom, beginPos-options.maxInsertSize + devL, beginPos + devL, options.addReadGroup, options.verbose, bars1L, bars2L );
-    readBamRegion( baiI, bamS, chrom, beginPos+devR, beginPos + devR + options.maxInsertSize, options.addReadGroup, options.verbose, bars1R, bars2R );
+    readBamRegion( bams, chrom, beginPos-options.maxInsertSize + devL, beginPos + devL, options.addReadGroup, options.verbose, bars1L, bars2L );
+    readBamRegion( bams, chrom, beginPos+devR, beginPos + devR + options.maxInsertSize, options.addReadGroup, options.verbose, bars1R, bars2R );
     readBamRegion( baiIAlt, bamSAlt, componentName, 0, 1e9, options.addReadGroup, options.verbose, bars1Ins, bars2Ins );
     if( options.verbose ) std::cout << "variantCallRegionReadPair " << bars1L.size() << " " << bars2L.size() << " " << bars1R.size() << " " << bars2R.size() << " " << bars1Ins.size() << " " << bars2Ins.size() << std::endl;
     if( componentDir == left_dir_forward or componentDir == left_dir_reverse ){
@@ -484,7 +502,7 @@ int variantCallRegionReadPair(CharString & chrom, CharString & componentName,
 template<typename TOptions>
 int variantCallRegion(VcfRecord & variant, VcfFileIn & vcfS,
         FaiIndex & faiI, FaiIndex & faiIAlt,
-        BamIndex<Bai> & baiI, BamFileIn & bamS,
+        std::vector<std::unique_ptr<IndexedBamFileIn> > & bams,
         BamIndex<Bai> & baiIAlt, BamFileIn & bamSAlt,
         TOptions & options, std::vector< double> & vC)
 {
@@ -525,7 +543,7 @@ int variantCallRegion(VcfRecord & variant, VcfFileIn & vcfS,
     parseInfoField( variant.info, options.verbose, devL, devR );
     if( not compIsPlaced || options.callBoth ){
         if( options.verbose ) std::cout << "variantCallRegionReadPair " << devL << " " << devR << " " << std::endl; 
-        variantCallRegionReadPair( chrom, componentName, variant.beginPos, devL, devR, componentDir, baiI, bamS, baiIAlt, bamSAlt, options, vC);
+        variantCallRegionReadPair( chrom, componentName, variant.beginPos, devL, devR, componentDir, bams, baiIAlt, bamSAlt, options, vC);
         if( not options.callBoth ){
             transformLogLtoP( vC ); 
             return 0;
@@ -640,7 +658,7 @@ int variantCallRegion(VcfRecord & variant, VcfFileIn & vcfS,
     std::map< CharString, BamAlignmentRecord> bars2;
 
     // Need to get chromosome from VCF file
-    readBamRegion( baiI, bamS, chrom, beginPos-options.regionWindowSize, beginPos+options.regionWindowSize, options.addReadGroup, options.verbose, bars1, bars2 );
+    readBamRegion( bams, chrom, beginPos-options.regionWindowSize, beginPos+options.regionWindowSize, options.addReadGroup, options.verbose, bars1, bars2 );
 
     if( altRegEnd > altRegBeg )
         readBamRegion( baiIAlt, bamSAlt, componentName, altRegBeg, altRegEnd, options.addReadGroup, options.verbose, bars1, bars2 );
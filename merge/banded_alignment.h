@@ -0,0 +1,370 @@
+#ifndef POPINS_MERGE_BANDED_ALIGNMENT_H_
+#define POPINS_MERGE_BANDED_ALIGNMENT_H_
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POPINS_BANDED_X86 1
+#include <immintrin.h>
+#endif
+
+// ==========================================================================
+// Banded local alignment score kernels
+// ==========================================================================
+
+// Score-only banded Smith-Waterman with linear gap costs that decides whether the best local alignment of two
+// sequences within the band lowerDiag <= i - j <= upperDiag scores more than minScore, where i is a position in the
+// first and j a position in the second sequence. This is the decision that pairwiseAlignment() takes from a full
+// localAlignment() with traceback.
+//
+// The band is computed row by row for the positions j of the second sequence and stored in diagonal coordinates:
+// cell k of row j is position i = j + lowerDiag + k of the first sequence, so that the diagonal and vertical
+// predecessors of a cell are cells k and k + 1 of the previous row. The horizontal predecessor, cell k - 1 of the same
+// row, is resolved by a prefix maximum over the lanes of a vector. The first sequence is padded with a code that
+// matches no base, so cells outside the matrix never score above the cells inside it. The kernels stop at the first
+// row exceeding minScore, thus scores never exceed minScore + match and 8-bit lanes suffice for the default scoring.
+//
+// The kernels are selected by bandedScoreKernel(): SSE4.1 with 8-bit or 16-bit saturating lanes if the CPU supports
+// it and the scores fit, otherwise scalar code with 32-bit scores. Bands are typically a few vectors wide, which is
+// why AVX2, whose prefix maximum needs shifts across its 128-bit halves, is not used.
+
+// Code of the padding around the first sequence.
+static const uint8_t BANDED_PAD_CODE = 0xff;
+
+// Padding in addition to the band width on both sides of the first sequence.
+static const unsigned BANDED_PADDING = 32;
+
+// --------------------------------------------------------------------------
+// Struct BandedScoring
+// --------------------------------------------------------------------------
+
+// Scores as in a Score<int, Simple> with linear gaps, requires match > 0, mismatch <= 0, and gap < 0.
+struct BandedScoring
+{
+    int match;
+    int mismatch;
+    int gap;
+    int minScore;
+
+    BandedScoring(int ma, int mm, int g, int minS) :
+        match(ma), mismatch(mm), gap(g), minScore(minS)
+    {}
+};
+
+typedef bool (*TBandedScoreKernel)(uint8_t const *, int, uint8_t const *, int, int, int, BandedScoring const &);
+
+// --------------------------------------------------------------------------
+// Function _bandedRows()
+// --------------------------------------------------------------------------
+
+// The rows j of the second sequence in which the band overlaps the first sequence.
+inline void
+_bandedRows(int & jBegin, int & jEnd, int lenA, int lenB, int lowerDiag, int upperDiag)
+{
+    jBegin = std::max(0, -upperDiag);
+    jEnd = std::min(lenB, lenA - lowerDiag);
+}
+
+// --------------------------------------------------------------------------
+// Function _bandedScoreExceeds()
+// --------------------------------------------------------------------------
+
+// Scalar kernel. Codes of a must be readable from a[-(width + BANDED_PADDING)] to a[lenA + width + BANDED_PADDING - 1].
+inline bool
+_bandedScoreExceeds(uint8_t const * a,
+        int lenA,
+        uint8_t const * b,
+        int lenB,
+        int lowerDiag,
+        int upperDiag,
+        BandedScoring const & scoring)
+{
+    int width = upperDiag - lowerDiag + 1;
+    int jBegin, jEnd;
+    _bandedRows(jBegin, jEnd, lenA, lenB, lowerDiag, upperDiag);
+
+    thread_local std::vector<int32_t> rows;
+    rows.assign(2 * (width + 1), 0);
+    int32_t * prev = &rows[0];
+    int32_t * cur = &rows[width + 1];
+
+    for (int j = jBegin; j < jEnd; ++j)
+    {
+        uint8_t const * aRow = a + j + lowerDiag;
+        int32_t left = 0;
+        for (int k = 0; k < width; ++k)
+        {
+            int32_t h = prev[k] + (aRow[k] == b[j] ? scoring.match : scoring.mismatch);
+            h = std::max(h, prev[k + 1] + scoring.gap);
+            h = std::max(h, left + scoring.gap);
+            h = std::max(h, 0);
+            if (h > scoring.minScore)
+                return true;
+            cur[k] = left = h;
+        }
+        std::swap(prev, cur);
+    }
+    return false;
+}
+
+#ifdef POPINS_BANDED_X86
+
+// --------------------------------------------------------------------------
+// SSE4.1 lanes
+// --------------------------------------------------------------------------
+
+// Unsigned saturating lanes of 8 bits. Subtraction saturates at 0, which is the floor of local alignment scores.
+struct SseU8Lanes
+{
+    typedef uint8_t TValue;
+    static const int LANES = 16;
+    static const int MAX_VALUE = 255;
+
+    __attribute__((target("sse4.1")))
+    static inline __m128i set1(int x) { return _mm_set1_epi8((char)x); }
+
+    __attribute__((target("sse4.1")))
+    static inline __m128i adds(__m128i x, __m128i y) { return _mm_adds_epu8(x, y); }
+
+    __attribute__((target("sse4.1")))
+    static inline __m128i subs(__m128i x, __m128i y) { return _mm_subs_epu8(x, y); }
+
+    __attribute__((target("sse4.1")))
+    static inline __m128i max(__m128i x, __m128i y) { return _mm_max_epu8(x, y); }
+
+    // All bits set in lanes whose code in a equals code.
+    __attribute__((target("sse4.1")))
+    static inline __m128i equalCodes(uint8_t const * a, uint8_t code)
+    {
+        return _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const *)a), _mm_set1_epi8((char)code));
+    }
+
+    // Prefix maximum of x[l'] - (l - l') * gap over the lanes l' <= l, gapSteps holding gap, 2 gap, 4 gap, 8 gap.
+    __attribute__((target("sse4.1")))
+    static inline __m128i scanLeft(__m128i x, __m128i const * gapSteps)
+    {
+        x = _mm_max_epu8(x, _mm_subs_epu8(_mm_slli_si128(x, 1), gapSteps[0]));
+        x = _mm_max_epu8(x, _mm_subs_epu8(_mm_slli_si128(x, 2), gapSteps[1]));
+        x = _mm_max_epu8(x, _mm_subs_epu8(_mm_slli_si128(x, 4), gapSteps[2]));
+        x = _mm_max_epu8(x, _mm_subs_epu8(_mm_slli_si128(x, 8), gapSteps[3]));
+        return x;
+    }
+
+    __attribute__((target("sse4.1")))
+    static inline int lastLane(__m128i x) { return _mm_extract_epi8(x, 15); }
+
+    // True if any lane is at least the corresponding lane of t.
+    __attribute__((target("sse4.1")))
+    static inline bool anyAtLeast(__m128i x, __m128i t)
+    {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(x, t), x)) != 0;
+    }
+};
+
+// Unsigned saturating lanes of 16 bits for scores above 8 bits.
+struct SseU16Lanes
+{
+    typedef uint16_t TValue;
+    static const int LANES = 8;
+    static const int MAX_VALUE = 65535;
+
+    __attribute__((target("sse4.1")))
+    static inline __m128i set1(int x) { return _mm_set1_epi16((short)x); }
+
+    __attribute__((target("sse4.1")))
+    static inline __m128i adds(__m128i x, __m128i y) { return _mm_adds_epu16(x, y); }
+
+    __attribute__((target("sse4.1")))
+    static inline __m128i subs(__m128i x, __m128i y) { return _mm_subs_epu16(x, y); }
+
+    __attribute__((target("sse4.1")))
+    static inline __m128i max(__m128i x, __m128i y) { return _mm_max_epu16(x, y); }
+
+    __attribute__((target("sse4.1")))
+    static inline __m128i equalCodes(uint8_t const * a, uint8_t code)
+    {
+        __m128i codes = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i const *)a));
+        return _mm_cmpeq_epi16(codes, _mm_set1_epi16(code));
+    }
+
+    __attribute__((target("sse4.1")))
+    static inline __m128i scanLeft(__m128i x, __m128i const * gapSteps)
+    {
+        x = _mm_max_epu16(x, _mm_subs_epu16(_mm_slli_si128(x, 2), gapSteps[0]));
+        x = _mm_max_epu16(x, _mm_subs_epu16(_mm_slli_si128(x, 4), gapSteps[1]));
+        x = _mm_max_epu16(x, _mm_subs_epu16(_mm_slli_si128(x, 8), gapSteps[2]));
+        return x;
+    }
+
+    __attribute__((target("sse4.1")))
+    static inline int lastLane(__m128i x) { return _mm_extract_epi16(x, 7); }
+
+    __attribute__((target("sse4.1")))
+    static inline bool anyAtLeast(__m128i x, __m128i t)
+    {
+        return _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_max_epu16(x, t), x)) != 0;
+    }
+};
+
+// --------------------------------------------------------------------------
+// Function _bandedScoreExceedsSse()
+// --------------------------------------------------------------------------
+
+// SSE4.1 kernel with the padding requirements of the scalar kernel. Requires minScore + match <= MAX_VALUE of the
+// lanes, such that no score saturates before the row exceeding minScore.
+template<typename TLanes>
+__attribute__((target("sse4.1")))
+inline bool
+_bandedScoreExceedsSse(uint8_t const * a,
+        int lenA,
+        uint8_t const * b,
+        int lenB,
+        int lowerDiag,
+        int upperDiag,
+        BandedScoring const & scoring)
+{
+    typedef typename TLanes::TValue TValue;
+
+    static const int LANES = TLanes::LANES;
+    static const int MAX_VALUE = TLanes::MAX_VALUE;
+
+    int width = upperDiag - lowerDiag + 1;
+    int numVectors = (width + LANES - 1) / LANES;
+    int paddedWidth = numVectors * LANES;
+    int jBegin, jEnd;
+    _bandedRows(jBegin, jEnd, lenA, lenB, lowerDiag, upperDiag);
+
+    // Two rows with a zero vector behind each for the vertical predecessors of the last cells.
+    thread_local std::vector<TValue> rows;
+    rows.assign(2 * (paddedWidth + LANES), 0);
+    TValue * prev = &rows[0];
+    TValue * cur = &rows[paddedWidth + LANES];
+
+    int gap = std::min(-scoring.gap, MAX_VALUE);
+    __m128i match = TLanes::set1(scoring.match);
+    __m128i mismatch = TLanes::set1(std::min(-scoring.mismatch, MAX_VALUE));
+    __m128i gapSteps[4];
+    for (int s = 0; s < 4; ++s)
+        gapSteps[s] = TLanes::set1(std::min(gap << s, MAX_VALUE));
+    __m128i threshold = TLanes::set1(scoring.minScore + 1);
+
+    // Gap costs from the last lane of the previous vector and the mask of the band's lanes in the last vector.
+    TValue lanes[LANES];
+    for (int l = 0; l < LANES; ++l)
+        lanes[l] = std::min((l + 1) * gap, MAX_VALUE);
+    __m128i carryGaps = _mm_loadu_si128((__m128i const *)lanes);
+    for (int l = 0; l < LANES; ++l)
+        lanes[l] = (paddedWidth - LANES + l < width) ? MAX_VALUE : 0;
+    __m128i lastMask = _mm_loadu_si128((__m128i const *)lanes);
+
+    for (int j = jBegin; j < jEnd; ++j)
+    {
+        uint8_t const * aRow = a + j + lowerDiag;
+        __m128i rowMax = _mm_setzero_si128();
+        int carry = 0;
+        for (int v = 0; v < numVectors; ++v)
+        {
+            TValue const * p = prev + v * LANES;
+            __m128i eq = TLanes::equalCodes(aRow + v * LANES, b[j]);
+            __m128i h = TLanes::adds(_mm_loadu_si128((__m128i const *)p), _mm_and_si128(eq, match));
+            h = TLanes::subs(h, _mm_andnot_si128(eq, mismatch));
+            h = TLanes::max(h, TLanes::subs(_mm_loadu_si128((__m128i const *)(p + 1)), gapSteps[0]));
+            h = TLanes::scanLeft(h, gapSteps);
+            h = TLanes::max(h, TLanes::subs(TLanes::set1(carry), carryGaps));
+            if (v == numVectors - 1)
+                h = _mm_and_si128(h, lastMask);
+            _mm_storeu_si128((__m128i *)(cur + v * LANES), h);
+            carry = TLanes::lastLane(h);
+            rowMax = TLanes::max(rowMax, h);
+        }
+        if (TLanes::anyAtLeast(rowMax, threshold))
+            return true;
+        std::swap(prev, cur);
+    }
+    return false;
+}
+
+#endif  // POPINS_BANDED_X86
+
+// --------------------------------------------------------------------------
+// Function bandedScoreKernel()
+// --------------------------------------------------------------------------
+
+enum BandedAlignIsa
+{
+    BANDED_ISA_AUTO,
+    BANDED_ISA_SCALAR,
+    BANDED_ISA_SSE41
+};
+
+// Returns the kernel for the scoring and the given instruction set, or the best one supported by the CPU.
+inline TBandedScoreKernel
+bandedScoreKernel(BandedScoring const & scoring, BandedAlignIsa isa = BANDED_ISA_AUTO)
+{
+#ifdef POPINS_BANDED_X86
+    if (isa == BANDED_ISA_AUTO)
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.1"))
+            isa = BANDED_ISA_SSE41;
+    }
+    if (isa == BANDED_ISA_SSE41)
+    {
+        if (scoring.minScore + scoring.match <= SseU8Lanes::MAX_VALUE)
+            return _bandedScoreExceedsSse<SseU8Lanes>;
+        if (scoring.minScore + scoring.match <= SseU16Lanes::MAX_VALUE)
+            return _bandedScoreExceedsSse<SseU16Lanes>;
+    }
+#else
+    (void)isa;
+    (void)scoring;
+#endif
+    return _bandedScoreExceeds;
+}
+
+// --------------------------------------------------------------------------
+// Function bandedScoreExceeds()
+// --------------------------------------------------------------------------
+
+/**
+ * Decides whether the best banded local alignment of two sequences scores more than scoring.minScore.
+ *
+ * @param seq1, seq2    the sequences, whose characters are compared by their ordValue()
+ * @param lowerDiag     the lowest diagonal i - j of the band, i a position in seq1 and j in seq2
+ * @param upperDiag     the highest diagonal of the band
+ * @param scoring       the scores
+ * @param kernel        the kernel from bandedScoreKernel()
+ */
+template<typename TSeq1, typename TSeq2>
+inline bool
+bandedScoreExceeds(TSeq1 const & seq1,
+        TSeq2 const & seq2,
+        int lowerDiag,
+        int upperDiag,
+        BandedScoring const & scoring,
+        TBandedScoreKernel kernel)
+{
+    // The empty alignment scores 0.
+    if (scoring.minScore < 0)
+        return true;
+    if (upperDiag < lowerDiag)
+        return false;
+
+    int lenA = length(seq1), lenB = length(seq2);
+    size_t padding = upperDiag - lowerDiag + 1 + BANDED_PADDING;
+
+    thread_local std::vector<uint8_t> codesA, codesB;
+    codesA.assign(lenA + 2 * padding, BANDED_PAD_CODE);
+    for (int i = 0; i < lenA; ++i)
+        codesA[padding + i] = ordValue(seq1[i]);
+    codesB.resize(lenB + 1);
+    for (int j = 0; j < lenB; ++j)
+        codesB[j] = ordValue(seq2[j]);
+
+    return kernel(&codesA[padding], lenA, &codesB[0], lenB, lowerDiag, upperDiag, scoring);
+}
+
+#endif  // POPINS_MERGE_BANDED_ALIGNMENT_H_
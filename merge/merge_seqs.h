@@ -1,6 +1,13 @@
 #ifndef POPINS_MERGE_SEQS_H_
 #define POPINS_MERGE_SEQS_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
 #include <seqan/align.h>
 
 #include "contig_structs.h"
@@ -420,7 +427,8 @@ addSequencesToGraph(ComponentGraph<TSeq1> & compGraph,
 // Function mergeSequences()
 // --------------------------------------------------------------------------
 
-template<typename TSeq1, typename TSeq2, typename TSpec, typename TLength, typename TValueMatch, typename TValueError>
+template<typename TSeq1, typename TSeq2, typename TSpec, typename TLength, typename TValueMatch, typename TValueError,
+         typename TStream>
 bool
 mergeSequences(String<TSeq1> & mergedSeqs,
         StringSet<Contig<TSeq2>, TSpec> & contigs,
@@ -428,7 +436,8 @@ mergeSequences(String<TSeq1> & mergedSeqs,
         TValueMatch matchScore,
         TValueError errorPenalty,
         unsigned qgramLength,
-        bool verbose)
+        bool verbose,
+        TStream & verboseStream)
 {
     typedef ComponentGraph<TSeq1> TGraph;
     typedef Path<TSeq1, typename TGraph::TVertexDescriptor> TPath;
@@ -443,11 +452,11 @@ mergeSequences(String<TSeq1> & mergedSeqs,
 
     if (verbose && numVertices(compGraph.graph) > 1)
     {
-        std::cout << compGraph.graph;
-        std::cout << "Vertex map:" << std::endl;
+        verboseStream << compGraph.graph;
+        verboseStream << "Vertex map:" << std::endl;
         for (TSize i = 0; i < length(compGraph.sequenceMap); ++i)
         {
-            std::cout << "Vertex: " << i << ", Length: " << length(compGraph.sequenceMap[i]) << std::endl;
+            verboseStream << "Vertex: " << i << ", Length: " << length(compGraph.sequenceMap[i]) << std::endl;
         }
     }
 
@@ -509,75 +518,260 @@ writeSupercontigs(TStream & outputStream, String<TSeq> & mergedSeqs, unsigned nu
     }
 }
 
+// --------------------------------------------------------------------------
+// Struct SupercontigResult
+// --------------------------------------------------------------------------
+
+// The output of one component, which is written once the outputs of all previous components are written.
+struct SupercontigResult
+{
+    std::string supercontigs;
+    std::string skipped;
+    std::string verbose;
+
+    bool singleton;
+    bool branching;
+    bool veryBranching;
+
+    SupercontigResult() :
+        singleton(false), branching(false), veryBranching(false)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Struct SupercontigQueue
+// --------------------------------------------------------------------------
+
+// The threads take the components in the order given by schedule and mark their results as ready.
+struct SupercontigQueue
+{
+    std::vector<unsigned> schedule;
+    std::atomic<unsigned> next;
+
+    std::vector<SupercontigResult> results;
+    std::vector<bool> ready;
+    std::mutex mutex;
+    std::condition_variable readyChanged;
+
+    SupercontigQueue(unsigned numComponents) :
+        next(0), results(numComponents), ready(numComponents, false)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Struct SupercontigPlan
+// --------------------------------------------------------------------------
+
+// The positions of the components merged from several contigs and the outputs of components that are reused from a
+// previous merge, all keyed by component. The outputs of these components are kept in results if keepResults is set.
+template<typename TSize>
+struct SupercontigPlan
+{
+    std::map<TSize, unsigned> positions;
+    std::map<TSize, SupercontigResult> reused;
+    unsigned nextPos;
+
+    bool keepResults;
+    std::map<TSize, SupercontigResult> results;
+
+    SupercontigPlan() :
+        nextPos(0), keepResults(false)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Function numberComponents()
+// --------------------------------------------------------------------------
+
+// Numbers the components that are merged from several contigs and have no position yet in their order.
+template<typename TSize, typename TSequence>
+void
+numberComponents(SupercontigPlan<TSize> & plan, std::map<TSize, ContigComponent<TSequence> > & components)
+{
+    typedef typename std::map<TSize, ContigComponent<TSequence> >::iterator TComponentIter;
+
+    for (TComponentIter it = components.begin(); it != components.end(); ++it)
+        if (length(it->second.alignedPairs) != 0 && plan.positions.count(it->first) == 0)
+            plan.positions[it->first] = plan.nextPos++;
+}
+
+// --------------------------------------------------------------------------
+// Function constructSupercontig()
+// --------------------------------------------------------------------------
+
+// Merges the contigs of one component into supercontigs named COMPONENT_<pos>_<x>, or outputs a single contig as is.
+template<typename TSize, typename TSequence, typename TContigs>
+void
+constructSupercontig(SupercontigResult & result,
+        TSize key,
+        ContigComponent<TSequence> component,
+        unsigned pos,
+        TContigs & contigs,
+        MergingOptions & options)
+{
+    std::ostringstream output, verbose;
+
+    // Output component if consisting of a single contig.
+    if (length(component.alignedPairs) == 0)
+    {
+        if (contigs[key].id.orientation == false)
+        {
+            contigs[key].id.orientation = true;
+            reverseComplement(contigs[key].seq);
+        }
+        output << ">" << contigs[key].id << std::endl;
+        output << contigs[key].seq << std::endl;
+
+        result.supercontigs = output.str();
+        result.singleton = true;
+        return;
+    }
+
+    // Sort the contigs for merging.
+    getSeqsByAlignOrder(component, contigs);
+
+    if (options.verbose) verbose << "COMPONENT_" << pos << " size:" << length(component.contigs) << std::endl;
+
+    // --- MERGE CONTIGS OF THE COMPONENT ---
+    String<TSequence> mergedSeqs;
+    if (!mergeSequences(mergedSeqs, component.contigs,
+            options.minTipScore, options.matchScore, options.errorPenalty, options.qgramLength,
+            options.verbose, verbose))
+    {
+        if (options.verbose)
+            verbose << "COMPONENT_" << pos << " size:" << length(component.contigs) << " given up." << std::endl;
+        if (options.skippedFile != "")
+        {
+            std::ostringstream skipped;
+            writeSkippedBranching(skipped, component.contigs);
+            result.skipped = skipped.str();
+        }
+        result.verbose = verbose.str();
+        result.veryBranching = true;
+        result.branching = true;
+        return;
+    }
+
+    if (length(mergedSeqs) > 1) result.branching = true;
+
+    // Output the supercontig.
+    writeSupercontigs(output, mergedSeqs, length(component.contigs), pos);
+
+    result.supercontigs = output.str();
+    result.verbose = verbose.str();
+}
+
+// --------------------------------------------------------------------------
+// Function _constructSupercontigsWorker()
+// --------------------------------------------------------------------------
+
+template<typename TComponentIter, typename TContigs>
+void
+_constructSupercontigsWorker(SupercontigQueue & queue,
+        std::vector<TComponentIter> const & componentIters,
+        std::vector<unsigned> const & positions,
+        std::vector<SupercontigResult const *> const & reused,
+        TContigs & contigs,
+        MergingOptions & options)
+{
+    for (unsigned i = queue.next++; i < queue.schedule.size(); i = queue.next++)
+    {
+        unsigned c = queue.schedule[i];
+        SupercontigResult result;
+        if (reused[c] != NULL)
+            result = *reused[c];
+        else
+            constructSupercontig(result, componentIters[c]->first, componentIters[c]->second, positions[c], contigs,
+                                 options);
+
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.results[c] = std::move(result);
+        queue.ready[c] = true;
+        queue.readyChanged.notify_one();
+    }
+}
+
 // ==========================================================================
 // Function constructSupercontigs()
 // ==========================================================================
 
+// Merges the components into supercontigs using the given number of threads. Components are independent of each
+// other and processed largest first, i.e. by decreasing number of aligned pairs, while the output is written in the
+// order of the components such that it does not depend on the number of threads. The plan gives the positions of
+// the components and the components whose output of a previous merge is written instead.
 template<typename TSize, typename TSequence, typename TContigs>
 void
 constructSupercontigs(std::map<TSize, ContigComponent<TSequence> > & components,
         TContigs & contigs,
-        MergingOptions & options)
+        MergingOptions & options,
+        SupercontigPlan<TSize> & plan)
 {
     typedef std::map<TSize, ContigComponent<TSequence> > TComponents;
+    typedef typename TComponents::iterator TComponentIter;
 
     printStatus("Constructing supercontigs");
 
     unsigned numSingleton = 0;
     unsigned numBranching = 0;
     unsigned numVeryBranching = 0;
+    unsigned numReused = 0;
 
-    // Iterate over the set of components.
-    unsigned pos = 0;
-    for (typename TComponents::iterator it = components.begin(); it != components.end(); ++it)
+    std::vector<TComponentIter> componentIters;
+    std::vector<unsigned> positions;
+    std::vector<SupercontigResult const *> reused;
+    for (TComponentIter it = components.begin(); it != components.end(); ++it)
     {
-        ContigComponent<TSequence> component = it->second;
+        componentIters.push_back(it);
+        positions.push_back(plan.positions.count(it->first) != 0 ? plan.positions[it->first] : 0);
+        typename std::map<TSize, SupercontigResult>::const_iterator r = plan.reused.find(it->first);
+        reused.push_back(r != plan.reused.end() ? &r->second : NULL);
+    }
 
-        // Output component if consisting of a single contig.
-        if (length(component.alignedPairs) == 0)
+    // Reused components need no merging and are scheduled last.
+    SupercontigQueue queue(componentIters.size());
+    for (unsigned c = 0; c < componentIters.size(); ++c)
+        queue.schedule.push_back(c);
+    std::stable_sort(queue.schedule.begin(), queue.schedule.end(), [&](unsigned x, unsigned y)
+                     {
+                         size_t xSize = reused[x] != NULL ? 0 : componentIters[x]->second.alignedPairs.size();
+                         size_t ySize = reused[y] != NULL ? 0 : componentIters[y]->second.alignedPairs.size();
+                         return xSize > ySize;
+                     });
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < options.threads; ++i)
+        workers.push_back(std::thread(_constructSupercontigsWorker<TComponentIter, TContigs>, std::ref(queue),
+                                      std::cref(componentIters), std::cref(positions), std::cref(reused),
+                                      std::ref(contigs), std::ref(options)));
+
+    // Write the results in the order of the components.
+    for (unsigned c = 0; c < componentIters.size(); ++c)
+    {
+        SupercontigResult result;
         {
-            if (contigs[it->first].id.orientation == false)
-            {
-                contigs[it->first].id.orientation = true;
-                reverseComplement(contigs[it->first].seq);
-            }
-            options.outputStream << ">" << contigs[it->first].id << std::endl;
-            options.outputStream << contigs[it->first].seq << std::endl;
-
-            ++numSingleton;
-            continue;
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            queue.readyChanged.wait(lock, [&]() { return queue.ready[c]; });
+            std::swap(result, queue.results[c]);
         }
 
-        // Sort the contigs for merging.
-        getSeqsByAlignOrder(component, contigs);
+        std::cout << result.verbose;
+        options.outputStream << result.supercontigs;
+        if (options.skippedFile != "")
+            options.skippedStream << result.skipped;
 
-        if (options.verbose) std::cout << "COMPONENT_" << pos << " size:" << length(component.contigs) << std::endl;
+        if (result.singleton) ++numSingleton;
+        if (result.branching) ++numBranching;
+        if (result.veryBranching) ++numVeryBranching;
+        if (reused[c] != NULL) ++numReused;
 
-        // --- MERGE CONTIGS OF THE COMPONENT ---
-        String<TSequence> mergedSeqs;
-        if (!mergeSequences(mergedSeqs, component.contigs,
-                options.minTipScore, options.matchScore, options.errorPenalty, options.qgramLength,
-                options.verbose))
+        if (plan.keepResults && !result.singleton)
         {
-            if (options.verbose)
-                std::cout << "COMPONENT_" << pos << " size:" << length(component.contigs) << " given up." << std::endl;
-            if (options.skippedFile != "")
-                writeSkippedBranching(options.skippedStream, component.contigs);
-            ++numVeryBranching;
-            ++numBranching;
-            clear(component);
-            ++pos;
-            continue;
+            result.verbose.clear();
+            plan.results[componentIters[c]->first] = std::move(result);
         }
-
-        if (length(mergedSeqs) > 1) ++numBranching;
-
-        // Output the supercontig.
-        writeSupercontigs(options.outputStream, mergedSeqs, length(component.contigs), pos);
-
-        clear(component);
-        ++pos;
     }
+    for (unsigned i = 0; i < workers.size(); ++i)
+        workers[i].join();
 
     options.outputStream.close();
 
@@ -592,6 +786,27 @@ constructSupercontigs(std::map<TSize, ContigComponent<TSequence> > & components,
     msg.str("");
     msg << numBranching << " components are branching, given up on " << numVeryBranching << " of them.";
     printStatus(msg);
+
+    if (!plan.reused.empty())
+    {
+        msg.str("");
+        msg << numReused << " components are reused from the previous merge.";
+        printStatus(msg);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+// Merges all components, numbering the ones merged from several contigs in their order.
+template<typename TSize, typename TSequence, typename TContigs>
+void
+constructSupercontigs(std::map<TSize, ContigComponent<TSequence> > & components,
+        TContigs & contigs,
+        MergingOptions & options)
+{
+    SupercontigPlan<TSize> plan;
+    numberComponents(plan, components);
+    constructSupercontigs(components, contigs, options, plan);
 }
 
 #endif // #ifndef POPINS_MERGE_SEQS_H_
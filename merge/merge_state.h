@@ -0,0 +1,384 @@
+#ifndef POPINS_MERGE_STATE_H_
+#define POPINS_MERGE_STATE_H_
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "contig_structs.h"
+#include "partition.h"
+#include "merge_seqs.h"
+
+using namespace seqan;
+
+// The state of a merge is written to a tab-separated text file, which a later merge of a grown set of samples reads
+// to align only the new contigs and to merge only the components that changed:
+//
+//   POPINS_MERGE_STATE  1
+//   CONTIG     <pn>  <contigId>                      one line per forward contig, in the order of partitioning
+//   PAIR       <i>   <+|->  <j>  <+|->               one line per aligned pair of contigs
+//   COMPONENT  <pos>  <contig>  <branching>  <veryBranching>  <numLines>  <numSkippedLines>
+//                                                    one line per component merged from several contigs, followed
+//                                                    by its lines of the supercontig and skipped output
+//   NEXT       <pos>                                 the next free component position
+
+// ==========================================================================
+// Struct MergeStateComponent
+// ==========================================================================
+
+struct MergeStateComponent
+{
+    unsigned pos;
+    unsigned contig;    // a forward contig of the component
+    SupercontigResult result;
+
+    MergeStateComponent() :
+        pos(0), contig(0)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Struct MergeState
+// --------------------------------------------------------------------------
+
+// Aligned pairs index the forward contigs by 0..n-1 and their reverse complements by n..2n-1 for n contigs.
+struct MergeState
+{
+    String<ContigId> contigs;
+    String<Pair<unsigned> > alignedPairs;
+    std::vector<MergeStateComponent> components;
+    unsigned nextPos;
+
+    MergeState() :
+        nextPos(0)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Function _readStateLines()
+// --------------------------------------------------------------------------
+
+inline bool
+_readStateLines(std::string & lines, std::ifstream & stream, unsigned numLines)
+{
+    std::string line;
+    for (unsigned i = 0; i < numLines; ++i)
+    {
+        if (!std::getline(stream, line))
+            return 1;
+        lines += line;
+        lines += '\n';
+    }
+    return 0;
+}
+
+// --------------------------------------------------------------------------
+// Function _readStateContig()
+// --------------------------------------------------------------------------
+
+inline bool
+_readStateContig(unsigned & index, std::istringstream & fields, unsigned numContigs)
+{
+    char orientation;
+    if (!(fields >> index >> orientation) || index >= numContigs || (orientation != '+' && orientation != '-'))
+        return 1;
+    if (orientation == '-')
+        index += numContigs;
+    return 0;
+}
+
+// --------------------------------------------------------------------------
+// Function readMergeState()
+// --------------------------------------------------------------------------
+
+inline bool
+readMergeState(MergeState & state, CharString const & filename)
+{
+    std::ifstream stream(toCString(filename));
+    if (!stream.is_open())
+    {
+        std::cerr << "ERROR: Could not open state file " << filename << std::endl;
+        return 1;
+    }
+
+    std::string line, type;
+    unsigned version = 0;
+    std::getline(stream, line);
+    std::istringstream header(line);
+    if (!(header >> type >> version) || type != "POPINS_MERGE_STATE" || version != 1)
+    {
+        std::cerr << "ERROR: " << filename << " is not a state file of popins merge." << std::endl;
+        return 1;
+    }
+
+    bool complete = false;
+    while (std::getline(stream, line))
+    {
+        std::istringstream fields(line);
+        fields >> type;
+
+        bool error = false;
+        if (type == "CONTIG")
+        {
+            // Contig names may contain spaces.
+            std::string pn, contigId;
+            fields.ignore();
+            error = !std::getline(fields, pn, '\t') || !std::getline(fields, contigId);
+            CharString p = pn, c = contigId;
+            appendValue(state.contigs, ContigId(p, c, true));
+        }
+        else if (type == "PAIR")
+        {
+            Pair<unsigned> pair;
+            error = _readStateContig(pair.i1, fields, length(state.contigs)) ||
+                    _readStateContig(pair.i2, fields, length(state.contigs));
+            appendValue(state.alignedPairs, pair);
+        }
+        else if (type == "COMPONENT")
+        {
+            MergeStateComponent component;
+            unsigned numLines = 0, numSkippedLines = 0;
+            error = !(fields >> component.pos >> component.contig >> component.result.branching
+                             >> component.result.veryBranching >> numLines >> numSkippedLines) ||
+                    component.contig >= length(state.contigs) ||
+                    _readStateLines(component.result.supercontigs, stream, numLines) ||
+                    _readStateLines(component.result.skipped, stream, numSkippedLines);
+            state.components.push_back(component);
+        }
+        else if (type == "NEXT")
+        {
+            error = !(fields >> state.nextPos);
+            complete = !error;
+        }
+        else
+        {
+            error = true;
+        }
+
+        if (error)
+        {
+            std::cerr << "ERROR: Invalid line in state file " << filename << ": " << line << std::endl;
+            return 1;
+        }
+    }
+
+    if (!complete)
+    {
+        std::cerr << "ERROR: State file " << filename << " is incomplete." << std::endl;
+        return 1;
+    }
+
+    std::ostringstream msg;
+    msg << "Loaded " << filename << ": " << length(state.contigs) << " contigs, " << length(state.alignedPairs)
+        << " aligned pairs, and " << state.components.size() << " components merged from several contigs";
+    printStatus(msg);
+
+    return 0;
+}
+
+// --------------------------------------------------------------------------
+// Function sortContigsByState()
+// --------------------------------------------------------------------------
+
+// Moves the contigs of the previous merge to the front in the order of the state file, such that they keep their
+// indices, and leaves the new contigs behind them in input order. Fails if a contig of the state is not in the input.
+template<typename TSeq>
+bool
+sortContigsByState(String<Contig<TSeq> > & contigs, MergeState const & state)
+{
+    std::map<ContigId, unsigned> inputIndices;
+    for (unsigned i = 0; i < length(contigs); ++i)
+        inputIndices[contigs[i].id] = i;
+
+    String<Contig<TSeq> > sorted;
+    reserve(sorted, length(contigs), Exact());
+    std::vector<bool> moved(length(contigs), false);
+    for (unsigned i = 0; i < length(state.contigs); ++i)
+    {
+        std::map<ContigId, unsigned>::iterator it = inputIndices.find(state.contigs[i]);
+        if (it == inputIndices.end())
+        {
+            ContigId id = state.contigs[i];
+            std::cerr << "ERROR: Contig " << id << " of the previous merge is not in the input contigs." << std::endl;
+            return 1;
+        }
+        appendValue(sorted, contigs[it->second]);
+        moved[it->second] = true;
+    }
+    for (unsigned i = 0; i < length(contigs); ++i)
+        if (!moved[i])
+            appendValue(sorted, contigs[i]);
+
+    swap(contigs, sorted);
+
+    std::ostringstream msg;
+    msg << (length(contigs) - length(state.contigs)) << " contigs are new since the previous merge.";
+    printStatus(msg);
+
+    return 0;
+}
+
+// --------------------------------------------------------------------------
+// Function replayMergeState()
+// --------------------------------------------------------------------------
+
+// Joins the sets of the aligned pairs of the previous merge. The contigs of the state are the first forward contigs.
+template<typename TSize>
+void
+replayMergeState(ConcurrentUnionFind & uf,
+        std::set<Pair<TSize> > & alignedPairs,
+        MergeState const & state,
+        unsigned fwdContigCount)
+{
+    unsigned stateCount = length(state.contigs);
+    for (unsigned i = 0; i < length(state.alignedPairs); ++i)
+    {
+        int a = state.alignedPairs[i].i1 < stateCount ? state.alignedPairs[i].i1
+                                                      : state.alignedPairs[i].i1 - stateCount + fwdContigCount;
+        int b = state.alignedPairs[i].i2 < stateCount ? state.alignedPairs[i].i2
+                                                      : state.alignedPairs[i].i2 - stateCount + fwdContigCount;
+        alignedPairs.insert(Pair<TSize>(a, b));
+
+        joinSets(uf, findSet(uf, a), findSet(uf, b));
+
+        int a1 = a < (int)fwdContigCount ? a + fwdContigCount : a - fwdContigCount;
+        int b1 = b < (int)fwdContigCount ? b + fwdContigCount : b - fwdContigCount;
+        joinSets(uf, findSet(uf, a1), findSet(uf, b1));
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function planSupercontigs()
+// --------------------------------------------------------------------------
+
+// Reuses the position and output of every component of the previous merge that has no new contig. Components that
+// contain new contigs are merged again and numbered after the positions of the previous merge.
+template<typename TSize, typename TSequence>
+void
+planSupercontigs(SupercontigPlan<TSize> & plan,
+        std::map<TSize, ContigComponent<TSequence> > & components,
+        ConcurrentUnionFind & uf,
+        MergeState const & state,
+        unsigned fwdContigCount)
+{
+    std::set<TSize> changed;
+    for (unsigned i = length(state.contigs); i < fwdContigCount; ++i)
+        changed.insert(std::min(findSet(uf, i), findSet(uf, i + fwdContigCount)));
+
+    unsigned numReused = 0;
+    for (unsigned c = 0; c < state.components.size(); ++c)
+    {
+        unsigned contig = state.components[c].contig;
+        TSize key = std::min(findSet(uf, contig), findSet(uf, contig + fwdContigCount));
+        if (changed.count(key) != 0 || components.count(key) == 0)
+            continue;
+
+        plan.positions[key] = state.components[c].pos;
+        plan.reused[key] = state.components[c].result;
+        ++numReused;
+    }
+    plan.nextPos = state.nextPos;
+    numberComponents(plan, components);
+
+    std::ostringstream msg;
+    msg << numReused << " of " << state.components.size() << " components of the previous merge are unchanged.";
+    printStatus(msg);
+}
+
+// --------------------------------------------------------------------------
+// Function _writeStateContig()
+// --------------------------------------------------------------------------
+
+template<typename TStream>
+inline void
+_writeStateContig(TStream & stream, unsigned index, unsigned fwdContigCount)
+{
+    if (index < fwdContigCount)
+        stream << index << "\t+";
+    else
+        stream << (index - fwdContigCount) << "\t-";
+}
+
+// --------------------------------------------------------------------------
+// Function _countLines()
+// --------------------------------------------------------------------------
+
+inline unsigned
+_countLines(std::string const & lines)
+{
+    return std::count(lines.begin(), lines.end(), '\n');
+}
+
+// --------------------------------------------------------------------------
+// Function writeMergeState()
+// --------------------------------------------------------------------------
+
+// Writes the contigs, the aligned pairs, and the outputs of the components merged from several contigs, which the
+// plan must have kept.
+template<typename TSize, typename TSequence>
+bool
+writeMergeState(CharString const & filename,
+        String<Contig<TSequence> > & contigs,
+        std::set<Pair<TSize> > & alignedPairs,
+        std::map<TSize, ContigComponent<TSequence> > & components,
+        SupercontigPlan<TSize> & plan)
+{
+    typedef typename std::map<TSize, ContigComponent<TSequence> >::iterator TComponentIter;
+
+    std::ofstream stream(toCString(filename));
+    if (!stream.is_open())
+    {
+        std::cerr << "ERROR: Could not open state file " << filename << std::endl;
+        return 1;
+    }
+
+    unsigned fwdContigCount = length(contigs)/2;
+
+    stream << "POPINS_MERGE_STATE\t1" << std::endl;
+    for (unsigned i = 0; i < fwdContigCount; ++i)
+        stream << "CONTIG\t" << contigs[i].id.pn << "\t" << contigs[i].id.contigId << std::endl;
+
+    for (typename std::set<Pair<TSize> >::iterator it = alignedPairs.begin(); it != alignedPairs.end(); ++it)
+    {
+        stream << "PAIR\t";
+        _writeStateContig(stream, (*it).i1, fwdContigCount);
+        stream << "\t";
+        _writeStateContig(stream, (*it).i2, fwdContigCount);
+        stream << std::endl;
+    }
+
+    for (TComponentIter it = components.begin(); it != components.end(); ++it)
+    {
+        if (length(it->second.alignedPairs) == 0)
+            continue;
+
+        SupercontigResult & result = plan.results[it->first];
+        TSize contig = (*it->second.alignedPairs.begin()).i1;
+        if (contig >= fwdContigCount)
+            contig -= fwdContigCount;
+
+        stream << "COMPONENT\t" << plan.positions[it->first] << "\t" << contig << "\t" << result.branching << "\t"
+               << result.veryBranching << "\t" << _countLines(result.supercontigs) << "\t"
+               << _countLines(result.skipped) << std::endl;
+        stream << result.supercontigs << result.skipped;
+    }
+    stream << "NEXT\t" << plan.nextPos << std::endl;
+
+    if (!stream.good())
+    {
+        std::cerr << "ERROR: Could not write state file " << filename << std::endl;
+        return 1;
+    }
+
+    std::ostringstream msg;
+    msg << "Merge state written to " << filename;
+    printStatus(msg);
+
+    return 0;
+}
+
+#endif // #ifndef POPINS_MERGE_STATE_H_
@@ -0,0 +1,209 @@
+#ifndef POPINS_MERGE_MINIMIZERS_H_
+#define POPINS_MERGE_MINIMIZERS_H_
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include <seqan/sequence.h>
+
+#include "contig_structs.h"
+
+using namespace seqan;
+
+// ==========================================================================
+// Struct Minimizer
+// ==========================================================================
+
+// A (w,k)-minimizer of a sequence: the k-mer of smallest hash value in a window of w consecutive k-mers.
+struct Minimizer
+{
+    uint64_t hash;
+    unsigned pos;
+
+    Minimizer(uint64_t h, unsigned p) :
+        hash(h), pos(p)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Struct MinimizerOccurrence
+// --------------------------------------------------------------------------
+
+struct MinimizerOccurrence
+{
+    uint64_t hash;
+    int seqNo;
+    unsigned pos;
+
+    MinimizerOccurrence(uint64_t h, int s, unsigned p) :
+        hash(h), seqNo(s), pos(p)
+    {}
+
+    bool operator<(MinimizerOccurrence const & other) const
+    {
+        if (hash != other.hash) return hash < other.hash;
+        if (seqNo != other.seqNo) return seqNo < other.seqNo;
+        return pos < other.pos;
+    }
+};
+
+// --------------------------------------------------------------------------
+// Struct MinimizerIndex
+// --------------------------------------------------------------------------
+
+// The minimizers of all contigs sorted by hash value, such that contigs sharing a minimizer form one bucket.
+struct MinimizerIndex
+{
+    unsigned k;
+    unsigned w;
+    std::vector<MinimizerOccurrence> occurrences;
+
+    MinimizerIndex() :
+        k(0), w(0)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Function _minimizerHash()
+// --------------------------------------------------------------------------
+
+// Invertible integer hash of a 2-bit encoded k-mer, such that minimizers are not biased towards poly-A.
+inline uint64_t
+_minimizerHash(uint64_t key, uint64_t mask)
+{
+    key = (~key + (key << 21)) & mask;
+    key = key ^ key >> 24;
+    key = ((key + (key << 3)) + (key << 8)) & mask;
+    key = key ^ key >> 14;
+    key = ((key + (key << 2)) + (key << 4)) & mask;
+    key = key ^ key >> 28;
+    key = (key + (key << 31)) & mask;
+    return key;
+}
+
+// --------------------------------------------------------------------------
+// Function computeMinimizers()
+// --------------------------------------------------------------------------
+
+// Computes the (w,k)-minimizers of a sequence in order of their positions. K-mers containing an N are skipped and on
+// ties the leftmost k-mer is the minimizer. Requires k <= 31.
+template<typename TSeq>
+void
+computeMinimizers(std::vector<Minimizer> & minimizers, TSeq const & seq, unsigned k, unsigned w)
+{
+    minimizers.clear();
+
+    uint64_t mask = (1ull << (2 * k)) - 1;
+    uint64_t kmer = 0;
+    unsigned validLength = 0;   // number of consecutive bases without N
+    unsigned windowKmers = 0;   // number of k-mers since the last N
+    std::deque<Minimizer> window;
+
+    for (unsigned i = 0; i < length(seq); ++i)
+    {
+        unsigned c = ordValue(seq[i]);
+        if (c > 3)
+        {
+            validLength = 0;
+            windowKmers = 0;
+            window.clear();
+            continue;
+        }
+        kmer = ((kmer << 2) | c) & mask;
+        if (++validLength < k)
+            continue;
+
+        Minimizer current(_minimizerHash(kmer, mask), i + 1 - k);
+        while (!window.empty() && window.back().hash > current.hash)
+            window.pop_back();
+        window.push_back(current);
+        ++windowKmers;
+        if (window.front().pos + w <= current.pos)
+            window.pop_front();
+
+        if (windowKmers >= w && (minimizers.empty() || minimizers.back().pos != window.front().pos))
+            minimizers.push_back(window.front());
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function _indexMinimizersWorker()
+// --------------------------------------------------------------------------
+
+template<typename TSeq>
+void
+_indexMinimizersWorker(std::vector<MinimizerOccurrence> & occurrences,
+        std::atomic<size_t> & nextContig,
+        String<Contig<TSeq> > const & contigs,
+        unsigned k,
+        unsigned w)
+{
+    std::vector<Minimizer> minimizers;
+    for (size_t i = nextContig++; i < length(contigs); i = nextContig++)
+    {
+        computeMinimizers(minimizers, contigs[i].seq, k, w);
+        for (unsigned j = 0; j < minimizers.size(); ++j)
+            occurrences.push_back(MinimizerOccurrence(minimizers[j].hash, i, minimizers[j].pos));
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function buildMinimizerIndex()
+// --------------------------------------------------------------------------
+
+// Collects the minimizers of all contigs using the given number of threads and sorts them into buckets.
+template<typename TSeq>
+void
+buildMinimizerIndex(MinimizerIndex & index,
+        String<Contig<TSeq> > const & contigs,
+        unsigned k,
+        unsigned w,
+        unsigned threads)
+{
+    index.k = k;
+    index.w = w;
+
+    std::atomic<size_t> nextContig(0);
+    std::vector<std::vector<MinimizerOccurrence> > threadOccurrences(threads);
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i)
+        workers.push_back(std::thread(_indexMinimizersWorker<TSeq>, std::ref(threadOccurrences[i]),
+                                      std::ref(nextContig), std::cref(contigs), k, w));
+    _indexMinimizersWorker(threadOccurrences[0], nextContig, contigs, k, w);
+    for (unsigned i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    size_t numOccurrences = 0;
+    for (unsigned i = 0; i < threads; ++i)
+        numOccurrences += threadOccurrences[i].size();
+
+    index.occurrences.clear();
+    index.occurrences.reserve(numOccurrences);
+    for (unsigned i = 0; i < threads; ++i)
+    {
+        index.occurrences.insert(index.occurrences.end(), threadOccurrences[i].begin(), threadOccurrences[i].end());
+        std::vector<MinimizerOccurrence>().swap(threadOccurrences[i]);
+    }
+    std::sort(index.occurrences.begin(), index.occurrences.end());
+}
+
+// --------------------------------------------------------------------------
+// Function findBucket()
+// --------------------------------------------------------------------------
+
+// Returns the range of occurrences of a minimizer in the index.
+inline std::pair<std::vector<MinimizerOccurrence>::const_iterator, std::vector<MinimizerOccurrence>::const_iterator>
+findBucket(MinimizerIndex const & index, uint64_t hash)
+{
+    struct HashLess
+    {
+        bool operator()(MinimizerOccurrence const & occ, uint64_t h) const { return occ.hash < h; }
+        bool operator()(uint64_t h, MinimizerOccurrence const & occ) const { return h < occ.hash; }
+    };
+    return std::equal_range(index.occurrences.begin(), index.occurrences.end(), hash, HashLess());
+}
+
+#endif // #ifndef POPINS_MERGE_MINIMIZERS_H_
@@ -1,10 +1,21 @@
 #ifndef POPINS_MERGE_PARTITION_H_
 #define POPINS_MERGE_PARTITION_H_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
 #include <seqan/index.h>
 #include <seqan/align.h>
 
+#include "banded_alignment.h"
 #include "contig_structs.h"
+#include "minimizers.h"
 
 using namespace seqan;
 
@@ -12,6 +23,8 @@ using namespace seqan;
 // Function pairwiseAlignment()
 // --------------------------------------------------------------------------
 
+// Returns true if the banded local alignment of the contigs scores more than minScore. Uses the score-only kernels of
+// banded_alignment.h for linear gap costs with positive match and negative error scores, otherwise a full alignment.
 template<typename TSeq, typename TValueScore>
 inline bool
 pairwiseAlignment(TSeq & contig1,
@@ -21,6 +34,13 @@ pairwiseAlignment(TSeq & contig1,
         int upperDiag,
         TValueScore minScore)
 {
+    BandedScoring scoring(scoreMatch(scoringScheme), scoreMismatch(scoringScheme), scoreGapExtend(scoringScheme),
+                          minScore);
+    if (scoreGapOpen(scoringScheme) == scoring.gap && scoring.match > 0 && scoring.mismatch <= 0 && scoring.gap < 0)
+    {
+        return bandedScoreExceeds(contig1, contig2, lowerDiag, upperDiag, scoring, bandedScoreKernel(scoring));
+    }
+
     // setup alignment object
     Align<TSeq, ArrayGaps> align;
     resize(rows(align), 2);
@@ -38,88 +58,435 @@ pairwiseAlignment(TSeq & contig1,
 }
 
 // ==========================================================================
-// Function partitionContigs()
+// Struct ConcurrentUnionFind
 // ==========================================================================
 
-template<typename TSize, typename TSeq>
-bool
-partitionContigs(UnionFind<int> & uf,
-        std::set<Pair<TSize> > & alignedPairs,
+// Union-find over contig indices whose findSet() may run in several threads concurrently with each other and with
+// joinSets() of one thread. As in SeqAn's UnionFind, a value is the parent index or, for a representative, the
+// negative size of its set. Concurrent finds only shorten paths by compare-and-swap (path halving), so they never
+// change the representatives. joinSets() links the smaller set below the larger one, on ties the right set below the
+// left one as in SeqAn's UnionFind, such that the sets and their representatives depend only on the order of joins.
+struct ConcurrentUnionFind
+{
+    std::vector<std::atomic<int> > values;
+};
+
+// --------------------------------------------------------------------------
+// Function resize()                                      ConcurrentUnionFind
+// --------------------------------------------------------------------------
+
+inline void
+resize(ConcurrentUnionFind & uf, size_t size)
+{
+    std::vector<std::atomic<int> > values(size);
+    for (size_t i = 0; i < size; ++i)
+        values[i].store(-1, std::memory_order_relaxed);
+    uf.values.swap(values);
+}
+
+// --------------------------------------------------------------------------
+// Function findSet()                                     ConcurrentUnionFind
+// --------------------------------------------------------------------------
+
+inline int
+findSet(ConcurrentUnionFind & uf, int element)
+{
+    int parent = uf.values[element].load(std::memory_order_acquire);
+    while (parent >= 0)
+    {
+        int grandparent = uf.values[parent].load(std::memory_order_acquire);
+        if (grandparent < 0)
+            return parent;
+
+        // Path halving, fails harmlessly if another thread shortened the path first.
+        int expected = parent;
+        uf.values[element].compare_exchange_weak(expected, grandparent, std::memory_order_release,
+                                                 std::memory_order_relaxed);
+        element = grandparent;
+        parent = uf.values[element].load(std::memory_order_acquire);
+    }
+    return element;
+}
+
+// --------------------------------------------------------------------------
+// Function setSize()                                     ConcurrentUnionFind
+// --------------------------------------------------------------------------
+
+// Number of elements in the set of a representative.
+inline int
+setSize(ConcurrentUnionFind & uf, int representative)
+{
+    return -uf.values[representative].load(std::memory_order_acquire);
+}
+
+// --------------------------------------------------------------------------
+// Function joinSets()                                    ConcurrentUnionFind
+// --------------------------------------------------------------------------
+
+// Joins the sets of two representatives and returns the new representative. Must not be called by several threads
+// at the same time. Ties must go to the left set: joining the sets of a and b and then those of their reverse
+// complements gives mirrored sets with mirrored representatives, which unionFindToComponents() and addSingletons()
+// rely on.
+inline int
+joinSets(ConcurrentUnionFind & uf, int left, int right)
+{
+    if (left == right)
+        return left;
+
+    int leftSize = setSize(uf, left);
+    int rightSize = setSize(uf, right);
+    if (rightSize > leftSize)
+    {
+        std::swap(left, right);
+        std::swap(leftSize, rightSize);
+    }
+
+    uf.values[left].store(-(leftSize + rightSize), std::memory_order_release);
+    uf.values[right].store(left, std::memory_order_release);
+    return left;
+}
+
+// --------------------------------------------------------------------------
+// Struct ContigHit
+// --------------------------------------------------------------------------
+
+// A candidate hit of a forward contig with another contig and the band for its verification.
+struct ContigHit
+{
+    int contig;
+    int lowerDiag;
+    int upperDiag;
+    bool verified;
+    bool aligned;
+
+    ContigHit() :
+        contig(0), lowerDiag(0), upperDiag(0), verified(false), aligned(false)
+    {}
+
+    ContigHit(int c, int lower, int upper) :
+        contig(c), lowerDiag(lower), upperDiag(upper), verified(false), aligned(false)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Struct PartitionQueue
+// --------------------------------------------------------------------------
+
+// Verified hits of the forward contigs from firstContig on. The threads take the contigs in chunks from nextContig and
+// mark them as ready once their hits are complete.
+struct PartitionQueue
+{
+    std::vector<String<ContigHit> > hits;
+    std::vector<bool> ready;
+    int firstContig;
+    std::atomic<int> nextContig;
+    std::atomic<size_t> numCandidates;
+    std::atomic<size_t> numComparisons;
+
+    std::mutex mutex;
+    std::condition_variable readyChanged;
+
+    PartitionQueue(int fwdContigCount, int first) :
+        hits(fwdContigCount), ready(fwdContigCount, false), firstContig(first), nextContig(first), numCandidates(0),
+        numComparisons(0)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Struct SwiftCandidateFinder
+// --------------------------------------------------------------------------
+
+// A thread's SWIFT pattern on the shared q-gram index.
+template<typename TIndex>
+struct SwiftCandidateFinder
+{
+    Pattern<TIndex, Swift<SwiftLocal> > pattern;
+
+    SwiftCandidateFinder(TIndex & index) :
+        pattern(index)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Struct MinimizerCandidateFinder
+// --------------------------------------------------------------------------
+
+// A minimizer anchor of a forward contig in another contig.
+struct MinimizerAnchor
+{
+    int contig;
+    int diag;
+    unsigned pos;
+
+    MinimizerAnchor(int c, int d, unsigned p) :
+        contig(c), diag(d), pos(p)
+    {}
+
+    bool operator<(MinimizerAnchor const & other) const
+    {
+        if (contig != other.contig) return contig < other.contig;
+        if (diag != other.diag) return diag < other.diag;
+        return pos < other.pos;
+    }
+};
+
+// A thread's buffers for finding candidates in the shared minimizer index.
+struct MinimizerCandidateFinder
+{
+    // Minimizers occurring more often are ignored as repeats.
+    static const unsigned MAX_BUCKET_SIZE = 1000;
+
+    MinimizerIndex & index;
+    std::vector<Minimizer> minimizers;
+    std::vector<MinimizerAnchor> anchors;
+
+    MinimizerCandidateFinder(MinimizerIndex & i) :
+        index(i)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Function findCandidates()
+// --------------------------------------------------------------------------
+
+// Appends all SWIFT hits of a forward contig with contigs of other individuals. A pair of contigs usually has several
+// hits.
+template<typename TIndex, typename TSeq>
+void
+findCandidates(String<ContigHit> & candidates,
+        SwiftCandidateFinder<TIndex> & finder,
+        int a,
         String<Contig<TSeq> > & contigs,
         MergingOptions & options)
 {
-    typedef typename Iterator<String<Contig<TSeq> > >::Type TContigIter;
-    typedef StringSet<TSeq, Dependent<> > TStringSet;
-    typedef Index<TStringSet, IndexQGram<SimpleShape, OpenAddressing> > TIndex;
     typedef Finder<TSeq, Swift<SwiftLocal> > TFinder;
 
-    printStatus("Partitioning contigs");
-    printStatus("- Indexing contigs");
+    int diagExtension = options.minScore/10;
+
+    // initialization of swift finder
+    TFinder swiftFinder(contigs[a].seq, 1000, 1);
+
+    hash(finder.pattern.shape, hostIterator(hostIterator(swiftFinder)));
+    while (find(swiftFinder, finder.pattern, options.errorRate, options.minimalLength))
+    {
+        // get index of pattern sequence
+        int b = finder.pattern.curSeqNo;
+
+        // align contigs only of different individuals
+        if (contigs[a].id.pn == contigs[b].id.pn) continue;
+
+        // compute upper and lower diagonal of band.
+        int upperDiag = (*swiftFinder.curHit).hstkPos - (*swiftFinder.curHit).ndlPos;
+        int lowerDiag = upperDiag - finder.pattern.bucketParams[b].delta - finder.pattern.bucketParams[b].overlap;
+        appendValue(candidates, ContigHit(b, lowerDiag - diagExtension, upperDiag + diagExtension));
+    }
+}
+
+// Appends one candidate per contig of another individual that shares a chain of minimizers with a forward contig.
+// Anchors of a contig pair are chained along their diagonals, allowing a drift of minScore/10 between neighbouring
+// anchors. The best chain of a pair is a candidate if it spans at least minLength bases of the forward contig, and
+// the band of its verification covers the diagonals of the chain. Candidates are ordered by decreasing number of
+// anchors.
+template<typename TSeq>
+void
+findCandidates(String<ContigHit> & candidates,
+        MinimizerCandidateFinder & finder,
+        int a,
+        String<Contig<TSeq> > & contigs,
+        MergingOptions & options)
+{
+    typedef std::vector<MinimizerOccurrence>::const_iterator TOccIter;
+
+    int diagExtension = options.minScore/10;
+    unsigned k = finder.index.k;
+
+    // Collect the anchors in contigs of other individuals.
+    computeMinimizers(finder.minimizers, contigs[a].seq, k, finder.index.w);
+    finder.anchors.clear();
+    for (unsigned i = 0; i < finder.minimizers.size(); ++i)
+    {
+        std::pair<TOccIter, TOccIter> bucket = findBucket(finder.index, finder.minimizers[i].hash);
+        if (bucket.second - bucket.first > (int)MinimizerCandidateFinder::MAX_BUCKET_SIZE) continue;
+        for (TOccIter occ = bucket.first; occ != bucket.second; ++occ)
+        {
+            if (contigs[a].id.pn == contigs[occ->seqNo].id.pn) continue;
+            int diag = (int)finder.minimizers[i].pos - (int)occ->pos;
+            finder.anchors.push_back(MinimizerAnchor(occ->seqNo, diag, finder.minimizers[i].pos));
+        }
+    }
+    std::sort(finder.anchors.begin(), finder.anchors.end());
+
+    // Chain the anchors of each contig pair and keep the best chain.
+    std::vector<std::pair<unsigned, ContigHit> > chains;
+    for (unsigned i = 0; i < finder.anchors.size(); )
+    {
+        int b = finder.anchors[i].contig;
+        unsigned bestCount = 0, bestFirst = 0, bestLast = 0, bestBegin = 0, bestEnd = 0;
+        while (i < finder.anchors.size() && finder.anchors[i].contig == b)
+        {
+            unsigned first = i;
+            unsigned beginPos = finder.anchors[i].pos, endPos = finder.anchors[i].pos;
+            for (++i; i < finder.anchors.size() && finder.anchors[i].contig == b &&
+                      finder.anchors[i].diag - finder.anchors[i - 1].diag <= diagExtension; ++i)
+            {
+                beginPos = std::min(beginPos, finder.anchors[i].pos);
+                endPos = std::max(endPos, finder.anchors[i].pos);
+            }
+            if (i - first > bestCount)
+            {
+                bestCount = i - first;
+                bestFirst = first;
+                bestLast = i - 1;
+                bestBegin = beginPos;
+                bestEnd = endPos;
+            }
+        }
+        if (bestEnd + k - bestBegin < (unsigned)options.minimalLength) continue;
+        chains.push_back(std::make_pair(bestCount, ContigHit(b,
+                                                             finder.anchors[bestFirst].diag - diagExtension,
+                                                             finder.anchors[bestLast].diag + diagExtension)));
+    }
+
+    std::stable_sort(chains.begin(), chains.end(),
+                     [](std::pair<unsigned, ContigHit> const & x, std::pair<unsigned, ContigHit> const & y)
+                     { return x.first > y.first; });
+    for (unsigned i = 0; i < chains.size(); ++i)
+        appendValue(candidates, chains[i].second);
+}
+
+// --------------------------------------------------------------------------
+// Function _findContigHitsWorker()
+// --------------------------------------------------------------------------
+
+// Finds the candidates of the forward contigs and verifies them by banded alignment. A candidate is left out if its
+// contigs are in the same set already, which the contigs then also are once the hit is joined in contig order. As the
+// joins of the contig's own hits happen later, the sets that the contig aligned to are recorded and their further
+// hits, e.g. repeated SWIFT hits of a pair, are left out as well. After a hit that will leave the contig in a set of
+// more than 100 contigs, the remaining hits are recorded without verification.
+template<typename TCandidateFinder, typename TIndex, typename TSeq>
+void
+_findContigHitsWorker(PartitionQueue & queue,
+        ConcurrentUnionFind & uf,
+        TIndex & index,
+        String<Contig<TSeq> > & contigs,
+        MergingOptions & options)
+{
+    static const int CHUNK_SIZE = 16;
 
-    TSize numComparisons = 0;
     int fwdContigCount = length(contigs)/2;
 
-    // initialization of SWIFT pattern (q-gram index)
-    TStringSet seqs;
-    StringSet<TSize> indices;
-    TContigIter itEnd = end(contigs);
-    for (TContigIter it = begin(contigs); it != itEnd; ++it)
-        appendValue(seqs, (*it).seq);
-    TIndex qgramIndex(seqs);
-    resize(indexShape(qgramIndex), options.qgramLength);
-    Pattern<TIndex, Swift<SwiftLocal> > swiftPattern(qgramIndex);
-    indexRequire(qgramIndex, QGramSADir());
+    TCandidateFinder finder(index);
+    String<ContigHit> candidates;
+    std::set<int> alignedSets;
+
+    Score<int, Simple> scoringScheme(options.matchScore, options.errorPenalty, options.errorPenalty);
+
+    for (int chunk = queue.nextContig.fetch_add(CHUNK_SIZE); chunk < fwdContigCount;
+         chunk = queue.nextContig.fetch_add(CHUNK_SIZE))
+    {
+        int chunkEnd = std::min(fwdContigCount, chunk + CHUNK_SIZE);
+        for (int a = chunk; a < chunkEnd; ++a)
+        {
+            clear(candidates);
+            findCandidates(candidates, finder, a, contigs, options);
+            queue.numCandidates += length(candidates);
+
+            String<ContigHit> hits;
+            bool verify = true;
+            alignedSets.clear();
+            int alignedSize = 0;
+            for (unsigned i = 0; i < length(candidates); ++i)
+            {
+                ContigHit hit = candidates[i];
+
+                // align contigs only if not same component already or once the contig's previous hits are joined
+                int setA = findSet(uf, a);
+                int setB = findSet(uf, hit.contig);
+                if (setA == setB || alignedSets.count(setB) != 0) continue;
+
+                // verify by banded Smith-Waterman alignment
+                if (verify)
+                {
+                    ++queue.numComparisons;
+                    hit.verified = true;
+                    hit.aligned = pairwiseAlignment(contigs[a].seq, contigs[hit.contig].seq, scoringScheme,
+                                                    hit.lowerDiag, hit.upperDiag, options.minScore);
+                    if (hit.aligned)
+                    {
+                        alignedSets.insert(setB);
+                        alignedSize += std::max(1, setSize(uf, setB));  // setB may have been joined since
+                        if (setSize(uf, setA) + alignedSize > 100)
+                            verify = false;
+                    }
+                }
+                appendValue(hits, hit);
+            }
+
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            swap(queue.hits[a], hits);
+            queue.ready[a] = true;
+            queue.readyChanged.notify_one();
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function _joinContigHits()
+// --------------------------------------------------------------------------
+
+// Joins the sets of the forward contigs in order as the threads complete their hits and waits for the threads.
+template<typename TSize, typename TSeq>
+void
+_joinContigHits(ConcurrentUnionFind & uf,
+        std::set<Pair<TSize> > & alignedPairs,
+        PartitionQueue & queue,
+        std::vector<std::thread> & workers,
+        String<Contig<TSeq> > & contigs,
+        MergingOptions & options)
+{
+    int fwdContigCount = length(contigs)/2;
 
     // define scoring scheme
     Score<int, Simple> scoringScheme(options.matchScore, options.errorPenalty, options.errorPenalty);
-    int diagExtension = options.minScore/10;
 
     // print status bar
-    printStatus("- Aligning contigs");
     std::cerr << "0%   10   20   30   40   50   60   70   80   90   100%" << std::endl;
     std::cerr << "|----|----|----|----|----|----|----|----|----|----|" << std::endl;
     std::cerr << "*" << std::flush;
 
-    double fiftieth = fwdContigCount / 50.0;
+    double fiftieth = (fwdContigCount - queue.firstContig) / 50.0;
     unsigned progress = 0;
 
-    // Iterate over the forward contigs.
-    for (int a = 0; a < fwdContigCount; ++a)
+    for (int a = queue.firstContig; a < fwdContigCount; ++a)
     {
-    	while (progress * fiftieth < a)
+    	while (progress * fiftieth < a - queue.firstContig)
         {
             std::cerr << "*" << std::flush;
             ++progress;
         }
 
-        // initialization of swift finder
-        TFinder swiftFinder(contigs[a].seq, 1000, 1);
-
-        hash(swiftPattern.data_host.data_value->shape, hostIterator(hostIterator(swiftFinder)));
-        while (find(swiftFinder, swiftPattern, options.errorRate, options.minimalLength))
+        String<ContigHit> hits;
         {
-            // get index of pattern sequence
-            int b = swiftPattern.curSeqNo;
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            queue.readyChanged.wait(lock, [&]() { return queue.ready[a]; });
+            swap(hits, queue.hits[a]);
+        }
 
-            // align contigs only of different individuals
-            if (contigs[a].id.pn == contigs[b].id.pn) continue;
+        for (unsigned i = 0; i < length(hits); ++i)
+        {
+            int b = hits[i].contig;
 
             // align contigs only if not same component already
             if (findSet(uf, a) == findSet(uf, b)) continue;
 
-            // find the contig sequences
-            TSeq contigA = haystack(swiftFinder);
-            TSeq contigB = indexText(needle(swiftPattern))[b];
-
-            // compute upper and lower diagonal of band.
-            int upperDiag = (*swiftFinder.curHit).hstkPos - (*swiftFinder.curHit).ndlPos;
-            int lowerDiag = upperDiag - swiftPattern.bucketParams[b].delta - swiftPattern.bucketParams[b].overlap;
-            upperDiag += diagExtension;
-            lowerDiag -= diagExtension;
-
-            // verify by banded Smith-Waterman alignment
-            ++numComparisons;
-            if (!pairwiseAlignment(contigA, contigB, scoringScheme, lowerDiag, upperDiag, options.minScore)) continue;
+            // verify hits the thread left out after the contig's set had grown large
+            if (!hits[i].verified)
+            {
+                ++queue.numComparisons;
+                hits[i].aligned = pairwiseAlignment(contigs[a].seq, contigs[b].seq, scoringScheme,
+                                                    hits[i].lowerDiag, hits[i].upperDiag, options.minScore);
+            }
+            if (!hits[i].aligned) continue;
             alignedPairs.insert(Pair<TSize>(a, b));
 
             // join sets of the two aligned contigs
@@ -131,24 +498,99 @@ partitionContigs(UnionFind<int> & uf,
             joinSets(uf, findSet(uf, a1), findSet(uf, b1));
 
             // stop aligning this contig if it is already in a component with more than 100 other contigs
-            if (uf._values[findSet(uf, a)] < -100) break;
+            if (setSize(uf, findSet(uf, a)) > 100) break;
         }
     }
+    for (unsigned i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
     while (progress < 50)
     {
     	std::cerr << "*" << std::flush;
     	++progress;
     }
     std::cerr << std::endl;
+}
+
+// ==========================================================================
+// Function partitionContigs()
+// ==========================================================================
+
+// Partitions the contigs into sets of aligned contigs. The threads find candidates by SWIFT filtering or shared
+// minimizers and verify them, while the calling thread joins the sets in contig order as the serial loop did, such
+// that the sets and aligned pairs do not depend on the number of threads. Only the forward contigs from firstQuery on
+// are aligned to all contigs, the sets of the previous ones are expected in uf already.
+template<typename TSize, typename TSeq>
+bool
+partitionContigs(ConcurrentUnionFind & uf,
+        std::set<Pair<TSize> > & alignedPairs,
+        String<Contig<TSeq> > & contigs,
+        MergingOptions & options,
+        int firstQuery = 0)
+{
+    typedef typename Iterator<String<Contig<TSeq> > >::Type TContigIter;
+    typedef StringSet<TSeq, Dependent<> > TStringSet;
+    typedef Index<TStringSet, IndexQGram<SimpleShape, OpenAddressing> > TIndex;
 
     std::ostringstream msg;
-    msg << "Number of pairwise comparisons: " << numComparisons;
+    msg << "Partitioning contigs using " << options.candidates << " candidates";
+    printStatus(msg);
+    printStatus("- Indexing contigs");
+
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    PartitionQueue queue(length(contigs)/2, firstQuery);
+    std::vector<std::thread> workers;
+
+    if (options.candidates == "minimizer")
+    {
+        // bucketing of the contigs by their minimizers
+        MinimizerIndex minimizerIndex;
+        buildMinimizerIndex(minimizerIndex, contigs, options.minimizerLength, options.minimizerWindow, options.threads);
+
+        printStatus("- Aligning contigs");
+        for (unsigned i = 0; i < options.threads; ++i)
+            workers.push_back(std::thread(_findContigHitsWorker<MinimizerCandidateFinder, MinimizerIndex, TSeq>,
+                                          std::ref(queue), std::ref(uf), std::ref(minimizerIndex), std::ref(contigs),
+                                          std::ref(options)));
+        _joinContigHits(uf, alignedPairs, queue, workers, contigs, options);
+    }
+    else
+    {
+        // initialization of the q-gram index, which is shared by the SWIFT patterns of all threads
+        TStringSet seqs;
+        TContigIter itEnd = end(contigs);
+        for (TContigIter it = begin(contigs); it != itEnd; ++it)
+            appendValue(seqs, (*it).seq);
+        TIndex qgramIndex(seqs);
+        resize(indexShape(qgramIndex), options.qgramLength);
+        indexRequire(qgramIndex, QGramSADir());
+
+        printStatus("- Aligning contigs");
+        for (unsigned i = 0; i < options.threads; ++i)
+            workers.push_back(std::thread(_findContigHitsWorker<SwiftCandidateFinder<TIndex>, TIndex, TSeq>,
+                                          std::ref(queue), std::ref(uf), std::ref(qgramIndex), std::ref(contigs),
+                                          std::ref(options)));
+        _joinContigHits(uf, alignedPairs, queue, workers, contigs, options);
+    }
+
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - startTime;
+
+    msg.str("");
+    msg << "Number of candidates:           " << queue.numCandidates;
+    printStatus(msg);
+
+    msg.str("");
+    msg << "Number of pairwise comparisons: " << queue.numComparisons;
     printStatus(msg);
 
     msg.str("");
     msg << "Number of valid alignments:     " << length(alignedPairs);
     printStatus(msg);
 
+    msg.str("");
+    msg << "Partitioning time in seconds:   " << std::fixed << std::setprecision(1) << seconds.count();
+    printStatus(msg);
+
     return 0;
 }
 
@@ -159,7 +601,7 @@ partitionContigs(UnionFind<int> & uf,
 template<typename TSize, typename TSeq>
 void
 unionFindToComponents(std::map<TSize, ContigComponent<TSeq> > & components,
-        UnionFind<int> & uf,
+        ConcurrentUnionFind & uf,
         std::set<Pair<TSize> > & alignedPairs,
       unsigned fwdContigCount)
 {
@@ -192,7 +634,7 @@ template<typename TSize, typename TSeq>
 void
 addSingletons(std::map<TSize, ContigComponent<TSeq> > & components,
         String<Contig<TSeq> > & contigs,
-        UnionFind<int> & uf)
+        ConcurrentUnionFind & uf)
 {
     unsigned numSingletons = 0;
     for (int i = 0; i < (int)length(contigs)/2; ++i)
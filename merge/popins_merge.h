@@ -10,6 +10,7 @@
 
 #include "partition.h"
 #include "merge_seqs.h"
+#include "merge_state.h"
 
 
 using namespace seqan;
@@ -182,23 +183,59 @@ int popins_merge(int argc, char const ** argv)
         }
     }
 
+    // Read the state of a previous merge to update.
+    MergeState state;
+    if (options.updateFile != "" && readMergeState(state, options.updateFile) != 0)
+        return 7;
+
     // Read and filter the contigs and add reverse complements.
     if (readInputFiles(contigs, options) != 0)
        return 7;
+    if (options.updateFile != "" && sortContigsByState(contigs, state) != 0)
+        return 7;
     addReverseComplementContigs(contigs);
 
     // PARTITIONING into components      --> partition.h
-    UnionFind<int> uf;
+    if (options.benchmarkCandidates)
+    {
+        // Partition with the other candidate method first to compare candidates, runtime, and components.
+        CharString candidates = options.candidates;
+        options.candidates = candidates == "swift" ? "minimizer" : "swift";
+
+        ConcurrentUnionFind benchmarkUf;
+        resize(benchmarkUf, 2 * length(contigs));
+        std::set<Pair<TSize> > benchmarkPairs;
+        std::map<TSize, ContigComponent<TSequence> > benchmarkComponents;
+        if (partitionContigs(benchmarkUf, benchmarkPairs, contigs, options) != 0)
+            return 7;
+        unionFindToComponents(benchmarkComponents, benchmarkUf, benchmarkPairs, length(contigs)/2);
+        addSingletons(benchmarkComponents, contigs, benchmarkUf);
+
+        options.candidates = candidates;
+    }
+
+    // When updating, only the new contigs are aligned to all contigs.
+    ConcurrentUnionFind uf;
     resize(uf, 2 * length(contigs));
     std::set<Pair<TSize> > alignedPairs;
-    if (partitionContigs(uf, alignedPairs, contigs, options) != 0)
+    replayMergeState(uf, alignedPairs, state, length(contigs)/2);
+    if (partitionContigs(uf, alignedPairs, contigs, options, length(state.contigs)) != 0)
         return 7;
 
     unionFindToComponents(components, uf, alignedPairs, length(contigs)/2);
     addSingletons(components, contigs, uf);
 
     // SUPERCONTIG CONSTRUCTION           --> merge_seqs.h
-    constructSupercontigs(components, contigs, options);
+    SupercontigPlan<TSize> plan;
+    plan.keepResults = options.stateFile != "";
+    if (options.updateFile != "")
+        planSupercontigs(plan, components, uf, state, length(contigs)/2);
+    else
+        numberComponents(plan, components);
+    constructSupercontigs(components, contigs, options, plan);
+
+    if (options.stateFile != "" && writeMergeState(options.stateFile, contigs, alignedPairs, components, plan) != 0)
+        return 7;
 
     return 0;
 }
@@ -10,6 +10,8 @@
 #include <seqan/stream.h>
 #include <seqan/bam_io.h>
 
+#include "../popins_bam_view.h"
+
 using namespace seqan;
 
 // ==========================================================================
@@ -402,35 +404,33 @@ avgQuality(CharString & qual, Pair<CigarElement<>::TCount> & interval)
 // ==========================================================================
 
 unsigned
-alignmentScore(BamAlignmentRecord & record)
+alignmentScore(BamRecordView & record)
 {
-    BamTagsDict tagsDict(record.tags);
-    unsigned idx;
-    if (findTagKey(idx, tagsDict, "AS"))
-    {
-        unsigned score = 0;
-        extractTagValue(score, tagsDict, idx);
-
+    CharString tags;
+    unsigned score = 0;
+    if (findTagValue(score, record, "AS", tags))
         return score;
-    }
-    return length(record.seq);
+    return record.seqLength;
 }
 
 // ==========================================================================
 
 bool
-isGoodQuality(BamAlignmentRecord & record, Pair<CigarElement<>::TCount> & interval)
+isGoodQuality(BamRecordView & record, Pair<CigarElement<>::TCount> & interval)
 {
     if (interval.i2 - interval.i1 < 50)
         return false;
 
-    if (interval.i2 - interval.i1 < length(record.seq) / 2)
+    if (interval.i2 - interval.i1 < record.seqLength / 2)
         return false;
 
-    if (avgQuality(record.qual, interval) <= 20)
+    if (alignmentScore(record) < 0.7 * (interval.i2 - interval.i1))
         return false;
 
-    if (alignmentScore(record) < 0.7 * (interval.i2 - interval.i1))
+    // Decode the qualities last, they are the most expensive to check.
+    CharString qual;
+    getQual(qual, record);
+    if (avgQuality(qual, interval) <= 20)
         return false;
 
     return true;
@@ -439,7 +439,7 @@ isGoodQuality(BamAlignmentRecord & record, Pair<CigarElement<>::TCount> & interv
 // ==========================================================================
 
 unsigned
-distanceToContigEnd(BamAlignmentRecord & record,
+distanceToContigEnd(BamRecordView & record,
         Pair<CigarElement<>::TCount> & interval,
         BamFileIn & infile)
 {
@@ -450,7 +450,7 @@ distanceToContigEnd(BamAlignmentRecord & record,
     else
     {
         unsigned endPos = record.beginPos + interval.i2 - interval.i1;
-        return getContigLength(record, infile) - endPos;
+        return contigLengths(context(infile))[record.rID] - endPos;
     }
 }
 
@@ -462,7 +462,9 @@ readAnchoringRecord(AnchoringRecord & record,
         BamFileIn & stream,
         unsigned nonContigSeqs)
 {
-    BamAlignmentRecord r;
+    // Only the read name is decoded from the records that pass the filters.
+    BamRecordView r;
+    CharString qName;
     while (!atEnd(stream))
     {
         readRecord(r, stream);
@@ -482,13 +484,14 @@ readAnchoringRecord(AnchoringRecord & record,
         if (isContig && distanceToContigEnd(r, interval, stream) > 500)
             continue;
 
-        CharString rName = getContigName(r, stream);
+        CharString rName = contigNames(context(stream))[r.rID];
         CharString rNextName = contigNames(context(stream))[r.rNextId];
+        getQName(qName, r);
 
-        Triple<CharString, CharString, unsigned> nameChrPos = Triple<CharString, CharString, unsigned>(r.qName, rNextName, r.pNext);
+        Triple<CharString, CharString, unsigned> nameChrPos = Triple<CharString, CharString, unsigned>(qName, rNextName, r.pNext);
         if (goodReads.count(nameChrPos) == 0)
         {
-            goodReads[Triple<CharString, CharString, unsigned>(r.qName, rName, r.beginPos)] = r.beginPos + interval.i2 - interval.i1;
+            goodReads[Triple<CharString, CharString, unsigned>(qName, rName, r.beginPos)] = r.beginPos + interval.i2 - interval.i1;
         }
         else if (isContig)
         {
@@ -206,6 +206,12 @@ loadInputAndSplitReadAlign(CharString & samplePath, PlacingOptions<SplitAlign> &
     if (readSampleInfo(sampleInfo, sampleInfoFile) != 0)
         return 1;
 
+    // Size the reference windows by the sample's read length and insert sizes.
+    if (options.sampleReadLength)
+        options.readLength = sampleReadLength(sampleInfo, options.readLength);
+    if (options.sampleInsertSize)
+        options.maxInsertSize = sampleMaxInsertSize(sampleInfo, options.maxInsertSize);
+
     // Load the locations.
     String<LocationInfo> locs;
     CharString locationsFile = getFileName(samplePath, "locations_unplaced.txt");
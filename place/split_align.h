@@ -58,14 +58,15 @@ hasGoodClippedPrefix(TQualString & qual, TCigar & cigar, unsigned minQual)
 }
 
 // ---------------------------------------------------------------------------------------
-// Function isCandidateSplitRead()
+// Function passesSplitReadFlags()
 // ---------------------------------------------------------------------------------------
 
-// Returns true if read is unmapped and it's mate is mapped in correct orientation or
-//              if the read is soft-clipped and the clipped prefix/suffix is of good quality.
+// Checks the cigar and the flags of a BamAlignmentRecord or a BamRecordView. Returns false if the read cannot be a
+// candidate split read, so that its sequence and qualities need not be decoded.
 
+template<typename TRecord>
 bool
-isCandidateSplitRead(BamAlignmentRecord & record, bool locOri)
+passesSplitReadFlags(TRecord const & record, bool locOri)
 {
     // Check cigar.
     if (length(record.cigar) == 1 || (length(record.cigar) == 3 &&
@@ -76,6 +77,26 @@ isCandidateSplitRead(BamAlignmentRecord & record, bool locOri)
     if (hasFlagSecondary(record) || hasFlagQCNoPass(record) || hasFlagDuplicate(record) || hasFlagSupplementary(record))
         return false;
 
+    // Check orientation of the mate of unmapped reads.
+    if (hasFlagUnmapped(record))
+        return hasFlagNextRC(record) != locOri;
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------
+// Function isCandidateSplitRead()
+// ---------------------------------------------------------------------------------------
+
+// Returns true if read is unmapped and it's mate is mapped in correct orientation or
+//              if the read is soft-clipped and the clipped prefix/suffix is of good quality.
+
+bool
+isCandidateSplitRead(BamAlignmentRecord & record, bool locOri)
+{
+    if (!passesSplitReadFlags(record, locOri))
+        return false;
+
     // Check if unmapped and otherwise for quality of interesting read end.
     // Reverse complement the read sequence if necessary.
     if (locOri)
@@ -222,23 +243,22 @@ alignRead(std::pair<unsigned, unsigned> & insPos, Dna5String readSeq, TContigSeq
 }
 
 // ---------------------------------------------------------------------------------------
-// Function splitAlignReads()
+// Function _splitAlignReadsInFile()
 // ---------------------------------------------------------------------------------------
 
+// Split-aligns the candidate reads of the location in one bam file of the sample. Returns 1 if the reads counted in
+// this and previous bam files exceed the coverage threshold.
 template<typename TContigSeq, typename TRefSeq>
 bool
-splitAlignReads(std::map<std::pair<unsigned, unsigned>, unsigned> & insPos,
+_splitAlignReadsInFile(std::map<std::pair<unsigned, unsigned>, unsigned> & insPos,
+        unsigned & readCount,
         BamFileIn & bamStream,
         BamIndex<Bai> & bai,
         TContigSeq & contigPrefix,
         TRefSeq & ref,
         Location & loc,
-      double avgCov,
-      unsigned readLength)
+        unsigned covThresh)
 {
-    // Set the coverage threshold for this BAM file for this location to 3 times the average coverage.
-    unsigned covThresh = 3 * avgCov * (loc.chrEnd - loc.chrStart) / readLength;
-
     // Find the rID in BAM file for the location's chromosome.
     int rID = 0;
     getIdByName(rID, contigNamesCache(context(bamStream)), loc.chr);
@@ -247,22 +267,21 @@ splitAlignReads(std::map<std::pair<unsigned, unsigned>, unsigned> & insPos,
     bool hasAlignments;
     jumpToRegion(bamStream, hasAlignments, rID, loc.chrStart, loc.chrEnd, bai);
 
-    unsigned readCount = 0;
-
     // Iterate reads in region and align candidate split reads.
+    BamRecordView view;
     BamAlignmentRecord record;
     std::pair<unsigned, unsigned> posPair;
     while (!atEnd(bamStream))
     {
         // Read record from BAM file.
-        readRecord(record, bamStream);
+        readRecord(view, bamStream);
 
         // Skip records before the region's start.
-        if (record.rID == rID && record.beginPos < (int32_t)loc.chrStart)
+        if (view.rID == rID && view.beginPos < (int32_t)loc.chrStart)
             continue;
 
         // Check if read's alignment position is still within the location.
-        if (record.rID != rID || record.beginPos > (int32_t)loc.chrEnd)
+        if (view.rID != rID || view.beginPos > (int32_t)loc.chrEnd)
             return 0;
 
         // Check for too high coverage.
@@ -270,7 +289,10 @@ splitAlignReads(std::map<std::pair<unsigned, unsigned>, unsigned> & insPos,
         if (readCount > covThresh)
             return 1;
 
-        // Check quality of record.
+        // Check quality of record, decoding it only if cigar and flags qualify.
+        if (!passesSplitReadFlags(view, loc.chrOri))
+            continue;
+        assignRecord(record, view);
         if (!isCandidateSplitRead(record, loc.chrOri))
             continue;
 
@@ -292,6 +314,32 @@ splitAlignReads(std::map<std::pair<unsigned, unsigned>, unsigned> & insPos,
     return 0;
 }
 
+// ---------------------------------------------------------------------------------------
+// Function splitAlignReads()
+// ---------------------------------------------------------------------------------------
+
+template<typename TContigSeq, typename TRefSeq>
+bool
+splitAlignReads(std::map<std::pair<unsigned, unsigned>, unsigned> & insPos,
+        std::vector<std::unique_ptr<IndexedBamFileIn> > & bams,
+        TContigSeq & contigPrefix,
+        TRefSeq & ref,
+        Location & loc,
+      double avgCov,
+      unsigned readLength)
+{
+    // Set the coverage threshold for the sample's BAM files for this location to 3 times the average coverage.
+    unsigned covThresh = 3 * avgCov * (loc.chrEnd - loc.chrStart) / readLength;
+
+    unsigned readCount = 0;
+    for (unsigned i = 0; i < bams.size(); ++i)
+        if (_splitAlignReadsInFile(insPos, readCount, bams[i]->stream, bams[i]->index, contigPrefix, ref, loc,
+                                   covThresh) != 0)
+            return 1;
+
+    return 0;
+}
+
 // ---------------------------------------------------------------------------------------
 // Function loadContigAndSplitAlign()
 // ---------------------------------------------------------------------------------------
@@ -299,8 +347,7 @@ splitAlignReads(std::map<std::pair<unsigned, unsigned>, unsigned> & insPos,
 template<typename TRefSeq>
 bool
 loadContigAndSplitAlign(std::map<std::pair<unsigned, unsigned>, unsigned> & insPos,
-        BamFileIn & bamStream,
-        BamIndex<Bai> & bai,
+        std::vector<std::unique_ptr<IndexedBamFileIn> > & bams,
         TRefSeq & ref,
         Dna5String & contig,
         Location & loc,
@@ -317,14 +364,14 @@ loadContigAndSplitAlign(std::map<std::pair<unsigned, unsigned>, unsigned> & insP
     {
         unsigned suffixBegPos = length(contig) - _min(preSufLen, length(contig));
         TInfix contigSuffix = infix(contig, suffixBegPos, length(contig));
-        return splitAlignReads(insPos, bamStream, bai, contigSuffix, ref, loc, avgCov, readLength);
+        return splitAlignReads(insPos, bams, contigSuffix, ref, loc, avgCov, readLength);
     }
     else
     {
         unsigned prefixEndPos = _min(preSufLen, length(contig));
         TInfix pref = infix(contig, 0, prefixEndPos);
         TRcInfix contigPrefix(pref);
-        return splitAlignReads(insPos, bamStream, bai, contigPrefix, ref, loc, avgCov, readLength);
+        return splitAlignReads(insPos, bams, contigPrefix, ref, loc, avgCov, readLength);
     }
 
 }
@@ -395,23 +442,10 @@ popins_place_split_read_align(CharString & outFile,
     typedef typename Iterator<String<LocationInfo> >::Type TIter;
     typedef std::pair<CharString, Dna5String> TPair;
 
-    // Open the BAM file.
-    BamFileIn bamStream(toCString(info.bam_file));
-
-    // Read the header and clear it since we don't need it.
-    BamHeader header;
-    readHeader(header, bamStream);
-    clear(header);
-
-    // Load the BAI file.
-    BamIndex<Bai> bai;
-    CharString baiFile = info.bam_file;
-    baiFile += ".bai";
-    if (!open(bai, toCString(baiFile)))
-    {
-        std::cerr << "ERROR: Could not read BAI index file " << baiFile << std::endl;
+    // Open the BAM files of the sample and their BAI files.
+    std::vector<std::unique_ptr<IndexedBamFileIn> > bams;
+    if (openSampleBams(bams, info) != 0)
         return 1;
-    }
 
     // Open the output file.
     std::fstream outStream(toCString(outFile), std::ios::out);
@@ -454,7 +488,7 @@ popins_place_split_read_align(CharString & outFile,
             ModifiedString<ModifiedString<Dna5String, ModComplementDna5>, ModReverse> ref(r);
 
             // Load the contig prefix/suffix and split align.
-            highCov = loadContigAndSplitAlign(insPos, bamStream, bai, ref, contigIt->second, (*it).loc, info.avg_cov, readLength);
+            highCov = loadContigAndSplitAlign(insPos, bams, ref, contigIt->second, (*it).loc, info.avg_cov, readLength);
 
             (*it).loc.chrEnd -= maxInsertSize;
         }
@@ -471,7 +505,7 @@ popins_place_split_read_align(CharString & outFile,
                 return 1;
 
             // Load the contig prefix/suffix and split align.
-            highCov = loadContigAndSplitAlign(insPos, bamStream, bai, ref, contigIt->second, (*it).loc, info.avg_cov, readLength);
+            highCov = loadContigAndSplitAlign(insPos, bams, ref, contigIt->second, (*it).loc, info.avg_cov, readLength);
 
             (*it).loc.chrStart += maxInsertSize;
         }
@@ -0,0 +1,304 @@
+#ifndef POPINS_BAM_VIEW_H_
+#define POPINS_BAM_VIEW_H_
+
+#include <seqan/bam_io.h>
+
+using namespace seqan;
+
+// ==========================================================================
+// Struct BamRecordView
+// ==========================================================================
+
+// A bam record read as raw bytes of which only the fixed fields and the cigar are decoded. The read name, sequence,
+// qualities, and tags are decoded on demand by getQName(), getSeq(), getQual(), and getTags(), or all at once into a
+// BamAlignmentRecord by assignRecord(). Scans that reject most records on flags, positions, or the cigar thereby skip
+// most of the decoding work of readRecord() for a BamAlignmentRecord.
+struct BamRecordView
+{
+    // Fixed fields as in BamAlignmentRecord.
+    __int32 rID;
+    __int32 beginPos;
+    __uint8 mapQ;
+    __uint16 bin;
+    __uint16 flag;
+    __int32 rNextId;
+    __int32 pNext;
+    __int32 tLen;
+    String<CigarElement<> > cigar;
+
+    // Length of the read sequence.
+    unsigned seqLength;
+
+    // The record without its block size and the positions of the variable-length fields in it.
+    CharString raw;
+    unsigned nameLength;
+    size_t seqOffset;
+    size_t qualOffset;
+    size_t tagsOffset;
+
+    BamRecordView() :
+        rID(BamAlignmentRecord::INVALID_REFID), beginPos(BamAlignmentRecord::INVALID_POS), mapQ(255), bin(0), flag(0),
+        rNextId(BamAlignmentRecord::INVALID_REFID), pNext(BamAlignmentRecord::INVALID_POS), tLen(0), seqLength(0),
+        nameLength(0), seqOffset(0), qualOffset(0), tagsOffset(0)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Function _bamValue()
+// --------------------------------------------------------------------------
+
+// Little-endian integer at a position of the raw record.
+inline __uint32
+_bamValue(CharString const & raw, size_t pos, unsigned numBytes)
+{
+    __uint32 value = 0;
+    for (unsigned i = 0; i < numBytes; ++i)
+        value |= (__uint32)(unsigned char)raw[pos + i] << (8 * i);
+    return value;
+}
+
+// --------------------------------------------------------------------------
+// Function readRecord()
+// --------------------------------------------------------------------------
+
+// Reads the next record of a bam file into the view. Throws a ParseError for malformed records and for files in
+// another format than BAM.
+inline void
+readRecord(BamRecordView & view, BamFileIn & file)
+{
+    static const char cigarOperations[] = "MIDNSHP=X";
+
+    if (!isEqual(format(file), Bam()))
+        SEQAN_THROW(ParseError("Lazy decoding of records requires a file in BAM format."));
+
+    __int32 recordLength = 0;
+    readRawPod(recordLength, file.iter);
+    if (recordLength < 32)
+        SEQAN_THROW(ParseError("Invalid BAM record length."));
+    clear(view.raw);
+    write(view.raw, file.iter, (size_t)recordLength);
+    if (length(view.raw) != (size_t)recordLength)
+        SEQAN_THROW(ParseError("Unexpected end of BAM file."));
+
+    CharString const & raw = view.raw;
+    view.rID = (__int32)_bamValue(raw, 0, 4);
+    view.beginPos = (__int32)_bamValue(raw, 4, 4);
+    unsigned nameBytes = _bamValue(raw, 8, 1);
+    view.mapQ = _bamValue(raw, 9, 1);
+    view.bin = _bamValue(raw, 10, 2);
+    unsigned numCigar = _bamValue(raw, 12, 2);
+    view.flag = _bamValue(raw, 14, 2);
+    view.seqLength = _bamValue(raw, 16, 4);
+    view.rNextId = (__int32)_bamValue(raw, 20, 4);
+    view.pNext = (__int32)_bamValue(raw, 24, 4);
+    view.tLen = (__int32)_bamValue(raw, 28, 4);
+
+    view.nameLength = nameBytes > 0 ? nameBytes - 1 : 0;
+    size_t cigarOffset = 32 + nameBytes;
+    view.seqOffset = cigarOffset + 4 * numCigar;
+    view.qualOffset = view.seqOffset + (view.seqLength + 1) / 2;
+    view.tagsOffset = view.qualOffset + view.seqLength;
+    if (view.tagsOffset > length(raw))
+        SEQAN_THROW(ParseError("Invalid BAM record field lengths."));
+
+    resize(view.cigar, numCigar, Exact());
+    for (unsigned i = 0; i < numCigar; ++i)
+    {
+        __uint32 value = _bamValue(raw, cigarOffset + 4 * i, 4);
+        view.cigar[i].operation = cigarOperations[std::min(value & 15, 8u)];
+        view.cigar[i].count = value >> 4;
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function getQName()
+// --------------------------------------------------------------------------
+
+inline void
+getQName(CharString & qName, BamRecordView const & view)
+{
+    resize(qName, view.nameLength, Exact());
+    std::copy(begin(view.raw, Standard()) + 32, begin(view.raw, Standard()) + 32 + view.nameLength,
+              begin(qName, Standard()));
+}
+
+inline void
+getQName(CharString & qName, BamAlignmentRecord const & record)
+{
+    qName = record.qName;
+}
+
+// --------------------------------------------------------------------------
+// Function getSeq()
+// --------------------------------------------------------------------------
+
+// Decodes the read sequence into any string of characters or of a SeqAn alphabet that converts from char.
+template<typename TSeq>
+inline void
+getSeq(TSeq & seq, BamRecordView const & view)
+{
+    static const char bases[] = "=ACMGRSVTWYHKDBN";
+
+    resize(seq, view.seqLength, Exact());
+    for (unsigned i = 0; i < view.seqLength; ++i)
+    {
+        unsigned char packed = view.raw[view.seqOffset + i / 2];
+        seq[i] = bases[(i % 2 == 0) ? (packed >> 4) : (packed & 15)];
+    }
+}
+
+template<typename TSeq>
+inline void
+getSeq(TSeq & seq, BamAlignmentRecord const & record)
+{
+    seq = record.seq;
+}
+
+// --------------------------------------------------------------------------
+// Function getQual()
+// --------------------------------------------------------------------------
+
+// Decodes the phred qualities as characters (offset 33). Missing qualities give an empty string as in
+// BamAlignmentRecord.
+inline void
+getQual(CharString & qual, BamRecordView const & view)
+{
+    if (view.seqLength == 0 || (unsigned char)view.raw[view.qualOffset] == 0xff)
+    {
+        clear(qual);
+        return;
+    }
+
+    resize(qual, view.seqLength, Exact());
+    for (unsigned i = 0; i < view.seqLength; ++i)
+        qual[i] = view.raw[view.qualOffset + i] + '!';
+}
+
+inline void
+getQual(CharString & qual, BamAlignmentRecord const & record)
+{
+    qual = record.qual;
+}
+
+// --------------------------------------------------------------------------
+// Function getTags()
+// --------------------------------------------------------------------------
+
+// Copies the tags in their binary representation as in BamAlignmentRecord.
+inline void
+getTags(CharString & tags, BamRecordView const & view)
+{
+    tags = suffix(view.raw, view.tagsOffset);
+}
+
+inline void
+getTags(CharString & tags, BamAlignmentRecord const & record)
+{
+    tags = record.tags;
+}
+
+// --------------------------------------------------------------------------
+// Function findTagValue()
+// --------------------------------------------------------------------------
+
+// Extracts the value of a tag. The buffer takes a copy of the view's tags and is unused for a BamAlignmentRecord.
+// Returns false if the record has no such tag.
+template<typename TValue>
+inline bool
+findTagValue(TValue & value, CharString & tags, char const * key)
+{
+    BamTagsDict tagsDict(tags);
+    unsigned idx;
+    return findTagKey(idx, tagsDict, key) && extractTagValue(value, tagsDict, idx);
+}
+
+template<typename TValue>
+inline bool
+findTagValue(TValue & value, BamRecordView const & view, char const * key, CharString & buffer)
+{
+    getTags(buffer, view);
+    return findTagValue(value, buffer, key);
+}
+
+template<typename TValue>
+inline bool
+findTagValue(TValue & value, BamAlignmentRecord & record, char const * key, CharString & /*buffer*/)
+{
+    return findTagValue(value, record.tags, key);
+}
+
+// --------------------------------------------------------------------------
+// Function assignRecord()
+// --------------------------------------------------------------------------
+
+// Decodes all fields of the view into a BamAlignmentRecord.
+inline void
+assignRecord(BamAlignmentRecord & record, BamRecordView const & view)
+{
+    record.rID = view.rID;
+    record.beginPos = view.beginPos;
+    record.mapQ = view.mapQ;
+    record.bin = view.bin;
+    record.flag = view.flag;
+    record.rNextId = view.rNextId;
+    record.pNext = view.pNext;
+    record.tLen = view.tLen;
+    record.cigar = view.cigar;
+    getQName(record.qName, view);
+    getSeq(record.seq, view);
+    getQual(record.qual, view);
+    getTags(record.tags, view);
+}
+
+// --------------------------------------------------------------------------
+// Function readLength()
+// --------------------------------------------------------------------------
+
+inline unsigned
+readLength(BamRecordView const & view)
+{
+    return view.seqLength;
+}
+
+inline unsigned
+readLength(BamAlignmentRecord const & record)
+{
+    return length(record.seq);
+}
+
+// --------------------------------------------------------------------------
+// Function getAlignmentLengthInRef()
+// --------------------------------------------------------------------------
+
+inline unsigned
+getAlignmentLengthInRef(BamRecordView const & view)
+{
+    unsigned len = 0;
+    for (unsigned i = 0; i < length(view.cigar); ++i)
+    {
+        char op = view.cigar[i].operation;
+        if (op == 'M' || op == 'D' || op == 'N' || op == '=' || op == 'X')
+            len += view.cigar[i].count;
+    }
+    return len;
+}
+
+// --------------------------------------------------------------------------
+// Functions hasFlag*()
+// --------------------------------------------------------------------------
+
+// The flag checks of BamAlignmentRecord for the view.
+inline bool hasFlagMultiple(BamRecordView const & view) { return (view.flag & BAM_FLAG_MULTIPLE) != 0; }
+inline bool hasFlagAllProper(BamRecordView const & view) { return (view.flag & BAM_FLAG_ALL_PROPER) != 0; }
+inline bool hasFlagUnmapped(BamRecordView const & view) { return (view.flag & BAM_FLAG_UNMAPPED) != 0; }
+inline bool hasFlagNextUnmapped(BamRecordView const & view) { return (view.flag & BAM_FLAG_NEXT_UNMAPPED) != 0; }
+inline bool hasFlagRC(BamRecordView const & view) { return (view.flag & BAM_FLAG_RC) != 0; }
+inline bool hasFlagNextRC(BamRecordView const & view) { return (view.flag & BAM_FLAG_NEXT_RC) != 0; }
+inline bool hasFlagFirst(BamRecordView const & view) { return (view.flag & BAM_FLAG_FIRST) != 0; }
+inline bool hasFlagLast(BamRecordView const & view) { return (view.flag & BAM_FLAG_LAST) != 0; }
+inline bool hasFlagSecondary(BamRecordView const & view) { return (view.flag & BAM_FLAG_SECONDARY) != 0; }
+inline bool hasFlagQCNoPass(BamRecordView const & view) { return (view.flag & BAM_FLAG_QC_NO_PASS) != 0; }
+inline bool hasFlagDuplicate(BamRecordView const & view) { return (view.flag & BAM_FLAG_DUPLICATE) != 0; }
+inline bool hasFlagSupplementary(BamRecordView const & view) { return (view.flag & BAM_FLAG_SUPPLEMENTARY) != 0; }
+
+#endif  // POPINS_BAM_VIEW_H_
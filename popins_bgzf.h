@@ -0,0 +1,338 @@
+#ifndef POPINS_BGZF_H_
+#define POPINS_BGZF_H_
+
+#include <deque>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include <seqan/bam_io.h>
+
+#include "popins_parallel.h"
+
+using namespace seqan;
+
+// Maximum number of uncompressed bytes in a BGZF block (as in htslib) and maximum size of a compressed block.
+static const size_t BGZF_BLOCK_DATA_SIZE = 0xff00;
+static const size_t BGZF_MAX_BLOCK_SIZE = 0x10000;
+static const size_t BGZF_HEADER_SIZE = 18;
+static const size_t BGZF_FOOTER_SIZE = 8;
+
+// Compression level of bam files that popins reads only once again, e.g. for sorting or merging.
+static const int BGZF_INTERMEDIATE_LEVEL = 1;
+
+// ==========================================================================
+// Function compressBgzfBlock()
+// ==========================================================================
+
+// Compresses at most BGZF_BLOCK_DATA_SIZE bytes into a BGZF block. Data that does not fit into a block after
+// compression is stored uncompressed. Returns false on error.
+inline bool
+compressBgzfBlock(std::string & block, std::string const & data, int level)
+{
+    block.resize(BGZF_MAX_BLOCK_SIZE);
+
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    if (deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    strm.next_in = (Bytef *)data.data();
+    strm.avail_in = data.size();
+    strm.next_out = (Bytef *)&block[BGZF_HEADER_SIZE];
+    strm.avail_out = BGZF_MAX_BLOCK_SIZE - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+    int status = deflate(&strm, Z_FINISH);
+    size_t compressedSize = strm.total_out;
+    deflateEnd(&strm);
+
+    if (status != Z_STREAM_END)
+        return level != 0 && compressBgzfBlock(block, data, 0);
+
+    size_t blockSize = BGZF_HEADER_SIZE + compressedSize + BGZF_FOOTER_SIZE;
+    auto setValue = [&](size_t pos, unsigned value, unsigned numBytes)
+    {
+        for (unsigned i = 0; i < numBytes; ++i)
+            block[pos + i] = (char)((value >> (8 * i)) & 0xff);
+    };
+
+    // Gzip header with the BC extra field that holds the block size.
+    static const char header[] = "\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00";
+    block.replace(0, 16, header, 16);
+    setValue(16, blockSize - 1, 2);
+
+    // Gzip footer.
+    unsigned long crc = crc32(crc32(0L, Z_NULL, 0), (Bytef const *)data.data(), data.size());
+    setValue(BGZF_HEADER_SIZE + compressedSize, crc, 4);
+    setValue(BGZF_HEADER_SIZE + compressedSize + 4, data.size(), 4);
+
+    block.resize(blockSize);
+    return true;
+}
+
+// ==========================================================================
+// Struct BgzfWriter
+// ==========================================================================
+
+// A block of the BGZF output, compressed by one of the writer's threads.
+struct BgzfBlock
+{
+    std::string data;
+    std::string block;
+    bool ok;
+    std::promise<void> compressed;
+};
+
+// Writes a BGZF file. Blocks are compressed by a pool of threads and written to the file in order by the calling
+// thread.
+struct BgzfWriter
+{
+    typedef std::shared_ptr<BgzfBlock> TBlock;
+
+    std::ofstream file;
+    int level;
+    bool ok;
+
+    // Uncompressed data of the next block.
+    std::string data;
+
+    // Blocks being compressed in file order, the threads compressing them, and their queue of blocks.
+    std::deque<TBlock> blocks;
+    std::vector<std::thread> threads;
+    BoundedQueue<TBlock> queue;
+
+    BgzfWriter() :
+        level(Z_DEFAULT_COMPRESSION), ok(true), queue(1)
+    {}
+
+    ~BgzfWriter()
+    {
+        closeQueue(queue);
+        for (unsigned i = 0; i < threads.size(); ++i)
+            threads[i].join();
+    }
+};
+
+// --------------------------------------------------------------------------
+// Function compressBgzfBlocks()
+// --------------------------------------------------------------------------
+
+// Thread function for compressing the blocks of a BgzfWriter.
+inline void
+compressBgzfBlocks(BoundedQueue<BgzfWriter::TBlock> & queue, int level)
+{
+    BgzfWriter::TBlock block;
+    while (dequeue(block, queue))
+    {
+        block->ok = compressBgzfBlock(block->block, block->data, level);
+        block->compressed.set_value();
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function open()
+// --------------------------------------------------------------------------
+
+// Returns false if the file cannot be opened.
+inline bool
+open(BgzfWriter & writer, CharString const & fileName, unsigned numThreads, int level)
+{
+    writer.file.open(toCString(fileName), std::ios::binary);
+    if (!writer.file.is_open())
+        return false;
+
+    writer.level = level;
+    writer.data.reserve(BGZF_BLOCK_DATA_SIZE);
+    if (numThreads > 1)
+    {
+        writer.queue.capacity = 2 * numThreads;
+        for (unsigned i = 0; i < numThreads; ++i)
+            writer.threads.push_back(std::thread(compressBgzfBlocks, std::ref(writer.queue), level));
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function writeFirstBlock()
+// --------------------------------------------------------------------------
+
+// Waits for the compression of the first block in file order and writes it to the file.
+inline void
+writeFirstBlock(BgzfWriter & writer)
+{
+    BgzfWriter::TBlock block = writer.blocks.front();
+    writer.blocks.pop_front();
+
+    block->compressed.get_future().wait();
+    writer.ok = writer.ok && block->ok;
+    writer.file.write(block->block.data(), block->block.size());
+}
+
+// --------------------------------------------------------------------------
+// Function flushBlock()
+// --------------------------------------------------------------------------
+
+inline void
+flushBlock(BgzfWriter & writer)
+{
+    if (writer.data.empty())
+        return;
+
+    if (writer.threads.empty())
+    {
+        std::string block;
+        writer.ok = writer.ok && compressBgzfBlock(block, writer.data, writer.level);
+        writer.file.write(block.data(), block.size());
+        writer.data.clear();
+        return;
+    }
+
+    BgzfWriter::TBlock block(new BgzfBlock);
+    block->data.swap(writer.data);
+    writer.data.reserve(BGZF_BLOCK_DATA_SIZE);
+
+    // Keep the number of blocks in memory bounded.
+    if (writer.blocks.size() >= 2 * writer.queue.capacity)
+        writeFirstBlock(writer);
+
+    writer.blocks.push_back(block);
+    enqueue(writer.queue, block);
+}
+
+// --------------------------------------------------------------------------
+// Function write()
+// --------------------------------------------------------------------------
+
+inline void
+write(BgzfWriter & writer, char const * data, size_t size)
+{
+    while (size > 0)
+    {
+        size_t n = std::min(size, BGZF_BLOCK_DATA_SIZE - writer.data.size());
+        writer.data.append(data, n);
+        data += n;
+        size -= n;
+        if (writer.data.size() == BGZF_BLOCK_DATA_SIZE)
+            flushBlock(writer);
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function close()
+// --------------------------------------------------------------------------
+
+// Writes the remaining blocks and the end-of-file marker. Returns false on error.
+inline bool
+close(BgzfWriter & writer)
+{
+    if (!writer.file.is_open())
+        return writer.ok;
+
+    flushBlock(writer);
+    while (!writer.blocks.empty())
+        writeFirstBlock(writer);
+
+    closeQueue(writer.queue);
+    for (unsigned i = 0; i < writer.threads.size(); ++i)
+        writer.threads[i].join();
+    writer.threads.clear();
+
+    // Empty block marking the end of the file.
+    static const char eofBlock[] = "\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00\x1b\x00"
+                                   "\x03\x00\x00\x00\x00\x00\x00\x00\x00\x00";
+    writer.file.write(eofBlock, 28);
+    writer.file.close();
+
+    writer.ok = writer.ok && !writer.file.fail();
+    return writer.ok;
+}
+
+// ==========================================================================
+// Struct ParallelBamFileOut
+// ==========================================================================
+
+// A bam output file that is compressed by multiple threads with a configurable compression level. Records are
+// encoded by SeqAn's bam writer.
+struct ParallelBamFileOut
+{
+    typedef FormattedFileContext<BamFileOut, Owner<> >::Type TContext;
+
+    TContext context;
+    BgzfWriter bgzf;
+    CharString buffer;
+    CharString fileName;
+
+    ~ParallelBamFileOut()
+    {
+        close(bgzf);
+    }
+};
+
+// --------------------------------------------------------------------------
+// Function open()
+// --------------------------------------------------------------------------
+
+// Opens the bam file for records with the reference sequences of the given context. Returns false on error.
+template<typename TContext>
+inline bool
+open(ParallelBamFileOut & bamFile, CharString const & fileName, TContext & context, unsigned threads, int level)
+{
+    contigNames(bamFile.context) = contigNames(context);
+    contigLengths(bamFile.context) = contigLengths(context);
+    bamFile.fileName = fileName;
+
+    if (!open(bamFile.bgzf, fileName, threads, level))
+    {
+        std::cerr << "ERROR: Could not open " << fileName << " for writing." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function writeHeader()
+// --------------------------------------------------------------------------
+
+inline void
+writeHeader(ParallelBamFileOut & bamFile, BamHeader const & header)
+{
+    clear(bamFile.buffer);
+    write(bamFile.buffer, header, bamFile.context, Bam());
+    write(bamFile.bgzf, begin(bamFile.buffer, Standard()), length(bamFile.buffer));
+}
+
+// --------------------------------------------------------------------------
+// Function writeRecord()
+// --------------------------------------------------------------------------
+
+inline void
+writeRecord(ParallelBamFileOut & bamFile, BamAlignmentRecord const & record)
+{
+    clear(bamFile.buffer);
+    write(bamFile.buffer, record, bamFile.context, Bam());
+    write(bamFile.bgzf, begin(bamFile.buffer, Standard()), length(bamFile.buffer));
+}
+
+// --------------------------------------------------------------------------
+// Function close()
+// --------------------------------------------------------------------------
+
+// Returns false on error.
+inline bool
+close(ParallelBamFileOut & bamFile)
+{
+    if (!close(bamFile.bgzf))
+    {
+        std::cerr << "ERROR: Could not write " << bamFile.fileName << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif  // POPINS_BGZF_H_
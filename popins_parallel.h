@@ -0,0 +1,111 @@
+#ifndef POPINS_PARALLEL_H_
+#define POPINS_PARALLEL_H_
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+// ==========================================================================
+// Struct BoundedQueue
+// ==========================================================================
+
+// A blocking FIFO queue of limited capacity for handing work items between threads.
+// Consumers receive false from dequeue() once the queue is closed and drained.
+template<typename TValue>
+struct BoundedQueue
+{
+    std::deque<TValue> values;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    size_t capacity;
+    bool closed;
+
+    BoundedQueue(size_t c) :
+        capacity(c), closed(false)
+    {}
+};
+
+// --------------------------------------------------------------------------
+// Function enqueue()
+// --------------------------------------------------------------------------
+
+// Blocks while the queue is full. Returns false if the queue has been closed.
+template<typename TValue>
+bool
+enqueue(BoundedQueue<TValue> & queue, TValue const & value)
+{
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    while (queue.values.size() >= queue.capacity && !queue.closed)
+        queue.notFull.wait(lock);
+
+    if (queue.closed)
+        return false;
+
+    queue.values.push_back(value);
+    queue.notEmpty.notify_one();
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function dequeue()
+// --------------------------------------------------------------------------
+
+// Blocks while the queue is empty. Returns false if the queue is closed and empty.
+template<typename TValue>
+bool
+dequeue(TValue & value, BoundedQueue<TValue> & queue)
+{
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    while (queue.values.empty() && !queue.closed)
+        queue.notEmpty.wait(lock);
+
+    if (queue.values.empty())
+        return false;
+
+    value = queue.values.front();
+    queue.values.pop_front();
+    queue.notFull.notify_one();
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function closeQueue()
+// --------------------------------------------------------------------------
+
+// Wakes up all waiting threads. Values already in the queue can still be dequeued.
+template<typename TValue>
+void
+closeQueue(BoundedQueue<TValue> & queue)
+{
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.closed = true;
+    queue.notEmpty.notify_all();
+    queue.notFull.notify_all();
+}
+
+// ==========================================================================
+// Struct ScopeGuard
+// ==========================================================================
+
+// Calls a function when going out of scope, also when leaving it by an exception. Used to join threads, as the
+// destructor of a joinable std::thread calls std::terminate().
+struct ScopeGuard
+{
+    std::function<void()> onExit;
+
+    explicit ScopeGuard(std::function<void()> f) :
+        onExit(f)
+    {}
+
+    ~ScopeGuard()
+    {
+        onExit();
+    }
+
+    ScopeGuard(ScopeGuard const &) = delete;
+    ScopeGuard & operator=(ScopeGuard const &) = delete;
+};
+
+#endif  // POPINS_PARALLEL_H_
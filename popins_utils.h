@@ -1,6 +1,16 @@
 #ifndef POPINS_UILS_H_
 #define POPINS_UILS_H_
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <ext/stdio_filebuf.h>
+
 #include <seqan/bam_io.h>
 #include <seqan/seq_io.h>
 
@@ -17,14 +27,155 @@ struct SampleInfo
     double avg_cov;
     unsigned read_len;
     CharString adapter_type;
+
+    // Median and median absolute deviation of the insert size of sampled proper pairs, zero if unknown.
+    unsigned ins_median;
+    unsigned ins_mad;
     
-    SampleInfo() {}
+    SampleInfo() :
+        avg_cov(0), read_len(0), ins_median(0), ins_mad(0)
+    {}
 };
 
+// ==========================================================================
+// Function readBaiMappedCount()
+// ==========================================================================
+
+// Sums up the numbers of mapped records per reference sequence that samtools stores in the pseudo-bin 37450 of a BAI
+// file. Returns false if the file cannot be read or lacks the pseudo-bins.
+inline bool
+readBaiMappedCount(unsigned long long & mappedCount, CharString const & baiFile)
+{
+    std::ifstream stream(toCString(baiFile), std::ios::binary);
+    char magic[4];
+    if (!stream.read(magic, 4) || strncmp(magic, "BAI\1", 4) != 0)
+        return false;
+
+    mappedCount = 0;
+    bool hasPseudoBin = false;
+    __int32 numRefs = 0;
+    stream.read((char *)&numRefs, 4);
+    for (__int32 i = 0; i < numRefs && stream; ++i)
+    {
+        __int32 numBins = 0;
+        stream.read((char *)&numBins, 4);
+        for (__int32 j = 0; j < numBins && stream; ++j)
+        {
+            __uint32 bin = 0;
+            __int32 numChunks = 0;
+            stream.read((char *)&bin, 4);
+            stream.read((char *)&numChunks, 4);
+            if (bin == 37450 && numChunks == 2)
+            {
+                // The second chunk of the pseudo-bin holds the numbers of mapped and unmapped records.
+                __uint64 values[4];
+                stream.read((char *)values, 32);
+                mappedCount += values[2];
+                hasPseudoBin = true;
+            }
+            else
+            {
+                stream.seekg(16 * (std::streamoff)numChunks, std::ios::cur);
+            }
+        }
+        __int32 numIntervals = 0;
+        stream.read((char *)&numIntervals, 4);
+        stream.seekg(8 * (std::streamoff)numIntervals, std::ios::cur);
+    }
+
+    return stream && hasPseudoBin;
+}
+
+// ==========================================================================
+// Function sampleBamStatistics()
+// ==========================================================================
+
+// Reads up to 10000 records at each of 50 positions spread evenly over the reference sequences of an indexed bam file.
+// Sets the median read length, the median and MAD of the insert sizes of proper pairs, and the average coverage
+// estimated from the index's numbers of mapped records. Counts bases like cropping does, i.e. of mapped records that
+// are primary, not supplementary, not duplicates, and pass quality control. Returns false if there is no index.
+inline bool
+sampleBamStatistics(SampleInfo & info, CharString const & bamFile)
+{
+    static const unsigned SAMPLE_REGIONS = 50;
+    static const unsigned SAMPLE_RECORDS = 10000;
+
+    CharString baiFile = bamFile;
+    baiFile += ".bai";
+    BamIndex<Bai> bai;
+    unsigned long long mappedCount = 0;
+    if (!open(bai, toCString(baiFile)) || !readBaiMappedCount(mappedCount, baiFile))
+        return false;
+
+    BamFileIn stream(toCString(bamFile));
+    BamHeader header;
+    readHeader(header, stream);
+
+    unsigned long long genomeLength = 0;
+    for (unsigned i = 0; i < length(contigLengths(context(stream))); ++i)
+        genomeLength += contigLengths(context(stream))[i];
+    if (genomeLength == 0)
+        return false;
+
+    std::vector<unsigned> readLengths, insertSizes;
+    unsigned long long sampledMapped = 0, sampledBases = 0;
+    BamAlignmentRecord record;
+    for (unsigned k = 0; k < SAMPLE_REGIONS; ++k)
+    {
+        // Find the reference sequence and position of the k-th sample region.
+        unsigned long long offset = (2 * k + 1) * genomeLength / (2 * SAMPLE_REGIONS);
+        __int32 rID = 0;
+        while (offset >= (unsigned long long)contigLengths(context(stream))[rID])
+            offset -= contigLengths(context(stream))[rID++];
+
+        bool hasAlignments = false;
+        if (!jumpToRegion(stream, hasAlignments, rID, offset, offset + 1, bai) || !hasAlignments)
+            continue;
+
+        for (unsigned i = 0; i < SAMPLE_RECORDS && !atEnd(stream); ++i)
+        {
+            readRecord(record, stream);
+            if (hasFlagUnmapped(record))
+                continue;
+
+            ++sampledMapped;
+            if (hasFlagDuplicate(record) || hasFlagSecondary(record) || hasFlagQCNoPass(record) || hasFlagSupplementary(record))
+                continue;
+
+            sampledBases += length(record.seq);
+            readLengths.push_back(length(record.seq));
+            if (hasFlagAllProper(record) && hasFlagFirst(record) && record.tLen > 0)
+                insertSizes.push_back(record.tLen);
+        }
+    }
+
+    auto median = [](std::vector<unsigned> & values) -> unsigned
+    {
+        std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+        return values[values.size() / 2];
+    };
+
+    if (!readLengths.empty())
+        info.read_len = median(readLengths);
+    if (!insertSizes.empty())
+    {
+        info.ins_median = median(insertSizes);
+        for (unsigned i = 0; i < insertSizes.size(); ++i)
+            insertSizes[i] = std::abs((int)insertSizes[i] - (int)info.ins_median);
+        info.ins_mad = median(insertSizes);
+    }
+    if (sampledMapped > 0)
+        info.avg_cov = (double)mappedCount * sampledBases / sampledMapped / genomeLength;
+
+    return true;
+}
+
 // ==========================================================================
 // Function initSampleInfo()
 // ==========================================================================
 
+// Sets the read length and insert sizes from records sampled using the bam index, if any. The average coverage is
+// set to an estimate from the index.
 SampleInfo
 initSampleInfo(CharString & filename, CharString sample_id, CharString & adapter_type)
 {
@@ -32,18 +183,43 @@ initSampleInfo(CharString & filename, CharString sample_id, CharString & adapter
     info.bam_file = filename;
     info.sample_id = sample_id;
 
-    BamFileIn bamFile(toCString(filename));
-    BamHeader header;
-    readHeader(header, bamFile);
-    BamAlignmentRecord record;
-    readRecord(record, bamFile);
-    info.read_len = length(record.seq);
-    
+    // A BAM file streamed from stdin can only be read once.
+    if (filename != "-" && !sampleBamStatistics(info, filename))
+    {
+        BamFileIn bamFile(toCString(filename));
+        BamHeader header;
+        readHeader(header, bamFile);
+        BamAlignmentRecord record;
+        readRecord(record, bamFile);
+        info.read_len = length(record.seq);
+    }
+
     info.adapter_type = adapter_type;
 
     return info;
 }
 
+// ==========================================================================
+// Functions sampleReadLength() and sampleMaxInsertSize()
+// ==========================================================================
+
+// The sample's read length or the default if unknown.
+inline unsigned
+sampleReadLength(SampleInfo const & info, unsigned defaultLength)
+{
+    return info.read_len == 0 ? defaultLength : info.read_len;
+}
+
+// The sample's maximum insert size, estimated as the median plus four standard deviations from the MAD but at least
+// 10% above the median, or the default if unknown.
+inline unsigned
+sampleMaxInsertSize(SampleInfo const & info, unsigned defaultSize)
+{
+    if (info.ins_median == 0)
+        return defaultSize;
+    return info.ins_median + std::max((unsigned)(4 * 1.4826 * info.ins_mad + 0.5), info.ins_median / 10);
+}
+
 // ==========================================================================
 // Function readSampleInfo()
 // ==========================================================================
@@ -71,6 +247,10 @@ readSampleInfo(SampleInfo & info, CharString & filename)
             lexicalCast<unsigned>(info.read_len, value);
         else if (field.compare("ADAPTER_TYPE") == 0)
             info.adapter_type = value;
+        else if (field.compare("INS_MEDIAN") == 0)
+            lexicalCast<unsigned>(info.ins_median, value);
+        else if (field.compare("INS_MAD") == 0)
+            lexicalCast<unsigned>(info.ins_mad, value);
         else
             std::cerr << "WARNING: Ignoring field \'" << field << "\' in sample info file \'" << filename << "\'." << std::endl;
     }
@@ -78,6 +258,79 @@ readSampleInfo(SampleInfo & info, CharString & filename)
     return 0;
 }
 
+// ==========================================================================
+// Function sampleBamFiles()
+// ==========================================================================
+
+// The bam files of a sample. BAM_FILE lists them separated by commas if the sample was assembled from several.
+inline String<CharString>
+sampleBamFiles(SampleInfo const & info)
+{
+    String<CharString> files;
+    CharString file;
+    for (unsigned i = 0; i < length(info.bam_file); ++i)
+    {
+        if (info.bam_file[i] == ',')
+        {
+            appendValue(files, file);
+            clear(file);
+        }
+        else
+        {
+            appendValue(file, info.bam_file[i]);
+        }
+    }
+    appendValue(files, file);
+    return files;
+}
+
+// --------------------------------------------------------------------------
+// Struct IndexedBamFileIn
+// --------------------------------------------------------------------------
+
+// A bam file opened together with its index.
+struct IndexedBamFileIn
+{
+    BamFileIn stream;
+    BamIndex<Bai> index;
+};
+
+// --------------------------------------------------------------------------
+// Function openSampleBams()
+// --------------------------------------------------------------------------
+
+// Opens all bam files of a sample with their indices and reads their headers. Regions are read from each of them in
+// turn, which gives the same reads as the region of the merged bam file.
+inline bool
+openSampleBams(std::vector<std::unique_ptr<IndexedBamFileIn> > & bams, SampleInfo const & info)
+{
+    String<CharString> files = sampleBamFiles(info);
+
+    bams.clear();
+    for (unsigned i = 0; i < length(files); ++i)
+    {
+        bams.push_back(std::unique_ptr<IndexedBamFileIn>(new IndexedBamFileIn()));
+        if (!open(bams.back()->stream, toCString(files[i])))
+        {
+            std::cerr << "ERROR: Could not open " << files[i] << " for reading." << std::endl;
+            return 1;
+        }
+
+        CharString baiFile = files[i];
+        baiFile += ".bai";
+        if (!open(bams.back()->index, toCString(baiFile)))
+        {
+            std::cerr << "ERROR: Could not read BAI index file " << baiFile << std::endl;
+            return 1;
+        }
+
+        BamHeader header;
+        readHeader(header, bams.back()->stream);
+    }
+
+    return 0;
+}
+
 // ==========================================================================
 // Function write()
 // ==========================================================================
@@ -98,6 +351,8 @@ writeSampleInfo(SampleInfo & info, CharString & filename)
     stream << "AVG_COV" << "\t" << info.avg_cov << "\n";
     stream << "READ_LEN" << "\t" << info.read_len << "\n";
     stream << "ADAPTER_TYPE" << "\t" << info.adapter_type << "\n";
+    stream << "INS_MEDIAN" << "\t" << info.ins_median << "\n";
+    stream << "INS_MAD" << "\t" << info.ins_mad << "\n";
     
     stream.close();
     return 0;
@@ -111,11 +366,14 @@ void printStatus(const char * message)
         char timestamp[80];
         time_t now = time(0);
         struct tm tstruct;
-        tstruct = *localtime(&now);
+        localtime_r(&now, &tstruct);
         strftime(timestamp, sizeof(timestamp), "[PopIns %Y-%m-%d %X] ", &tstruct);
 
-        // Print time and message.
-        std::cerr << timestamp << message << std::endl;
+        // Print time and message in one piece as messages may come from concurrent threads.
+        std::string line = timestamp;
+        line += message;
+        line += '\n';
+        std::cerr << line << std::flush;
 }
 
 void printStatus(std::ostringstream & message)
@@ -135,6 +393,23 @@ inline bool exists(CharString const & filename)
 
 // ==========================================================================
 
+// Returns true if the entry of directory path is a directory, but not a symbolic link to one. File systems that do not
+// fill in d_type, e.g. some network file systems, leave it DT_UNKNOWN and the entry needs an lstat().
+inline bool
+isDirectoryEntry(CharString const & path, struct dirent const * entry)
+{
+    if (entry->d_type != DT_UNKNOWN)
+        return entry->d_type == DT_DIR;
+
+    CharString entryPath = path;
+    entryPath += "/";
+    entryPath += entry->d_name;
+    struct stat buffer;
+    return lstat(toCString(entryPath), &buffer) == 0 && S_ISDIR(buffer.st_mode);
+}
+
+// ==========================================================================
+
 // Lists all files <prefix>/*/<filename>.
 String<Pair<CharString> >
 listFiles(CharString & prefix, CharString & filename)
@@ -146,7 +421,7 @@ listFiles(CharString & prefix, CharString & filename)
     struct dirent *entry = readdir(dir);
     while (entry != NULL)
     {
-        if (entry->d_type == DT_DIR)
+        if (isDirectoryEntry(prefix, entry))
         {
            CharString sampleID = entry->d_name;
            if (sampleID == "." || sampleID == "..")
@@ -183,7 +458,7 @@ listSubdirectories(CharString & prefix)
    struct dirent *entry = readdir(dir);
    while (entry != NULL)
    {
-      if (entry->d_type == DT_DIR)
+      if (isDirectoryEntry(prefix, entry))
       {
           CharString sampleID = entry->d_name;
           if (sampleID == "." || sampleID == "..")
@@ -223,6 +498,110 @@ removeFile(CharString const & path, const char * filename)
     remove(toCString(file));
 }
 
+// ==========================================================================
+// Function removeDirectory()
+// ==========================================================================
+
+// Removes a directory with all files and subdirectories in it.
+inline void
+removeDirectory(CharString const & path)
+{
+    DIR *dir = opendir(toCString(path));
+    if (dir == NULL)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        CharString name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        if (isDirectoryEntry(path, entry))
+            removeDirectory(getFileName(path, name));
+        else
+            remove(toCString(getFileName(path, name)));
+    }
+    closedir(dir);
+    remove(toCString(path));
+}
+
+// ==========================================================================
+// Struct ScratchDirectory
+// ==========================================================================
+
+// A directory for temporary files. A directory created by createScratchDirectory() is removed with all its content
+// when the ScratchDirectory goes out of scope.
+struct ScratchDirectory
+{
+    CharString path;
+    bool created;
+
+    ScratchDirectory() :
+        created(false)
+    {}
+
+    ~ScratchDirectory()
+    {
+        if (created)
+            removeDirectory(path);
+    }
+};
+
+// --------------------------------------------------------------------------
+// Function createScratchDirectory()
+// --------------------------------------------------------------------------
+
+// Creates a new directory <tmpDir>/popins_<sampleID>_XXXXXX. Returns false on error.
+inline bool
+createScratchDirectory(ScratchDirectory & scratch, CharString const & tmpDir, CharString const & sampleID)
+{
+    CharString name = "popins_";
+    name += sampleID;
+    name += "_XXXXXX";
+    std::string path = toCString(getFileName(tmpDir, name));
+    if (mkdtemp(&path[0]) == NULL)
+    {
+        std::cerr << "ERROR: Could not create temporary directory in " << tmpDir << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    scratch.path = path.c_str();
+    scratch.created = true;
+    return true;
+}
+
+// ==========================================================================
+// Function moveFile()
+// ==========================================================================
+
+// Moves a file, copying it if the target is on another file system. Returns false on error.
+inline bool
+moveFile(CharString const & source, CharString const & target)
+{
+    if (source == target || std::rename(toCString(source), toCString(target)) == 0)
+        return true;
+
+    if (errno == EXDEV)
+    {
+        std::ifstream src(toCString(source), std::ios::binary);
+        std::ofstream dst(toCString(target), std::ios::binary);
+        if (src.is_open() && dst.is_open())
+        {
+            if (src.peek() != std::ifstream::traits_type::eof())
+                dst << src.rdbuf();
+            dst.close();
+            if (dst)
+            {
+                src.close();
+                remove(toCString(source));
+                return true;
+            }
+        }
+    }
+
+    std::cerr << "ERROR: Could not move " << source << " to " << target << std::endl;
+    return false;
+}
+
 // ==========================================================================
 // Function checkFileEnding()
 // ==========================================================================
@@ -293,6 +672,96 @@ bool readFileNames(String<CharString> & files, String<TValue> & values)
     return 0;
 }
 
+// ==========================================================================
+// Struct SamPipe
+// ==========================================================================
+
+// The standard output of a shell command read as a SAM stream, e.g. the output of bwa. The command is started on
+// construction.
+struct SamPipe
+{
+    std::string command;
+    FILE * file;
+    __gnu_cxx::stdio_filebuf<char> buffer;
+    std::istream stream;
+    BamFileIn samStream;
+
+    SamPipe(std::string const & cmd) :
+        command(cmd), file(popen(cmd.c_str(), "r")), buffer(file, std::ios::in), stream(&buffer)
+    {}
+
+    ~SamPipe()
+    {
+        if (file != 0)
+            pclose(file);
+    }
+};
+
+// --------------------------------------------------------------------------
+// Function openSamPipe()
+// --------------------------------------------------------------------------
+
+// Reads the SAM header from the command's output. Returns false on error.
+inline bool
+openSamPipe(SamPipe & pipe, BamHeader & header)
+{
+    if (pipe.file == 0 || !open(pipe.samStream, pipe.stream, Sam()))
+    {
+        std::cerr << "ERROR: Could not run " << pipe.command << std::endl;
+        return false;
+    }
+    readHeader(header, pipe.samStream);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function closeSamPipe()
+// --------------------------------------------------------------------------
+
+// Waits for the command to finish. Returns false if it failed.
+inline bool
+closeSamPipe(SamPipe & pipe)
+{
+    int status = pclose(pipe.file);
+    pipe.file = 0;
+    if (status != 0)
+    {
+        std::cerr << "ERROR while running " << pipe.command << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// ==========================================================================
+// Function parseMemory()
+// ==========================================================================
+
+// Converts a memory size like 768M with optional suffix K/M/G to bytes. Returns 0 if the string is malformed.
+inline size_t
+parseMemory(CharString const & in)
+{
+    if (length(in) == 0)
+        return 0;
+
+    size_t factor = 1;
+    size_t numDigits = length(in);
+    switch (back(in))
+    {
+        case 'k': case 'K': factor = (size_t)1 << 10; --numDigits; break;
+        case 'm': case 'M': factor = (size_t)1 << 20; --numDigits; break;
+        case 'g': case 'G': factor = (size_t)1 << 30; --numDigits; break;
+    }
+
+    size_t value = 0;
+    for (size_t i = 0; i < numDigits; ++i)
+    {
+        if (in[i] < '0' || in[i] > '9')
+            return 0;
+        value = 10 * value + (in[i] - '0');
+    }
+    return value * factor;
+}
+
 // ==========================================================================
 
 bool
@@ -0,0 +1,226 @@
+// Test of cropping with read stores that spill to disk: the fastq output and the map of low quality mates do not depend
+// on the memory budget.
+//
+// Crops simulated unmapped and low quality reads, whose mates are mostly far apart in the input, once with stores that
+// fit all reads in memory and once with stores small enough to spill many run files. The second run is repeated on
+// consecutive shards of the input that are merged as in sharded cropping.
+//
+// Build and run with:  make tests/crop_spill_test && tests/crop_spill_test [NUM_PAIRS]
+
+#include <random>
+#include <algorithm>
+#include <iostream>
+
+#include "../popins_utils.h"
+#include "../assemble/crop_unmapped.h"
+
+using namespace seqan;
+
+typedef std::map<Pair<__int32>, Pair<CharString, bool> > TOtherMap;
+
+// A cropped record and what to do with it.
+struct CropInput
+{
+    BamAlignmentRecord record;
+    CropAction action;
+};
+
+// The output of cropping.
+struct CropOutput
+{
+    std::string fastq;
+    TOtherMap otherReads;
+    bool spilled;
+
+    CropOutput() : spilled(false) {}
+};
+
+// --------------------------------------------------------------------------
+// Function simulateRecords()
+// --------------------------------------------------------------------------
+
+// Read pairs of which one or both reads are cropped, in random order. Each read waiting for its mapped mate has a
+// mate position of its own.
+void
+simulateRecords(std::vector<CropInput> & inputs, unsigned numPairs, std::mt19937 & rng)
+{
+    char const * bases = "ACGTN";
+    for (unsigned i = 0; i < numPairs; ++i)
+    {
+        std::ostringstream name;
+        name << "sim:" << (rng() % 8) << ":" << i;
+
+        unsigned ends = rng() % 5 == 0 ? 1 + rng() % 2 : 3;    // 1 first read, 2 second read, 3 both
+        for (unsigned end = 1; end <= 2; ++end)
+        {
+            if ((ends & end) == 0)
+                continue;
+
+            CropInput input;
+            input.record.qName = name.str().c_str();
+            input.record.flag = BAM_FLAG_MULTIPLE | (end == 1 ? BAM_FLAG_FIRST : BAM_FLAG_LAST);
+            if (rng() % 2 == 0)
+                input.record.flag |= BAM_FLAG_RC;
+            input.record.rNextId = 0;
+            input.record.pNext = 2 * i + end;
+
+            CharString seq, qual;
+            unsigned len = 50 + rng() % 100;
+            for (unsigned j = 0; j < len; ++j)
+            {
+                appendValue(seq, bases[rng() % 5]);
+                appendValue(qual, (char)(33 + rng() % 41));
+            }
+            input.record.seq = seq;
+            input.record.qual = qual;
+            input.action = rng() % 2 == 0 ? CROP_UNMAPPED : CROP_LOW_MAPQ;
+            inputs.push_back(input);
+        }
+    }
+    std::shuffle(inputs.begin(), inputs.end(), rng);
+}
+
+// --------------------------------------------------------------------------
+// Function writeOutput()
+// --------------------------------------------------------------------------
+
+// Writes the stores to an interleaved fastq file and reads it back.
+bool
+writeOutput(CropOutput & output, FastqStore & firstReads, FastqStore & secondReads, CharString const & fastqFile)
+{
+    output.spilled = output.spilled || !firstReads.runFiles.empty() || !secondReads.runFiles.empty();
+    {
+        CropFastqOut fastqOut;
+        if (!open(fastqOut, fastqFile, CROP_INTERLEAVED_FASTQ, Triple<CharString>()) ||
+                writeFastq(fastqOut, firstReads, secondReads) != 0)
+            return false;
+    }
+
+    std::ifstream stream(toCString(fastqFile));
+    std::ostringstream content;
+    content << stream.rdbuf();
+    output.fastq = content.str();
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function crop()
+// --------------------------------------------------------------------------
+
+// Applies the crop actions in input order to stores with the given memory budget.
+bool
+crop(CropOutput & output, std::vector<CropInput> const & inputs, size_t budget, CharString const & prefix)
+{
+    std::string storePrefix = toCString(prefix);
+    FastqStore firstReads(storePrefix + ".first", budget);
+    FastqStore secondReads(storePrefix + ".second", budget);
+    BamNameSorter matesStream(prefix, 1 << 20, 1);
+
+    for (unsigned i = 0; i < inputs.size(); ++i)
+        applyCropAction(matesStream, firstReads, secondReads, output.otherReads, inputs[i].record, inputs[i].action);
+
+    CharString fastqFile = prefix;
+    fastqFile += ".fastq";
+    return writeOutput(output, firstReads, secondReads, fastqFile);
+}
+
+// --------------------------------------------------------------------------
+// Function cropInShards()
+// --------------------------------------------------------------------------
+
+// Applies the crop actions of consecutive shards of the input to stores of each shard and merges them.
+bool
+cropInShards(CropOutput & output, std::vector<CropInput> const & inputs, unsigned numShards, size_t budget,
+        CharString const & prefix)
+{
+    std::string storePrefix = toCString(prefix);
+    BamNameSorter matesStream(prefix, 1 << 20, 1);
+
+    String<CropShard<TOtherMap> > shards;
+    resize(shards, numShards);
+    for (unsigned s = 0; s < numShards; ++s)
+    {
+        std::ostringstream shardPrefix;
+        shardPrefix << storePrefix << ".shard" << s;
+        shards[s].firstReads = new FastqStore(shardPrefix.str() + ".first", budget);
+        shards[s].secondReads = new FastqStore(shardPrefix.str() + ".second", budget);
+
+        for (unsigned i = s * inputs.size() / numShards; i < (s + 1) * inputs.size() / numShards; ++i)
+            applyCropAction(matesStream, *shards[s].firstReads, *shards[s].secondReads, shards[s].otherReads,
+                            inputs[i].record, inputs[i].action);
+        output.spilled = output.spilled || !shards[s].firstReads->runFiles.empty();
+    }
+
+    FastqStore firstReads(storePrefix + ".first", budget);
+    FastqStore secondReads(storePrefix + ".second", budget);
+    unsigned long alignedBaseCount = 0;
+    mergeCropShards(alignedBaseCount, firstReads, secondReads, output.otherReads, shards);
+
+    CharString fastqFile = prefix;
+    fastqFile += ".fastq";
+    return writeOutput(output, firstReads, secondReads, fastqFile);
+}
+
+// --------------------------------------------------------------------------
+// Function compareOutputs()
+// --------------------------------------------------------------------------
+
+bool
+compareOutputs(CropOutput const & expected, CropOutput const & output, char const * run)
+{
+    bool passed = true;
+    if (!output.spilled)
+    {
+        std::cerr << "FAILED: " << run << " did not spill to disk." << std::endl;
+        passed = false;
+    }
+    if (output.fastq != expected.fastq)
+    {
+        std::cerr << "FAILED: " << run << " wrote a different fastq file." << std::endl;
+        passed = false;
+    }
+    if (output.otherReads != expected.otherReads)
+    {
+        std::cerr << "FAILED: " << run << " has " << output.otherReads.size() << " instead of ";
+        std::cerr << expected.otherReads.size() << " low quality reads waiting for their mate." << std::endl;
+        passed = false;
+    }
+    return passed;
+}
+
+int main(int argc, char const ** argv)
+{
+    unsigned numPairs = argc > 1 ? lexicalCast<unsigned>(argv[1]) : 30000;
+
+    ScratchDirectory scratch;
+    if (!createScratchDirectory(scratch, "/tmp", "crop_spill_test"))
+        return 1;
+
+    std::mt19937 rng(42);
+    std::vector<CropInput> inputs;
+    simulateRecords(inputs, numPairs, rng);
+
+    // A budget of 64 KB spills about every 300 reads.
+    size_t largeBudget = (size_t)1 << 30, smallBudget = (size_t)1 << 16;
+    CropOutput expected, spilled, sharded;
+    if (!crop(expected, inputs, largeBudget, getFileName(scratch.path, "memory")) ||
+            !crop(spilled, inputs, smallBudget, getFileName(scratch.path, "spilled")) ||
+            !cropInShards(sharded, inputs, 4, smallBudget, getFileName(scratch.path, "sharded")))
+    {
+        std::cerr << "FAILED: could not write temporary files to " << scratch.path << std::endl;
+        return 1;
+    }
+
+    if (expected.spilled)
+    {
+        std::cerr << "FAILED: the run in memory spilled to disk." << std::endl;
+        return 1;
+    }
+
+    bool passed = compareOutputs(expected, spilled, "spilled run");
+    passed = compareOutputs(expected, sharded, "sharded run") && passed;
+
+    if (passed)
+        std::cout << "All tests passed." << std::endl;
+    return passed ? 0 : 1;
+}
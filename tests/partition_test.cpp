@@ -0,0 +1,160 @@
+// Test of the components of partitionContigs(): every forward contig ends up in exactly one component.
+//
+// Joins random aligned pairs of contigs and of their reverse complements into the union-find as partitionContigs()
+// does, including pairs of a forward contig with the reverse complement of another contig, and checks that
+// unionFindToComponents() and addSingletons() output no contig twice and none not at all.
+//
+// Build and run with:  make tests/partition_test && tests/partition_test [ROUNDS]
+
+#include <random>
+#include <iostream>
+
+#include "../popins_utils.h"
+#include "../merge/popins_merge.h"
+
+using namespace seqan;
+
+// --------------------------------------------------------------------------
+// Function countOutputs()
+// --------------------------------------------------------------------------
+
+// Number of components that output each forward contig, as a member of aligned pairs or as a singleton.
+template<typename TSize>
+void
+countOutputs(std::vector<unsigned> & outputs,
+        std::map<TSize, ContigComponent<Dna5String> > & components,
+        unsigned fwdContigCount)
+{
+    typedef typename std::map<TSize, ContigComponent<Dna5String> >::iterator TComponentIter;
+
+    outputs.assign(fwdContigCount, 0);
+    for (TComponentIter it = components.begin(); it != components.end(); ++it)
+    {
+        if (length(it->second.alignedPairs) == 0)
+        {
+            ++outputs[it->first];
+            continue;
+        }
+        std::set<TSize> members;
+        for (typename std::set<Pair<TSize> >::iterator p = it->second.alignedPairs.begin();
+             p != it->second.alignedPairs.end(); ++p)
+            members.insert((*p).i1 % fwdContigCount);
+        for (typename std::set<TSize>::iterator m = members.begin(); m != members.end(); ++m)
+            ++outputs[*m];
+    }
+}
+
+// --------------------------------------------------------------------------
+// Function testPair()
+// --------------------------------------------------------------------------
+
+// A single pair of a forward contig and the reverse complement of a contig with a smaller index.
+bool
+testPair(String<Contig<Dna5String> > & contigs)
+{
+    typedef Size<Dna5String>::Type TSize;
+
+    unsigned fwdContigCount = length(contigs)/2;
+    ConcurrentUnionFind uf;
+    resize(uf, length(contigs));
+    std::set<Pair<TSize> > alignedPairs;
+
+    alignedPairs.insert(Pair<TSize>(5, 2 + fwdContigCount));
+    joinSets(uf, findSet(uf, 5), findSet(uf, 2 + fwdContigCount));
+    joinSets(uf, findSet(uf, 5 + fwdContigCount), findSet(uf, 2));
+
+    std::map<TSize, ContigComponent<Dna5String> > components;
+    unionFindToComponents(components, uf, alignedPairs, fwdContigCount);
+    addSingletons(components, contigs, uf);
+
+    std::vector<unsigned> outputs;
+    countOutputs(outputs, components, fwdContigCount);
+    for (unsigned i = 0; i < fwdContigCount; ++i)
+        if (outputs[i] != 1)
+            return false;
+    return true;
+}
+
+// --------------------------------------------------------------------------
+// Function testRandomPairs()
+// --------------------------------------------------------------------------
+
+// Joins the sets of random pairs in the order of _joinContigHits(), skipping pairs that are in the same set already.
+bool
+testRandomPairs(String<Contig<Dna5String> > & contigs, std::mt19937 & rng)
+{
+    typedef Size<Dna5String>::Type TSize;
+
+    int fwdContigCount = length(contigs)/2;
+    ConcurrentUnionFind uf;
+    resize(uf, length(contigs));
+    std::set<Pair<TSize> > alignedPairs;
+
+    unsigned numHits = 1 + rng() % 8;
+    for (unsigned i = 0; i < numHits; ++i)
+    {
+        int a = rng() % fwdContigCount;
+        int b = rng() % (2 * fwdContigCount);
+        if (b % fwdContigCount == a || findSet(uf, a) == findSet(uf, b))
+            continue;
+
+        alignedPairs.insert(Pair<TSize>(a, b));
+        joinSets(uf, findSet(uf, a), findSet(uf, b));
+        int b1 = b < fwdContigCount ? b + fwdContigCount : b - fwdContigCount;
+        joinSets(uf, findSet(uf, a + fwdContigCount), findSet(uf, b1));
+    }
+
+    std::map<TSize, ContigComponent<Dna5String> > components;
+    unionFindToComponents(components, uf, alignedPairs, fwdContigCount);
+    addSingletons(components, contigs, uf);
+
+    std::vector<unsigned> outputs;
+    countOutputs(outputs, components, fwdContigCount);
+    for (int i = 0; i < fwdContigCount; ++i)
+    {
+        if (outputs[i] != 1)
+        {
+            std::cerr << "Contig " << i << " is output " << outputs[i] << " times." << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char const ** argv)
+{
+    unsigned rounds = argc > 1 ? lexicalCast<unsigned>(argv[1]) : 2000;
+
+    String<Contig<Dna5String> > contigs;
+    for (unsigned i = 0; i < 10; ++i)
+    {
+        Dna5String seq = "ACGTACGTAC";
+        CharString pn = "sample";
+        CharString contigId = "contig";
+        ContigId id(pn, contigId, true);
+        appendValue(contigs, Contig<Dna5String>(seq, id));
+    }
+    addReverseComplementContigs(contigs);
+
+    unsigned failed = 0;
+    if (!testPair(contigs))
+    {
+        std::cerr << "FAILED: pair of contig 5 and the reverse complement of contig 2" << std::endl;
+        ++failed;
+    }
+
+    std::mt19937 rng(42);
+    unsigned failedRounds = 0;
+    for (unsigned r = 0; r < rounds; ++r)
+        if (!testRandomPairs(contigs, rng))
+            ++failedRounds;
+    if (failedRounds > 0)
+    {
+        std::cerr << "FAILED: " << failedRounds << " of " << rounds << " random sets of pairs" << std::endl;
+        ++failed;
+    }
+
+    if (failed == 0)
+        std::cout << "All tests passed." << std::endl;
+    return failed == 0 ? 0 : 1;
+}